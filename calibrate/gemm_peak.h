@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cutlass/gemm/device/gemm.h>
+#include <cutlass/numeric_types.h>
+
+#include "peak_gpu.hpp"
+
+namespace cfk {
+namespace utils {
+
+// Half-precision tensor-core GEMM throughput (fp32 accumulate) on square
+// n x n operands, in GFLOP/s.
+inline double gpu_hgemm_gflops(int n = 8192, int trials = 10) {
+  using Gemm = cutlass::gemm::device::Gemm<
+      cutlass::half_t, cutlass::layout::RowMajor, cutlass::half_t,
+      cutlass::layout::ColumnMajor, float, cutlass::layout::RowMajor, float,
+      cutlass::arch::OpClassTensorOp, cutlass::arch::Sm80>;
+
+  cutlass::half_t *A, *B;
+  float *C;
+  cudaMalloc(&A, sizeof(cutlass::half_t) * n * n);
+  cudaMalloc(&B, sizeof(cutlass::half_t) * n * n);
+  cudaMalloc(&C, sizeof(float) * n * n);
+  cudaMemset(A, 0, sizeof(cutlass::half_t) * n * n);
+  cudaMemset(B, 0, sizeof(cutlass::half_t) * n * n);
+
+  Gemm gemm_op;
+  typename Gemm::Arguments arguments{
+      {n, n, n}, {A, n}, {B, n}, {C, n}, {C, n}, {1.0f, 0.0f}};
+  double gflops = 0;
+  if (gemm_op.initialize(arguments) == cutlass::Status::kSuccess) {
+    float ms = best_event_ms(trials, [&] { gemm_op.run(); });
+    gflops = 2e-6 * n * double(n) * n / ms;
+  }
+
+  cudaFree(A);
+  cudaFree(B);
+  cudaFree(C);
+  return gflops;
+}
+
+} // namespace utils
+} // namespace cfk
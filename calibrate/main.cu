@@ -0,0 +1,87 @@
+// Measures achievable memory bandwidth and GEMM throughput on this machine
+// and stores them in the per-machine peak table (see peak.hpp). The
+// benchmark drivers report their results relative to these numbers.
+//
+// Built with nvcc this calibrates the GPU and the CPU. Built with a plain
+// host compiler (`make cpu`) it calibrates only the CPU, so it also runs on
+// build hosts without a GPU.
+
+#include <cstring>
+#include <iostream>
+
+#if defined(__CUDACC__)
+#include "gemm_peak.h"
+#else
+#include "peak.hpp"
+#endif
+#include "perf_counters.hpp"
+
+int main(int argc, char const **argv) {
+
+  // cutlass::CommandLine pulls in the CUDA runtime, so parse --threads=N by
+  // hand to keep the CPU-only build free of CUDA headers.
+  int threads = 0;
+  for (int i = 1; i < argc; ++i)
+    if (std::strncmp(argv[i], "--threads=", 10) == 0)
+      threads = std::atoi(argv[i] + 10);
+
+  if (threads > 0)
+    cfk::utils::TaskRuntime::configure(threads);
+
+  auto &table = cfk::utils::PeakTable::instance();
+
+  auto cpu = cfk::utils::cpu_stream(size_t(1) << 24);
+  std::cout << "CPU STREAM copy:  " << cpu.copy_gbs << " GB/s" << std::endl;
+  std::cout << "CPU STREAM triad: " << cpu.triad_gbs << " GB/s" << std::endl;
+  table.set("cpu.stream_copy_gbs", cpu.copy_gbs);
+  table.set("cpu.stream_triad_gbs", cpu.triad_gbs);
+
+  int const gemm_n = 1024;
+  double cpu_gemm = cfk::utils::cpu_sgemm_gflops(gemm_n);
+  std::cout << "CPU SGEMM:        " << cpu_gemm << " GFLOP/s" << std::endl;
+  {
+    // Counters for one GEMM on warm operands, so the counts, bytes and time
+    // all cover the same single call.
+    std::vector<float> A(size_t(gemm_n) * gemm_n, 1.0f),
+        B(size_t(gemm_n) * gemm_n, 0.5f), C(size_t(gemm_n) * gemm_n, 0.0f);
+    cfk::utils::cpu_sgemm(gemm_n, A.data(), B.data(), C.data());
+    cfk::utils::PerfCounters counters(
+        cfk::utils::TaskRuntime::instance().thread_ids());
+    counters.start();
+    auto t1 = std::chrono::steady_clock::now();
+    cfk::utils::cpu_sgemm(gemm_n, A.data(), B.data(), C.data());
+    auto t2 = std::chrono::steady_clock::now();
+    auto sample = counters.stop();
+    std::cout << "  "
+              << cfk::utils::format_perf_sample(
+                     sample, 3.0 * gemm_n * gemm_n * sizeof(float),
+                     std::chrono::duration<double>(t2 - t1).count())
+              << std::endl;
+  }
+  table.set("cpu.sgemm_gflops", cpu_gemm);
+
+#if defined(__CUDACC__)
+  int devices = 0;
+  if (cudaGetDeviceCount(&devices) == cudaSuccess && devices > 0) {
+    auto gpu = cfk::utils::gpu_stream();
+    std::cout << "GPU STREAM copy:  " << gpu.copy_gbs << " GB/s" << std::endl;
+    std::cout << "GPU STREAM triad: " << gpu.triad_gbs << " GB/s" << std::endl;
+    table.set(cfk::utils::gpu_peak_key("stream_copy_gbs"), gpu.copy_gbs);
+    table.set(cfk::utils::gpu_peak_key("stream_triad_gbs"), gpu.triad_gbs);
+
+    double gpu_gemm = cfk::utils::gpu_hgemm_gflops();
+    std::cout << "GPU HGEMM:        " << gpu_gemm << " GFLOP/s" << std::endl;
+    table.set(cfk::utils::gpu_peak_key("hgemm_gflops"), gpu_gemm);
+  } else {
+    std::cout << "No CUDA device found, skipping GPU calibration." << std::endl;
+  }
+#endif
+
+  if (!table.save()) {
+    std::cerr << "Could not write " << table.path() << std::endl;
+    return -1;
+  }
+  std::cout << "Saved peaks to " << table.path() << std::endl;
+
+  return 0;
+}
@@ -8,6 +8,7 @@
 
 // File containing the CUTLASS portion of the code.
 #include "cutlass_gemm.hpp"
+#include "host_stats.hpp"
 
 // Not strictly necessary, but here for convenience.
 template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC);
@@ -23,15 +24,17 @@ template<typename DataType, typename OutputType> void cutlass_gemm_unpack(torch:
   DataType const *ptrA = reinterpret_cast<DataType*>(A.data_ptr());
   DataType const *ptrB = reinterpret_cast<DataType*>(B.data_ptr());
   OutputType *ptrC = reinterpret_cast<OutputType*>(C.data_ptr());
-  cutlass_gemm_wrapper<DataType, OutputType>(M, N, K, ptrA, ptrB, ptrC);
+  cutlass_gemm_dispatch<DataType, OutputType>(M, N, K, ptrA, ptrB, ptrC);
 }
 
+using GemmUnpack = void (*)(torch::Tensor, torch::Tensor, torch::Tensor);
+
 // Intermediate function to get the output precision to use for the wrapper template. 
-template<typename DataType> void cutlass_gemm_find_output_type(torch::Tensor A, torch::Tensor B, torch::Tensor C) {
+template<typename DataType> GemmUnpack cutlass_gemm_find_output_type(torch::Tensor const &C) {
   if(C.dtype() == torch::kFloat16)
-    cutlass_gemm_unpack<DataType, cutlass::half_t>(A, B, C);
+    return &cutlass_gemm_unpack<DataType, cutlass::half_t>;
   else if(C.dtype() == torch::kFloat32)
-    cutlass_gemm_unpack<DataType, float>(A, B, C);
+    return &cutlass_gemm_unpack<DataType, float>;
   else
     throw std::invalid_argument("Unsupported precision type");
 }
@@ -40,10 +43,12 @@ template<typename DataType> void cutlass_gemm_find_output_type(torch::Tensor A,
 torch::Tensor cutlass_gemm(torch::Tensor A,  // A matrix (m x k)
                            torch::Tensor B,  // B matrix (k x n)
                            c10::optional<torch::Tensor> out) {   // optional out matrix (m x n)
-
+  cfk::utils::ScopedRange range("cutlass_gemm.mm");
+  CFK_HOST_STAGE(total_timer, "mm.total");
 
   // Handling the optional C matrix.
   torch::Tensor C;
+  CFK_HOST_STAGE(alloc_timer, "mm.alloc_output");
   if(out.has_value()) {  // Output tensor was provided. So we will use it.
     C = out.value();
   } else {               // Output tensor was not provided. Creating an empty tensor.
@@ -54,8 +59,10 @@ torch::Tensor cutlass_gemm(torch::Tensor A,  // A matrix (m x k)
     auto c_options = torch::TensorOptions().device(torch::kCUDA).dtype(A.dtype());
     C = torch::empty({M, N}, c_options);
   }
+  alloc_timer.stop();
 
   // Check that all tensors are allocated on GPU device.
+  CFK_HOST_STAGE(contiguous_timer, "mm.contiguous");
   if(!(A.device().is_cuda() && B.device().is_cuda() && C.device().is_cuda()))
     throw std::invalid_argument("cutlass_gemm only supports GPU device. Use .to(device=torch.device('cuda'))");
 
@@ -65,14 +72,20 @@ torch::Tensor cutlass_gemm(torch::Tensor A,  // A matrix (m x k)
   torch::Tensor _A = A.contiguous();
   torch::Tensor _B = B.contiguous();
   torch::Tensor _C = C.contiguous();
+  contiguous_timer.stop();
 
   // Select the CUTLASS precision type to use based on Torch input data type.
+  // The dispatch stage covers only the selection, not the launch.
+  CFK_HOST_STAGE(dispatch_timer, "mm.dispatch");
+  GemmUnpack unpack;
   if(_A.dtype() == torch::kFloat16)
-    cutlass_gemm_find_output_type<cutlass::half_t>(_A, _B, _C);
+    unpack = cutlass_gemm_find_output_type<cutlass::half_t>(_C);
   else if(_A.dtype() == torch::kFloat32)
-    cutlass_gemm_find_output_type<float>(_A, _B, _C);
+    unpack = cutlass_gemm_find_output_type<float>(_C);
   else
     throw std::invalid_argument("Unsupported precision type");
+  dispatch_timer.stop();
+  unpack(_A, _B, _C);
 
   // If C was not contiguous, C != _C so copy the result back into C
   if(!C.is_contiguous())
@@ -85,4 +98,6 @@ torch::Tensor cutlass_gemm(torch::Tensor A,  // A matrix (m x k)
 // Binding the function to Python
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   m.def("mm", py::overload_cast<torch::Tensor,torch::Tensor,c10::optional<torch::Tensor>>(&cutlass_gemm), py::arg("A"), py::arg("B"), py::arg("out") = py::none());
+  // Host overhead counters: stats() and reset_stats().
+  cfk::utils::bind_host_stats(m);
 }
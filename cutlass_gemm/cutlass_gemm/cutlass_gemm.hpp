@@ -30,6 +30,13 @@
  **************************************************************************************************/
 
 
+#include <stdexcept>
+#include <type_traits>
+
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "static_shapes.hpp"
+
 #ifndef COMPILE_3X_HOPPER
 
 // CUTLASS 2.X syntax GEMM
@@ -38,6 +45,8 @@
 #include <cutlass/gemm/device/gemm.h>
 
 template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
+  char const* dtype = cfk::utils::dtype_name<DataType>();
+
   using Gemm = cutlass::gemm::device::Gemm<
     DataType,                     // ElementA
     cutlass::layout::RowMajor,    // LayoutA
@@ -56,14 +65,31 @@ template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M
   int ldc = M;
 
   Gemm gemm_op;
-  gemm_op({
-    {M, N, K},
-    {ptrA, lda},            // TensorRef to A device tensor
-    {ptrB, ldb},            // TensorRef to B device tensor
-    {ptrC, ldc},            // TensorRef to C device tensor
-    {ptrC, ldc},            // TensorRef to D device tensor - may be the same as C
-    {alpha, beta}           // epilogue operation arguments
-  });
+  typename Gemm::Arguments arguments;
+  {
+    cfk::utils::ScopedRange range("gemm.operator_build", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.operator_build");
+    arguments = typename Gemm::Arguments{
+      {M, N, K},
+      {ptrA, lda},            // TensorRef to A device tensor
+      {ptrB, ldb},            // TensorRef to B device tensor
+      {ptrC, ldc},            // TensorRef to C device tensor
+      {ptrC, ldc},            // TensorRef to D device tensor - may be the same as C
+      {alpha, beta}           // epilogue operation arguments
+    };
+  }
+
+  {
+    cfk::utils::ScopedRange range("gemm.initialize", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.initialize");
+    gemm_op.initialize(arguments);
+  }
+
+  {
+    cfk::utils::ScopedRange range("gemm.run", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.run");
+    gemm_op.run();
+  }
 }
 
 #else
@@ -86,8 +112,13 @@ template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M
 
 using namespace cute;
 
-template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
-
+// The GEMM for a problem shape (M, N, K) of runtime ints, or of cute::Int
+// extents for a kernel specialized to one shape (see cutlass_gemm_dispatch).
+template<typename DataType, typename OutputType, class ProblemShape> void cutlass_gemm_problem(ProblemShape problem, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
+  char const* dtype = cfk::utils::dtype_name<DataType>();
+  int const M = int(get<0>(problem));
+  int const N = int(get<1>(problem));
+  int const K = int(get<2>(problem));
 
   // A matrix configuration
   using         LayoutA     = cutlass::layout::RowMajor;                      // Layout type for A matrix operand
@@ -131,7 +162,7 @@ template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M
   >::CollectiveOp;
 
   using GemmKernel = cutlass::gemm::kernel::GemmUniversal<
-      Shape<int,int,int>, // Indicates ProblemShape
+      ProblemShape,       // Shape<int,int,int> or static extents
       CollectiveMainloop,
       CollectiveEpilogue
   >;
@@ -169,31 +200,82 @@ template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M
   //
   // Launch GEMM on the device
   //
-  typename Gemm::Arguments arguments{
-    cutlass::gemm::GemmUniversalMode::kGemm,
-    {M, N, K},
-    {ptrA, stride_A, ptrB, stride_B},
-    {{alpha, beta}, ptrC, stride_C, ptrC, stride_D}
-  };
-  
-  // Using the arguments, query for extra workspace required for matrix multiplication computation
-  size_t workspace_size = Gemm::get_workspace_size(arguments);
+  typename Gemm::Arguments arguments;
+  size_t workspace_size;
+  {
+    cfk::utils::ScopedRange range("gemm.operator_build", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.operator_build");
+    arguments = typename Gemm::Arguments{
+      cutlass::gemm::GemmUniversalMode::kGemm,
+      problem,
+      {ptrA, stride_A, ptrB, stride_B},
+      {{alpha, beta}, ptrC, stride_C, ptrC, stride_D}
+    };
+
+    // Using the arguments, query for extra workspace required for matrix multiplication computation
+    workspace_size = Gemm::get_workspace_size(arguments);
+  }
 
   // Allocate workspace memory
-  cutlass::device_memory::allocation<uint8_t> workspace(workspace_size);
+  cutlass::device_memory::allocation<uint8_t> workspace;
+  {
+    cfk::utils::ScopedRange range("gemm.workspace", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.workspace");
+    workspace.reset(cutlass::device_memory::allocate<uint8_t>(workspace_size),
+                    workspace_size);
+  }
 
   // Check if the problem size is supported or not
   gemm_op.can_implement(arguments);
 
   // Initialize CUTLASS kernel with arguments and workspace pointer
-  gemm_op.initialize(arguments, workspace.get());
+  {
+    cfk::utils::ScopedRange range("gemm.initialize", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.initialize");
+    gemm_op.initialize(arguments, workspace.get());
+  }
 
   // Correctness / Warmup iteration
-  gemm_op.run();
+  {
+    cfk::utils::ScopedRange range("gemm.run", dtype, {M, N, K});
+    CFK_HOST_STAGE(timer, "gemm.run");
+    gemm_op.run();
+  }
 
 }
+
+template<typename DataType, typename OutputType> void cutlass_gemm_wrapper(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
+  cutlass_gemm_problem<DataType, OutputType>(make_shape(M, N, K), ptrA, ptrB, ptrC);
+}
+
+// cutlass_gemm_wrapper for the one problem (E::m, E::n, E::k).
+template<typename DataType, typename OutputType, class E> void cutlass_gemm_static(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
+  if (M != E::m || N != E::n || K != E::k)
+    throw std::invalid_argument("cutlass_gemm_static instantiated for another shape");
+  cutlass_gemm_problem<DataType, OutputType>(Shape<Int<E::m>, Int<E::n>, Int<E::k>>{}, ptrA, ptrB, ptrC);
+}
 #endif
 
+// Runs the GEMMs of the model manifest (static_shapes.hpp) with their
+// static-shape instantiations and everything else through
+// cutlass_gemm_wrapper. Only fp16 inputs are specialized, to bound the number
+// of CUTLASS kernels compiled; the CUTLASS 2.X GEMM takes its problem size at
+// run time only, so without COMPILE_3X_HOPPER every shape is dynamic.
+template<typename DataType, typename OutputType, class Manifest = cfk::utils::Llama7BGemmShapes> void cutlass_gemm_dispatch(int M, int N, int K, DataType const* ptrA, DataType const* ptrB, OutputType* ptrC) {
+  using Fn = void (*)(int, int, int, DataType const*, DataType const*, OutputType*);
+  static cfk::utils::ShapeRegistry<Fn> const registry = [] {
+    cfk::utils::ShapeRegistry<Fn> r;
+#ifdef COMPILE_3X_HOPPER
+    if constexpr (std::is_same_v<DataType, cutlass::half_t>)
+      cfk::utils::register_shapes(r, Manifest{}, [](auto e) -> Fn {
+        return &cutlass_gemm_static<DataType, OutputType, decltype(e)>;
+      });
+#endif
+    return r;
+  }();
+  registry.dispatch({M, N, K}, &cutlass_gemm_wrapper<DataType, OutputType>)(M, N, K, ptrA, ptrB, ptrC);
+}
+
 
 
 
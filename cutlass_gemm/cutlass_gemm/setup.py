@@ -9,6 +9,9 @@ if not os.path.isdir(cutlass_dir):
 _cutlass_include_dirs = ["tools/util/include","include"]
 cutlass_include_dirs = [os.path.join(cutlass_dir, d) for d in _cutlass_include_dirs]
 
+# Shared host utilities (tracing, etc.) live at the top of the repo
+repo_utils_dir = [os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "..", "include", "utils")]
+
 # Set additional flags needed for compilation here
 nvcc_flags=["-O3","-DNDEBUG","-std=c++17"]
 ld_flags=[]
@@ -24,7 +27,7 @@ setup(
         CUDAExtension(
                 name="cutlass_gemm",  
                 sources=["cutlass_gemm.cu"],
-                include_dirs=cutlass_include_dirs,
+                include_dirs=cutlass_include_dirs+repo_utils_dir,
                 extra_compile_args={'nvcc': nvcc_flags},
                 libraries=ld_flags)
    ],
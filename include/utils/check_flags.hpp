@@ -0,0 +1,49 @@
+#pragma once
+
+// Host-side self-tests selected with --check-* flags.
+//
+// Each check returns whether it passed. The drivers fold the results into
+// their exit status, and skip the benchmarks when every flag on the command
+// line was a check, so that the checks can run as a test on a machine
+// without a GPU.
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+namespace cfk {
+namespace utils {
+
+template <class CommandLine> class CheckFlags {
+public:
+  explicit CheckFlags(CommandLine const &cmd) : cmd_(cmd) {}
+
+  // Runs `check` if --<flag> was given.
+  template <class Check> void run(char const *flag, Check &&check) {
+    if (!cmd_.check_cmd_line_flag(flag))
+      return;
+    ++ran_;
+    if (!std::forward<Check>(check)())
+      ok_ = false;
+  }
+
+  bool ok() const { return ok_; }
+
+  // True when at least one check ran and every flag given was a check.
+  bool only_checks() const {
+    return ran_ > 0 && std::all_of(cmd_.keys.begin(), cmd_.keys.end(),
+                                   [](std::string const &key) {
+                                     return key.rfind("check-", 0) == 0;
+                                   });
+  }
+
+  int exit_code() const { return ok_ ? 0 : 1; }
+
+private:
+  CommandLine const &cmd_;
+  int ran_ = 0;
+  bool ok_ = true;
+};
+
+} // namespace utils
+} // namespace cfk
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <iostream>
+
+#include <cuda_runtime.h>
+
 namespace cfk {
 namespace utils {
 inline void set_smem_size(int smem_size, void const *kernel) {
@@ -15,5 +19,67 @@ inline void set_smem_size(int smem_size, void const *kernel) {
     }
   }
 }
+
+// Launch shape for launch(). With `pdl` set the kernel is a programmatic
+// dependent launch: it may start while the previous kernel in the stream is
+// still draining, so its prologue (descriptor prefetch, smem and mbarrier
+// setup) overlaps that kernel's tail. It must call grid_dependency_wait()
+// before touching anything the previous kernel writes.
+struct LaunchConfig {
+  dim3 grid;
+  dim3 block;
+  dim3 cluster = dim3(1, 1, 1);
+  int smem = 0;
+  cudaStream_t stream = nullptr;
+  bool pdl = false;
+};
+
+template <class... Args>
+cudaError_t launch(void const *kernel, LaunchConfig const &config,
+                   Args const &...args) {
+  cudaLaunchAttribute attrs[2];
+  int n = 0;
+  if (config.cluster.x * config.cluster.y * config.cluster.z > 1) {
+    attrs[n].id = cudaLaunchAttributeClusterDimension;
+    attrs[n].val.clusterDim.x = config.cluster.x;
+    attrs[n].val.clusterDim.y = config.cluster.y;
+    attrs[n].val.clusterDim.z = config.cluster.z;
+    ++n;
+  }
+  if (config.pdl) {
+    attrs[n].id = cudaLaunchAttributeProgrammaticStreamSerialization;
+    attrs[n].val.programmaticStreamSerializationAllowed = 1;
+    ++n;
+  }
+  cudaLaunchConfig_t cfg = {};
+  cfg.gridDim = config.grid;
+  cfg.blockDim = config.block;
+  cfg.dynamicSmemBytes = config.smem;
+  cfg.stream = config.stream;
+  cfg.attrs = attrs;
+  cfg.numAttrs = n;
+  void *ptrs[] = {const_cast<void *>(static_cast<void const *>(&args))...,
+                  nullptr};
+  return cudaLaunchKernelExC(&cfg, kernel, ptrs);
+}
+
+#if defined(__CUDACC__)
+// Block until every kernel this one depends on has completed and its
+// writes are visible. A no-op without a programmatic dependent launch.
+__device__ __forceinline__ void grid_dependency_wait() {
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+  asm volatile("griddepcontrol.wait;" ::: "memory");
+#endif
+}
+
+// Let the next kernel in the stream start its prologue. Its
+// grid_dependency_wait() still waits for this kernel to finish.
+__device__ __forceinline__ void launch_dependent_grids() {
+#if defined(__CUDA_ARCH__) && __CUDA_ARCH__ >= 900
+  asm volatile("griddepcontrol.launch_dependents;" ::: "memory");
+#endif
+}
+#endif // __CUDACC__
+
 } // namespace utils
-} // namespace cfk
\ No newline at end of file
+} // namespace cfk
@@ -0,0 +1,90 @@
+#pragma once
+
+// Portable FP8 (E4M3) and block-scale helpers for the quantization kernels.
+//
+// fp8_e4m3_encode rounds to nearest even and saturates to +-448, the same
+// as the cvt.rn.satfinite.e4m3x2.f32 the device uses. The CPU reference can
+// therefore be compared with the GPU output bit for bit. Block scales are
+// computed with one IEEE division each way, so they also match exactly
+// (this holds as long as the kernels are not built with --use_fast_math).
+
+#include <cstdint>
+#include <cstring>
+
+#include "host_device.hpp"
+
+namespace cfk {
+namespace utils {
+
+constexpr float kFp8E4M3Max = 448.0f;
+
+CFK_HOST_DEVICE uint32_t float_bits(float x) {
+  uint32_t u;
+  std::memcpy(&u, &x, sizeof(u));
+  return u;
+}
+
+CFK_HOST_DEVICE float bf16_bits_to_float(uint16_t b) {
+  uint32_t u = uint32_t(b) << 16;
+  float x;
+  std::memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+CFK_HOST_DEVICE uint8_t fp8_e4m3_encode(float x) {
+  uint32_t u = float_bits(x);
+  uint8_t sign = uint8_t((u >> 24) & 0x80);
+  float a = x < 0 ? -x : x;
+  if (a != a)
+    return sign | 0x7F; // NaN
+  if (a >= kFp8E4M3Max)
+    return sign | 0x7E; // saturate
+  if (a < 0.015625f) {
+    // Subnormal: a multiple of 2^-9. A result of 8 encodes the smallest
+    // normal, 2^-6, which is exactly what code 0x08 means.
+    float m = a * 512.0f;
+    uint32_t q = uint32_t(m);
+    float frac = m - float(q);
+    if (frac > 0.5f || (frac == 0.5f && (q & 1)))
+      ++q;
+    return sign | uint8_t(q);
+  }
+  uint32_t ua = float_bits(a);
+  int e = int(ua >> 23) - 127;
+  uint32_t mant = ua & 0x7FFFFF;
+  uint32_t q = mant >> 20, rem = mant & 0xFFFFF;
+  if (rem > 0x80000 || (rem == 0x80000 && (q & 1)))
+    ++q; // a carry out of the mantissa bumps the exponent
+  uint32_t code = (uint32_t(e + 7) << 3) + q;
+  return sign | uint8_t(code > 0x7E ? 0x7E : code);
+}
+
+CFK_HOST_DEVICE float fp8_e4m3_decode(uint8_t b) {
+  float sign = (b & 0x80) ? -1.0f : 1.0f;
+  int e = (b >> 3) & 0xF, m = b & 0x7;
+  if (e == 0xF && m == 0x7)
+    return 0.0f / 0.0f;
+  if (e == 0)
+    return sign * float(m) * (1.0f / 512.0f);
+  float p = 1.0f;
+  for (int k = e; k > 7; --k)
+    p *= 2.0f;
+  for (int k = e; k < 7; ++k)
+    p *= 0.5f;
+  return sign * p * (1.0f + float(m) * 0.125f);
+}
+
+// Scale of a block with absolute maximum `amax`, so that q = x * inv fits
+// FP8 and x ~= q * scale. All-zero blocks get scale 1.
+CFK_HOST_DEVICE void fp8_block_scale(float amax, float &scale, float &inv) {
+  if (!(amax > 0.0f)) {
+    scale = 1.0f;
+    inv = 1.0f;
+    return;
+  }
+  scale = amax / kFp8E4M3Max;
+  inv = kFp8E4M3Max / amax;
+}
+
+} // namespace utils
+} // namespace cfk
@@ -0,0 +1,8 @@
+#pragma once
+
+// Qualifier for small helpers shared by host code and device kernels.
+#if defined(__CUDACC__)
+#define CFK_HOST_DEVICE __host__ __device__ __forceinline__
+#else
+#define CFK_HOST_DEVICE inline
+#endif
@@ -0,0 +1,140 @@
+#pragma once
+
+// Per-call-site host overhead counters.
+//
+// Each instrumented stage (contiguity checks, output allocation, dtype
+// dispatch, CuTe layout construction, TMA descriptor encoding, ...) owns a
+// StageStat holding a call count and a cumulative nanosecond timer. Stats
+// are registered by name on first use and looked up once per call site, so
+// the steady-state cost is two clock reads and two relaxed atomic adds.
+//
+// Define CFK_DISABLE_HOST_STATS to compile the timers out. Python modules
+// expose the counters with bind_host_stats().
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cfk {
+namespace utils {
+
+struct StageStat {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> total_ns{0};
+
+  void add(uint64_t ns) {
+    calls.fetch_add(1, std::memory_order_relaxed);
+    total_ns.fetch_add(ns, std::memory_order_relaxed);
+  }
+};
+
+struct StageSnapshot {
+  std::string name;
+  uint64_t calls;
+  uint64_t total_ns;
+};
+
+class HostStats {
+public:
+  static HostStats &instance() {
+    static HostStats stats;
+    return stats;
+  }
+
+  // Stats live as long as the process; references stay valid.
+  StageStat &stage(std::string const &name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto &slot = stages_[name];
+    if (!slot)
+      slot = std::make_unique<StageStat>();
+    return *slot;
+  }
+
+  std::vector<StageSnapshot> snapshot() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<StageSnapshot> out;
+    out.reserve(stages_.size());
+    for (auto const &[name, stat] : stages_)
+      out.push_back({name, stat->calls.load(std::memory_order_relaxed),
+                     stat->total_ns.load(std::memory_order_relaxed)});
+    return out;
+  }
+
+  void reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &[name, stat] : stages_) {
+      stat->calls.store(0, std::memory_order_relaxed);
+      stat->total_ns.store(0, std::memory_order_relaxed);
+    }
+  }
+
+private:
+  std::mutex mutex_;
+  std::map<std::string, std::unique_ptr<StageStat>> stages_;
+};
+
+// Adds the time between construction and stop() (or destruction) to a stat.
+class StageTimer {
+public:
+  explicit StageTimer(StageStat &stat) : stat_(&stat) {
+#if !defined(CFK_DISABLE_HOST_STATS)
+    start_ = std::chrono::steady_clock::now();
+#endif
+  }
+
+  void stop() {
+#if !defined(CFK_DISABLE_HOST_STATS)
+    if (stat_ == nullptr)
+      return;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - start_)
+                  .count();
+    stat_->add(uint64_t(ns));
+    stat_ = nullptr;
+#endif
+  }
+
+  ~StageTimer() { stop(); }
+
+  StageTimer(StageTimer const &) = delete;
+  StageTimer &operator=(StageTimer const &) = delete;
+
+private:
+  StageStat *stat_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+#if defined(PYBIND11_VERSION_MAJOR)
+// {stage: {"calls": n, "total_ns": t}} for every registered stage.
+inline pybind11::dict host_stats_dict() {
+  pybind11::dict out;
+  for (auto const &s : HostStats::instance().snapshot()) {
+    pybind11::dict entry;
+    entry["calls"] = s.calls;
+    entry["total_ns"] = s.total_ns;
+    out[pybind11::str(s.name)] = entry;
+  }
+  return out;
+}
+
+// Binds <module>.stats() and <module>.reset_stats().
+inline void bind_host_stats(pybind11::module_ &m) {
+  m.def("stats", &host_stats_dict);
+  m.def("reset_stats", [] { HostStats::instance().reset(); });
+}
+#endif
+
+} // namespace utils
+} // namespace cfk
+
+// Declare a StageTimer named `var` for the stage `name`. The registry lookup
+// happens once per call site.
+#define CFK_HOST_STAGE(var, name)                                              \
+  static cfk::utils::StageStat &var##_stat =                                   \
+      cfk::utils::HostStats::instance().stage(name);                           \
+  cfk::utils::StageTimer var(var##_stat)
@@ -0,0 +1,185 @@
+#pragma once
+
+// Scoped host-side ranges for the launchers.
+//
+// When the NVTX v3 headers are available (they ship with the CUDA toolkit),
+// each ScopedRange pushes an NVTX range named after the kernel variant, with
+// the shape and dtype in the message, so Nsight Systems can attribute time
+// to individual calls. Define CFK_DISABLE_NVTX to opt out.
+//
+// Without NVTX, ranges are collected by a small built-in tracer instead.
+// Set CFK_HOST_TRACE=<path> in the environment and a Chrome trace JSON file
+// is written to <path> when the process exits. If the variable is unset the
+// ranges cost one branch each.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if !defined(CFK_DISABLE_NVTX) && __has_include(<nvtx3/nvToolsExt.h>)
+#include <nvtx3/nvToolsExt.h>
+#define CFK_HAVE_NVTX 1
+#endif
+
+#if __has_include(<cutlass/numeric_types.h>)
+#include <cutlass/numeric_types.h>
+#endif
+
+namespace cfk {
+namespace utils {
+
+template <class T> constexpr char const *dtype_name() { return "unknown"; }
+template <> constexpr char const *dtype_name<float>() { return "float32"; }
+template <> constexpr char const *dtype_name<double>() { return "float64"; }
+template <> constexpr char const *dtype_name<int8_t>() { return "int8"; }
+template <> constexpr char const *dtype_name<uint8_t>() { return "uint8"; }
+template <> constexpr char const *dtype_name<int32_t>() { return "int32"; }
+template <> constexpr char const *dtype_name<uint32_t>() { return "uint32"; }
+#if __has_include(<cutlass/numeric_types.h>)
+template <> constexpr char const *dtype_name<cutlass::half_t>() {
+  return "float16";
+}
+template <> constexpr char const *dtype_name<cutlass::bfloat16_t>() {
+  return "bfloat16";
+}
+#endif
+
+inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Collects completed ranges and writes them as Chrome trace "X" events.
+class HostTracer {
+public:
+  static HostTracer &instance() {
+    static HostTracer tracer;
+    return tracer;
+  }
+
+  bool enabled() const { return !path_.empty(); }
+
+  void record(std::string name, std::string args, uint64_t start_ns,
+              uint64_t end_ns) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto tid = std::this_thread::get_id();
+    auto it = tids_.find(tid);
+    if (it == tids_.end())
+      it = tids_.emplace(tid, uint32_t(tids_.size())).first;
+    events_.push_back(
+        {std::move(name), std::move(args), start_ns, end_ns, it->second});
+  }
+
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!enabled())
+      return;
+    std::ofstream out(path_);
+    out << "{\"traceEvents\":[";
+    for (size_t i = 0; i < events_.size(); ++i) {
+      auto const &e = events_[i];
+      out << (i ? ",\n" : "\n") << "{\"name\":\"" << e.name
+          << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.tid
+          << ",\"ts\":" << double(e.start_ns - origin_ns_) * 1e-3
+          << ",\"dur\":" << double(e.end_ns - e.start_ns) * 1e-3
+          << ",\"args\":{\"detail\":\"" << e.args << "\"}}";
+    }
+    out << "\n]}\n";
+  }
+
+  ~HostTracer() { flush(); }
+
+private:
+  HostTracer() : origin_ns_(now_ns()) {
+    if (char const *path = std::getenv("CFK_HOST_TRACE"))
+      path_ = path;
+  }
+
+  struct Event {
+    std::string name;
+    std::string args;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    uint32_t tid;
+  };
+
+  std::string path_;
+  uint64_t origin_ns_;
+  std::mutex mutex_;
+  std::vector<Event> events_;
+  std::unordered_map<std::thread::id, uint32_t> tids_;
+};
+
+inline bool host_tracing_active() {
+#if defined(CFK_HAVE_NVTX)
+  return true;
+#else
+  return HostTracer::instance().enabled();
+#endif
+}
+
+// RAII range carrying a kernel variant name, a shape and a dtype. The detail
+// string is only formatted when a consumer (NVTX or the CPU tracer) is active.
+class ScopedRange {
+public:
+  ScopedRange(char const *name, char const *dtype,
+              std::initializer_list<int> shape)
+      : name_(name), active_(host_tracing_active()) {
+    if (!active_)
+      return;
+    detail_ = dtype;
+    char const *sep = " [";
+    for (int extent : shape) {
+      detail_ += sep;
+      detail_ += std::to_string(extent);
+      sep = ", ";
+    }
+    if (shape.size())
+      detail_ += "]";
+#if defined(CFK_HAVE_NVTX)
+    std::string message = std::string(name_) + " " + detail_;
+    nvtxEventAttributes_t attr = {};
+    attr.version = NVTX_VERSION;
+    attr.size = NVTX_EVENT_ATTRIB_STRUCT_SIZE;
+    attr.messageType = NVTX_MESSAGE_TYPE_ASCII;
+    attr.message.ascii = message.c_str();
+    nvtxRangePushEx(&attr);
+#else
+    start_ns_ = now_ns();
+#endif
+  }
+
+  explicit ScopedRange(char const *name) : ScopedRange(name, "", {}) {}
+
+  ~ScopedRange() {
+    if (!active_)
+      return;
+#if defined(CFK_HAVE_NVTX)
+    nvtxRangePop();
+#else
+    HostTracer::instance().record(name_, std::move(detail_), start_ns_,
+                                  now_ns());
+#endif
+  }
+
+  ScopedRange(ScopedRange const &) = delete;
+  ScopedRange &operator=(ScopedRange const &) = delete;
+
+private:
+  char const *name_;
+  bool active_;
+  std::string detail_;
+  uint64_t start_ns_ = 0;
+};
+
+} // namespace utils
+} // namespace cfk
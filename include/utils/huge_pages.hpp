@@ -0,0 +1,158 @@
+#pragma once
+
+// Host buffers backed by 2 MiB pages.
+//
+// A column-order pass over a wide row-major matrix touches a new 4 KiB page
+// on every row, so host transposes are bound by dTLB misses long before
+// DRAM bandwidth. HostBuffer maps its storage with one of three page modes:
+//
+//   kSmall       regular 4 KiB pages (madvise NOHUGEPAGE, for comparison)
+//   kTransparent 2 MiB aligned mapping with madvise(MADV_HUGEPAGE)
+//   kExplicit    MAP_HUGETLB | MAP_HUGE_2MB from the hugetlbfs pool, falling
+//                back to kTransparent if the pool is empty
+//
+// When compiled by nvcc, pin() page-locks the buffer with cudaHostRegister
+// so it can be used for async copies.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace cfk {
+namespace utils {
+
+constexpr size_t kSmallPageBytes = size_t(4) << 10;
+constexpr size_t kHugePageBytes = size_t(2) << 20;
+
+enum class PageMode { kSmall, kTransparent, kExplicit };
+
+inline char const *page_mode_name(PageMode mode) {
+  switch (mode) {
+  case PageMode::kSmall:
+    return "4K";
+  case PageMode::kTransparent:
+    return "2M (THP)";
+  case PageMode::kExplicit:
+    return "2M (hugetlb)";
+  }
+  return "?";
+}
+
+template <class T> class HostBuffer {
+public:
+  HostBuffer() = default;
+
+  HostBuffer(size_t count, PageMode mode = PageMode::kTransparent)
+      : count_(count) {
+    bytes_ = (count * sizeof(T) + kHugePageBytes - 1) / kHugePageBytes *
+             kHugePageBytes;
+#if defined(__linux__)
+    void *p = MAP_FAILED;
+    if (mode == PageMode::kExplicit) {
+#if defined(MAP_HUGE_2MB)
+      p = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+#endif
+      mode = p == MAP_FAILED ? PageMode::kTransparent : PageMode::kExplicit;
+    }
+    if (p == MAP_FAILED) {
+      // Over-allocate so the start can be rounded up to a 2 MiB boundary;
+      // THP only backs naturally aligned 2 MiB ranges.
+      size_t mapped = bytes_ + kHugePageBytes;
+      char *raw = static_cast<char *>(mmap(nullptr, mapped,
+                                           PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+      if (raw == MAP_FAILED)
+        throw std::bad_alloc();
+      size_t lead = (kHugePageBytes - uintptr_t(raw) % kHugePageBytes) %
+                    kHugePageBytes;
+      if (lead)
+        munmap(raw, lead);
+      munmap(raw + lead + bytes_, mapped - lead - bytes_);
+      p = raw + lead;
+#if defined(MADV_HUGEPAGE)
+      madvise(p, bytes_,
+              mode == PageMode::kSmall ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+#endif
+    }
+    data_ = static_cast<T *>(p);
+#else
+    data_ = static_cast<T *>(std::aligned_alloc(kHugePageBytes, bytes_));
+    if (!data_)
+      throw std::bad_alloc();
+    mode = PageMode::kSmall;
+#endif
+    mode_ = mode;
+  }
+
+  ~HostBuffer() { release(); }
+
+  HostBuffer(HostBuffer &&o) noexcept { *this = std::move(o); }
+  HostBuffer &operator=(HostBuffer &&o) noexcept {
+    if (this != &o) {
+      release();
+      std::swap(data_, o.data_);
+      std::swap(count_, o.count_);
+      std::swap(bytes_, o.bytes_);
+      std::swap(mode_, o.mode_);
+      std::swap(pinned_, o.pinned_);
+    }
+    return *this;
+  }
+  HostBuffer(HostBuffer const &) = delete;
+  HostBuffer &operator=(HostBuffer const &) = delete;
+
+#if defined(__CUDACC__)
+  // Page-lock the buffer for DMA. Returns false if registration failed.
+  bool pin() {
+    if (!pinned_ && data_)
+      pinned_ = cudaHostRegister(data_, bytes_, cudaHostRegisterDefault) ==
+                cudaSuccess;
+    return pinned_;
+  }
+#endif
+
+  T *data() { return data_; }
+  T const *data() const { return data_; }
+  size_t size() const { return count_; }
+  T &operator[](size_t i) { return data_[i]; }
+  T const &operator[](size_t i) const { return data_[i]; }
+  T *begin() { return data_; }
+  T *end() { return data_ + count_; }
+
+  // Page mode actually obtained, after any fallback.
+  PageMode mode() const { return mode_; }
+  bool pinned() const { return pinned_; }
+
+private:
+  void release() {
+    if (!data_)
+      return;
+#if defined(__CUDACC__)
+    if (pinned_)
+      cudaHostUnregister(data_);
+#endif
+#if defined(__linux__)
+    munmap(data_, bytes_);
+#else
+    std::free(data_);
+#endif
+    data_ = nullptr;
+    pinned_ = false;
+  }
+
+  T *data_ = nullptr;
+  size_t count_ = 0;
+  size_t bytes_ = 0;
+  PageMode mode_ = PageMode::kSmall;
+  bool pinned_ = false;
+};
+
+} // namespace utils
+} // namespace cfk
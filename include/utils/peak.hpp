@@ -0,0 +1,187 @@
+#pragma once
+
+// Measured hardware peaks, stored per machine.
+//
+// The calibrate/ program measures achievable bandwidth with STREAM-style
+// kernels (and GEMM throughput) and saves the numbers with PeakTable::save.
+// The benchmark drivers load the same file and print their results as a
+// percentage of the measured peak next to the raw number.
+//
+// The table is a plain `key value` text file at $CFK_PEAK_FILE, or at
+// $HOME/.cache/cfk/peak-<hostname>.txt by default. Everything in this header
+// is host-only and works without a GPU.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include "task_runtime.hpp"
+
+namespace cfk {
+namespace utils {
+
+class PeakTable {
+public:
+  static PeakTable &instance() {
+    static PeakTable table(default_path());
+    return table;
+  }
+
+  static std::string default_path() {
+    if (char const *path = std::getenv("CFK_PEAK_FILE"))
+      return path;
+    char host[256] = "localhost";
+    gethostname(host, sizeof(host) - 1);
+    char const *home = std::getenv("HOME");
+    return std::string(home ? home : ".") + "/.cache/cfk/peak-" + host +
+           ".txt";
+  }
+
+  explicit PeakTable(std::string path) : path_(std::move(path)) {
+    std::ifstream in(path_);
+    std::string key;
+    double value;
+    while (in >> key >> value)
+      values_[key] = value;
+  }
+
+  // Returns 0 if the key has not been calibrated on this machine.
+  double get(std::string const &key) const {
+    auto it = values_.find(key);
+    return it == values_.end() ? 0.0 : it->second;
+  }
+
+  void set(std::string const &key, double value) { values_[key] = value; }
+
+  bool save() const {
+    std::filesystem::path const parent =
+        std::filesystem::path(path_).parent_path();
+    std::error_code ec;
+    if (!parent.empty())
+      std::filesystem::create_directories(parent, ec);
+    std::ofstream out(path_);
+    if (!out)
+      return false;
+    for (auto const &[key, value] : values_)
+      out << key << " " << value << "\n";
+    return bool(out);
+  }
+
+  std::string const &path() const { return path_; }
+
+private:
+  std::string path_;
+  std::map<std::string, double> values_;
+};
+
+// Format "<value> <unit>" followed by the fraction of the calibrated peak
+// for `key`, if one is known, e.g. "812.4 GB/s, 24.3% of peak".
+inline std::string with_peak(double value, char const *unit,
+                             std::string const &key) {
+  std::ostringstream os;
+  os << value << " " << unit;
+  double peak = PeakTable::instance().get(key);
+  if (peak > 0)
+    os << ", " << std::fixed << std::setprecision(1) << 100.0 * value / peak
+       << "% of peak";
+  return os.str();
+}
+
+//
+// CPU calibration
+//
+
+template <class F> double best_seconds(int trials, F &&f) {
+  double best = 1e30;
+  for (int t = 0; t < trials; ++t) {
+    auto t1 = std::chrono::steady_clock::now();
+    f();
+    auto t2 = std::chrono::steady_clock::now();
+    best = std::min(best, std::chrono::duration<double>(t2 - t1).count());
+  }
+  return best;
+}
+
+struct CpuStreamResult {
+  double copy_gbs;
+  double triad_gbs;
+};
+
+// STREAM copy (a = b) and triad (a = b + s * c) over `n` doubles per array
+// on the shared task runtime. parallel_for hints the same chunk to the same
+// worker on every pass, so the arrays are mostly first-touched by the thread
+// that later streams them.
+inline CpuStreamResult cpu_stream(size_t n = size_t(1) << 24, int trials = 5) {
+  size_t grain = n / TaskRuntime::instance().num_threads() + 1;
+  std::unique_ptr<double[]> a(new double[n]), b(new double[n]),
+      c(new double[n]);
+  parallel_for(0, n, grain, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i) {
+      a[i] = 0.0;
+      b[i] = 1.0;
+      c[i] = 2.0;
+    }
+  });
+
+  double t_copy = best_seconds(trials, [&] {
+    parallel_for(0, n, grain, [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; ++i)
+        a[i] = b[i];
+    });
+  });
+  double t_triad = best_seconds(trials, [&] {
+    parallel_for(0, n, grain, [&](size_t lo, size_t hi) {
+      for (size_t i = lo; i < hi; ++i)
+        a[i] = b[i] + 3.0 * c[i];
+    });
+  });
+
+  double bytes = double(n) * sizeof(double);
+  return {2 * bytes / t_copy * 1e-9, 3 * bytes / t_triad * 1e-9};
+}
+
+// C += A * B with square n x n row-major operands (n a multiple of 64), a
+// cache-blocked kernel on the shared task runtime.
+inline void cpu_sgemm(int n, float const *A, float const *B, float *C) {
+  constexpr int kBlock = 64;
+  parallel_for(0, n / kBlock, 1, [&](size_t lo, size_t hi) {
+    for (size_t ib = lo * kBlock; ib < hi * kBlock; ib += kBlock)
+      for (int kb = 0; kb < n; kb += kBlock)
+        for (int jb = 0; jb < n; jb += kBlock)
+          for (size_t i = ib; i < ib + kBlock; ++i)
+            for (int k = kb; k < kb + kBlock; ++k) {
+              float aik = A[i * n + k];
+              float *c = &C[i * n + jb];
+              float const *b = &B[size_t(k) * n + jb];
+              for (int j = 0; j < kBlock; ++j)
+                c[j] += aik * b[j];
+            }
+  });
+}
+
+// Single-precision GEMM throughput of cpu_sgemm(). This is an achievable
+// number for simple host code, not the vendor BLAS peak.
+inline double cpu_sgemm_gflops(int n = 1024, int trials = 3) {
+  std::vector<float> A(size_t(n) * n, 1.0f), B(size_t(n) * n, 0.5f),
+      C(size_t(n) * n, 0.0f);
+
+  double t = best_seconds(
+      trials, [&] { cpu_sgemm(n, A.data(), B.data(), C.data()); });
+  return 2.0 * n * n * double(n) / t * 1e-9;
+}
+
+} // namespace utils
+} // namespace cfk
@@ -0,0 +1,102 @@
+#pragma once
+
+// GPU half of the peak calibration (see peak.hpp). Keys are prefixed with
+// the device name so one table can hold several GPUs. The GEMM measurement
+// lives in calibrate/gemm_peak.h so the drivers do not pull in CUTLASS GEMM.
+
+#include <string>
+
+#include "peak.hpp"
+
+namespace cfk {
+namespace utils {
+
+inline std::string gpu_peak_key(char const *metric, int device = -1) {
+  if (device < 0)
+    cudaGetDevice(&device);
+  cudaDeviceProp prop;
+  cudaGetDeviceProperties(&prop, device);
+  std::string name = prop.name;
+  std::replace(name.begin(), name.end(), ' ', '_');
+  return "gpu." + name + "." + metric;
+}
+
+// Bandwidth of the current device as "<GB/s> GB/s[, x% of peak]", relative
+// to the calibrated STREAM copy bandwidth.
+inline std::string gpu_bandwidth_with_peak(double gbs) {
+  return with_peak(gbs, "GB/s", gpu_peak_key("stream_copy_gbs"));
+}
+
+__global__ void streamCopyKernel(float4 const *__restrict__ src,
+                                 float4 *__restrict__ dst, size_t n) {
+  for (size_t i = blockIdx.x * size_t(blockDim.x) + threadIdx.x; i < n;
+       i += size_t(gridDim.x) * blockDim.x)
+    dst[i] = src[i];
+}
+
+__global__ void streamTriadKernel(float4 const *__restrict__ b,
+                                  float4 const *__restrict__ c,
+                                  float4 *__restrict__ a, float s, size_t n) {
+  for (size_t i = blockIdx.x * size_t(blockDim.x) + threadIdx.x; i < n;
+       i += size_t(gridDim.x) * blockDim.x) {
+    float4 x = b[i], y = c[i];
+    a[i] = make_float4(x.x + s * y.x, x.y + s * y.y, x.z + s * y.z,
+                       x.w + s * y.w);
+  }
+}
+
+template <class F> float best_event_ms(int trials, F &&launch) {
+  cudaEvent_t start, stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+  launch(); // warmup
+  float best = 1e30f;
+  for (int t = 0; t < trials; ++t) {
+    cudaEventRecord(start);
+    launch();
+    cudaEventRecord(stop);
+    cudaEventSynchronize(stop);
+    float ms;
+    cudaEventElapsedTime(&ms, start, stop);
+    best = std::min(best, ms);
+  }
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+  return best;
+}
+
+struct GpuStreamResult {
+  double copy_gbs;
+  double triad_gbs;
+};
+
+// STREAM copy and triad over `bytes` per array.
+inline GpuStreamResult gpu_stream(size_t bytes = size_t(1) << 30,
+                                  int trials = 10) {
+  size_t n = bytes / sizeof(float4);
+  float4 *a, *b, *c;
+  cudaMalloc(&a, n * sizeof(float4));
+  cudaMalloc(&b, n * sizeof(float4));
+  cudaMalloc(&c, n * sizeof(float4));
+  cudaMemset(b, 0, n * sizeof(float4));
+  cudaMemset(c, 0, n * sizeof(float4));
+
+  int device, sms;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+  dim3 grid(sms * 8), block(256);
+
+  float copy_ms = best_event_ms(
+      trials, [&] { streamCopyKernel<<<grid, block>>>(b, a, n); });
+  float triad_ms = best_event_ms(
+      trials, [&] { streamTriadKernel<<<grid, block>>>(b, c, a, 3.0f, n); });
+
+  cudaFree(a);
+  cudaFree(b);
+  cudaFree(c);
+  double total = double(n) * sizeof(float4);
+  return {2e-6 * total / copy_ms, 3e-6 * total / triad_ms};
+}
+
+} // namespace utils
+} // namespace cfk
@@ -0,0 +1,225 @@
+#pragma once
+
+// Hardware counters for the CPU benchmark harness via perf_event_open.
+//
+// PerfCounters opens one group of counters (instructions, LLC read misses,
+// dTLB load and store misses) per monitored thread: the calling thread,
+// which also passes them on to threads it creates later, and any
+// already-running threads passed by id (the task runtime's workers). Any
+// counter that cannot be opened (no PMU in a VM, perf_event_paranoid,
+// seccomp in a container, non-Linux host) is simply reported as
+// unavailable. The harness then falls back to plain timing.
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cfk {
+namespace utils {
+
+enum PerfCounter {
+  kInstructions = 0,
+  kLLCMisses,
+  kDTLBLoadMisses,
+  kDTLBStoreMisses,
+  kNumPerfCounters
+};
+
+inline char const *perf_counter_name(int c) {
+  static char const *names[] = {"instructions", "LLC-misses",
+                                "dTLB-load-misses", "dTLB-store-misses"};
+  return names[c];
+}
+
+struct PerfSample {
+  bool valid[kNumPerfCounters] = {};
+  uint64_t value[kNumPerfCounters] = {};
+
+  bool any() const {
+    for (bool v : valid)
+      if (v)
+        return true;
+    return false;
+  }
+};
+
+class PerfCounters {
+public:
+  // Count on the calling thread (and threads it creates from now on), plus
+  // the already-running threads in `tids`, such as the task runtime's
+  // workers. Values are summed over all threads.
+  explicit PerfCounters(std::vector<long> const &tids = {}) {
+    std::vector<long> targets = {0};
+    targets.insert(targets.end(), tids.begin(), tids.end());
+    for (long tid : targets) {
+      groups_.emplace_back();
+      open_group(tid, groups_.back());
+    }
+  }
+
+  ~PerfCounters() {
+#if defined(__linux__)
+    for (auto const &g : groups_)
+      for (int fd : g)
+        if (fd >= 0)
+          close(fd);
+#endif
+  }
+
+  PerfCounters(PerfCounters const &) = delete;
+  PerfCounters &operator=(PerfCounters const &) = delete;
+
+  bool available() const {
+    for (auto const &g : groups_)
+      for (int fd : g)
+        if (fd >= 0)
+          return true;
+    return false;
+  }
+
+  // Reason the first unavailable counter failed to open, if any.
+  std::string const &error() const { return error_; }
+
+  void start() {
+#if defined(__linux__)
+    for (auto const &g : groups_)
+      for (int fd : g)
+        if (fd >= 0) {
+          ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+          ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+  }
+
+  // Stop counting and return the values, scaled for multiplexing and summed
+  // over threads.
+  PerfSample stop() {
+    PerfSample s;
+#if defined(__linux__)
+    for (auto const &g : groups_)
+      for (int c = 0; c < kNumPerfCounters; ++c) {
+        if (g[c] < 0)
+          continue;
+        ioctl(g[c], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t buf[3] = {}; // value, time_enabled, time_running
+        if (read(g[c], buf, sizeof(buf)) != ssize_t(sizeof(buf)) ||
+            buf[2] == 0)
+          continue;
+        s.valid[c] = true;
+        s.value[c] += buf[2] < buf[1]
+                          ? uint64_t(double(buf[0]) * buf[1] / buf[2])
+                          : buf[0];
+      }
+#endif
+    return s;
+  }
+
+private:
+  using Group = std::array<int, kNumPerfCounters>;
+
+  void open_group(long tid, Group &fds) {
+    fds.fill(-1);
+#if defined(__linux__)
+    int leader = -1;
+    for (int c = 0; c < kNumPerfCounters; ++c) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.disabled = 1;
+      attr.inherit = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format =
+          PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      config(c, attr);
+      // Group everything under the first counter that opened so the events
+      // are scheduled on the PMU together.
+      int fd = int(syscall(__NR_perf_event_open, &attr, tid, -1, leader, 0));
+      if (fd < 0 && leader >= 0)
+        fd = int(syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+      if (fd < 0) {
+        if (error_.empty())
+          error_ = std::strerror(errno);
+        continue;
+      }
+      fds[c] = fd;
+      if (leader < 0)
+        leader = fd;
+    }
+#else
+    (void)tid;
+    error_ = "perf_event_open is Linux-only";
+#endif
+  }
+
+#if defined(__linux__)
+  static void config(int c, perf_event_attr &attr) {
+    auto cache = [](uint64_t id, uint64_t op) {
+      return id | (op << 8) | (uint64_t(PERF_COUNT_HW_CACHE_RESULT_MISS) << 16);
+    };
+    switch (c) {
+    case kInstructions:
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+      break;
+    case kLLCMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config =
+          cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ);
+      break;
+    case kDTLBLoadMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config =
+          cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ);
+      break;
+    case kDTLBStoreMisses:
+      attr.type = PERF_TYPE_HW_CACHE;
+      attr.config =
+          cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_WRITE);
+      break;
+    }
+  }
+#endif
+
+  std::vector<Group> groups_;
+  std::string error_;
+};
+
+// One line of derived metrics for a kernel that moved `bytes` in
+// `seconds`: raw counts, instructions per byte and LLC miss bandwidth.
+inline std::string format_perf_sample(PerfSample const &s, double bytes,
+                                      double seconds) {
+  std::ostringstream os;
+  os << std::setprecision(4);
+  if (!s.any())
+    return "counters unavailable";
+  char const *sep = "";
+  for (int c = 0; c < kNumPerfCounters; ++c) {
+    if (!s.valid[c])
+      continue;
+    os << sep << perf_counter_name(c) << "=" << s.value[c];
+    sep = ", ";
+  }
+  if (s.valid[kInstructions])
+    os << sep << "instr/byte=" << double(s.value[kInstructions]) / bytes;
+  if (s.valid[kLLCMisses])
+    os << sep << "LLC-miss GB/s="
+       << 64e-9 * double(s.value[kLLCMisses]) / seconds;
+  return os.str();
+}
+
+} // namespace utils
+} // namespace cfk
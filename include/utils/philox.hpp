@@ -0,0 +1,68 @@
+#pragma once
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al., SC'11) shared
+// by host and device.
+//
+// The value at element i depends only on (seed, i), so a kernel can
+// regenerate any input element instead of reading it back, and the CPU
+// produces bit-identical inputs for cross-checking. philox_uniform returns
+// floats with 24 random bits in [0, 1). Every one of them is exactly
+// representable, so scaling by a power of two or converting back and forth
+// never rounds differently on host and device.
+
+#include <cstdint>
+
+#include "host_device.hpp"
+
+namespace cfk {
+namespace utils {
+
+struct Philox4x32 {
+  uint32_t v[4];
+};
+
+CFK_HOST_DEVICE void philox_mulhilo(uint32_t a, uint32_t b, uint32_t &hi,
+                                    uint32_t &lo) {
+  uint64_t p = uint64_t(a) * b;
+  hi = uint32_t(p >> 32);
+  lo = uint32_t(p);
+}
+
+// Ten rounds of Philox4x32 on `counter` with a 64-bit key.
+CFK_HOST_DEVICE Philox4x32 philox4x32(Philox4x32 counter, uint64_t key) {
+  uint32_t k0 = uint32_t(key), k1 = uint32_t(key >> 32);
+  uint32_t c0 = counter.v[0], c1 = counter.v[1], c2 = counter.v[2],
+           c3 = counter.v[3];
+  for (int r = 0; r < 10; ++r) {
+    uint32_t hi0, lo0, hi1, lo1;
+    philox_mulhilo(0xD2511F53u, c0, hi0, lo0);
+    philox_mulhilo(0xCD9E8D57u, c2, hi1, lo1);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = lo1;
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = lo0;
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+  return {{c0, c1, c2, c3}};
+}
+
+// Four consecutive 32-bit draws for elements 4 * block .. 4 * block + 3.
+CFK_HOST_DEVICE Philox4x32 philox_block(uint64_t seed, uint64_t block) {
+  return philox4x32({{uint32_t(block), uint32_t(block >> 32), 0u, 0u}}, seed);
+}
+
+CFK_HOST_DEVICE uint32_t philox_bits(uint64_t seed, uint64_t index) {
+  return philox_block(seed, index >> 2).v[index & 3];
+}
+
+CFK_HOST_DEVICE float philox_to_uniform(uint32_t bits) {
+  return float(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+CFK_HOST_DEVICE float philox_uniform(uint64_t seed, uint64_t index) {
+  return philox_to_uniform(philox_bits(seed, index));
+}
+
+} // namespace utils
+} // namespace cfk
@@ -0,0 +1,193 @@
+#pragma once
+
+// Kernels specialized for the fixed shapes of a model.
+//
+// The launchers build their CuTe layouts from runtime ints, so tile counts,
+// strides and bounds live in registers and are recomputed on every call. A
+// model runs a handful of shapes over and over. Built from cute::Int extents
+// instead, the same layouts fold into immediates. The shapes come from a
+// manifest: a ShapeList of Extents compiled into the binary. For each
+// operation, a ShapeRegistry maps the manifest shapes to specialized
+// launchers, and dispatch() falls back to the dynamic launcher for any other
+// shape. A launcher may decline a shape (a null entry), e.g. one that its
+// tiles do not divide; that shape stays dynamic.
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace cfk {
+namespace utils {
+
+// (m, n) for the 2D operations, (m, n, k) for GEMMs.
+template <int M, int N, int K = 0> struct Extents {
+  static constexpr int m = M, n = N, k = K;
+};
+
+template <class... E> struct ShapeList {
+  static constexpr int size = sizeof...(E);
+};
+
+struct StaticShape {
+  int m, n, k = 0;
+
+  friend bool operator<(StaticShape const &a, StaticShape const &b) {
+    return std::make_pair(a.m, std::make_pair(a.n, a.k)) <
+           std::make_pair(b.m, std::make_pair(b.n, b.k));
+  }
+  friend bool operator==(StaticShape const &a, StaticShape const &b) {
+    return a.m == b.m && a.n == b.n && a.k == b.k;
+  }
+};
+
+template <class E> constexpr StaticShape shape_of() {
+  return {E::m, E::n, E::k};
+}
+
+// True if (tile_m, tile_n) tiles divide the shape, so a specialized kernel
+// needs no partial tiles.
+template <class E> constexpr bool tiles_evenly(int tile_m, int tile_n) {
+  return E::m % tile_m == 0 && E::n % tile_n == 0;
+}
+
+// The default manifest: Llama-2 7B (hidden 4096, fused QKV 12288, FFN 11008)
+// on 4096 tokens. Weights and activations as (rows, cols).
+using Llama7BShapes =
+    ShapeList<Extents<4096, 4096>, Extents<4096, 11008>,
+              Extents<11008, 4096>, Extents<4096, 12288>>;
+
+// Its projections as (M, N, K) = (tokens, out features, in features).
+using Llama7BGemmShapes =
+    ShapeList<Extents<4096, 12288, 4096>, Extents<4096, 4096, 4096>,
+              Extents<4096, 11008, 4096>, Extents<4096, 4096, 11008>>;
+
+// Shape -> launcher, sorted for binary search. Filled once, then read only;
+// the users keep one per operation and dtype in a function-local static.
+template <class Fn> class ShapeRegistry {
+public:
+  // A null fn is skipped. Throws std::invalid_argument for a shape that is
+  // already registered.
+  void add(StaticShape s, Fn fn) {
+    if (!fn)
+      return;
+    auto it = lower(s);
+    if (it != entries_.end() && it->first == s)
+      throw std::invalid_argument(
+          "shape (" + std::to_string(s.m) + ", " + std::to_string(s.n) +
+          ", " + std::to_string(s.k) + ") registered twice");
+    entries_.insert(it, {s, fn});
+  }
+
+  // The specialized launcher for s, or null.
+  Fn find(StaticShape s) const {
+    auto it = lower(s);
+    return it != entries_.end() && it->first == s ? it->second : nullptr;
+  }
+
+  Fn dispatch(StaticShape s, Fn dynamic) const {
+    Fn fn = find(s);
+    return fn ? fn : dynamic;
+  }
+
+  int size() const { return int(entries_.size()); }
+
+private:
+  using Entry = std::pair<StaticShape, Fn>;
+
+  typename std::vector<Entry>::const_iterator lower(StaticShape s) const {
+    return std::lower_bound(
+        entries_.begin(), entries_.end(), s,
+        [](Entry const &e, StaticShape const &v) { return e.first < v; });
+  }
+
+  std::vector<Entry> entries_;
+};
+
+// Registers make(E{}) for every E of the manifest. make is typically a
+// generic lambda that instantiates the launcher for decltype(e).
+template <class Fn, class... E, class Make>
+void register_shapes(ShapeRegistry<Fn> &registry, ShapeList<E...>,
+                     Make &&make) {
+  (registry.add(shape_of<E>(), make(E{})), ...);
+}
+
+// Stand-ins for launchers in the check. A specialization called with another
+// shape than its own is off by the difference.
+template <class E> int static_area(int m, int n) {
+  return E::m * E::n + (m - E::m) + (n - E::n);
+}
+
+inline int dynamic_area(int m, int n) { return -m * n; }
+
+// Checks the registry on host functions standing in for launchers: manifest
+// shapes resolve to their own instantiation, everything else and declined
+// shapes fall back, and duplicates are rejected.
+inline bool check_static_shapes() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Static shape check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  using Fn = int (*)(int, int);
+  ShapeRegistry<Fn> all, tiled;
+  register_shapes(all, Llama7BShapes{}, [](auto e) -> Fn {
+    return &static_area<decltype(e)>;
+  });
+  // As a launcher with 1024-wide tiles would: 11008 is not a multiple.
+  register_shapes(tiled, Llama7BShapes{}, [](auto e) -> Fn {
+    using E = decltype(e);
+    if constexpr (tiles_evenly<E>(32, 1024))
+      return &static_area<E>;
+    else
+      return nullptr;
+  });
+  if (all.size() != Llama7BShapes::size || tiled.size() != 3)
+    fail("registered " + std::to_string(all.size()) + " and " +
+         std::to_string(tiled.size()) + " shapes");
+
+  auto call = [](ShapeRegistry<Fn> const &r, int m, int n) {
+    return r.dispatch({m, n}, &dynamic_area)(m, n);
+  };
+  for (StaticShape s : {StaticShape{4096, 4096}, StaticShape{4096, 11008},
+                        StaticShape{11008, 4096}, StaticShape{4096, 12288}}) {
+    std::string const shape =
+        "(" + std::to_string(s.m) + ", " + std::to_string(s.n) + ")";
+    if (call(all, s.m, s.n) != s.m * s.n)
+      fail(shape + " did not reach its specialization");
+    bool const even = s.n % 1024 == 0;
+    if (call(tiled, s.m, s.n) != (even ? 1 : -1) * s.m * s.n)
+      fail(shape + (even ? " was declined" : " was not declined"));
+  }
+  for (StaticShape s : {StaticShape{12288, 4096}, StaticShape{4096, 4097},
+                        StaticShape{1, 1}, StaticShape{4096, 4096, 4096}})
+    if (all.find(s))
+      fail("(" + std::to_string(s.m) + ", " + std::to_string(s.n) + ", " +
+           std::to_string(s.k) + ") is not in the manifest");
+  if (call(all, 4096, 4097) != -4096 * 4097)
+    fail("an unknown shape did not fall back");
+
+  ShapeRegistry<Fn> gemm;
+  register_shapes(gemm, Llama7BGemmShapes{}, [](auto e) -> Fn {
+    return &static_area<decltype(e)>;
+  });
+  if (gemm.size() != Llama7BGemmShapes::size ||
+      !gemm.find({4096, 4096, 11008}) || gemm.find({4096, 4096}))
+    fail("GEMM shapes keyed without K");
+
+  try {
+    all.add({4096, 4096}, &dynamic_area);
+    fail("accepted a shape twice");
+  } catch (std::invalid_argument const &) {
+  }
+
+  if (ok)
+    std::cout << "Static shape check passed." << std::endl;
+  return ok;
+}
+
+} // namespace utils
+} // namespace cfk
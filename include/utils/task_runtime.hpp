@@ -0,0 +1,361 @@
+#pragma once
+
+// Work-stealing task runtime shared by all host kernels.
+//
+// One process-wide pool of worker threads, each with its own deque. A worker
+// pops its own deque from the back (LIFO, cache-warm) and steals from the
+// front of a random victim's deque (FIFO, oldest and largest work first).
+// Tasks submitted from outside the pool go to an injection queue. A thread
+// in TaskGroup::wait() executes queued tasks while there are any and sleeps
+// only when there are none, so nested parallel_for calls run on the same
+// threads and never oversubscribe the machine. An exception thrown by a
+// task is kept by its group and rethrown from wait(). A multi-tenant
+// process pays for one set of threads no matter how many backends are
+// active.
+//
+// The pool has CFK_NUM_THREADS threads (default: hardware concurrency),
+// counting the calling thread, which participates while it waits.
+// TaskRuntime::configure() overrides this before first use.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace cfk {
+namespace utils {
+
+class TaskGroup;
+
+struct Task {
+  std::function<void()> fn;
+  TaskGroup *group;
+};
+
+class TaskRuntime {
+public:
+  static TaskRuntime &instance() {
+    static TaskRuntime runtime(requested_threads());
+    return runtime;
+  }
+
+  // Set the total thread count. Only effective before the first instance().
+  static void configure(int threads) { requested_threads() = threads; }
+
+  // Total threads, including the calling thread.
+  int num_threads() const { return int(workers_.size()) + 1; }
+
+  // Index of the calling worker, or -1 for threads outside the pool.
+  static int current_worker() { return tls_worker(); }
+
+  // Kernel thread ids of the workers, for per-thread profiling. Empty on
+  // platforms without gettid.
+  std::vector<long> thread_ids() const {
+    std::vector<long> ids;
+#if defined(__linux__)
+    for (auto const &w : workers_) {
+      while (w->tid.load() == 0) // worker still starting up
+        std::this_thread::yield();
+      ids.push_back(w->tid.load());
+    }
+#endif
+    return ids;
+  }
+
+  // Queue a task. `affinity` >= 0 places it on that worker's deque; it may
+  // still be stolen if the worker is busy.
+  void submit(Task *task, int affinity = -1) {
+    int n = int(workers_.size());
+    if (n == 0) {
+      run_task(task);
+      return;
+    }
+    int self = tls_worker();
+    if (affinity >= 0)
+      push(*workers_[affinity % n], task);
+    else if (self >= 0)
+      push(*workers_[self], task);
+    else {
+      std::lock_guard<std::mutex> lock(inject_mutex_);
+      inject_.push_back(task);
+    }
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    sleep_cv_.notify_one();
+    if (waiters_.load(std::memory_order_seq_cst) > 0)
+      notify_waiters();
+  }
+
+  // Run one queued task on the calling thread, if any is available.
+  bool try_run_one() {
+    Task *task = take(tls_worker());
+    if (!task)
+      return false;
+    run_task(task);
+    return true;
+  }
+
+  // Sleep until a task is queued or `pending` drops to zero. For threads in
+  // TaskGroup::wait() that found nothing to run.
+  void wait_idle(std::atomic<long> const &pending) {
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    waiters_.fetch_add(1, std::memory_order_seq_cst);
+    wait_cv_.wait(lock, [&] {
+      return pending.load(std::memory_order_acquire) == 0 ||
+             queued_.load(std::memory_order_seq_cst) > 0;
+    });
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void notify_waiters() {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    wait_cv_.notify_all();
+  }
+
+  ~TaskRuntime() {
+    stop_.store(true);
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.notify_all();
+    }
+    for (auto &w : workers_)
+      w->thread.join();
+  }
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<Task *> deque;
+    std::thread thread;
+    std::atomic<long> tid{0};
+  };
+
+  static int &requested_threads() {
+    static int threads = [] {
+      char const *env = std::getenv("CFK_NUM_THREADS");
+      int n = env ? std::atoi(env) : 0;
+      return n > 0 ? n : int(std::max(1u, std::thread::hardware_concurrency()));
+    }();
+    return threads;
+  }
+
+  static int &tls_worker() {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  explicit TaskRuntime(int threads) {
+    for (int i = 0; i + 1 < threads; ++i)
+      workers_.emplace_back(std::make_unique<Worker>());
+    for (int i = 0; i < int(workers_.size()); ++i)
+      workers_[i]->thread = std::thread([this, i] { worker_loop(i); });
+  }
+
+  static void push(Worker &w, Task *task) {
+    std::lock_guard<std::mutex> lock(w.mutex);
+    w.deque.push_back(task);
+  }
+
+  Task *take(int self) {
+    if (queued_.load(std::memory_order_acquire) == 0)
+      return nullptr;
+    Task *task = nullptr;
+    if (self >= 0) {
+      Worker &w = *workers_[self];
+      std::lock_guard<std::mutex> lock(w.mutex);
+      if (!w.deque.empty()) {
+        task = w.deque.back();
+        w.deque.pop_back();
+      }
+    }
+    if (!task) {
+      std::lock_guard<std::mutex> lock(inject_mutex_);
+      if (!inject_.empty()) {
+        task = inject_.front();
+        inject_.pop_front();
+      }
+    }
+    if (!task) {
+      static thread_local std::minstd_rand rng(std::random_device{}());
+      int n = int(workers_.size());
+      int start = int(rng() % n);
+      for (int k = 0; k < n && !task; ++k) {
+        Worker &victim = *workers_[(start + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.deque.empty()) {
+          task = victim.deque.front();
+          victim.deque.pop_front();
+        }
+      }
+    }
+    if (task)
+      queued_.fetch_sub(1, std::memory_order_relaxed);
+    return task;
+  }
+
+  void run_task(Task *task);
+
+  void worker_loop(int index) {
+    tls_worker() = index;
+#if defined(__linux__)
+    workers_[index]->tid.store(long(syscall(SYS_gettid)));
+#endif
+    while (!stop_.load(std::memory_order_relaxed)) {
+      if (try_run_one())
+        continue;
+      std::unique_lock<std::mutex> lock(sleep_mutex_);
+      sleep_cv_.wait_for(lock, std::chrono::milliseconds(1), [this] {
+        return stop_.load() || queued_.load(std::memory_order_acquire) > 0;
+      });
+    }
+  }
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::mutex inject_mutex_;
+  std::deque<Task *> inject_;
+  std::atomic<long> queued_{0};
+  std::atomic<bool> stop_{false};
+  std::atomic<int> waiters_{0};
+  std::mutex sleep_mutex_;
+  std::condition_variable sleep_cv_; // idle workers
+  std::condition_variable wait_cv_;  // idle threads in TaskGroup::wait()
+};
+
+// A set of tasks that can be waited on together. Tasks may spawn further
+// tasks into the same or other groups.
+class TaskGroup {
+public:
+  TaskGroup() = default;
+  TaskGroup(TaskGroup const &) = delete;
+  TaskGroup &operator=(TaskGroup const &) = delete;
+  // Waits for outstanding tasks, which may reference the caller's frame,
+  // but drops their exception: a destructor must not throw.
+  ~TaskGroup() { drain(); }
+
+  template <class F> void run(F &&f, int affinity = -1) {
+    pending_.fetch_add(1, std::memory_order_relaxed);
+    TaskRuntime::instance().submit(new Task{std::forward<F>(f), this},
+                                   affinity);
+  }
+
+  // Block until every task in the group has finished, executing queued
+  // tasks (from any group) in the meantime. Rethrows the first exception
+  // thrown by a task of the group.
+  void wait() {
+    drain();
+    std::exception_ptr error;
+    {
+      std::lock_guard<std::mutex> lock(error_mutex_);
+      std::swap(error, error_);
+    }
+    if (error)
+      std::rethrow_exception(error);
+  }
+
+private:
+  friend class TaskRuntime;
+
+  void drain() {
+    auto &rt = TaskRuntime::instance();
+    while (pending_.load(std::memory_order_acquire) > 0)
+      if (!rt.try_run_one())
+        rt.wait_idle(pending_);
+  }
+
+  void capture(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    if (!error_)
+      error_ = std::move(error);
+  }
+
+  // The group may be destroyed as soon as pending_ reaches zero, so only
+  // the runtime is touched after the decrement.
+  void finish_one() {
+    if (pending_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+      TaskRuntime::instance().notify_waiters();
+  }
+
+  std::atomic<long> pending_{0};
+  std::mutex error_mutex_;
+  std::exception_ptr error_;
+};
+
+inline void TaskRuntime::run_task(Task *task) {
+  // Deletes the task and retires it from its group however fn() exits.
+  struct Retire {
+    Task *task;
+    ~Retire() {
+      TaskGroup *group = task->group;
+      delete task;
+      group->finish_one();
+    }
+  } retire{task};
+  try {
+    task->fn();
+  } catch (...) {
+    task->group->capture(std::current_exception());
+  }
+}
+
+namespace detail {
+template <class F>
+void split_range(TaskGroup &g, size_t lo, size_t hi, size_t grain, F &f) {
+  while (hi - lo > grain) {
+    size_t mid = lo + (hi - lo) / 2;
+    g.run([&g, mid, hi, grain, &f] { split_range(g, mid, hi, grain, f); });
+    hi = mid;
+  }
+  f(lo, hi);
+}
+} // namespace detail
+
+// Call f(lo, hi) over disjoint subranges covering [begin, end). The range
+// is first cut into one chunk per thread, with chunk k hinted to worker k.
+// Repeated calls over the same range therefore tend to touch the same data
+// on the same threads. Chunks are split recursively down to `grain`
+// elements so idle threads can steal from uneven ones. grain = 0 picks a
+// default of about eight pieces per thread.
+template <class F>
+void parallel_for(size_t begin, size_t end, size_t grain, F &&f) {
+  if (end <= begin)
+    return;
+  auto &rt = TaskRuntime::instance();
+  size_t n = end - begin;
+  size_t threads = size_t(rt.num_threads());
+  if (grain == 0)
+    grain = std::max<size_t>(1, n / (8 * threads));
+  if (n <= grain || threads == 1) {
+    f(begin, end);
+    return;
+  }
+  TaskGroup g;
+  size_t chunks = std::min(threads, (n + grain - 1) / grain);
+  size_t chunk = (n + chunks - 1) / chunks;
+  for (size_t c = 1; c < chunks; ++c) {
+    size_t lo = begin + c * chunk, hi = std::min(end, lo + chunk);
+    if (lo < hi)
+      g.run(
+          [&g, lo, hi, grain, &f] {
+            detail::split_range(g, lo, hi, grain, f);
+          },
+          int(c - 1));
+  }
+  detail::split_range(g, begin, std::min(end, begin + chunk), grain, f);
+  g.wait();
+}
+
+} // namespace utils
+} // namespace cfk
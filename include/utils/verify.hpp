@@ -0,0 +1,209 @@
+#pragma once
+
+// Deterministic inputs and closed-form output checks for the benchmark
+// drivers.
+//
+// Inputs are Philox draws (philox.hpp) indexed by element, so the expected
+// value of any output element can be computed from its index alone: an
+// Expect* functor maps an output index to the value the kernel should have
+// written there. The same functors run on the host (below) and on the
+// device (verify_gpu.hpp). A check only returns the mismatch count and the
+// first few bad elements, never the whole output.
+
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+#include "philox.hpp"
+#include "task_runtime.hpp"
+
+namespace cfk {
+namespace utils {
+
+constexpr uint64_t kDefaultInputSeed = 0x5eed;
+
+// Element value for one 32-bit draw: a uniform [0, 1) float converted to T,
+// or raw bits for uint32_t (packed sub-byte data) and uint8_t (pixels).
+template <class T> CFK_HOST_DEVICE T random_from_bits(uint32_t bits) {
+  return static_cast<T>(philox_to_uniform(bits));
+}
+
+template <>
+CFK_HOST_DEVICE uint32_t random_from_bits<uint32_t>(uint32_t bits) {
+  return bits;
+}
+
+template <>
+CFK_HOST_DEVICE uint8_t random_from_bits<uint8_t>(uint32_t bits) {
+  return uint8_t(bits >> 24);
+}
+
+template <class T>
+CFK_HOST_DEVICE T random_value(uint64_t seed, uint64_t index) {
+  return random_from_bits<T>(philox_bits(seed, index));
+}
+
+// out[i] == in[i]
+template <class T> struct ExpectIdentity {
+  uint64_t seed;
+  CFK_HOST_DEVICE T operator()(uint64_t i) const {
+    return random_value<T>(seed, i);
+  }
+};
+
+// out is the (N, M) row-major transpose of the (M, N) row-major input.
+template <class T> struct ExpectTranspose {
+  uint64_t seed;
+  uint64_t M, N;
+  CFK_HOST_DEVICE T operator()(uint64_t d) const {
+    return random_value<T>(seed, (d % M) * N + d / M);
+  }
+};
+
+// out = alpha * A + beta * B^T for an (M, N) input A drawn from seed_a and
+// an (N, M) input B drawn from seed_b. With seed_a == seed_b and M == N this
+// also describes symmetrize, whose result is the same however often it runs.
+template <class T> struct ExpectTransposeAdd {
+  uint64_t seed_a, seed_b;
+  uint64_t M, N;
+  T alpha, beta;
+  CFK_HOST_DEVICE T operator()(uint64_t d) const {
+    return alpha * random_value<T>(seed_a, d) +
+           beta * random_value<T>(seed_b, (d % N) * M + d / N);
+  }
+};
+
+// out[i] == scale * in[i], computed in T like the kernel does.
+template <class T> struct ExpectScale {
+  uint64_t seed;
+  T scale;
+  CFK_HOST_DEVICE T operator()(uint64_t i) const {
+    return scale * random_value<T>(seed, i);
+  }
+};
+
+// out holds copies of an n-element input back to back.
+template <class T> struct ExpectReplicate {
+  uint64_t seed;
+  uint64_t n;
+  CFK_HOST_DEVICE T operator()(uint64_t i) const {
+    return random_value<T>(seed, i % n);
+  }
+};
+
+// out is the (N, M) transpose of an (M, N) matrix of kBits-wide elements
+// packed LSB-first into 32-bit words, whose input words are raw draws.
+template <int kBits> struct ExpectPackedTranspose {
+  uint64_t seed;
+  uint64_t M, N;
+  CFK_HOST_DEVICE uint32_t operator()(uint64_t d) const {
+    constexpr int kPerWord = 32 / kBits;
+    constexpr uint32_t kMask = (1u << kBits) - 1;
+    uint64_t const wordsM = M / kPerWord;
+    uint64_t const c = d / wordsM, r0 = d % wordsM * kPerWord;
+    uint32_t out = 0;
+    for (int t = 0; t < kPerWord; ++t) {
+      uint64_t e = (r0 + t) * N + c;
+      uint32_t v = philox_bits(seed, e / kPerWord) >> (e % kPerWord * kBits);
+      out |= (v & kMask) << (t * kBits);
+    }
+    return out;
+  }
+};
+
+// Another expectation converted to To, for kernels that change dtype.
+template <class Expect, class To> struct ExpectCast {
+  Expect expect;
+  CFK_HOST_DEVICE To operator()(uint64_t i) const {
+    return static_cast<To>(expect(i));
+  }
+};
+
+constexpr int kMaxReportedMismatches = 8;
+
+struct Mismatch {
+  unsigned long long index;
+  double got;
+  double expected;
+};
+
+// Result of a check. Plain data so the device can fill it in place.
+struct VerifyReport {
+  unsigned long long checked;
+  unsigned long long mismatches;
+  unsigned int reported; // <= kMaxReportedMismatches
+  Mismatch first[kMaxReportedMismatches];
+
+  bool ok() const { return mismatches == 0; }
+
+  // Order the reported mismatches by index. The device records them in
+  // whatever order threads hit them.
+  void sort() {
+    std::sort(first, first + reported,
+              [](Mismatch const &a, Mismatch const &b) {
+                return a.index < b.index;
+              });
+  }
+};
+
+// Print in the drivers' usual format. `cols` is the row length of the
+// output, used to turn indices into (row, col) coordinates; 0 prints flat
+// indices, for outputs without a single row length.
+inline void print_verify_report(std::ostream &os, VerifyReport const &r,
+                                uint64_t cols) {
+  if (r.ok()) {
+    os << "Validation success." << std::endl;
+    return;
+  }
+  os << "Validation failed. Correct values: " << r.checked - r.mismatches
+     << ". Incorrect values: " << r.mismatches << std::endl;
+  for (unsigned k = 0; k < r.reported; ++k) {
+    if (cols == 0)
+      os << "  [" << r.first[k].index << "]";
+    else
+      os << "  (" << r.first[k].index / cols << ", "
+         << r.first[k].index % cols << ")";
+    os << ": got " << r.first[k].got << ", expected " << r.first[k].expected
+       << std::endl;
+  }
+}
+
+// Host generator, bit-identical to fill_random() on the device.
+template <class T> void fill_random_cpu(T *data, size_t n, uint64_t seed) {
+  parallel_for(0, (n + 3) / 4, 0, [&](size_t lo, size_t hi) {
+    for (size_t b = lo; b < hi; ++b) {
+      Philox4x32 r = philox_block(seed, b);
+      for (size_t k = 0; k < 4 && 4 * b + k < n; ++k)
+        data[4 * b + k] = random_from_bits<T>(r.v[k]);
+    }
+  });
+}
+
+template <class T, class Expect>
+VerifyReport verify_cpu(T const *data, size_t n, Expect expect) {
+  VerifyReport report{};
+  report.checked = n;
+  std::mutex mutex;
+  parallel_for(0, n, 0, [&](size_t lo, size_t hi) {
+    unsigned long long bad = 0;
+    for (size_t i = lo; i < hi; ++i) {
+      T want = expect(i);
+      if (data[i] == want)
+        continue;
+      if (bad++ < kMaxReportedMismatches) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (report.reported < kMaxReportedMismatches)
+          report.first[report.reported++] = {i, double(float(data[i])),
+                                             double(float(want))};
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    report.mismatches += bad;
+  });
+  report.sort();
+  return report;
+}
+
+} // namespace utils
+} // namespace cfk
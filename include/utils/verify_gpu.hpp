@@ -0,0 +1,94 @@
+#pragma once
+
+// Device half of verify.hpp: generate inputs and check outputs in place so
+// a benchmark never has to move the full matrix across PCIe or scan it on
+// the host. Only a VerifyReport (count plus a few mismatches) comes back.
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "verify.hpp"
+
+namespace cfk {
+namespace utils {
+
+template <class T>
+__global__ void fillRandomKernel(T *data, size_t n, uint64_t seed) {
+  for (size_t b = blockIdx.x * size_t(blockDim.x) + threadIdx.x;
+       b < (n + 3) / 4; b += size_t(gridDim.x) * blockDim.x) {
+    Philox4x32 r = philox_block(seed, b);
+#pragma unroll
+    for (int k = 0; k < 4; ++k)
+      if (4 * b + k < n)
+        data[4 * b + k] = random_from_bits<T>(r.v[k]);
+  }
+}
+
+template <class T, class Expect>
+__global__ void verifyKernel(T const *data, size_t n, Expect expect,
+                             VerifyReport *report) {
+  for (size_t i = blockIdx.x * size_t(blockDim.x) + threadIdx.x; i < n;
+       i += size_t(gridDim.x) * blockDim.x) {
+    T got = data[i], want = expect(i);
+    if (got == want)
+      continue;
+    unsigned long long slot = atomicAdd(&report->mismatches, 1ull);
+    if (slot < kMaxReportedMismatches) {
+      report->first[slot] = {i, double(float(got)), double(float(want))};
+      atomicAdd(&report->reported, 1u);
+    }
+  }
+}
+
+inline dim3 verify_grid() {
+  int device, sms;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+  return dim3(sms * 8);
+}
+
+// Fill n elements at `data` with the Philox stream for `seed`.
+template <class T>
+void fill_random(T *data, size_t n, uint64_t seed = kDefaultInputSeed) {
+  fillRandomKernel<<<verify_grid(), 256>>>(data, n, seed);
+}
+
+// Check every element of `data` against `expect` on the device.
+template <class T, class Expect>
+VerifyReport verify_on_device(T const *data, size_t n, Expect expect) {
+  VerifyReport report{}, *d_report;
+  cudaMalloc(&d_report, sizeof(VerifyReport));
+  cudaMemset(d_report, 0, sizeof(VerifyReport));
+  verifyKernel<<<verify_grid(), 256>>>(data, n, expect, d_report);
+  cudaMemcpy(&report, d_report, sizeof(VerifyReport), cudaMemcpyDeviceToHost);
+  cudaFree(d_report);
+  report.checked = n;
+  report.sort();
+  return report;
+}
+
+// Generate the same n elements on both sides and compare bitwise. Meant for
+// small n; it is the one place the generated data crosses PCIe.
+template <class T>
+bool check_generators(size_t n = size_t(1) << 20,
+                      uint64_t seed = kDefaultInputSeed) {
+  T *d_data;
+  cudaMalloc(&d_data, n * sizeof(T));
+  fill_random(d_data, n, seed);
+  std::vector<T> host(n), device(n);
+  cudaMemcpy(device.data(), d_data, n * sizeof(T), cudaMemcpyDeviceToHost);
+  cudaFree(d_data);
+  fill_random_cpu(host.data(), n, seed);
+  size_t bad = 0;
+  for (size_t i = 0; i < n; ++i)
+    bad += std::memcmp(&host[i], &device[i], sizeof(T)) != 0;
+  std::cout << "Generator cross-check (" << n << " elements): "
+            << (bad ? "FAILED, " + std::to_string(bad) + " differ" : "match")
+            << std::endl;
+  return bad == 0;
+}
+
+} // namespace utils
+} // namespace cfk
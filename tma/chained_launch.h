@@ -0,0 +1,123 @@
+#pragma once
+
+// Back-to-back dependent kernels with and without programmatic dependent
+// launch (PDL). The chain ping-pongs between two buffers:
+//   copyTMAKernel X0 -> X1, scaleTMAKernel X1 -> X0, copyTMAKernel, ...
+// so every kernel reads what the one before it wrote. Serialized, each
+// kernel's prologue (descriptor prefetch, smem carve-up, mbarrier init)
+// starts only after the previous grid has fully drained. With PDL it runs
+// during that grid's tail, and grid_dependency_wait() holds back the first
+// TMA load until the data is there.
+//
+// The scales alternate between 2 and 1/2, so with the length rounded up to
+// a multiple of four X0 ends up equal to the input, checked bit-exactly.
+
+#include <iostream>
+
+#include <thrust/device_vector.h>
+
+#include "cuda_launch.hpp"
+#include "scale_tma_kernel.h"
+#include "tma_copy.h"
+
+template <int TILE_M = 128, int TILE_N = 128>
+int chained_launch_host(int M, int N, int kernels, int iterations = 1) {
+  using namespace cute;
+  using Element = float;
+
+  kernels = (kernels + 3) / 4 * 4;
+  printf("Chain of %d dependent TMA kernels, (%d, %d).\n", kernels, M, N);
+
+  thrust::device_vector<Element> d_X0(size_t(M) * N), d_X1(size_t(M) * N);
+  Element *X0 = thrust::raw_pointer_cast(d_X0.data());
+  Element *X1 = thrust::raw_pointer_cast(d_X1.data());
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(X0, d_X0.size(), seed);
+
+  auto gmemLayout = make_layout(make_shape(M, N), LayoutRight{});
+  Tensor tensor_X0 = make_tensor(make_gmem_ptr(X0), gmemLayout);
+  Tensor tensor_X1 = make_tensor(make_gmem_ptr(X1), gmemLayout);
+  auto tileShape = make_shape(Int<TILE_M>{}, Int<TILE_N>{});
+  dim3 gridDim(ceil_div(M, TILE_M), ceil_div(N, TILE_N));
+
+  // X0 -> X1
+  auto copyLayout = make_layout(tileShape, LayoutRight{});
+  Params copy_params(make_tma_copy(SM90_TMA_LOAD{}, tensor_X0, copyLayout),
+                     make_tma_copy(SM90_TMA_STORE{}, tensor_X1, copyLayout),
+                     gmemLayout, copyLayout, tileShape);
+  int const copy_smem =
+      int(sizeof(SharedStorageTMA<Element, decltype(copyLayout)>));
+  void const *copy_kernel =
+      (void const *)copyTMAKernel<32, Element, decltype(copy_params)>;
+  cfk::utils::set_smem_size(copy_smem, copy_kernel);
+
+  // X1 -> X0
+  auto scaleLayout =
+      tile_to_shape(cfx::getSmemLayoutK<Element, TILE_N>(), tileShape);
+  ScaleKernelParams scale_params(
+      make_tma_copy(SM90_TMA_LOAD{}, tensor_X1, scaleLayout, tileShape,
+                    Int<1>{}),
+      make_tma_copy(SM90_TMA_STORE{}, tensor_X0, scaleLayout, tileShape,
+                    Int<1>{}),
+      gmemLayout, scaleLayout, tileShape,
+      make_layout(Shape<_32, _8>{}));
+  int const scale_smem =
+      int(sizeof(SharedStorageTMA<Element, decltype(scaleLayout)>));
+  void const *scale_kernel =
+      (void const *)scaleTMAKernel<256, Element, decltype(scale_params)>;
+  cfk::utils::set_smem_size(scale_smem, scale_kernel);
+
+  cudaEvent_t start, stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+
+  char const *modes[] = {"Serialized", "Programmatic dependent launch"};
+  double chain_ms[2] = {};
+  for (int pdl = 0; pdl < 2; ++pdl) {
+    printf("%s:\n", modes[pdl]);
+    cfk::utils::LaunchConfig copy_config{gridDim, dim3(32), dim3(1),
+                                         copy_smem, nullptr, pdl == 1};
+    cfk::utils::LaunchConfig scale_config{gridDim, dim3(256), dim3(1),
+                                          scale_smem, nullptr, pdl == 1};
+    for (int i = 0; i < iterations; i++) {
+      cfk::utils::ScopedRange range(pdl ? "chain.pdl" : "chain.serialized",
+                                    cfk::utils::dtype_name<Element>(),
+                                    {M, N, kernels});
+      cudaEventRecord(start);
+      cudaError launched = cudaSuccess;
+      for (int k = 0; k < kernels && launched == cudaSuccess; k += 2) {
+        Element const scale = k % 4 == 0 ? Element(2) : Element(0.5);
+        launched = cfk::utils::launch(copy_kernel, copy_config, copy_params);
+        if (launched == cudaSuccess)
+          launched = cfk::utils::launch(scale_kernel, scale_config, scale,
+                                        scale_params);
+      }
+      cudaEventRecord(stop);
+      cudaError result = cudaDeviceSynchronize();
+      if (launched != cudaSuccess || result != cudaSuccess) {
+        result = launched != cudaSuccess ? launched : result;
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      float time_ms = 0;
+      cudaEventElapsedTime(&time_ms, start, stop);
+      chain_ms[pdl] += time_ms / iterations;
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << time_ms * 1e3 / kernels << "us per kernel, "
+                << cfk::utils::gpu_bandwidth_with_peak(
+                       2e-6 * kernels * M * N * sizeof(Element) / time_ms)
+                << ")" << std::endl;
+    }
+  }
+  std::cout << "PDL saved " << (chain_ms[0] - chain_ms[1]) * 1e3 / kernels
+            << "us per kernel" << std::endl;
+
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+
+  auto report = cfk::utils::verify_on_device(
+      X0, d_X0.size(), cfk::utils::ExpectIdentity<Element>{seed});
+  cfk::utils::print_verify_report(std::cout, report, N);
+  return 0;
+}
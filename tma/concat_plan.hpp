@@ -0,0 +1,319 @@
+#pragma once
+
+// Host-side planning for concatenation and split along the inner dimension
+// of row-major tensors, see concat_split.h.
+//
+// Concat writes pieces (M, w_p) side by side into one (M, sum w_p) tensor;
+// split is the reverse. Every piece is cut into kTileM x kTileN tiles of its
+// own, so no tile straddles two pieces, and the plan stores the prefix sums
+// of the piece widths and of their tile counts. A CTA finds its piece from
+// the tile prefix table and copies the tile between the piece and the
+// piece's column window of the whole tensor. The CPU implementation below
+// walks the same tiles; check_concat_plan() exercises both on the CPU.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_device.hpp"
+#include "philox.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+namespace cfx {
+
+// Pieces per launch. Two descriptors per piece travel in the kernel
+// parameters, which must stay under 4 KiB.
+constexpr int kMaxConcatPieces = 8;
+
+struct ConcatPlan {
+  int M = 0, N = 0; // the whole tensor
+  int tile_m = 0, tile_n = 0;
+  int tiles_m = 0;             // tiles down M, the same for every piece
+  std::vector<int> col_start;  // pieces + 1, prefix sum of widths
+  std::vector<int> tile_start; // pieces + 1, prefix sum of tile counts
+
+  int pieces() const { return int(col_start.size()) - 1; }
+  int tiles() const { return tile_start.back(); }
+  int width(int p) const { return col_start[p + 1] - col_start[p]; }
+};
+
+// Throws std::invalid_argument for an empty list, more than
+// kMaxConcatPieces pieces, or a width that is not a positive multiple of 16
+// bytes: TMA needs 16-byte aligned bases and strides, and every piece starts
+// a column window of the whole tensor.
+inline ConcatPlan make_concat_plan(int M, std::vector<int> const &widths,
+                                   int tile_m, int tile_n, int elem_bytes) {
+  if (widths.empty() || int(widths.size()) > kMaxConcatPieces)
+    throw std::invalid_argument("concat needs 1 to " +
+                                std::to_string(kMaxConcatPieces) +
+                                " pieces, got " +
+                                std::to_string(widths.size()));
+  if (M <= 0)
+    throw std::invalid_argument("concat needs at least one row");
+
+  ConcatPlan plan;
+  plan.M = M;
+  plan.tile_m = tile_m;
+  plan.tile_n = tile_n;
+  plan.tiles_m = (M + tile_m - 1) / tile_m;
+  plan.col_start.assign(1, 0);
+  plan.tile_start.assign(1, 0);
+  for (int w : widths) {
+    if (w <= 0 || (int64_t(w) * elem_bytes) % 16 != 0)
+      throw std::invalid_argument(
+          "concat piece widths must be positive multiples of 16 bytes");
+    int64_t const tiles =
+        int64_t(plan.tiles_m) * ((w + tile_n - 1) / tile_n);
+    if (int64_t(plan.col_start.back()) + w > INT32_MAX ||
+        plan.tile_start.back() + tiles > INT32_MAX)
+      throw std::invalid_argument("concat result too large");
+    plan.col_start.push_back(plan.col_start.back() + w);
+    plan.tile_start.push_back(plan.tile_start.back() + int(tiles));
+  }
+  plan.N = plan.col_start.back();
+  return plan;
+}
+
+// One launch of a concat with any number of pieces: up to kMaxConcatPieces
+// non-empty pieces of the caller's list, whose column window of the whole
+// tensor starts at col0.
+struct ConcatGroup {
+  std::vector<int> index;  // the caller's index of each piece
+  std::vector<int> widths; // all positive
+  int col0 = 0;
+};
+
+// Splits a concat into launches of at most kMaxConcatPieces pieces, in
+// order. Empty pieces take no columns and are dropped. Throws
+// std::invalid_argument for a negative width or a total width past
+// INT32_MAX. A list of only empty pieces gives no launches.
+inline std::vector<ConcatGroup>
+concat_groups(std::vector<int> const &widths) {
+  std::vector<ConcatGroup> groups;
+  int64_t col = 0;
+  for (size_t p = 0; p < widths.size(); ++p) {
+    if (widths[p] < 0)
+      throw std::invalid_argument("concat piece widths must not be negative");
+    if (widths[p] == 0)
+      continue;
+    if (col + widths[p] > INT32_MAX)
+      throw std::invalid_argument("concat result too large");
+    if (groups.empty() || int(groups.back().index.size()) == kMaxConcatPieces)
+      groups.push_back({{}, {}, int(col)});
+    groups.back().index.push_back(int(p));
+    groups.back().widths.push_back(widths[p]);
+    col += widths[p];
+  }
+  return groups;
+}
+
+// Piece and piece-local origin (row m0, column n0) of tile t. A linear scan
+// of the prefix table: there are at most kMaxConcatPieces entries.
+struct ConcatTile {
+  int piece;
+  int m0, n0;
+};
+
+CFK_HOST_DEVICE ConcatTile concat_tile(int const *tile_start, int pieces,
+                                       int tiles_m, int tile_m, int tile_n,
+                                       int t) {
+  int p = 0;
+  while (p + 1 < pieces && tile_start[p + 1] <= t)
+    ++p;
+  int const tiles_n = (tile_start[p + 1] - tile_start[p]) / tiles_m;
+  int const local = t - tile_start[p];
+  return {p, local / tiles_n * tile_m, local % tiles_n * tile_n};
+}
+
+// CPU implementation over the plan's tiles: concat copies piece -> whole,
+// kSplit copies whole -> piece.
+template <class T, bool kSplit>
+void concat_tiles_cpu(ConcatPlan const &plan, T *const *pieces, T *whole) {
+  cfk::utils::parallel_for(0, plan.tiles(), 0, [&](size_t lo, size_t hi) {
+    for (size_t t = lo; t < hi; ++t) {
+      ConcatTile const tile =
+          concat_tile(plan.tile_start.data(), plan.pieces(), plan.tiles_m,
+                      plan.tile_m, plan.tile_n, int(t));
+      int const w = plan.width(tile.piece);
+      int const rows = std::min(plan.tile_m, plan.M - tile.m0);
+      size_t const bytes = std::min(plan.tile_n, w - tile.n0) * sizeof(T);
+      for (int m = tile.m0; m < tile.m0 + rows; ++m) {
+        T *piece = pieces[tile.piece] + size_t(m) * w + tile.n0;
+        T *row = whole + size_t(m) * plan.N + plan.col_start[tile.piece] +
+                 tile.n0;
+        if constexpr (kSplit)
+          std::memcpy(piece, row, bytes);
+        else
+          std::memcpy(row, piece, bytes);
+      }
+    }
+  });
+}
+
+template <class T>
+void concat_cpu(ConcatPlan const &plan, std::vector<T const *> const &srcs,
+                T *dst) {
+  std::vector<T *> pieces(srcs.size());
+  for (size_t p = 0; p < srcs.size(); ++p)
+    pieces[p] = const_cast<T *>(srcs[p]); // only read
+  concat_tiles_cpu<T, false>(plan, pieces.data(), dst);
+}
+
+template <class T>
+void split_cpu(ConcatPlan const &plan, T const *src,
+               std::vector<T *> const &dsts) {
+  concat_tiles_cpu<T, true>(plan, dsts.data(), const_cast<T *>(src));
+}
+
+// Output element d of a concat of pieces drawn from seed + p.
+template <class T> struct ExpectConcat {
+  uint64_t seed;
+  int N, pieces;
+  int col_start[kMaxConcatPieces + 1];
+  CFK_HOST_DEVICE T operator()(uint64_t d) const {
+    int const m = int(d / N), n = int(d % N);
+    int p = 0;
+    while (p + 1 < pieces && col_start[p + 1] <= n)
+      ++p;
+    int const w = col_start[p + 1] - col_start[p];
+    return cfk::utils::random_value<T>(seed + p,
+                                       uint64_t(m) * w + n - col_start[p]);
+  }
+};
+
+template <class T>
+ExpectConcat<T> expect_concat(ConcatPlan const &plan, uint64_t seed) {
+  ExpectConcat<T> e{seed, plan.N, plan.pieces(), {}};
+  std::copy(plan.col_start.begin(), plan.col_start.end(), e.col_start);
+  return e;
+}
+
+// Piece widths for the driver and the check: multiples of `align` elements
+// in [align, 512 * align], deliberately not multiples of the tile width.
+inline std::vector<int> concat_widths(int pieces, int align, uint64_t seed) {
+  std::vector<int> widths(pieces);
+  for (int p = 0; p < pieces; ++p)
+    widths[p] = align * (1 + cfk::utils::philox_bits(seed, p) % 512);
+  return widths;
+}
+
+// Checks the planner and the CPU implementation: every element of the
+// whole tensor lies in exactly one tile, concat matches ExpectConcat, split
+// undoes it, bad inputs are rejected, and longer lists are grouped into
+// launches correctly.
+inline bool check_concat_plan() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Concat plan check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  int const tile_m = 32, tile_n = 32;
+  for (int pieces : {1, 3, kMaxConcatPieces})
+    for (int M : {1, 45, 128}) {
+      std::string const shape =
+          std::to_string(pieces) + " pieces of " + std::to_string(M) + " rows";
+      auto widths = concat_widths(pieces, 4, pieces * 100 + M);
+      ConcatPlan plan = make_concat_plan(M, widths, tile_m, tile_n, 4);
+
+      std::vector<int> hits(size_t(M) * plan.N, 0);
+      for (int t = 0; t < plan.tiles(); ++t) {
+        ConcatTile tile = concat_tile(plan.tile_start.data(), plan.pieces(),
+                                      plan.tiles_m, tile_m, tile_n, t);
+        int const w = plan.width(tile.piece);
+        if (tile.m0 >= M || tile.n0 >= w)
+          fail("tile " + std::to_string(t) + " outside its piece, " + shape);
+        for (int m = tile.m0; m < std::min(M, tile.m0 + tile_m); ++m)
+          for (int n = tile.n0; n < std::min(w, tile.n0 + tile_n); ++n)
+            ++hits[size_t(m) * plan.N + plan.col_start[tile.piece] + n];
+      }
+      if (std::count(hits.begin(), hits.end(), 1) != int64_t(hits.size()))
+        fail("tile coverage, " + shape);
+
+      std::vector<std::vector<float>> src(pieces), back(pieces);
+      std::vector<float const *> src_ptrs;
+      std::vector<float *> back_ptrs;
+      for (int p = 0; p < pieces; ++p) {
+        src[p].resize(size_t(M) * widths[p]);
+        back[p].assign(src[p].size(), 0.0f);
+        cfk::utils::fill_random_cpu(src[p].data(), src[p].size(), 5 + p);
+        src_ptrs.push_back(src[p].data());
+        back_ptrs.push_back(back[p].data());
+      }
+      std::vector<float> whole(size_t(M) * plan.N);
+      concat_cpu(plan, src_ptrs, whole.data());
+      if (!cfk::utils::verify_cpu(whole.data(), whole.size(),
+                                  expect_concat<float>(plan, 5))
+               .ok())
+        fail("CPU concat disagrees with ExpectConcat, " + shape);
+      split_cpu(plan, whole.data(), back_ptrs);
+      if (back != src)
+        fail("split does not undo concat, " + shape);
+    }
+
+  auto rejects = [&](std::vector<int> const &widths) {
+    try {
+      make_concat_plan(16, widths, tile_m, tile_n, 4);
+    } catch (std::invalid_argument const &) {
+      return true;
+    }
+    return false;
+  };
+  if (!rejects({}))
+    fail("accepted an empty list");
+  if (!rejects(std::vector<int>(kMaxConcatPieces + 1, 4)))
+    fail("accepted more than kMaxConcatPieces pieces");
+  if (!rejects({8, 6}))
+    fail("accepted a width that is not a multiple of 16 bytes");
+  if (!rejects({8, 0}))
+    fail("accepted an empty piece");
+  if (rejects({4, 12}))
+    fail("rejected a valid plan");
+
+  // Longer lists with empty pieces go out in launches of at most
+  // kMaxConcatPieces pieces that tile the columns in order.
+  std::vector<int> widths = concat_widths(3 * kMaxConcatPieces + 1, 4, 17);
+  for (size_t p = 0; p < widths.size(); p += 5)
+    widths[p] = 0;
+  auto groups = concat_groups(widths);
+  std::vector<int> seen;
+  int col = 0;
+  for (auto const &g : groups) {
+    if (g.index.empty() || int(g.index.size()) > kMaxConcatPieces ||
+        g.index.size() != g.widths.size() || g.col0 != col)
+      fail("concat group layout");
+    for (size_t k = 0; k < g.index.size(); ++k) {
+      if (g.widths[k] != widths[g.index[k]] || g.widths[k] <= 0)
+        fail("concat group widths");
+      seen.push_back(g.index[k]);
+      col += g.widths[k];
+    }
+  }
+  std::vector<int> nonempty;
+  for (size_t p = 0; p < widths.size(); ++p)
+    if (widths[p] > 0)
+      nonempty.push_back(int(p));
+  if (seen != nonempty)
+    fail("concat groups do not cover the non-empty pieces in order");
+  if (!concat_groups({0, 0}).empty())
+    fail("a list of empty pieces needs no launch");
+  bool negative_rejected = false;
+  try {
+    concat_groups({4, -4});
+  } catch (std::invalid_argument const &) {
+    negative_rejected = true;
+  }
+  if (!negative_rejected)
+    fail("concat groups accepted a negative width");
+
+  if (ok)
+    std::cout << "Concat plan check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
@@ -0,0 +1,275 @@
+#pragma once
+
+// Concatenation and split along the inner dimension (torch.cat / split on
+// dim 1 of row-major tensors) in one launch per kMaxConcatPieces pieces.
+//
+// The host encodes two descriptors per piece: the piece itself and the
+// piece's column window of the whole tensor (base offset by the window's
+// first column, row stride of the whole tensor). Both go to the kernel by
+// value with the tile prefix table of the plan (concat_plan.hpp). A single
+// thread per CTA walks tiles across the grid; for each it finds the piece in
+// the table and copies the tile with a TMA load and a TMA store at the same
+// coordinates: piece -> window for concat, window -> piece for split. TMA
+// clips every box at the window edge, so a partial last tile never writes
+// into the neighbouring piece. The baseline is what a copy per piece costs:
+// one cudaMemcpy2DAsync per piece.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#include <cuda.h>
+#include <thrust/device_vector.h>
+
+#include <cutlass/arch/barrier.h>
+#include <cutlass/arch/memory_sm90.hpp>
+#include <cutlass/cutlass.h>
+
+#include "concat_plan.hpp"
+#include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
+#include "pipeline.hpp"
+#include "tensormap.hpp"
+#include "verify_gpu.hpp"
+
+template <class Element, int kTileM, int kTileN, int kStages>
+struct SharedStorageConcat {
+  alignas(128) Element tile[kStages][kTileM * kTileN];
+  typename cfx::TmaPipeline<kStages>::SharedStorage pipeline;
+};
+
+struct ConcatParams {
+  CUtensorMap load[cfx::kMaxConcatPieces];
+  CUtensorMap store[cfx::kMaxConcatPieces];
+  int tile_start[cfx::kMaxConcatPieces + 1];
+  int pieces;
+  int tiles_m;
+};
+
+// One thread per CTA runs cfx::persistent_tma_loop; each tile goes through
+// the descriptors of its own piece.
+template <class Element, int kTileM, int kTileN, int kStages>
+__global__ static void __launch_bounds__(1)
+    concatTMAKernel(CUTE_GRID_CONSTANT ConcatParams const p) {
+  extern __shared__ __align__(128) char shared_memory[];
+  using SharedStorage = SharedStorageConcat<Element, kTileM, kTileN, kStages>;
+  SharedStorage &ss = *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  using Pipeline = cfx::TmaPipeline<kStages>;
+  Pipeline pipeline(ss.pipeline, {kTileM * kTileN * sizeof(Element)}, true);
+  __syncthreads();
+  auto tile_of = [&](int t) {
+    return cfx::concat_tile(p.tile_start, p.pieces, p.tiles_m, kTileM, kTileN,
+                            t);
+  };
+
+  cfx::persistent_tma_loop(
+      pipeline, p.tile_start[p.pieces],
+      [&](int t, typename Pipeline::State const &state) {
+        cfx::ConcatTile const tile = tile_of(t);
+        cfx::tma_load_2d(&p.load[tile.piece], pipeline.full_barrier(state),
+                         ss.tile[state.index], tile.n0, tile.m0);
+      },
+      [&](int t, int s) {
+        cfx::ConcatTile const tile = tile_of(t);
+        cfx::tma_store_2d(&p.store[tile.piece], ss.tile[s], tile.n0, tile.m0);
+      });
+}
+
+// Shared by concat_cols and split_cols: pieces[p] is (M, widths[p]) and
+// whole is (M, sum widths). Lists longer than kMaxConcatPieces go out in
+// several launches (concat_groups), and empty pieces and M == 0 are no-ops.
+// Throws std::invalid_argument for a list the plan rejects (see
+// make_concat_plan).
+template <bool kSplit, class Element, int TILE_M, int TILE_N,
+          int kStages = 4>
+cudaError_t concat_split(std::vector<Element *> const &pieces,
+                         std::vector<int> const &widths, Element *whole,
+                         int M, cudaStream_t stream) {
+  if (pieces.size() != widths.size())
+    throw std::invalid_argument("concat needs one width per piece");
+  std::vector<cfx::ConcatGroup> const groups = cfx::concat_groups(widths);
+  if (M < 0)
+    throw std::invalid_argument("concat needs a non-negative row count");
+  if (M == 0 || groups.empty())
+    return cudaSuccess;
+  int N = 0; // concat_groups checked that the sum fits
+  for (int w : widths)
+    N += w;
+  cfk::utils::ScopedRange range(kSplit ? "split_cols" : "concat_cols",
+                                cfk::utils::dtype_name<Element>(),
+                                {M, N, int(pieces.size())});
+
+  int device = 0, sms = 0;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+  int smem_size = int(
+      sizeof(SharedStorageConcat<Element, TILE_M, TILE_N, kStages>));
+  auto kernel = concatTMAKernel<Element, TILE_M, TILE_N, kStages>;
+  cfk::utils::set_smem_size(smem_size, (void const *)kernel);
+
+  for (cfx::ConcatGroup const &group : groups) {
+    cfx::ConcatPlan const plan = cfx::make_concat_plan(
+        M, group.widths, TILE_M, TILE_N, sizeof(Element));
+    ConcatParams params{};
+    for (int k = 0; k < plan.pieces(); ++k) {
+      CUtensorMap *piece = kSplit ? &params.store[k] : &params.load[k];
+      CUtensorMap *window = kSplit ? &params.load[k] : &params.store[k];
+      if (cfx::make_tensor_map_2d(piece, pieces[group.index[k]], M,
+                                  plan.width(k), TILE_M,
+                                  TILE_N) != CUDA_SUCCESS ||
+          cfx::make_tensor_map_2d(window,
+                                  whole + group.col0 + plan.col_start[k], M,
+                                  plan.width(k), TILE_M, TILE_N,
+                                  N) != CUDA_SUCCESS)
+        return cudaErrorInvalidValue;
+    }
+    std::copy(plan.tile_start.begin(), plan.tile_start.end(),
+              params.tile_start);
+    params.pieces = plan.pieces();
+    params.tiles_m = plan.tiles_m;
+
+    kernel<<<std::max(1, std::min(plan.tiles(), sms)), 1, smem_size,
+             stream>>>(params);
+    cudaError_t result = cudaGetLastError();
+    if (result != cudaSuccess)
+      return result;
+  }
+  return cudaSuccess;
+}
+
+// dst = cat(srcs, dim=1) for (M, widths[p]) pieces. Non-zero widths must
+// be multiples of 16 bytes. Each launch takes up to kMaxConcatPieces
+// pieces.
+template <class Element, int TILE_M = 64, int TILE_N = 128>
+cudaError_t concat_cols(std::vector<Element const *> const &srcs,
+                        std::vector<int> const &widths, Element *dst, int M,
+                        cudaStream_t stream = 0) {
+  std::vector<Element *> pieces;
+  for (Element const *s : srcs)
+    pieces.push_back(const_cast<Element *>(s)); // only read
+  return concat_split<false, Element, TILE_M, TILE_N>(pieces, widths, dst, M,
+                                                      stream);
+}
+
+// The reverse: dsts[p] = src[:, col_start[p] : col_start[p + 1]].
+template <class Element, int TILE_M = 64, int TILE_N = 128>
+cudaError_t split_cols(Element const *src, int M,
+                       std::vector<int> const &widths,
+                       std::vector<Element *> const &dsts,
+                       cudaStream_t stream = 0) {
+  return concat_split<true, Element, TILE_M, TILE_N>(
+      dsts, widths, const_cast<Element *>(src), M, stream);
+}
+
+template <class Element, int TILE_M = 64, int TILE_N = 128>
+int concat_host(int M, int pieces, int iterations = 1) {
+  printf("Concat / split of %d pieces along the columns, one launch with "
+         "%d TMA descriptors.\n",
+         pieces, 2 * pieces);
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  std::vector<int> const widths =
+      cfx::concat_widths(pieces, 16 / sizeof(Element), seed + 9);
+  cfx::ConcatPlan plan;
+  try {
+    plan = cfx::make_concat_plan(M, widths, TILE_M, TILE_N, sizeof(Element));
+  } catch (std::invalid_argument const &e) {
+    std::cerr << "Invalid concat: " << e.what() << std::endl;
+    return -1;
+  }
+  size_t const elems = size_t(M) * plan.N;
+  printf("(%d, %d) from widths", M, plan.N);
+  for (int w : widths)
+    printf(" %d", w);
+  printf(", %d tiles.\n", plan.tiles());
+
+  std::vector<thrust::device_vector<Element>> d_pieces(pieces);
+  std::vector<Element const *> srcs;
+  std::vector<Element *> dsts;
+  for (int p = 0; p < pieces; ++p) {
+    d_pieces[p].resize(size_t(M) * widths[p]);
+    Element *ptr = thrust::raw_pointer_cast(d_pieces[p].data());
+    cfk::utils::fill_random(ptr, d_pieces[p].size(), seed + p);
+    srcs.push_back(ptr);
+    dsts.push_back(ptr);
+  }
+  thrust::device_vector<Element> d_D(elems);
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+
+  double const bytes = 2.0 * elems * sizeof(Element);
+  auto run = [&](char const *name, auto &&launch) {
+    printf("%s:\n", name);
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      cudaError result = launch();
+      if (result == cudaSuccess)
+        result = cudaDeviceSynchronize();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+                << ")" << std::endl;
+    }
+    return 0;
+  };
+  auto check_concat = [&] {
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_on_device(
+            D, elems, cfx::expect_concat<Element>(plan, seed)),
+        plan.N);
+  };
+
+  auto per_piece = [&] {
+    cudaError result = cudaSuccess;
+    for (int p = 0; p < pieces && result == cudaSuccess; ++p)
+      result = cudaMemcpy2DAsync(
+          D + plan.col_start[p], plan.N * sizeof(Element), srcs[p],
+          widths[p] * sizeof(Element), widths[p] * sizeof(Element), M,
+          cudaMemcpyDeviceToDevice);
+    return result;
+  };
+  if (run("Concat, one cudaMemcpy2DAsync per piece", per_piece))
+    return -1;
+  check_concat();
+
+  cudaMemset(D, 0, elems * sizeof(Element));
+  if (run("Concat, one TMA launch", [&] {
+        return concat_cols<Element, TILE_M, TILE_N>(srcs, widths, D, M);
+      }))
+    return -1;
+  check_concat();
+
+  // Split the result back over the inputs; each must come out unchanged.
+  for (auto &piece : d_pieces)
+    cudaMemset(thrust::raw_pointer_cast(piece.data()), 0,
+               piece.size() * sizeof(Element));
+  if (run("Split, one TMA launch", [&] {
+        return split_cols<Element, TILE_M, TILE_N>(D, M, widths, dsts);
+      }))
+    return -1;
+  cfk::utils::VerifyReport report{};
+  int p = 0;
+  for (; p < pieces; ++p) {
+    report = cfk::utils::verify_on_device(
+        dsts[p], d_pieces[p].size(),
+        cfk::utils::ExpectIdentity<Element>{seed + p});
+    if (!report.ok())
+      break;
+  }
+  if (p < pieces)
+    std::cout << "Piece " << p << ": ";
+  cfk::utils::print_verify_report(std::cout, report,
+                                  widths[std::min(p, pieces - 1)]);
+  return 0;
+}
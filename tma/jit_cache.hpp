@@ -0,0 +1,275 @@
+#pragma once
+
+// On-disk cache of JIT-compiled kernels (jit_kernels.h).
+//
+// An entry is keyed by everything that determines the binary: the kernel
+// configuration (jit_key), the compiler version, the target architecture
+// and a hash of the generated source, so a change to the generator or the
+// toolkit misses instead of loading a stale cubin. Each entry is one file,
+// named by a hash of its key, holding the full key on its first line and
+// the cubin after it. The directory is the index: lookup() compares the
+// stored key, so a hash collision or a damaged file reads as a miss, and
+// keys() lists what is cached. Entries are written to a temporary file and
+// renamed into place, so processes sharing the directory never see a
+// partial entry. check_jit() tests the generator and the cache on the host.
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <set>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "jit_source.hpp"
+
+namespace cfx {
+
+// 64-bit FNV-1a.
+inline uint64_t jit_hash(std::string const &s) {
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (unsigned char c : s)
+    h = (h ^ c) * 0x100000001b3ull;
+  return h;
+}
+
+inline std::string jit_hex(uint64_t h) {
+  static char const digits[] = "0123456789abcdef";
+  std::string s(16, '0');
+  for (int i = 15; i >= 0; --i, h >>= 4)
+    s[i] = digits[h & 15];
+  return s;
+}
+
+// "<config key> <toolkit> <arch> src:<source hash>"; one line.
+inline std::string jit_cache_key(JitConfig const &c, std::string const &toolkit,
+                                 std::string const &arch) {
+  return jit_key(c) + ' ' + toolkit + ' ' + arch + " src:" +
+         jit_hex(jit_hash(jit_source(c)));
+}
+
+// $CFK_JIT_CACHE, else $XDG_CACHE_HOME/cfk-jit, else ~/.cache/cfk-jit.
+inline std::string jit_default_cache_dir() {
+  if (char const *dir = std::getenv("CFK_JIT_CACHE"))
+    return dir;
+  if (char const *xdg = std::getenv("XDG_CACHE_HOME"))
+    return std::string(xdg) + "/cfk-jit";
+  if (char const *home = std::getenv("HOME"))
+    return std::string(home) + "/.cache/cfk-jit";
+  return (std::filesystem::temp_directory_path() / "cfk-jit").string();
+}
+
+class JitCache {
+public:
+  explicit JitCache(std::string dir = jit_default_cache_dir())
+      : dir_(std::move(dir)) {}
+
+  std::string const &dir() const { return dir_; }
+
+  // The cached binary for key, if there is an intact entry for it.
+  bool lookup(std::string const &key, std::vector<char> &binary) const {
+    std::ifstream in(path(key), std::ios::binary);
+    std::string stored;
+    if (!in || !std::getline(in, stored) || stored != key)
+      return false;
+    binary.assign(std::istreambuf_iterator<char>(in),
+                  std::istreambuf_iterator<char>());
+    return !binary.empty();
+  }
+
+  // False if the entry could not be written; the cache is then only slower.
+  bool store(std::string const &key, std::vector<char> const &binary) const {
+    std::error_code ec;
+    std::filesystem::create_directories(dir_, ec);
+    std::filesystem::path const final_path = path(key);
+    std::filesystem::path tmp = final_path;
+    tmp += ".tmp" + std::to_string(::getpid());
+    {
+      std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+      out << key << '\n';
+      out.write(binary.data(), std::streamsize(binary.size()));
+      if (!out)
+        return false;
+    }
+    std::filesystem::rename(tmp, final_path, ec);
+    if (ec)
+      std::filesystem::remove(tmp, ec);
+    return !ec;
+  }
+
+  // Keys of the intact entries, sorted.
+  std::vector<std::string> keys() const {
+    std::vector<std::string> out;
+    std::error_code ec;
+    for (auto const &e : std::filesystem::directory_iterator(dir_, ec)) {
+      if (e.path().extension() != ".cubin")
+        continue;
+      std::ifstream in(e.path(), std::ios::binary);
+      std::string key;
+      if (std::getline(in, key) && e.path() == path(key))
+        out.push_back(key);
+    }
+    std::sort(out.begin(), out.end());
+    return out;
+  }
+
+  // Removes every entry; returns how many.
+  int clear() const {
+    int removed = 0;
+    std::error_code ec;
+    for (auto const &e : std::filesystem::directory_iterator(dir_, ec))
+      if (e.path().extension() == ".cubin" &&
+          std::filesystem::remove(e.path(), ec))
+        ++removed;
+    return removed;
+  }
+
+private:
+  std::filesystem::path path(std::string const &key) const {
+    return std::filesystem::path(dir_) / (jit_hex(jit_hash(key)) + ".cubin");
+  }
+
+  std::string dir_;
+};
+
+// Checks the generator and the cache without a GPU: every configuration of
+// a grid has its own key, symbol and deterministic source, fixed shapes
+// reach the source as literals, invalid configurations are rejected, and
+// the cache round-trips binaries, misses on any change of key, survives
+// into a new JitCache on the same directory and ignores damaged entries.
+inline bool check_jit() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "JIT check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  std::vector<JitConfig> configs;
+  for (JitDtype t : {JitDtype::F32, JitDtype::F16, JitDtype::BF16}) {
+    for (bool swizzle : {false, true})
+      for (int M : {0, 4096})
+        configs.push_back(
+            {JitKernel::Transpose, t, 64, 32, 0, swizzle, M, M ? 11008 : 0});
+    configs.push_back({JitKernel::TmaScale, t, 64, 128});
+    for (int tile : {64, 128})
+      for (int M : {0, 1024})
+        configs.push_back({JitKernel::Gemm, t, tile, tile, 16, false, M, M, M});
+  }
+  std::set<std::string> keys, symbols;
+  for (JitConfig const &c : configs) {
+    std::string const key = jit_key(c), symbol = jit_symbol(c);
+    keys.insert(key);
+    symbols.insert(symbol);
+    std::string src;
+    try {
+      src = jit_source(c);
+    } catch (std::invalid_argument const &e) {
+      fail(std::string("rejected a valid configuration: ") + e.what());
+      continue;
+    }
+    if (src != jit_source(c))
+      fail(key + " source is not deterministic");
+    if (src.find("extern \"C\" __global__") == std::string::npos ||
+        src.find(symbol + "(") == std::string::npos)
+      fail(key + " source does not define " + symbol);
+    if (src.find("#include") != std::string::npos)
+      fail(key + " source is not self-contained");
+    bool const literal =
+        src.find("const int M = " + std::to_string(c.M) + ";") !=
+        std::string::npos;
+    bool const runtime = src.find("const int M = m_arg;") != std::string::npos;
+    if (c.kernel != JitKernel::TmaScale &&
+        (c.static_shape() ? !literal || runtime : !runtime))
+      fail(key + " shape not generated as " +
+           (c.static_shape() ? "literals" : "arguments"));
+    if (std::count(src.begin(), src.end(), '{') !=
+        std::count(src.begin(), src.end(), '}'))
+      fail(key + " source has unbalanced braces");
+  }
+  if (keys.size() != configs.size() || symbols.size() != configs.size())
+    fail("configurations share keys or symbols");
+
+  auto rejects = [](JitConfig const &c) {
+    try {
+      jit_source(c);
+    } catch (std::invalid_argument const &) {
+      return true;
+    }
+    return false;
+  };
+  if (!rejects({JitKernel::Transpose, JitDtype::F32, 48, 64}))
+    fail("accepted a transpose tile that is not a multiple of 32");
+  if (!rejects({JitKernel::Transpose, JitDtype::F32, 128, 128}))
+    fail("accepted a transpose tile beyond the shared memory limit");
+  if (!rejects({JitKernel::TmaScale, JitDtype::F16, 64, 4}))
+    fail("accepted a TMA box row of 8 bytes");
+  if (!rejects({JitKernel::TmaScale, JitDtype::F32, 64, 64, 0, false, 64, 64}))
+    fail("accepted a fixed shape for the TMA kernel");
+  if (!rejects({JitKernel::Gemm, JitDtype::F32, 64, 64, 0}))
+    fail("accepted a GEMM without a K tile");
+  if (!rejects({JitKernel::Gemm, JitDtype::F32, 64, 64, 16, true}))
+    fail("accepted a swizzled GEMM");
+  if (!rejects({JitKernel::Gemm, JitDtype::F32, 64, 64, 16, false, 64, 64}))
+    fail("accepted a fixed GEMM shape without K");
+
+  std::filesystem::path const dir =
+      std::filesystem::temp_directory_path() /
+      ("cfk-jit-check-" + std::to_string(::getpid()));
+  std::filesystem::remove_all(dir);
+  {
+    JitCache cache(dir.string());
+    JitConfig const a = configs[0], b = configs[1];
+    std::string const key_a = jit_cache_key(a, "nvrtc-12.4", "sm_90");
+    std::string const key_b = jit_cache_key(b, "nvrtc-12.4", "sm_90");
+    // Binaries hold newlines and zero bytes.
+    std::vector<char> const bin_a = {'\x7f', 'E', 'L', 'F', '\n', '\0', '\n'};
+    std::vector<char> const bin_b(1000, '\0');
+    std::vector<char> got;
+    if (cache.lookup(key_a, got) || !cache.keys().empty())
+      fail("empty cache is not empty");
+    if (!cache.store(key_a, bin_a) || !cache.store(key_b, bin_b))
+      fail("could not store into " + dir.string());
+    if (!cache.lookup(key_a, got) || got != bin_a)
+      fail("binary did not round-trip");
+    for (std::string const &other :
+         {jit_cache_key(a, "nvrtc-12.5", "sm_90"),
+          jit_cache_key(a, "nvrtc-12.4", "sm_100"), key_a + " "})
+      if (cache.lookup(other, got))
+        fail("hit for another key: " + other);
+
+    JitCache later(dir.string()); // as a new process would
+    if (!later.lookup(key_b, got) || got != bin_b)
+      fail("entry not visible to a new cache object");
+    std::vector<std::string> want = {key_a, key_b};
+    std::sort(want.begin(), want.end());
+    if (later.keys() != want)
+      fail("index does not list the stored keys");
+
+    // An entry whose stored key differs, as after a hash collision.
+    std::filesystem::path const damaged =
+        dir / (jit_hex(jit_hash(key_a)) + ".cubin");
+    std::ofstream(damaged, std::ios::binary) << "other key\nbinary";
+    if (later.lookup(key_a, got))
+      fail("hit on an entry stored under another key");
+    if (later.keys() != std::vector<std::string>{key_b})
+      fail("index lists a damaged entry");
+    if (!later.store(key_a, bin_a) || !later.lookup(key_a, got) ||
+        got != bin_a)
+      fail("damaged entry not replaced");
+    if (later.clear() != 2 || !later.keys().empty())
+      fail("clear left entries behind");
+  }
+  std::filesystem::remove_all(dir);
+
+  if (ok)
+    std::cout << "JIT check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
@@ -0,0 +1,414 @@
+#pragma once
+
+// Kernels compiled at run time with NVRTC from the sources of jit_source.hpp,
+// with the cubins cached on disk (jit_cache.hpp).
+//
+// JitRuntime resolves a configuration in three steps: the modules this
+// process has loaded, the disk cache, and NVRTC. Only the first call in a
+// process for a configuration touches the disk, and only the first call on
+// a machine (per toolkit and GPU architecture) compiles. A configuration
+// nobody pre-instantiated, e.g. the exact shape of the problem at hand,
+// costs one compile instead of a slow fallback path or another template
+// instantiation in every build. Link with -lnvrtc -lcuda.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <cuda.h>
+#include <nvrtc.h>
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include <cutlass/numeric_types.h>
+
+#include "host_trace.hpp"
+#include "huge_pages.hpp"
+#include "jit_cache.hpp"
+#include "peak_gpu.hpp"
+#include "task_runtime.hpp"
+#include "tensormap.hpp"
+#include "verify_gpu.hpp"
+
+template <class T> cfx::JitDtype jit_dtype_of();
+template <> inline cfx::JitDtype jit_dtype_of<float>() {
+  return cfx::JitDtype::F32;
+}
+template <> inline cfx::JitDtype jit_dtype_of<cutlass::half_t>() {
+  return cfx::JitDtype::F16;
+}
+template <> inline cfx::JitDtype jit_dtype_of<cutlass::bfloat16_t>() {
+  return cfx::JitDtype::BF16;
+}
+
+inline std::string jit_toolkit() {
+  int major = 0, minor = 0;
+  nvrtcVersion(&major, &minor);
+  return "nvrtc-" + std::to_string(major) + "." + std::to_string(minor);
+}
+
+// "sm_90" for the current device.
+inline std::string jit_arch() {
+  int device = 0, major = 0, minor = 0;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&major, cudaDevAttrComputeCapabilityMajor, device);
+  cudaDeviceGetAttribute(&minor, cudaDevAttrComputeCapabilityMinor, device);
+  return "sm_" + std::to_string(major * 10 + minor);
+}
+
+// Compiles one translation unit to a cubin for arch. Throws
+// std::runtime_error with the compiler log on failure.
+inline std::vector<char> jit_compile(std::string const &source,
+                                     std::string const &name,
+                                     std::string const &arch) {
+  cfk::utils::ScopedRange range("jit.compile", name.c_str(), {});
+  nvrtcProgram prog;
+  if (nvrtcCreateProgram(&prog, source.c_str(), (name + ".cu").c_str(), 0,
+                         nullptr, nullptr) != NVRTC_SUCCESS)
+    throw std::runtime_error(name + ": nvrtcCreateProgram failed");
+  std::string const gpu = "--gpu-architecture=" + arch;
+  char const *options[] = {gpu.c_str(), "-std=c++17"};
+  nvrtcResult const result = nvrtcCompileProgram(prog, 2, options);
+
+  size_t size = 0;
+  nvrtcGetProgramLogSize(prog, &size);
+  std::string log(size, '\0');
+  nvrtcGetProgramLog(prog, &log[0]);
+  std::vector<char> cubin;
+  if (result == NVRTC_SUCCESS && nvrtcGetCUBINSize(prog, &size) ==
+                                     NVRTC_SUCCESS) {
+    cubin.resize(size);
+    nvrtcGetCUBIN(prog, cubin.data());
+  }
+  nvrtcDestroyProgram(&prog);
+  if (result != NVRTC_SUCCESS || cubin.empty())
+    throw std::runtime_error(name + ": " + nvrtcGetErrorString(result) +
+                             "\n" + log);
+  return cubin;
+}
+
+enum class JitOrigin { Process, Disk, Compiled };
+
+inline char const *jit_origin_name(JitOrigin o) {
+  switch (o) {
+  case JitOrigin::Process:
+    return "already loaded";
+  case JitOrigin::Disk:
+    return "loaded from the disk cache";
+  case JitOrigin::Compiled:
+    return "compiled";
+  }
+  return "unknown";
+}
+
+struct JitFunction {
+  CUfunction fn;
+  JitOrigin origin;
+  double ms; // to resolve it
+};
+
+// Process-wide table of loaded kernels. Modules stay loaded until exit.
+class JitRuntime {
+public:
+  static JitRuntime &instance() {
+    static JitRuntime runtime;
+    return runtime;
+  }
+
+  // Throws std::invalid_argument for an invalid configuration and
+  // std::runtime_error if it does not compile or load.
+  JitFunction get(cfx::JitConfig const &c) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    std::string const key = cfx::jit_cache_key(c, toolkit_, arch_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    JitOrigin origin = JitOrigin::Process;
+    auto it = loaded_.find(key);
+    if (it == loaded_.end()) {
+      std::string const symbol = cfx::jit_symbol(c);
+      std::vector<char> cubin;
+      CUfunction fn = nullptr;
+      origin = JitOrigin::Disk;
+      // A cached cubin that fails to load is compiled again.
+      if (!cache_.lookup(key, cubin) || !load(cubin, symbol, fn)) {
+        origin = JitOrigin::Compiled;
+        cubin = jit_compile(cfx::jit_source(c), symbol, arch_);
+        cache_.store(key, cubin);
+        if (!load(cubin, symbol, fn))
+          throw std::runtime_error(key + ": cuModuleLoadData failed");
+      }
+      it = loaded_.emplace(key, fn).first;
+    }
+    std::chrono::duration<double, std::milli> ms =
+        std::chrono::high_resolution_clock::now() - t1;
+    return {it->second, origin, ms.count()};
+  }
+
+  cfx::JitCache const &cache() const { return cache_; }
+
+private:
+  JitRuntime() : toolkit_(jit_toolkit()) {
+    cudaFree(0); // make the primary context current for the driver API
+    arch_ = jit_arch();
+  }
+
+  static bool load(std::vector<char> const &cubin, std::string const &symbol,
+                   CUfunction &fn) {
+    CUmodule module;
+    if (cuModuleLoadData(&module, cubin.data()) != CUDA_SUCCESS)
+      return false;
+    if (cuModuleGetFunction(&fn, module, symbol.c_str()) == CUDA_SUCCESS)
+      return true;
+    cuModuleUnload(module);
+    return false;
+  }
+
+  std::string toolkit_, arch_;
+  cfx::JitCache cache_;
+  std::mutex mutex_;
+  std::map<std::string, CUfunction> loaded_;
+};
+
+// The runtime's error codes have the driver's values (each cudaError is
+// documented with the CUresult it maps to), so a driver error keeps its
+// meaning, e.g. CUDA_ERROR_LAUNCH_OUT_OF_RESOURCES reads as
+// cudaErrorLaunchOutOfResources.
+inline cudaError_t jit_cuda_error(CUresult result) {
+  return static_cast<cudaError_t>(result);
+}
+
+// Resolves c and launches it. Returns cudaErrorInvalidValue for an invalid
+// configuration and cudaErrorInvalidKernelImage if it does not compile or
+// load, with the reason (and the compiler log) on stderr, and the driver's
+// error for a failed launch.
+inline cudaError_t jit_launch(cfx::JitConfig const &c, int M, int N,
+                              void **args, cudaStream_t stream) {
+  unsigned gx, gy, bx, by;
+  cfx::jit_grid(c, M, N, gx, gy);
+  cfx::jit_block(c.kernel, bx, by);
+  CUfunction fn;
+  try {
+    fn = JitRuntime::instance().get(c).fn;
+  } catch (std::invalid_argument const &e) {
+    std::cerr << "JIT configuration rejected: " << e.what() << std::endl;
+    return cudaErrorInvalidValue;
+  } catch (std::exception const &e) {
+    std::cerr << "JIT failed: " << e.what() << std::endl;
+    return cudaErrorInvalidKernelImage;
+  }
+  return jit_cuda_error(
+      cuLaunchKernel(fn, gx, gy, 1, bx, by, 1, 0, stream, args, nullptr));
+}
+
+// True if c is a kernel of family k for T that takes an (M, N[, K]) problem.
+template <class T>
+bool jit_accepts(cfx::JitConfig const &c, cfx::JitKernel k, int M, int N,
+                 int K = 0) {
+  return c.kernel == k && c.dtype == jit_dtype_of<T>() && M > 0 && N > 0 &&
+         (!c.static_shape() || (c.M == M && c.N == N && c.K == K));
+}
+
+// out = in^T for a row-major (M, N) input.
+template <class T>
+cudaError_t jit_transpose(cfx::JitConfig const &c, T const *in, T *out, int M,
+                          int N, cudaStream_t stream = 0) {
+  if (!jit_accepts<T>(c, cfx::JitKernel::Transpose, M, N))
+    return cudaErrorInvalidValue;
+  void *args[] = {&in, &out, &M, &N};
+  return jit_launch(c, M, N, args, stream);
+}
+
+// out = in^T for any (M, N), through the predicated transpose with the
+// shape passed at launch. The fallback of the tiled transposes, which do not
+// predicate partial tiles, for shapes they do not divide (the Python
+// transpose in a CFK_JIT=1 build): one kernel per dtype for every shape,
+// compiled once per machine.
+template <class T>
+cudaError_t jit_transpose_fallback(T const *in, T *out, int M, int N,
+                                   cudaStream_t stream = 0) {
+  cfx::JitConfig const c{cfx::JitKernel::Transpose, jit_dtype_of<T>(), 64, 64,
+                         0, true};
+  return jit_transpose(c, in, out, M, N, stream);
+}
+
+// out = scale * in for row-major (M, N) tensors, through TMA. Rows must be
+// multiples of 16 bytes.
+template <class T>
+cudaError_t jit_tma_scale(cfx::JitConfig const &c, T const *in, T *out,
+                          int M, int N, float scale, cudaStream_t stream = 0) {
+  if (!jit_accepts<T>(c, cfx::JitKernel::TmaScale, M, N))
+    return cudaErrorInvalidValue;
+  CUtensorMap src, dst;
+  CUresult result =
+      cfx::make_tensor_map_2d(&src, in, M, N, c.tile_m, c.tile_n);
+  if (result == CUDA_SUCCESS)
+    result = cfx::make_tensor_map_2d(&dst, out, M, N, c.tile_m, c.tile_n);
+  if (result != CUDA_SUCCESS)
+    return jit_cuda_error(result);
+  void *args[] = {&src, &dst, &scale};
+  return jit_launch(c, M, N, args, stream);
+}
+
+// C = A B for row-major A (M, K), B (K, N) and C (M, N), accumulated in
+// fp32.
+template <class T>
+cudaError_t jit_gemm(cfx::JitConfig const &c, T const *A, T const *B, T *C,
+                     int M, int N, int K, cudaStream_t stream = 0) {
+  if (!jit_accepts<T>(c, cfx::JitKernel::Gemm, M, N, K) || K <= 0)
+    return cudaErrorInvalidValue;
+  void *args[] = {&A, &B, &C, &M, &N, &K};
+  return jit_launch(c, M, N, args, stream);
+}
+
+// GEMM reference in double on the host, held to fp32 accumulation plus the
+// rounding of the output type.
+template <class T>
+cfk::utils::VerifyReport jit_gemm_verify(T const *C, T const *A, T const *B,
+                                         int M, int N, int K) {
+  double const rtol = sizeof(T) == 2 ? 0x1p-7 : 0x1p-15;
+  cfk::utils::VerifyReport report{};
+  report.checked = uint64_t(M) * N;
+  std::mutex mutex;
+  cfk::utils::parallel_for(0, M, 1, [&](size_t lo, size_t hi) {
+    std::vector<double> row(N), scale(N);
+    unsigned long long bad = 0;
+    for (size_t m = lo; m < hi; ++m) {
+      std::fill(row.begin(), row.end(), 0.0);
+      // Sum of |a| |b| per output, which bounds the accumulation error.
+      std::fill(scale.begin(), scale.end(), 0.0);
+      for (int k = 0; k < K; ++k) {
+        double const a = double(float(A[m * K + k]));
+        for (int n = 0; n < N; ++n) {
+          double const b = double(float(B[size_t(k) * N + n]));
+          row[n] += a * b;
+          scale[n] += std::abs(a * b);
+        }
+      }
+      for (int n = 0; n < N; ++n) {
+        double const g = double(float(C[m * N + n]));
+        double const atol = 0x1p-20 * K * scale[n];
+        if (std::abs(g - row[n]) <= atol + rtol * std::abs(row[n]))
+          continue;
+        if (bad++ < cfk::utils::kMaxReportedMismatches) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (report.reported < cfk::utils::kMaxReportedMismatches)
+            report.first[report.reported++] = {m * N + n, g, row[n]};
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    report.mismatches += bad;
+  });
+  report.sort();
+  return report;
+}
+
+// Transpose (runtime and compiled-in shape), TMA scale and GEMM through the
+// JIT. Each configuration reports how it was resolved: a second run of the
+// program loads every cubin from the disk cache.
+inline int jit_host(int M, int N, int gemm_size, int iterations = 1) {
+  using namespace cfx;
+  using Element = float;
+  printf("NVRTC kernels (%s, %s), cache in %s.\n", jit_toolkit().c_str(),
+         jit_arch().c_str(), JitRuntime::instance().cache().dir().c_str());
+
+  auto resolve = [](JitConfig const &c) {
+    try {
+      JitFunction f = JitRuntime::instance().get(c);
+      printf("%s: %s in %.2f ms\n", jit_key(c).c_str(),
+             jit_origin_name(f.origin), f.ms);
+      return true;
+    } catch (std::exception const &e) {
+      std::cerr << "JIT failed: " << e.what() << std::endl;
+      return false;
+    }
+  };
+  auto trials = [&](double bytes, double flops, auto &&launch) {
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      cudaError result = launch();
+      if (result == cudaSuccess)
+        result = cudaDeviceSynchronize();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << (flops ? cfk::utils::with_peak(
+                                1e-6 * flops / time_ms, "GFLOP/s",
+                                cfk::utils::gpu_peak_key("hgemm_gflops"))
+                          : cfk::utils::gpu_bandwidth_with_peak(
+                                1e-6 * bytes / time_ms))
+                << ")" << std::endl;
+    }
+    return 0;
+  };
+
+  size_t const size = size_t(M) * N;
+  thrust::device_vector<Element> d_S(size), d_D(size);
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(S, size, seed);
+  double const bytes = 2.0 * size * sizeof(Element);
+
+  // The second transpose has this run's shape compiled in.
+  for (JitConfig const &c :
+       {JitConfig{JitKernel::Transpose, JitDtype::F32, 64, 64, 0, true},
+        JitConfig{JitKernel::Transpose, JitDtype::F32, 64, 64, 0, true, M,
+                  N}}) {
+    if (!resolve(c) ||
+        trials(bytes, 0, [&] { return jit_transpose(c, S, D, M, N); }))
+      return -1;
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_on_device(
+            D, size, cfk::utils::ExpectTranspose<Element>{seed, size_t(M),
+                                                          size_t(N)}),
+        M);
+  }
+
+  JitConfig const scale{JitKernel::TmaScale, JitDtype::F32, 64, 128};
+  if (!resolve(scale) ||
+      trials(bytes, 0, [&] { return jit_tma_scale(scale, S, D, M, N, 2.0f); }))
+    return -1;
+  cfk::utils::print_verify_report(
+      std::cout,
+      cfk::utils::verify_on_device(
+          D, size, cfk::utils::ExpectScale<Element>{seed, Element(2)}),
+      N);
+
+  // fp16 GEMM at a compiled-in square shape, checked on the host.
+  using Half = cutlass::half_t;
+  int const G = gemm_size;
+  size_t const gsize = size_t(G) * G;
+  thrust::device_vector<Half> d_A(gsize), d_B(gsize), d_C(gsize);
+  Half *A = thrust::raw_pointer_cast(d_A.data());
+  Half *B = thrust::raw_pointer_cast(d_B.data());
+  Half *C = thrust::raw_pointer_cast(d_C.data());
+  cfk::utils::fill_random(A, gsize, seed + 1);
+  cfk::utils::fill_random(B, gsize, seed + 2);
+  JitConfig const gemm{JitKernel::Gemm, JitDtype::F16, 128, 128, 16, false,
+                       G,               G,               G};
+  if (!resolve(gemm) || trials(0, 2.0 * G * double(gsize), [&] {
+        return jit_gemm(gemm, A, B, C, G, G, G);
+      }))
+    return -1;
+  cfk::utils::HostBuffer<Half> h_A(gsize), h_B(gsize);
+  cfk::utils::fill_random_cpu(h_A.data(), gsize, seed + 1);
+  cfk::utils::fill_random_cpu(h_B.data(), gsize, seed + 2);
+  thrust::host_vector<Half> h_C = d_C;
+  cfk::utils::print_verify_report(
+      std::cout, jit_gemm_verify(h_C.data(), h_A.data(), h_B.data(), G, G, G),
+      G);
+  return 0;
+}
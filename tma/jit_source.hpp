@@ -0,0 +1,378 @@
+#pragma once
+
+// Kernel sources for run-time compilation with NVRTC (jit_kernels.h).
+//
+// A JitConfig names one kernel of a family (transpose through smem, TMA
+// scale, tiled GEMM), its element type, its tile and, optionally, a fixed
+// problem shape. jit_source() prints a self-contained CUDA translation unit
+// for it: no headers, an extern "C" entry point named by jit_symbol(), and
+// the configuration as literal constants, so a fixed shape folds into the
+// index math the way a cute::Int extent does. Element conversions and the
+// TMA / mbarrier operations are inline PTX. Everything here is host code;
+// check_jit() in jit_cache.hpp runs it without a GPU.
+
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+namespace cfx {
+
+enum class JitKernel { Transpose, TmaScale, Gemm };
+enum class JitDtype { F32, F16, BF16 };
+
+inline char const *jit_kernel_name(JitKernel k) {
+  switch (k) {
+  case JitKernel::Transpose:
+    return "transpose";
+  case JitKernel::TmaScale:
+    return "tma_scale";
+  case JitKernel::Gemm:
+    return "gemm";
+  }
+  return "unknown";
+}
+
+inline char const *jit_dtype_name(JitDtype t) {
+  switch (t) {
+  case JitDtype::F32:
+    return "f32";
+  case JitDtype::F16:
+    return "f16";
+  case JitDtype::BF16:
+    return "bf16";
+  }
+  return "unknown";
+}
+
+inline int jit_dtype_bytes(JitDtype t) { return t == JitDtype::F32 ? 4 : 2; }
+
+// CTA shape of each family.
+inline void jit_block(JitKernel k, unsigned &x, unsigned &y) {
+  x = k == JitKernel::Transpose ? 32 : k == JitKernel::TmaScale ? 128 : 256;
+  y = k == JitKernel::Transpose ? 8 : 1;
+}
+
+// Static shared memory a kernel may use without an opt-in.
+constexpr int kJitMaxSmemBytes = 48 * 1024;
+
+struct JitConfig {
+  JitKernel kernel = JitKernel::Transpose;
+  JitDtype dtype = JitDtype::F32;
+  int tile_m = 64, tile_n = 64;
+  int tile_k = 0;       // GEMM only
+  bool swizzle = false; // transpose only: XOR-swizzled instead of padded
+  // A fixed (M, N[, K]) problem, or 0 for shapes passed at launch.
+  int M = 0, N = 0, K = 0;
+
+  bool static_shape() const { return M > 0; }
+};
+
+// Canonical text of a configuration, e.g. "transpose.f32.64x64.swizzle.dyn"
+// or "gemm.f16.128x128x16.4096x4096x4096". Distinct configurations have
+// distinct keys; the cache and the symbol name derive from it.
+inline std::string jit_key(JitConfig const &c) {
+  std::ostringstream os;
+  os << jit_kernel_name(c.kernel) << '.' << jit_dtype_name(c.dtype) << '.'
+     << c.tile_m << 'x' << c.tile_n;
+  if (c.kernel == JitKernel::Gemm)
+    os << 'x' << c.tile_k;
+  if (c.swizzle)
+    os << ".swizzle";
+  if (!c.static_shape())
+    os << ".dyn";
+  else if (c.kernel == JitKernel::Gemm)
+    os << '.' << c.M << 'x' << c.N << 'x' << c.K;
+  else
+    os << '.' << c.M << 'x' << c.N;
+  return os.str();
+}
+
+inline std::string jit_symbol(JitConfig const &c) {
+  std::string s = "cfk_jit_" + jit_key(c);
+  for (char &ch : s)
+    if (ch == '.')
+      ch = '_';
+  return s;
+}
+
+// Throws std::invalid_argument for a configuration the family cannot
+// generate: tiles that do not match its thread layout, more than
+// kJitMaxSmemBytes of shared memory, or options it does not have.
+inline void jit_validate(JitConfig const &c) {
+  auto reject = [&](std::string const &why) {
+    throw std::invalid_argument(jit_key(c) + ": " + why);
+  };
+  int const bytes = jit_dtype_bytes(c.dtype);
+  if (c.tile_m <= 0 || c.tile_n <= 0)
+    reject("tiles must be positive");
+  if (c.M < 0 || c.N < 0 || c.K < 0 ||
+      (c.static_shape() &&
+       (c.N <= 0 || (c.kernel == JitKernel::Gemm) != (c.K > 0))))
+    reject("a fixed shape needs M, N and, for a GEMM only, K");
+  if (c.swizzle && c.kernel != JitKernel::Transpose)
+    reject("only the transpose has a swizzled layout");
+  if (c.tile_k && c.kernel != JitKernel::Gemm)
+    reject("only the GEMM has a K tile");
+
+  switch (c.kernel) {
+  case JitKernel::Transpose:
+    // 32 x 8 threads; a warp spans 32 columns on load and 32 rows on store.
+    if (c.tile_m % 32 || c.tile_n % 32)
+      reject("transpose tiles must be multiples of 32");
+    if (c.tile_m * (c.tile_n + 1) * bytes > kJitMaxSmemBytes)
+      reject("transpose tile exceeds the shared memory limit");
+    break;
+  case JitKernel::TmaScale:
+    if (c.static_shape())
+      reject("the TMA kernel takes its shape from the descriptors");
+    if (c.tile_m > 256 || c.tile_n > 256 || (c.tile_n * bytes) % 16)
+      reject("TMA boxes are at most 256 x 256 with rows of 16-byte multiples");
+    if (c.tile_m * c.tile_n * bytes > kJitMaxSmemBytes)
+      reject("TMA tile exceeds the shared memory limit");
+    break;
+  case JitKernel::Gemm:
+    // 16 x 16 threads, each owning a (tile_m / 16) x (tile_n / 16) block.
+    if (c.tile_m % 16 || c.tile_n % 16 || c.tile_m > 128 || c.tile_n > 128)
+      reject("GEMM tiles must be multiples of 16 up to 128");
+    if (c.tile_k <= 0 || c.tile_k > 64)
+      reject("GEMM K tile must be in [1, 64]");
+    if ((c.tile_m + c.tile_n) * c.tile_k * 4 > kJitMaxSmemBytes)
+      reject("GEMM tiles exceed the shared memory limit");
+    break;
+  }
+}
+
+namespace jit_detail {
+
+inline void prelude(std::ostream &os, JitConfig const &c) {
+  os << "// Generated for " << jit_key(c) << ".\n"
+     << "typedef unsigned long long u64;\n";
+  switch (c.dtype) {
+  case JitDtype::F32:
+    os << "typedef float T;\n"
+          "__device__ __forceinline__ float to_float(T x) { return x; }\n"
+          "__device__ __forceinline__ T from_float(float x) { return x; }\n";
+    break;
+  case JitDtype::F16:
+    os << "typedef unsigned short T;\n"
+          "__device__ __forceinline__ float to_float(T x) {\n"
+          "  float f;\n"
+          "  asm(\"cvt.f32.f16 %0, %1;\" : \"=f\"(f) : \"h\"(x));\n"
+          "  return f;\n"
+          "}\n"
+          "__device__ __forceinline__ T from_float(float x) {\n"
+          "  T h;\n"
+          "  asm(\"cvt.rn.f16.f32 %0, %1;\" : \"=h\"(h) : \"f\"(x));\n"
+          "  return h;\n"
+          "}\n";
+    break;
+  case JitDtype::BF16:
+    os << "typedef unsigned short T;\n"
+          "__device__ __forceinline__ float to_float(T x) {\n"
+          "  float f;\n"
+          "  asm(\"mov.b32 %0, %1;\" : \"=f\"(f) : \"r\"((unsigned)x << 16));\n"
+          "  return f;\n"
+          "}\n"
+          "__device__ __forceinline__ T from_float(float x) {\n"
+          "  T h;\n"
+          "  asm(\"cvt.rn.bf16.f32 %0, %1;\" : \"=h\"(h) : \"f\"(x));\n"
+          "  return h;\n"
+          "}\n";
+    break;
+  }
+}
+
+// "const int M = 4096;" for a fixed shape, "const int M = m_arg;" otherwise.
+inline void extent(std::ostream &os, char const *name, int value,
+                   char const *arg) {
+  os << "  const int " << name << " = ";
+  if (value > 0)
+    os << value;
+  else
+    os << arg;
+  os << ";\n";
+}
+
+inline void transpose(std::ostream &os, JitConfig const &c) {
+  os << "#define TILE_M " << c.tile_m << "\n#define TILE_N " << c.tile_n
+     << "\n";
+  if (c.swizzle)
+    os << "#define COL(r, c) ((c) ^ ((r) % 32))\n#define PAD 0\n";
+  else
+    os << "#define COL(r, c) (c)\n#define PAD 1\n";
+  os << "extern \"C\" __global__ void __launch_bounds__(256)\n"
+     << jit_symbol(c)
+     << "(const T *__restrict__ in, T *__restrict__ out, int m_arg, "
+        "int n_arg) {\n";
+  extent(os, "M", c.M, "m_arg");
+  extent(os, "N", c.N, "n_arg");
+  os << "  __shared__ T tile[TILE_M][TILE_N + PAD];\n"
+        "  const int m0 = blockIdx.y * TILE_M, n0 = blockIdx.x * TILE_N;\n"
+        "#pragma unroll\n"
+        "  for (int r = threadIdx.y; r < TILE_M; r += 8)\n"
+        "#pragma unroll\n"
+        "    for (int c = threadIdx.x; c < TILE_N; c += 32)\n"
+        "      if (m0 + r < M && n0 + c < N)\n"
+        "        tile[r][COL(r, c)] = in[(u64)(m0 + r) * N + n0 + c];\n"
+        "  __syncthreads();\n"
+        "#pragma unroll\n"
+        "  for (int c = threadIdx.y; c < TILE_N; c += 8)\n"
+        "#pragma unroll\n"
+        "    for (int r = threadIdx.x; r < TILE_M; r += 32)\n"
+        "      if (m0 + r < M && n0 + c < N)\n"
+        "        out[(u64)(n0 + c) * M + m0 + r] = tile[r][COL(r, c)];\n"
+        "}\n";
+}
+
+inline void tma_scale(std::ostream &os, JitConfig const &c) {
+  int const bytes = c.tile_m * c.tile_n * jit_dtype_bytes(c.dtype);
+  os << "#define TILE_M " << c.tile_m << "\n#define TILE_N " << c.tile_n
+     << "\n#define TILE_BYTES " << bytes << "\n";
+  os << R"(struct __align__(64) TensorMap {
+  u64 opaque[16];
+};
+__device__ __forceinline__ unsigned smem_addr(const void *p) {
+  unsigned a;
+  asm("{ .reg .u64 t; cvta.to.shared.u64 t, %1; cvt.u32.u64 %0, t; }"
+      : "=r"(a) : "l"(p));
+  return a;
+}
+)";
+  os << "extern \"C\" __global__ void __launch_bounds__(128)\n"
+     << jit_symbol(c)
+     << "(const __grid_constant__ TensorMap src, "
+        "const __grid_constant__ TensorMap dst, float scale) {\n";
+  os << R"(  __shared__ __align__(128) T tile[TILE_M * TILE_N];
+  __shared__ __align__(8) u64 full;
+  const int c0 = blockIdx.x * TILE_N, c1 = blockIdx.y * TILE_M;
+  const unsigned bar = smem_addr(&full), buf = smem_addr(tile);
+  if (threadIdx.x == 0) {
+    asm volatile("mbarrier.init.shared::cta.b64 [%0], 1;" ::"r"(bar));
+    asm volatile("fence.mbarrier_init.release.cluster;" ::: "memory");
+    asm volatile("mbarrier.arrive.expect_tx.shared::cta.b64 _, [%0], %1;"
+                 ::"r"(bar), "r"(TILE_BYTES) : "memory");
+    asm volatile("cp.async.bulk.tensor.2d.shared::cluster.global.mbarrier::"
+                 "complete_tx::bytes [%0], [%1, {%3, %4}], [%2];"
+                 ::"r"(buf), "l"(&src), "r"(bar), "r"(c0), "r"(c1)
+                 : "memory");
+  }
+  __syncthreads();
+  asm volatile("{\n"
+               ".reg .pred p;\n"
+               "WAIT:\n"
+               "mbarrier.try_wait.parity.shared::cta.b64 p, [%0], 0;\n"
+               "@!p bra WAIT;\n"
+               "}" ::"r"(bar) : "memory");
+#pragma unroll 4
+  for (int i = threadIdx.x; i < TILE_M * TILE_N; i += 128)
+    tile[i] = from_float(scale * to_float(tile[i]));
+  // Make the generic-proxy writes visible to the TMA store.
+  asm volatile("fence.proxy.async.shared::cta;" ::: "memory");
+  __syncthreads();
+  if (threadIdx.x == 0) {
+    asm volatile("cp.async.bulk.tensor.2d.global.shared::cta.bulk_group "
+                 "[%0, {%2, %3}], [%1];"
+                 ::"l"(&dst), "r"(buf), "r"(c0), "r"(c1) : "memory");
+    asm volatile("cp.async.bulk.commit_group;" ::: "memory");
+    asm volatile("cp.async.bulk.wait_group.read 0;" ::: "memory");
+  }
+}
+)";
+}
+
+inline void gemm(std::ostream &os, JitConfig const &c) {
+  os << "#define BM " << c.tile_m << "\n#define BN " << c.tile_n
+     << "\n#define BK " << c.tile_k << "\n#define TM " << c.tile_m / 16
+     << "\n#define TN " << c.tile_n / 16 << "\n";
+  os << "extern \"C\" __global__ void __launch_bounds__(256)\n"
+     << jit_symbol(c)
+     << "(const T *__restrict__ A, const T *__restrict__ B, "
+        "T *__restrict__ C, int m_arg, int n_arg, int k_arg) {\n";
+  extent(os, "M", c.M, "m_arg");
+  extent(os, "N", c.N, "n_arg");
+  extent(os, "K", c.K, "k_arg");
+  // Thread (tx, ty) owns rows ty + 16 i and columns tx + 16 j of the tile,
+  // so a warp's smem reads are broadcasts or consecutive words.
+  os << R"(  __shared__ float As[BK][BM];
+  __shared__ float Bs[BK][BN];
+  const int tx = threadIdx.x % 16, ty = threadIdx.x / 16;
+  const int m0 = blockIdx.y * BM, n0 = blockIdx.x * BN;
+  float acc[TM][TN];
+#pragma unroll
+  for (int i = 0; i < TM; ++i)
+#pragma unroll
+    for (int j = 0; j < TN; ++j)
+      acc[i][j] = 0.0f;
+  for (int k0 = 0; k0 < K; k0 += BK) {
+    for (int e = threadIdx.x; e < BM * BK; e += 256) {
+      const int r = e / BK, k = e % BK;
+      As[k][r] = m0 + r < M && k0 + k < K
+                     ? to_float(A[(u64)(m0 + r) * K + k0 + k])
+                     : 0.0f;
+    }
+    for (int e = threadIdx.x; e < BK * BN; e += 256) {
+      const int k = e / BN, n = e % BN;
+      Bs[k][n] = k0 + k < K && n0 + n < N
+                     ? to_float(B[(u64)(k0 + k) * N + n0 + n])
+                     : 0.0f;
+    }
+    __syncthreads();
+#pragma unroll
+    for (int k = 0; k < BK; ++k) {
+      float a[TM], b[TN];
+#pragma unroll
+      for (int i = 0; i < TM; ++i)
+        a[i] = As[k][ty + 16 * i];
+#pragma unroll
+      for (int j = 0; j < TN; ++j)
+        b[j] = Bs[k][tx + 16 * j];
+#pragma unroll
+      for (int i = 0; i < TM; ++i)
+#pragma unroll
+        for (int j = 0; j < TN; ++j)
+          acc[i][j] += a[i] * b[j];
+    }
+    __syncthreads();
+  }
+#pragma unroll
+  for (int i = 0; i < TM; ++i)
+#pragma unroll
+    for (int j = 0; j < TN; ++j) {
+      const int m = m0 + ty + 16 * i, n = n0 + tx + 16 * j;
+      if (m < M && n < N)
+        C[(u64)m * N + n] = from_float(acc[i][j]);
+    }
+}
+)";
+}
+
+} // namespace jit_detail
+
+// The translation unit for c. Throws like jit_validate.
+inline std::string jit_source(JitConfig const &c) {
+  jit_validate(c);
+  std::ostringstream os;
+  jit_detail::prelude(os, c);
+  switch (c.kernel) {
+  case JitKernel::Transpose:
+    jit_detail::transpose(os, c);
+    break;
+  case JitKernel::TmaScale:
+    jit_detail::tma_scale(os, c);
+    break;
+  case JitKernel::Gemm:
+    jit_detail::gemm(os, c);
+    break;
+  }
+  return os.str();
+}
+
+// Grid for an (M, N) problem: x over the column tiles, y over the rows.
+inline void jit_grid(JitConfig const &c, int M, int N, unsigned &x,
+                     unsigned &y) {
+  x = unsigned((N + c.tile_n - 1) / c.tile_n);
+  y = unsigned((M + c.tile_m - 1) / c.tile_m);
+}
+
+} // namespace cfx
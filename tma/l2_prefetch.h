@@ -0,0 +1,205 @@
+#pragma once
+
+// Warming a tensor in L2 ahead of the kernel that reads it, with TMA
+// prefetch-to-L2 (cp.async.bulk.prefetch.tensor).
+//
+// An L2PrefetchRegion is a row-major tensor map whose boxes are the
+// prefetch granule (32 rows x up to 1 KiB). The boxes can be issued two
+// ways:
+//   - prefetch_l2(): a small side kernel, e.g. on a second stream while the
+//     previous kernel is still running;
+//   - prefetch_l2_share(): from inside the previous kernel, each CTA
+//     issuing its share as the last thing it does.
+// Prefetches are hints: they neither complete on a barrier nor order with
+// anything, so the consumer needs no synchronization with them.
+//
+// l2_prefetch_host() (`--prefetch`) measures how much of the latency of a
+// copyTMAKernel that follows a memory-bound kernel each variant saves.
+
+#include <algorithm>
+#include <iostream>
+
+#include <cuda.h>
+#include <thrust/device_vector.h>
+
+#include "tensormap.hpp"
+#include "tma_copy.h"
+
+namespace cfx {
+
+constexpr int kPrefetchBoxRows = 32;
+constexpr int kPrefetchBoxBytes = 1024;
+
+struct L2PrefetchRegion {
+  CUtensorMap map;
+  int box_cols;
+  int tiles_m, tiles_n; // boxes down and across
+};
+
+// Region covering a row-major (rows, cols) tensor at `base`.
+template <class Element>
+CUresult make_l2_prefetch_region(L2PrefetchRegion *r, Element const *base,
+                                 int rows, int cols) {
+  r->box_cols = std::min<int>(256, kPrefetchBoxBytes / sizeof(Element));
+  r->tiles_m = (rows + kPrefetchBoxRows - 1) / kPrefetchBoxRows;
+  r->tiles_n = (cols + r->box_cols - 1) / r->box_cols;
+  return make_tensor_map_2d(&r->map, base, rows, cols, kPrefetchBoxRows,
+                            r->box_cols);
+}
+
+#if defined(__CUDACC__)
+
+// Boxes part, part + parts, ... of the region, spread over the lanes of the
+// calling warp. `r` must be a kernel parameter (or in global memory) so the
+// TMA unit can read its map.
+CUTLASS_DEVICE void prefetch_l2_share(L2PrefetchRegion const &r, int part,
+                                      int parts) {
+  int const boxes = r.tiles_m * r.tiles_n;
+  for (int b = part * 32 + threadIdx.x % 32; b < boxes; b += parts * 32)
+    tma_prefetch_2d(&r.map, b % r.tiles_n * r.box_cols,
+                    b / r.tiles_n * kPrefetchBoxRows);
+}
+
+__global__ static void __launch_bounds__(32)
+    prefetchL2Kernel(CUTE_GRID_CONSTANT L2PrefetchRegion const r) {
+  prefetch_l2_share(r, blockIdx.x, gridDim.x);
+}
+
+// Issue the whole region from `ctas` single-warp CTAs on `stream`. The
+// kernel finishes as soon as the requests are issued.
+inline cudaError_t prefetch_l2(L2PrefetchRegion const &r,
+                               cudaStream_t stream = 0, int ctas = 8) {
+  prefetchL2Kernel<<<ctas, 32, 0, stream>>>(r);
+  return cudaGetLastError();
+}
+
+#endif // __CUDACC__
+
+} // namespace cfx
+
+// Memory-bound producer for the benchmark: y = a * x. With prefetch_next,
+// warp 0 of every CTA prefetches its share of `next` once its loop is done.
+__global__ static void scaleThenPrefetchKernel(
+    float4 const *__restrict__ x, float4 *__restrict__ y, float a, size_t n,
+    CUTE_GRID_CONSTANT cfx::L2PrefetchRegion const next, bool prefetch_next) {
+  for (size_t i = blockIdx.x * size_t(blockDim.x) + threadIdx.x; i < n;
+       i += size_t(gridDim.x) * blockDim.x) {
+    float4 v = x[i];
+    y[i] = make_float4(a * v.x, a * v.y, a * v.z, a * v.w);
+  }
+  if (prefetch_next && threadIdx.x < 32)
+    cfx::prefetch_l2_share(next, blockIdx.x, gridDim.x);
+}
+
+// Producer kernel followed by a copyTMAKernel over an L2-sized tensor, with
+// the tensor cold, prefetched from a side stream, or prefetched from the
+// producer's tail. L2 is flushed before every trial.
+template <int TILE_M = 128, int TILE_N = 128, int THREADS = 32>
+int l2_prefetch_host(int iterations = 1) {
+  using namespace cute;
+  using Element = float;
+
+  printf("L2 prefetch ahead of copyTMAKernel.\n");
+
+  int device = 0, l2_bytes = 0, sms = 0;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&l2_bytes, cudaDevAttrL2CacheSize, device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+
+  // Consumer tensor: half of L2. Producer: a quarter of L2 in and out.
+  int const N = 4096;
+  int const M = std::max(
+      TILE_M, int(l2_bytes / 2 / (N * sizeof(Element))) / TILE_M * TILE_M);
+  size_t const producer_n4 = std::max<size_t>(1, l2_bytes / 4 / 16);
+  printf("L2: %d MiB, consumer (%d, %d), producer %zu MiB in + out.\n",
+         l2_bytes >> 20, M, N, producer_n4 * 16 >> 20);
+
+  thrust::device_vector<Element> d_S(size_t(M) * N), d_D(size_t(M) * N);
+  thrust::device_vector<float4> d_x(producer_n4), d_y(producer_n4);
+  thrust::device_vector<char> d_flush(2 * size_t(l2_bytes));
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(S, d_S.size(), seed);
+
+  auto gmemLayout = make_layout(make_shape(M, N), LayoutRight{});
+  Tensor tensor_S = make_tensor(make_gmem_ptr(S), gmemLayout);
+  Tensor tensor_D = make_tensor(
+      make_gmem_ptr(thrust::raw_pointer_cast(d_D.data())), gmemLayout);
+  auto tileShape = make_shape(Int<TILE_M>{}, Int<TILE_N>{});
+  auto smemLayout = make_layout(tileShape, LayoutRight{});
+  Params params(make_tma_copy(SM90_TMA_LOAD{}, tensor_S, smemLayout),
+                make_tma_copy(SM90_TMA_STORE{}, tensor_D, smemLayout),
+                gmemLayout, smemLayout, tileShape);
+  int smem_size = int(sizeof(SharedStorageTMA<Element, decltype(smemLayout)>));
+  void const *kernel =
+      (void const *)copyTMAKernel<THREADS, Element, decltype(params)>;
+  cfk::utils::set_smem_size(smem_size, kernel);
+  cfk::utils::LaunchConfig launch_config{
+      dim3(M / TILE_M, N / TILE_N), dim3(THREADS), dim3(1), smem_size};
+
+  cfx::L2PrefetchRegion region;
+  if (cfx::make_l2_prefetch_region(&region, S, M, N) != CUDA_SUCCESS) {
+    std::cerr << "cuTensorMapEncodeTiled failed for the prefetch region"
+              << std::endl;
+    return -1;
+  }
+
+  cudaStream_t side;
+  cudaStreamCreateWithFlags(&side, cudaStreamNonBlocking);
+  cudaEvent_t start, produced, consumed;
+  cudaEventCreate(&start);
+  cudaEventCreate(&produced);
+  cudaEventCreate(&consumed);
+
+  char const *modes[] = {"Cold", "Side-stream prefetch", "Tail prefetch"};
+  double copy_ms[3] = {};
+  for (int mode = 0; mode < 3; ++mode) {
+    printf("%s:\n", modes[mode]);
+    for (int i = 0; i < iterations; i++) {
+      cudaMemsetAsync(thrust::raw_pointer_cast(d_flush.data()), i & 0xff,
+                      d_flush.size());
+      cudaEventRecord(start);
+      if (mode == 1) {
+        cudaStreamWaitEvent(side, start);
+        cfx::prefetch_l2(region, side);
+      }
+      scaleThenPrefetchKernel<<<4 * sms, 256>>>(
+          thrust::raw_pointer_cast(d_x.data()),
+          thrust::raw_pointer_cast(d_y.data()), 2.0f, producer_n4, region,
+          mode == 2);
+      cudaEventRecord(produced);
+      cudaError launched = cfk::utils::launch(kernel, launch_config, params);
+      cudaEventRecord(consumed);
+      cudaError result = cudaDeviceSynchronize();
+      if (launched != cudaSuccess || result != cudaSuccess) {
+        result = launched != cudaSuccess ? launched : result;
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      float total = 0, copy = 0;
+      cudaEventElapsedTime(&total, start, consumed);
+      cudaEventElapsedTime(&copy, produced, consumed);
+      copy_ms[mode] += copy / iterations;
+      std::cout << "Trial " << i << " Completed in " << total << "ms (copy "
+                << copy << "ms, "
+                << cfk::utils::gpu_bandwidth_with_peak(
+                       2e-6 * M * N * sizeof(Element) / copy)
+                << ")" << std::endl;
+    }
+  }
+  std::cout << "Copy latency saved vs. cold: side stream "
+            << copy_ms[0] - copy_ms[1] << "ms, tail "
+            << copy_ms[0] - copy_ms[2] << "ms" << std::endl;
+
+  cudaEventDestroy(start);
+  cudaEventDestroy(produced);
+  cudaEventDestroy(consumed);
+  cudaStreamDestroy(side);
+
+  auto report = cfk::utils::verify_on_device(
+      thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+      cfk::utils::ExpectIdentity<Element>{seed});
+  cfk::utils::print_verify_report(std::cout, report, N);
+  return 0;
+}
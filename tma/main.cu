@@ -1,30 +1,97 @@
 #include "cutlass/util/command_line.h"
 
+#include "check_flags.hpp"
+#include "chained_launch.h"
+#include "concat_split.h"
+#include "jit_kernels.h"
+#include "l2_prefetch.h"
+#include "ragged_copy.h"
+#include "row_norm.h"
 #include "scale_tma_kernel.h"
 #include "tma_copy.h"
 #include "tma_copy_multicast.h"
+#include "tma_reduce.h"
 
 int main(int argc, char const **argv) {
 
   cutlass::CommandLine cmd(argc, argv);
   // Parses the command line
 
-  int M, N, iterations;  
+  int M, N, iterations, segments, ragged_cols, chain;
   cmd.get_cmd_line_argument("M", M, 16384);
   cmd.get_cmd_line_argument("N", N, 16384);
   cmd.get_cmd_line_argument("iterations", iterations, 10);
+  cmd.get_cmd_line_argument("segments", segments, 4096);
+  cmd.get_cmd_line_argument("ragged-cols", ragged_cols, 256);
+  cmd.get_cmd_line_argument("chain", chain, 0);
 
   std::cout << "(M, N): " << M << ", " << N << std::endl;
 
+  // Host-side self-tests. Given only --check-* flags, the driver runs them
+  // and exits with their status; otherwise it goes on to the benchmarks.
+  cfk::utils::CheckFlags checks(cmd);
+  // Inputs are generated and checked on the device; this compares the device
+  // generator against its CPU twin.
+  checks.run("check-rng", [] { return cfk::utils::check_generators<float>(); });
+  // Stage / phase state machine of the TMA pipeline; needs no GPU.
+  checks.run("check-pipeline", [] { return cfx::check_pipeline(); });
+  // Host-side tile planning for the ragged kernels; needs no GPU.
+  checks.run("check-ragged", [] { return cfx::check_ragged_plan(); });
+  // Tile mapping and CPU implementation of concat / split; needs no GPU.
+  checks.run("check-concat", [] { return cfx::check_concat_plan(); });
+  // Softmax / Welford statistics against the double reference; needs no GPU.
+  checks.run("check-row-norm", [] { return cfx::check_row_norm(); });
+  // Manifest registry and fallback of the static-shape launchers; needs no
+  // GPU.
+  checks.run("check-static", [] { return cfk::utils::check_static_shapes(); });
+  // Kernel source generation and the on-disk cubin cache; needs no GPU.
+  checks.run("check-jit", [] { return cfx::check_jit(); });
+  // Phase pairing and histogram buckets of the trace aggregator on synthetic
+  // records; needs no GPU.
+  checks.run("check-trace", [] { return cfx::check_trace(); });
+  if (checks.only_checks())
+    return checks.exit_code();
+
   // in tma copy h
   copy_host_tma_load_and_store_kernel(M, N, iterations);
+  copy_host_tma_pipelined(M, N, iterations);
   // in scale tma kernel h
   scaleTmaKernelHost(M, N, iterations);
+  // the same on the FFN activation shape of the manifest, then specialized
+  scaleTmaKernelHost(4096, 11008, iterations);
+  scaleTmaKernelHost(4096, 11008, iterations, true);
   // in tma copy multicast h
   copy_host_tma_load_and_store_kernel_multicast<true, 2>(M, N, iterations);
   copy_host_tma_load_and_store_kernel_multicast<false, 2>(M, N, iterations);
   copy_host_tma_load_and_store_kernel_multicast<true, 4>(M, N, iterations);
   copy_host_tma_load_and_store_kernel_multicast<false, 4>(M, N, iterations);
+  // in tma reduce h (f32 reduce-stores support add only)
+  copy_reduce_host<float, cfx::ReduceOp::Add>(M, N, iterations);
+  copy_reduce_host<uint32_t, cfx::ReduceOp::Max>(M, N, iterations);
+  // in l2 prefetch h: latency saved for a following copy
+  if (cmd.check_cmd_line_flag("prefetch"))
+    l2_prefetch_host(iterations);
+  // in jit kernels h: NVRTC-compiled kernels, the transpose specialized to
+  // the run's shape; a second run loads them from the disk cache
+  if (cmd.check_cmd_line_flag("jit"))
+    jit_host(4096, 11008, 1024, iterations);
+  // in chained launch h: --chain=<kernels> on a small tensor, where the
+  // prologue and tail are a visible share of each kernel
+  if (chain > 0)
+    chained_launch_host(2048, 2048, chain, iterations);
+  // in row norm h: rows up to 64K wide, resident in smem up to 32K floats
+  // or 64K bf16 values, streamed twice beyond
+  row_norm_host<cfx::RowNorm::Softmax, float>(1024, 65536, iterations);
+  row_norm_host<cfx::RowNorm::LayerNorm, cutlass::bfloat16_t>(8192, 8192,
+                                                              iterations);
+  row_norm_host<cfx::RowNorm::LayerNorm, float>(4096, 16384, iterations);
+  row_norm_host<cfx::RowNorm::RMSNorm, cutlass::bfloat16_t>(1024, 65536,
+                                                            iterations);
+  // in concat split h: as many pieces as one launch takes
+  concat_host<float>(M, cfx::kMaxConcatPieces, iterations);
+  // in ragged copy h
+  ragged_copy_host<false>(segments, ragged_cols, iterations);
+  ragged_copy_host<true>(segments, ragged_cols, iterations);
 
-  return 0;
+  return checks.exit_code();
 }
@@ -0,0 +1,336 @@
+#pragma once
+
+// Producer/consumer pipeline over kStages shared-memory buffers, each
+// guarded by a pair of mbarriers:
+//   full[s]  - the producer arrives once and posts the TMA transaction
+//              bytes. The loads complete the transaction, and the phase
+//              flips when the data has landed.
+//   empty[s] - every consumer thread of every CTA the stage is multicast
+//              into arrives when it is done. The phase flips when the
+//              producer may refill the stage.
+// A PipelineState walks the stages in order and flips its phase bit each
+// time it wraps around. The producer waits on empty with the opposite
+// parity, so its first pass over fresh barriers does not block.
+//
+// The class is generic over the barrier types so the same code runs on the
+// host against a software model of mbarrier parity (check_pipeline());
+// TmaPipeline is the device instantiation.
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_device.hpp"
+#include "philox.hpp"
+
+#if defined(__CUDACC__)
+#include <cute/arch/cluster_sm90.hpp>
+#include <cutlass/arch/barrier.h>
+
+#include "tensormap.hpp"
+#endif
+
+namespace cfx {
+
+template <int kStages> struct PipelineState {
+  static_assert(kStages > 0, "a pipeline needs at least one stage");
+  int index = 0;
+  uint32_t phase = 0;
+
+  CFK_HOST_DEVICE void advance() {
+    if (++index == kStages) {
+      index = 0;
+      phase ^= 1;
+    }
+  }
+};
+
+template <int kStages, class FullBarrier, class EmptyBarrier>
+class BasicTmaPipeline {
+public:
+  static constexpr int Stages = kStages;
+  using State = PipelineState<kStages>;
+
+  struct SharedStorage {
+    FullBarrier full[kStages];
+    EmptyBarrier empty[kStages];
+  };
+
+  struct Params {
+    uint32_t transaction_bytes; // bytes landing in each CTA per stage
+    uint32_t num_consumers = 1; // threads per CTA calling consumer_release
+    uint16_t mcast_mask = 1;    // CTAs of the cluster a stage is written to
+  };
+
+  // Barrier initialization happens on `leader` only. The caller must make
+  // it visible before first use: __syncthreads(), or cute::cluster_sync()
+  // when peers will signal these barriers.
+  CFK_HOST_DEVICE BasicTmaPipeline(SharedStorage &storage,
+                                   Params const &params, bool leader)
+      : storage_(storage), params_(params) {
+    if (!leader)
+      return;
+    uint32_t const peers = popcount(params.mcast_mask);
+    for (int s = 0; s < kStages; ++s) {
+      storage_.full[s].init(1);
+      storage_.empty[s].init(params.num_consumers * peers);
+    }
+#if defined(__CUDA_ARCH__)
+    cutlass::arch::fence_barrier_init();
+#endif
+  }
+
+  // Producer, one thread: wait until the stage is free, then post the
+  // bytes its loads will deliver.
+  CFK_HOST_DEVICE void producer_acquire(State const &state) {
+    storage_.empty[state.index].wait(state.phase ^ 1);
+    storage_.full[state.index].arrive_and_expect_tx(params_.transaction_bytes);
+  }
+
+  // As above for a stage whose loads deliver `bytes` instead, e.g. the
+  // short last chunk of a row.
+  CFK_HOST_DEVICE void producer_acquire(State const &state, uint32_t bytes) {
+    storage_.empty[state.index].wait(state.phase ^ 1);
+    storage_.full[state.index].arrive_and_expect_tx(bytes);
+  }
+
+  CFK_HOST_DEVICE bool producer_ready(State const &state) const {
+    return storage_.empty[state.index].test_wait(state.phase ^ 1);
+  }
+
+  // The barrier to pass to the stage's TMA loads (`tma.with(...)`).
+  CFK_HOST_DEVICE uint64_t &producer_barrier(State const &state) {
+    return reinterpret_cast<uint64_t &>(storage_.full[state.index]);
+  }
+
+  CFK_HOST_DEVICE FullBarrier &full_barrier(State const &state) {
+    return storage_.full[state.index];
+  }
+
+  // Consumer: wait until the stage's data has landed.
+  CFK_HOST_DEVICE void consumer_wait(State const &state) {
+    storage_.full[state.index].wait(state.phase);
+  }
+
+  CFK_HOST_DEVICE bool consumer_ready(State const &state) const {
+    return storage_.full[state.index].test_wait(state.phase);
+  }
+
+  // Consumer, every consumer thread: hand the stage back to the producer of
+  // each CTA that writes into it.
+  CFK_HOST_DEVICE void consumer_release(State const &state) {
+    if (params_.mcast_mask == 1) {
+      storage_.empty[state.index].arrive();
+      return;
+    }
+    for (uint32_t cta = 0; cta < 16; ++cta)
+      if (params_.mcast_mask & (1u << cta))
+        storage_.empty[state.index].arrive(cta, 1u);
+  }
+
+private:
+  CFK_HOST_DEVICE static uint32_t popcount(uint32_t x) {
+    uint32_t n = 0;
+    for (; x; x &= x - 1)
+      ++n;
+    return n;
+  }
+
+  SharedStorage &storage_;
+  Params params_;
+};
+
+#if defined(__CUDACC__)
+template <int kStages>
+using TmaPipeline =
+    BasicTmaPipeline<kStages, cutlass::arch::ClusterTransactionBarrier,
+                     cutlass::arch::ClusterBarrier>;
+
+// The persistent loop of a kernel whose single thread is both producer and
+// consumer: it walks tiles blockIdx.x, blockIdx.x + gridDim.x, ... < tiles
+// and keeps up to kStages loads in flight while it stores earlier tiles.
+//   load(t, state) - issue tile t's TMA load into stage state.index,
+//                    completing on that stage's full barrier.
+//   store(t, s)    - issue tile t's TMA store or reduce-store from stage s.
+//   primed()       - runs once the first loads are out (e.g. to let a
+//                    dependent grid launch).
+// A stage is refilled only after its store has read it out.
+template <int kStages, class Load, class Store, class Primed>
+CUTLASS_DEVICE void persistent_tma_loop(TmaPipeline<kStages> &pipeline,
+                                        int tiles, Load &&load, Store &&store,
+                                        Primed &&primed) {
+  typename TmaPipeline<kStages>::State load_state, store_state;
+  int next = blockIdx.x;
+  auto issue_load = [&] {
+    pipeline.producer_acquire(load_state);
+    load(next, load_state);
+    load_state.advance();
+    next += gridDim.x;
+  };
+
+  for (int s = 0; s < kStages && next < tiles; ++s)
+    issue_load();
+  primed();
+  for (int t = blockIdx.x; t < tiles; t += gridDim.x) {
+    pipeline.consumer_wait(store_state);
+    cutlass::arch::fence_view_async_shared();
+    store(t, store_state.index);
+    tma_store_commit();
+    tma_store_wait_read();
+    pipeline.consumer_release(store_state);
+    store_state.advance();
+    if (next < tiles)
+      issue_load();
+  }
+}
+
+template <int kStages, class Load, class Store>
+CUTLASS_DEVICE void persistent_tma_loop(TmaPipeline<kStages> &pipeline,
+                                        int tiles, Load &&load,
+                                        Store &&store) {
+  persistent_tma_loop(pipeline, tiles, load, store, [] {});
+}
+#endif
+
+// Software model of an mbarrier's phase, for the host check. A phase
+// completes when all expected arrivals and transaction bytes are in;
+// test_wait(p) is true once the phase with parity p has completed.
+struct ModelBarrier {
+  uint32_t expected = 0, pending = 0;
+  int64_t tx = 0;
+  uint32_t completed = 0;
+
+  void init(uint32_t count) { expected = pending = count; }
+  bool test_wait(uint32_t parity) const { return (completed & 1) != parity; }
+  void wait(uint32_t parity) const {
+    if (!test_wait(parity))
+      throw std::logic_error("wait on a barrier that would block");
+  }
+  void arrive() {
+    if (--pending == 0 && tx == 0)
+      complete();
+  }
+  void arrive(uint32_t, uint32_t) { arrive(); }
+  void arrive_and_expect_tx(uint32_t bytes) {
+    tx += bytes;
+    arrive();
+  }
+  void complete_tx(uint32_t bytes) {
+    tx -= bytes;
+    if (pending == 0 && tx == 0)
+      complete();
+  }
+  void complete() {
+    ++completed;
+    pending = expected;
+  }
+};
+
+// Runs a producer and `consumers` consumer threads over a kStages model
+// pipeline in a pseudo-random interleaving, with loads landing in several
+// pieces after random delays. Checks that items arrive in order, that no
+// stage is refilled before every consumer released it, and that the run
+// neither deadlocks nor blocks on a barrier that is not ready.
+template <int kStages>
+bool check_pipeline_schedule(int items, int consumers, uint64_t seed) {
+  using Pipeline = BasicTmaPipeline<kStages, ModelBarrier, ModelBarrier>;
+  typename Pipeline::SharedStorage storage;
+  uint32_t const kBytes = 4096, kPieces = 4;
+  Pipeline pipeline(storage, {kBytes, uint32_t(consumers), 1}, true);
+
+  int stage_item[kStages] = {};
+  int stage_readers[kStages] = {};
+  std::vector<typename Pipeline::State> cstate(consumers);
+  std::vector<int> consumed(consumers, 0), in_stage(consumers, -1);
+  typename Pipeline::State pstate;
+  int produced = 0;
+  struct Flight {
+    int stage;
+    uint32_t pieces_left;
+  };
+  std::vector<Flight> flights;
+
+  for (uint64_t step = 0; step < 1000000; ++step) {
+    bool done = produced == items && flights.empty();
+    for (int c = 0; c < consumers; ++c)
+      done = done && consumed[c] == items;
+    if (done)
+      return true;
+
+    uint32_t const r = cfk::utils::philox_bits(seed, step);
+    int const actor = int(r % uint32_t(consumers + 2)) - 2;
+    if (actor == -2) { // the TMA unit lands a piece of some load
+      if (flights.empty())
+        continue;
+      size_t const k = (r >> 8) % flights.size();
+      storage.full[flights[k].stage].complete_tx(kBytes / kPieces);
+      if (--flights[k].pieces_left == 0)
+        flights.erase(flights.begin() + k);
+    } else if (actor == -1) { // producer
+      if (produced == items || !pipeline.producer_ready(pstate))
+        continue;
+      if (stage_readers[pstate.index] != 0)
+        throw std::logic_error("stage refilled before it was released");
+      pipeline.producer_acquire(pstate);
+      stage_item[pstate.index] = produced++;
+      stage_readers[pstate.index] = consumers;
+      flights.push_back({pstate.index, kPieces});
+      pstate.advance();
+    } else { // consumer `actor`: wait for a stage, then release it
+      int const c = actor;
+      auto &state = cstate[c];
+      if (consumed[c] == items)
+        continue;
+      if (in_stage[c] < 0) {
+        if (!pipeline.consumer_ready(state))
+          continue;
+        pipeline.consumer_wait(state);
+        if (stage_item[state.index] != consumed[c])
+          throw std::logic_error("consumer saw items out of order");
+        in_stage[c] = state.index;
+      } else {
+        --stage_readers[state.index];
+        pipeline.consumer_release(state);
+        state.advance();
+        ++consumed[c];
+        in_stage[c] = -1;
+      }
+    }
+  }
+  throw std::logic_error("pipeline made no progress");
+}
+
+// Host check of the stage / phase state machine, run with --check-pipeline.
+inline bool check_pipeline() {
+  bool ok = true;
+  auto expect = [&](bool cond, std::string const &what) {
+    if (!cond) {
+      std::cout << "Pipeline check failed: " << what << std::endl;
+      ok = false;
+    }
+  };
+
+  PipelineState<3> s;
+  int const want_index[] = {0, 1, 2, 0, 1, 2, 0};
+  uint32_t const want_phase[] = {0, 0, 0, 1, 1, 1, 0};
+  for (int i = 0; i < 7; ++i, s.advance())
+    expect(s.index == want_index[i] && s.phase == want_phase[i],
+           "PipelineState<3> step " + std::to_string(i));
+
+  try {
+    expect(check_pipeline_schedule<1>(50, 1, 1), "1 stage");
+    expect(check_pipeline_schedule<2>(200, 1, 2), "2 stages");
+    expect(check_pipeline_schedule<4>(500, 4, 3), "4 stages, 4 consumers");
+    expect(check_pipeline_schedule<3>(500, 32, 4), "3 stages, 32 consumers");
+  } catch (std::logic_error const &e) {
+    expect(false, e.what());
+  }
+
+  if (ok)
+    std::cout << "Pipeline check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
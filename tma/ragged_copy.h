@@ -0,0 +1,268 @@
+#pragma once
+
+// Ragged batch copy and transpose with one launch and one pair of TMA
+// descriptors.
+//
+// The host encodes a load and a store descriptor once, over the whole
+// packed tensor (see ragged_plan.hpp). A persistent CTA walks the tile list
+// and, each time it crosses into a new segment, rebases those descriptors
+// onto the segment: the template is copied to smem, its base address,
+// extents and (for the transposed store) row stride are patched, and the
+// result is published to the CTA's slot in a global workspace. TMA then
+// clips every box at the segment end, so tiles never read or write into a
+// neighbour. The alternative, one host-encoded descriptor pair per segment,
+// costs a driver call per segment and a descriptor table in gmem; the
+// driver below times that encode for comparison.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include <cuda.h>
+#include <thrust/device_vector.h>
+
+#include <cutlass/arch/barrier.h>
+#include <cutlass/arch/memory_sm90.hpp>
+#include <cutlass/cutlass.h>
+
+#include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
+#include "pipeline.hpp"
+#include "ragged_plan.hpp"
+#include "tensormap.hpp"
+#include "verify_gpu.hpp"
+
+template <class Element, int kTileM, int kTileN> struct SharedStorageRagged {
+  alignas(128) Element tile[kTileM * kTileN];
+  alignas(128) Element tileT[kTileM * kTileN];
+  alignas(128) CUtensorMap desc[2]; // load, store
+  cfx::TmaPipeline<1>::SharedStorage pipeline;
+};
+
+template <class Element> struct RaggedParams {
+  CUtensorMap load; // templates over the packed tensor
+  CUtensorMap store;
+  Element const *input;
+  Element *output;
+  int64_t const *offsets;
+  int const *tile_start;
+  int segments;
+  int tiles;
+  int tiles_n;
+  int N;
+  CUtensorMap *workspace; // two descriptors per CTA
+};
+
+template <class Element, int kTileM, int kTileN, bool kTranspose,
+          int kNumThreads = 128>
+__global__ static void __launch_bounds__(kNumThreads)
+    raggedTMAKernel(CUTE_GRID_CONSTANT RaggedParams<Element> const p) {
+  extern __shared__ __align__(128) char shared_memory[];
+  using SharedStorage = SharedStorageRagged<Element, kTileM, kTileN>;
+  SharedStorage &ss = *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  int const warp_idx = cutlass::canonical_warp_idx_sync();
+  bool const leader = threadIdx.x == 0;
+  CUtensorMap *gload = p.workspace + 2 * blockIdx.x;
+  CUtensorMap *gstore = gload + 1;
+  constexpr int kTileBytes = kTileM * kTileN * sizeof(Element);
+
+  // One stage, recycled every tile: the leader releases it once the store
+  // has read it.
+  using Pipeline = cfx::TmaPipeline<1>;
+  Pipeline pipeline(ss.pipeline, {kTileBytes}, leader);
+  typename Pipeline::State state;
+  __syncthreads();
+
+  int segment = -1;
+  for (int t = blockIdx.x; t < p.tiles; t += gridDim.x) {
+    cfx::RaggedTile const tile = cfx::ragged_tile(
+        p.tile_start, p.segments, p.tiles_n, kTileM, kTileN, t);
+
+    // Rebase the descriptors; the branch is uniform across the CTA.
+    if (tile.segment != segment) {
+      segment = tile.segment;
+      if (warp_idx == 0) {
+        if (leader) {
+          // Stores through the old descriptor must land before it changes.
+          cfx::tma_store_wait_all();
+          int64_t const o = p.offsets[segment];
+          uint32_t const rows = uint32_t(p.offsets[segment + 1] - o);
+          ss.desc[0] = p.load;
+          ss.desc[1] = p.store;
+          cfx::tensormap_replace_global_address(&ss.desc[0],
+                                                p.input + o * p.N);
+          cfx::tensormap_replace_global_dim<1>(&ss.desc[0], rows);
+          cfx::tensormap_replace_global_address(&ss.desc[1],
+                                                p.output + o * p.N);
+          if constexpr (kTranspose) {
+            // (N, rows) block: rows is now the contiguous dimension.
+            cfx::tensormap_replace_global_dim<0>(&ss.desc[1], rows);
+            cfx::tensormap_replace_global_stride<0>(
+                &ss.desc[1], uint64_t(rows) * sizeof(Element));
+          } else {
+            cfx::tensormap_replace_global_dim<1>(&ss.desc[1], rows);
+          }
+        }
+        __syncwarp();
+        cfx::tensormap_cp_fence_release(gload, &ss.desc[0]);
+        cfx::tensormap_cp_fence_release(gstore, &ss.desc[1]);
+        if (leader) {
+          cfx::tensormap_fence_acquire(gload);
+          cfx::tensormap_fence_acquire(gstore);
+        }
+      }
+    }
+
+    if (leader) {
+      pipeline.producer_acquire(state);
+      cfx::tma_load_2d(gload, pipeline.full_barrier(state), ss.tile, tile.n0,
+                       tile.m0);
+    }
+    pipeline.consumer_wait(state);
+
+    Element const *out = ss.tile;
+    if constexpr (kTranspose) {
+      // Out-of-bounds box elements are zero-filled by TMA and clipped again
+      // by the store, so the whole tile can be transposed.
+      for (int i = threadIdx.x; i < kTileM * kTileN; i += kNumThreads) {
+        int const n = i / kTileM, m = i % kTileM;
+        ss.tileT[i] = ss.tile[m * kTileN + n];
+      }
+      out = ss.tileT;
+      cutlass::arch::fence_view_async_shared();
+    }
+    __syncthreads();
+
+    if (leader) {
+      if constexpr (kTranspose)
+        cfx::tma_store_2d(gstore, out, tile.m0, tile.n0);
+      else
+        cfx::tma_store_2d(gstore, out, tile.n0, tile.m0);
+      cfx::tma_store_commit();
+      cfx::tma_store_wait_read();
+      pipeline.consumer_release(state);
+    }
+    state.advance();
+    __syncthreads();
+  }
+  if (leader)
+    cfx::tma_store_wait_all();
+}
+
+template <bool kTranspose, int TILE_M = 64, int TILE_N = 64>
+int ragged_copy_host(int segments, int N, int iterations = 1) {
+  using Element = float;
+  constexpr int kThreads = 128;
+
+  printf("Ragged %s with device-side TMA descriptor updates.\n",
+         kTranspose ? "transpose" : "copy");
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  auto offsets = cfx::ragged_offsets(segments, 4, seed + 7);
+  cfx::RaggedPlan plan;
+  try {
+    plan = cfx::make_ragged_plan(offsets, N, TILE_M, TILE_N, sizeof(Element),
+                                 kTranspose);
+  } catch (std::invalid_argument const &e) {
+    std::cerr << "Invalid ragged batch: " << e.what() << std::endl;
+    return -1;
+  }
+  int64_t const elems = plan.rows() * N;
+  printf("%d segments, %lld rows x %d, %d tiles.\n", segments,
+         (long long)plan.rows(), N, plan.tiles());
+
+  thrust::device_vector<Element> d_S(elems);
+  thrust::device_vector<Element> d_D(elems);
+  thrust::device_vector<int64_t> d_offsets(plan.offsets);
+  thrust::device_vector<int> d_tile_start(plan.tile_start);
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+  cfk::utils::fill_random(S, elems, seed);
+
+  int sms = 0;
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, 0);
+  int const grid = std::max(1, std::min(plan.tiles(), 4 * sms));
+  thrust::device_vector<CUtensorMap> d_workspace(2 * grid);
+
+  RaggedParams<Element> params;
+  CUresult encoded = cfx::make_tensor_map_2d(&params.load, S, plan.rows(),
+                                             N, TILE_M, TILE_N);
+  if (encoded == CUDA_SUCCESS) {
+    encoded = kTranspose ? cfx::make_tensor_map_2d(&params.store, D, N,
+                                                   plan.rows(), TILE_N, TILE_M)
+                         : cfx::make_tensor_map_2d(&params.store, D,
+                                                   plan.rows(), N, TILE_M,
+                                                   TILE_N);
+  }
+  if (encoded != CUDA_SUCCESS) {
+    std::cerr << "cuTensorMapEncodeTiled failed: " << encoded << std::endl;
+    return -1;
+  }
+  params.input = S;
+  params.output = D;
+  params.offsets = thrust::raw_pointer_cast(d_offsets.data());
+  params.tile_start = thrust::raw_pointer_cast(d_tile_start.data());
+  params.segments = plan.segments();
+  params.tiles = plan.tiles();
+  params.tiles_n = plan.tiles_n;
+  params.N = N;
+  params.workspace = thrust::raw_pointer_cast(d_workspace.data());
+
+  // What the one-descriptor-pair-per-segment alternative costs on the host.
+  {
+    std::vector<CUtensorMap> maps(2);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (int s = 0; s < segments; ++s) {
+      int64_t const o = offsets[s], rows = offsets[s + 1] - o;
+      if (rows == 0)
+        continue;
+      cfx::make_tensor_map_2d(&maps[0], S + o * N, rows, N, TILE_M, TILE_N);
+      cfx::make_tensor_map_2d(&maps[1], D + o * N, rows, N, TILE_M, TILE_N);
+    }
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    std::cout << "Host encode of per-segment descriptors: " << tDiff.count()
+              << "ms (avoided)" << std::endl;
+  }
+
+  int smem_size =
+      int(sizeof(SharedStorageRagged<Element, TILE_M, TILE_N>));
+  auto kernel = raggedTMAKernel<Element, TILE_M, TILE_N, kTranspose, kThreads>;
+  cfk::utils::set_smem_size(smem_size, (void const *)kernel);
+
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    cfk::utils::ScopedRange range("raggedTMAKernel",
+                                  cfk::utils::dtype_name<Element>(),
+                                  {segments, N});
+    kernel<<<grid, kThreads, smem_size>>>(params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     2e-6 * elems * sizeof(Element) / time_ms)
+              << ")" << std::endl;
+  }
+
+  cfk::utils::VerifyReport report;
+  if constexpr (kTranspose)
+    report = cfk::utils::verify_on_device(
+        D, elems,
+        cfx::ExpectRaggedTranspose<Element>{seed, params.offsets,
+                                            plan.segments(), N});
+  else
+    report = cfk::utils::verify_on_device(
+        D, elems, cfk::utils::ExpectIdentity<Element>{seed});
+  cfk::utils::print_verify_report(std::cout, report, N);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+#pragma once
+
+// Host-side planning for ragged (variable-length) batch copies and
+// transposes, see ragged_copy.h.
+//
+// A ragged batch is a packed (offsets.back(), N) row-major tensor whose
+// segment s is rows [offsets[s], offsets[s + 1]). A copy writes the same
+// layout; a transpose writes each segment as its own (N, len_s) row-major
+// block in the same footprint. The plan cuts every segment into
+// kTileM x kTileN tiles and stores the prefix sum of tile counts, so a CTA
+// finds the segment of any tile with a binary search. Nothing here needs a
+// GPU; check_ragged_plan() exercises it on the CPU.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_device.hpp"
+#include "philox.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+namespace cfx {
+
+struct RaggedPlan {
+  int N = 0;
+  int tile_m = 0, tile_n = 0;
+  int tiles_n = 0;               // tiles across N, the same for every segment
+  std::vector<int64_t> offsets;  // segments + 1
+  std::vector<int> tile_start;   // segments + 1, prefix sum of tile counts
+
+  int segments() const { return int(offsets.size()) - 1; }
+  int tiles() const { return tile_start.back(); }
+  int64_t rows() const { return offsets.back(); }
+};
+
+// Throws std::invalid_argument if a segment cannot be addressed by TMA:
+// every row, and for a transpose every segment length, must be a multiple
+// of 16 bytes.
+inline RaggedPlan make_ragged_plan(std::vector<int64_t> const &offsets, int N,
+                                   int tile_m, int tile_n, int elem_bytes,
+                                   bool transpose) {
+  if (offsets.empty() || offsets[0] != 0)
+    throw std::invalid_argument("ragged offsets must start at 0");
+  if (N <= 0 || (int64_t(N) * elem_bytes) % 16 != 0)
+    throw std::invalid_argument("ragged rows must be a multiple of 16 bytes");
+
+  RaggedPlan plan;
+  plan.N = N;
+  plan.tile_m = tile_m;
+  plan.tile_n = tile_n;
+  plan.tiles_n = (N + tile_n - 1) / tile_n;
+  plan.offsets = offsets;
+  plan.tile_start.assign(1, 0);
+  for (size_t s = 0; s + 1 < offsets.size(); ++s) {
+    int64_t len = offsets[s + 1] - offsets[s];
+    if (len < 0)
+      throw std::invalid_argument("ragged offsets must be non-decreasing");
+    if (transpose && (len * elem_bytes) % 16 != 0)
+      throw std::invalid_argument(
+          "ragged transpose needs segment lengths of 16-byte multiples");
+    int64_t tiles = (len + tile_m - 1) / tile_m * plan.tiles_n;
+    if (plan.tile_start.back() + tiles > INT32_MAX)
+      throw std::invalid_argument("too many ragged tiles");
+    plan.tile_start.push_back(plan.tile_start.back() + int(tiles));
+  }
+  return plan;
+}
+
+// Largest s < segments with starts[s] <= x, for x < starts[segments]. Empty
+// segments are skipped because their successor has the same start.
+template <class Index>
+CFK_HOST_DEVICE int ragged_segment(Index const *starts, int segments,
+                                   int64_t x) {
+  int lo = 0, hi = segments;
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    if (int64_t(starts[mid]) <= x)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+// Segment and segment-local origin (row m0, column n0) of tile t.
+struct RaggedTile {
+  int segment;
+  int m0, n0;
+};
+
+CFK_HOST_DEVICE RaggedTile ragged_tile(int const *tile_start, int segments,
+                                       int tiles_n, int tile_m, int tile_n,
+                                       int t) {
+  int s = ragged_segment(tile_start, segments, t);
+  int local = t - tile_start[s];
+  return {s, local / tiles_n * tile_m, local % tiles_n * tile_n};
+}
+
+// Output element d of a ragged transpose of an input drawn from `seed`.
+// `offsets` must be readable where the functor runs.
+template <class T> struct ExpectRaggedTranspose {
+  uint64_t seed;
+  int64_t const *offsets;
+  int segments;
+  int64_t N;
+  CFK_HOST_DEVICE T operator()(uint64_t d) const {
+    int s = ragged_segment(offsets, segments, int64_t(d / N));
+    int64_t const len = offsets[s + 1] - offsets[s];
+    int64_t const local = int64_t(d) - offsets[s] * N;
+    int64_t const n = local / len, m = local % len;
+    return cfk::utils::random_value<T>(seed, (offsets[s] + m) * N + n);
+  }
+};
+
+// CPU reference for ragged_copy.
+template <class T, bool kTranspose>
+void ragged_copy_cpu(T const *in, T *out, std::vector<int64_t> const &offsets,
+                     int64_t N) {
+  cfk::utils::parallel_for(0, offsets.size() - 1, 1, [&](size_t lo,
+                                                          size_t hi) {
+    for (size_t s = lo; s < hi; ++s) {
+      int64_t const o = offsets[s], len = offsets[s + 1] - o;
+      if constexpr (kTranspose) {
+        for (int64_t m = 0; m < len; ++m)
+          for (int64_t n = 0; n < N; ++n)
+            out[o * N + n * len + m] = in[(o + m) * N + n];
+      } else {
+        std::memcpy(out + o * N, in + o * N, len * N * sizeof(T));
+      }
+    }
+  });
+}
+
+// Segment lengths for the drivers and the plan check: multiples of `align`
+// rows in [align, align * 256], with every 16th segment empty.
+inline std::vector<int64_t> ragged_offsets(int segments, int align,
+                                           uint64_t seed) {
+  std::vector<int64_t> offsets(1, 0);
+  for (int s = 0; s < segments; ++s) {
+    uint32_t b = cfk::utils::philox_bits(seed, s);
+    int64_t len = (s % 16 == 15) ? 0 : int64_t(align) * (1 + b % 256);
+    offsets.push_back(offsets.back() + len);
+  }
+  return offsets;
+}
+
+// Checks the planner on the CPU: every element of every segment lies in
+// exactly one tile (tiles are clipped at segment ends), bad inputs are
+// rejected, and the CPU reference agrees with ExpectRaggedTranspose.
+inline bool check_ragged_plan() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Ragged plan check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  int const N = 72, tile_m = 32, tile_n = 32;
+  for (int segments : {1, 7, 100}) {
+    auto offsets = ragged_offsets(segments, 4, segments);
+    RaggedPlan plan = make_ragged_plan(offsets, N, tile_m, tile_n, 4, true);
+    std::vector<int> hits(size_t(plan.rows()) * N, 0);
+    for (int t = 0; t < plan.tiles(); ++t) {
+      RaggedTile tile = ragged_tile(plan.tile_start.data(), plan.segments(),
+                                    plan.tiles_n, tile_m, tile_n, t);
+      int64_t const o = offsets[tile.segment];
+      int64_t const len = offsets[tile.segment + 1] - o;
+      if (len == 0 || tile.m0 >= len || tile.n0 >= N)
+        fail("tile " + std::to_string(t) + " outside its segment");
+      for (int64_t m = tile.m0; m < std::min<int64_t>(len, tile.m0 + tile_m);
+           ++m)
+        for (int n = tile.n0; n < std::min(N, tile.n0 + tile_n); ++n)
+          ++hits[(o + m) * N + n];
+    }
+    for (size_t i = 0; i < hits.size(); ++i)
+      if (hits[i] != 1) {
+        fail("element " + std::to_string(i) + " covered " +
+             std::to_string(hits[i]) + " times");
+        break;
+      }
+
+    size_t const n = size_t(plan.rows()) * N;
+    std::vector<float> in(n), out(n);
+    cfk::utils::fill_random_cpu(in.data(), n, 1);
+    ragged_copy_cpu<float, true>(in.data(), out.data(), offsets, N);
+    auto report = cfk::utils::verify_cpu(
+        out.data(), n,
+        ExpectRaggedTranspose<float>{1, offsets.data(), plan.segments(), N});
+    if (!report.ok())
+      fail("CPU transpose disagrees with ExpectRaggedTranspose");
+  }
+
+  auto rejects = [&](std::vector<int64_t> const &offsets, int cols,
+                     bool transpose) {
+    try {
+      make_ragged_plan(offsets, cols, tile_m, tile_n, 4, transpose);
+    } catch (std::invalid_argument const &) {
+      return true;
+    }
+    return false;
+  };
+  if (!rejects({0, 4}, 3, false))
+    fail("accepted a row that is not a multiple of 16 bytes");
+  if (!rejects({0, 3}, 4, true))
+    fail("accepted a transpose of a 12-byte segment length");
+  if (!rejects({0, 8, 4}, 4, false))
+    fail("accepted decreasing offsets");
+  if (rejects({0, 3, 3}, 4, false))
+    fail("rejected a valid copy plan");
+
+  if (ok)
+    std::cout << "Ragged plan check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
@@ -0,0 +1,72 @@
+#pragma once
+
+// Element-wise reductions for accumulating copies (tma_reduce.h): dst =
+// op(dst, src) with op one of add, min or max. The same definitions give
+// the CPU reference, the read-modify-write baseline kernel and the device
+// check, so all three agree bit for bit.
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#include "host_device.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+namespace cfx {
+
+enum class ReduceOp { Add, Min, Max };
+
+inline char const *reduce_op_name(ReduceOp op) {
+  switch (op) {
+  case ReduceOp::Add:
+    return "add";
+  case ReduceOp::Min:
+    return "min";
+  default:
+    return "max";
+  }
+}
+
+// Inverse of reduce_op_name; throws std::invalid_argument otherwise.
+inline ReduceOp parse_reduce_op(std::string const &name) {
+  if (name == "add")
+    return ReduceOp::Add;
+  if (name == "min")
+    return ReduceOp::Min;
+  if (name == "max")
+    return ReduceOp::Max;
+  throw std::invalid_argument(
+      "reduce must be one of 'add', 'min', 'max', got '" + name + "'");
+}
+
+template <ReduceOp kOp, class T>
+CFK_HOST_DEVICE T reduce_apply(T const &d, T const &s) {
+  if constexpr (kOp == ReduceOp::Add)
+    return T(d + s);
+  else if constexpr (kOp == ReduceOp::Min)
+    return s < d ? s : d;
+  else
+    return d < s ? s : d;
+}
+
+// CPU reference: dst[i] = op(dst[i], src[i]).
+template <ReduceOp kOp, class T>
+void copy_reduce_cpu(T const *src, T *dst, size_t n) {
+  cfk::utils::parallel_for(0, n, 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      dst[i] = reduce_apply<kOp>(dst[i], src[i]);
+  });
+}
+
+// out[i] == op(dst0[i], src[i]) with src and the initial dst drawn from
+// their own seeds.
+template <ReduceOp kOp, class T> struct ExpectReduce {
+  uint64_t seed_src, seed_dst;
+  CFK_HOST_DEVICE T operator()(uint64_t i) const {
+    return reduce_apply<kOp>(cfk::utils::random_value<T>(seed_dst, i),
+                             cfk::utils::random_value<T>(seed_src, i));
+  }
+};
+
+} // namespace cfx
@@ -0,0 +1,267 @@
+#pragma once
+
+// Fused row-wise softmax, LayerNorm and RMSNorm forward on the TMA pipeline
+// (statistics and CPU reference in row_norm.hpp).
+//
+// A persistent CTA owns one row at a time. Thread 0 streams the row into
+// kStages smem chunks with 1D bulk copies, running ahead across rows; all
+// threads consume. Pass 1 folds every chunk into per-thread running
+// statistics (online softmax, Welford, sum of squares), which merge into one
+// per row. Pass 2 normalizes each chunk in place and bulk-stores it.
+//
+// A row of at most kStages chunks (32K floats, 64K bf16 values) stays
+// resident: pass 1 holds its stages and pass 2 re-walks them, so the row is
+// read from HBM once and written once. A longer row is streamed twice; the
+// second read mostly hits L2. Rows must be a multiple of 16 bytes.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include <cutlass/arch/barrier.h>
+#include <cutlass/arch/memory_sm90.hpp>
+#include <cutlass/cutlass.h>
+
+#include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "huge_pages.hpp"
+#include "peak_gpu.hpp"
+#include "pipeline.hpp"
+#include "row_norm.hpp"
+#include "tensormap.hpp"
+#include "verify_gpu.hpp"
+
+template <class Element, class Stat, int kThreads, int kStages, int kChunk>
+struct SharedStorageRowNorm {
+  alignas(128) Element chunk[kStages][kChunk];
+  typename cfx::TmaPipeline<kStages>::SharedStorage pipeline;
+  Stat warp[kThreads / 32];
+  cfx::RowNormCoef coef;
+};
+
+// Merge over the lanes of a warp with a butterfly of shuffles, field by
+// field; every lane ends with a result, lane 0's is the one used.
+template <class Stat> CUTLASS_DEVICE Stat warp_merge(Stat s) {
+  constexpr int kFields = sizeof(Stat) / sizeof(float);
+  for (int offset = 16; offset > 0; offset /= 2) {
+    float f[kFields];
+    memcpy(f, &s, sizeof(Stat));
+    for (int k = 0; k < kFields; ++k)
+      f[k] = __shfl_xor_sync(0xffffffff, f[k], offset);
+    Stat o;
+    memcpy(&o, f, sizeof(Stat));
+    s.merge(o);
+  }
+  return s;
+}
+
+template <cfx::RowNorm kOp, class Element, int kThreads, int kStages,
+          int kChunk>
+__global__ static void __launch_bounds__(kThreads, 1)
+    rowNormKernel(Element const *__restrict__ in, Element *__restrict__ out,
+                  float const *__restrict__ gamma,
+                  float const *__restrict__ beta, int rows, int cols,
+                  float eps) {
+  static_assert(kChunk % kThreads == 0, "threads stride whole chunks");
+  using Stat = cfx::RowStat<kOp>;
+  using SharedStorage =
+      SharedStorageRowNorm<Element, Stat, kThreads, kStages, kChunk>;
+  extern __shared__ __align__(128) char shared_memory[];
+  SharedStorage &ss = *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  int const tid = threadIdx.x, lane = tid % 32, warp = tid / 32;
+  int const chunks = (cols + kChunk - 1) / kChunk;
+  bool const resident = chunks <= kStages;
+  int const loads_per_row = resident ? chunks : 2 * chunks;
+  auto chunk_elems = [&](int c) { return min(kChunk, cols - c * kChunk); };
+
+  using Pipeline = cfx::TmaPipeline<kStages>;
+  Pipeline pipeline(ss.pipeline, {0, kThreads}, tid == 0);
+  __syncthreads();
+
+  // Producer cursor, used by thread 0 only. A stage is refilled once thread
+  // 0 has released it, which keeps exactly kStages loads in flight or held.
+  typename Pipeline::State load_state;
+  int load_row = blockIdx.x, load_idx = 0, issued = 0, released = 0;
+  auto refill = [&] {
+    while (load_row < rows && issued < released + kStages) {
+      int const c = load_idx % chunks;
+      uint32_t const bytes = chunk_elems(c) * sizeof(Element);
+      pipeline.producer_acquire(load_state, bytes);
+      cfx::bulk_load_1d(pipeline.full_barrier(load_state),
+                        ss.chunk[load_state.index],
+                        in + size_t(load_row) * cols + size_t(c) * kChunk,
+                        bytes);
+      load_state.advance();
+      ++issued;
+      if (++load_idx == loads_per_row) {
+        load_idx = 0;
+        load_row += gridDim.x;
+      }
+    }
+  };
+  auto release = [&](typename Pipeline::State const &s) {
+    pipeline.consumer_release(s);
+    if (tid == 0) {
+      ++released;
+      refill();
+    }
+  };
+  if (tid == 0)
+    refill();
+
+  typename Pipeline::State state;
+  for (int row = blockIdx.x; row < rows; row += gridDim.x) {
+    // Pass 1: statistics.
+    Stat stat;
+    typename Pipeline::State const row_start = state;
+    for (int c = 0; c < chunks; ++c) {
+      pipeline.consumer_wait(state);
+      Element const *chunk = ss.chunk[state.index];
+      for (int k = tid; k < chunk_elems(c); k += kThreads)
+        stat.add(float(chunk[k]));
+      if (!resident)
+        release(state);
+      state.advance();
+    }
+    stat = warp_merge(stat);
+    if (lane == 0)
+      ss.warp[warp] = stat;
+    __syncthreads();
+    if (tid == 0) {
+      Stat block;
+      for (int w = 0; w < kThreads / 32; ++w)
+        block.merge(ss.warp[w]);
+      ss.coef = block.coef(eps);
+    }
+    __syncthreads();
+    cfx::RowNormCoef const coef = ss.coef;
+
+    // Pass 2: normalize in place, store, hand the stage back.
+    if (resident)
+      state = row_start;
+    Element *out_row = out + size_t(row) * cols;
+    for (int c = 0; c < chunks; ++c) {
+      pipeline.consumer_wait(state);
+      Element *chunk = ss.chunk[state.index];
+      int const col0 = c * kChunk, n = chunk_elems(c);
+      for (int k = tid; k < n; k += kThreads) {
+        int const j = col0 + k;
+        chunk[k] = Element(cfx::row_norm_apply<kOp>(
+            coef, float(chunk[k]), gamma ? gamma[j] : 1.0f,
+            beta ? beta[j] : 0.0f));
+      }
+      cutlass::arch::fence_view_async_shared();
+      __syncthreads();
+      if (tid == 0) {
+        cfx::bulk_store_1d(out_row + col0, chunk, n * sizeof(Element));
+        cfx::tma_store_commit();
+        // The stage is refilled as soon as it is released.
+        cfx::tma_store_wait_read();
+      }
+      __syncthreads();
+      release(state);
+      state.advance();
+    }
+  }
+  if (tid == 0)
+    cfx::tma_store_wait_all();
+}
+
+// out = op(in) row by row over row-major (rows, cols) tensors. gamma and
+// beta (cols floats each) may be null; softmax ignores both and RMSNorm
+// ignores beta. Rows and pointers must be 16-byte aligned.
+template <cfx::RowNorm kOp, class Element, int kThreads = 256,
+          int kStages = 8, int kChunk = 16384 / sizeof(Element)>
+cudaError_t row_norm(Element const *in, Element *out, float const *gamma,
+                     float const *beta, int rows, int cols,
+                     float eps = 1e-5f, cudaStream_t stream = 0) {
+  cfk::utils::ScopedRange range(cfx::row_norm_name(kOp),
+                                cfk::utils::dtype_name<Element>(),
+                                {rows, cols});
+  if (rows <= 0 || cols <= 0 || (size_t(cols) * sizeof(Element)) % 16 != 0 ||
+      reinterpret_cast<uintptr_t>(in) % 16 != 0 ||
+      reinterpret_cast<uintptr_t>(out) % 16 != 0)
+    return cudaErrorInvalidValue;
+
+  using SharedStorage =
+      SharedStorageRowNorm<Element, cfx::RowStat<kOp>, kThreads, kStages,
+                           kChunk>;
+  int const smem_size = int(sizeof(SharedStorage));
+  void const *kernel =
+      (void const *)rowNormKernel<kOp, Element, kThreads, kStages, kChunk>;
+  cfk::utils::set_smem_size(smem_size, kernel);
+
+  int sms = 0;
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, 0);
+  rowNormKernel<kOp, Element, kThreads, kStages, kChunk>
+      <<<std::min(rows, sms), kThreads, smem_size, stream>>>(
+          in, out, gamma, beta, rows, cols, eps);
+  return cudaGetLastError();
+}
+
+template <cfx::RowNorm kOp, class Element>
+int row_norm_host(int rows, int cols, int iterations = 1) {
+  using namespace cfx;
+  printf("Fused %s forward (%s), (%d, %d).\n", row_norm_name(kOp),
+         cfk::utils::dtype_name<Element>(), rows, cols);
+
+  size_t const size = size_t(rows) * cols;
+  thrust::device_vector<Element> d_S(size), d_D(size);
+  thrust::device_vector<float> d_gamma(cols), d_beta(cols);
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(S, size, seed);
+  bool const affine = kOp != RowNorm::Softmax;
+  float const *gamma = nullptr, *beta = nullptr;
+  if (affine) {
+    cfk::utils::fill_random(thrust::raw_pointer_cast(d_gamma.data()), cols,
+                            seed + 1);
+    cfk::utils::fill_random(thrust::raw_pointer_cast(d_beta.data()), cols,
+                            seed + 2);
+    gamma = thrust::raw_pointer_cast(d_gamma.data());
+    beta = thrust::raw_pointer_cast(d_beta.data());
+  }
+  float const eps = 1e-5f;
+
+  // One read and one write of the tensor; longer rows re-read from L2.
+  double const bytes = 2.0 * size * sizeof(Element);
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    cudaError result = row_norm<kOp>(S, D, gamma, beta, rows, cols, eps);
+    if (result == cudaSuccess)
+      result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+
+  // The input is regenerated on the host; the output is held to the double
+  // reference within the tolerance for Element.
+  cfk::utils::HostBuffer<Element> h_S(size);
+  cfk::utils::fill_random_cpu(h_S.data(), size, seed);
+  std::vector<float> h_gamma(cols), h_beta(cols);
+  cfk::utils::fill_random_cpu(h_gamma.data(), cols, seed + 1);
+  cfk::utils::fill_random_cpu(h_beta.data(), cols, seed + 2);
+  thrust::host_vector<Element> h_D = d_D;
+  auto report = row_norm_verify<kOp>(
+      h_D.data(), h_S.data(), rows, cols, affine ? h_gamma.data() : nullptr,
+      affine ? h_beta.data() : nullptr, eps,
+      row_norm_tolerance<Element>(kOp, cols));
+  cfk::utils::print_verify_report(std::cout, report, cols);
+  return 0;
+}
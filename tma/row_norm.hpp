@@ -0,0 +1,333 @@
+#pragma once
+
+// Row-wise softmax, LayerNorm and RMSNorm (forward): the running statistics
+// shared by the fused kernel (row_norm.h) and the CPU code, a
+// double-precision CPU reference, and the tolerances results are held to.
+//
+// A row is reduced with mergeable statistics, so a kernel may split it
+// across threads, chunks and warps in any order and still needs only one
+// pass over the data to normalize it:
+//   softmax    online (max, sum of exp(x - max)); a merge rescales the sum
+//              of the side with the smaller max.
+//   LayerNorm  Welford (count, mean, M2), merged with Chan's formula, so a
+//              row with a large mean loses no precision to cancellation.
+//   RMSNorm    (count, sum of squares).
+// Nothing here needs a GPU; check_row_norm() exercises it on the CPU.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "host_device.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+namespace cfx {
+
+enum class RowNorm { Softmax, LayerNorm, RMSNorm };
+
+inline char const *row_norm_name(RowNorm op) {
+  switch (op) {
+  case RowNorm::Softmax:
+    return "softmax";
+  case RowNorm::LayerNorm:
+    return "layernorm";
+  default:
+    return "rmsnorm";
+  }
+}
+
+// y = (x - center) * scale, then the op's epilogue.
+struct RowNormCoef {
+  float center, scale;
+};
+
+struct SoftmaxStat {
+  float max = -INFINITY, sum = 0;
+
+  CFK_HOST_DEVICE void add(float x) {
+    if (x == -INFINITY) // masked out
+      return;
+    if (x > max) {
+      sum = sum * expf(max - x) + 1.0f;
+      max = x;
+    } else {
+      sum += expf(x - max);
+    }
+  }
+  CFK_HOST_DEVICE void merge(SoftmaxStat const &o) {
+    if (o.max == -INFINITY)
+      return;
+    if (max == -INFINITY) {
+      *this = o;
+      return;
+    }
+    float const m = max > o.max ? max : o.max;
+    sum = sum * expf(max - m) + o.sum * expf(o.max - m);
+    max = m;
+  }
+  CFK_HOST_DEVICE RowNormCoef coef(float) const { return {max, 1.0f / sum}; }
+};
+
+struct WelfordStat {
+  float n = 0, mean = 0, m2 = 0;
+
+  CFK_HOST_DEVICE void add(float x) {
+    n += 1.0f;
+    float const d = x - mean;
+    mean += d / n;
+    m2 += d * (x - mean);
+  }
+  CFK_HOST_DEVICE void merge(WelfordStat const &o) {
+    if (o.n == 0)
+      return;
+    if (n == 0) {
+      *this = o;
+      return;
+    }
+    float const t = n + o.n, d = o.mean - mean;
+    mean += d * (o.n / t);
+    m2 += o.m2 + d * d * (n * o.n / t);
+    n = t;
+  }
+  // Biased variance, as torch.nn.functional.layer_norm.
+  CFK_HOST_DEVICE RowNormCoef coef(float eps) const {
+    return {mean, 1.0f / sqrtf(m2 / n + eps)};
+  }
+};
+
+struct SquareStat {
+  float n = 0, sumsq = 0;
+
+  CFK_HOST_DEVICE void add(float x) {
+    n += 1.0f;
+    sumsq += x * x;
+  }
+  CFK_HOST_DEVICE void merge(SquareStat const &o) {
+    n += o.n;
+    sumsq += o.sumsq;
+  }
+  CFK_HOST_DEVICE RowNormCoef coef(float eps) const {
+    return {0.0f, 1.0f / sqrtf(sumsq / n + eps)};
+  }
+};
+
+template <RowNorm kOp>
+using RowStat = std::conditional_t<
+    kOp == RowNorm::Softmax, SoftmaxStat,
+    std::conditional_t<kOp == RowNorm::LayerNorm, WelfordStat, SquareStat>>;
+
+// gamma and beta are ignored by softmax, beta by RMSNorm.
+template <RowNorm kOp>
+CFK_HOST_DEVICE float row_norm_apply(RowNormCoef const &c, float x,
+                                     float gamma, float beta) {
+  if constexpr (kOp == RowNorm::Softmax)
+    return expf(x - c.center) * c.scale;
+  else if constexpr (kOp == RowNorm::LayerNorm)
+    return (x - c.center) * c.scale * gamma + beta;
+  else
+    return x * c.scale * gamma;
+}
+
+// One row in double with two exact passes. gamma and beta may be null.
+template <RowNorm kOp, class T>
+void row_norm_reference_row(T const *x, int cols, float const *gamma,
+                            float const *beta, float eps, double *y) {
+  double center = 0, scale = 0;
+  if constexpr (kOp == RowNorm::Softmax) {
+    center = -INFINITY;
+    for (int j = 0; j < cols; ++j)
+      center = std::max(center, double(float(x[j])));
+    for (int j = 0; j < cols; ++j)
+      scale += std::exp(double(float(x[j])) - center);
+    scale = 1.0 / scale;
+  } else {
+    if constexpr (kOp == RowNorm::LayerNorm) {
+      for (int j = 0; j < cols; ++j)
+        center += double(float(x[j]));
+      center /= cols;
+    }
+    double ss = 0;
+    for (int j = 0; j < cols; ++j) {
+      double const d = double(float(x[j])) - center;
+      ss += d * d;
+    }
+    scale = 1.0 / std::sqrt(ss / cols + eps);
+  }
+  for (int j = 0; j < cols; ++j) {
+    double const v = double(float(x[j]));
+    if constexpr (kOp == RowNorm::Softmax)
+      y[j] = std::exp(v - center) * scale;
+    else
+      y[j] = (v - center) * scale * (gamma ? gamma[j] : 1.0) +
+             (kOp == RowNorm::LayerNorm && beta ? beta[j] : 0.0);
+  }
+}
+
+// |got - want| <= atol + rtol * |want|. Outputs are stored in T, so the
+// bound starts at a few units of T's precision; softmax values are
+// O(1 / cols), which sets their absolute tolerance.
+struct RowNormTolerance {
+  double atol, rtol;
+};
+
+template <class T>
+RowNormTolerance row_norm_tolerance(RowNorm op, int cols) {
+  double const rtol = sizeof(T) == 2 ? 0x1p-7 : 0x1p-15;
+  double const magnitude = op == RowNorm::Softmax ? 1.0 / cols : 1.0;
+  return {rtol * magnitude, rtol};
+}
+
+// Compares a (rows, cols) result against row_norm_reference_row, one row
+// per task, without materializing the reference.
+template <RowNorm kOp, class T>
+cfk::utils::VerifyReport
+row_norm_verify(T const *got, T const *in, int rows, int cols,
+                float const *gamma, float const *beta, float eps,
+                RowNormTolerance tol) {
+  cfk::utils::VerifyReport report{};
+  report.checked = uint64_t(rows) * cols;
+  std::mutex mutex;
+  cfk::utils::parallel_for(0, rows, 1, [&](size_t lo, size_t hi) {
+    std::vector<double> want(cols);
+    unsigned long long bad = 0;
+    for (size_t r = lo; r < hi; ++r) {
+      row_norm_reference_row<kOp>(in + r * cols, cols, gamma, beta, eps,
+                                  want.data());
+      for (int j = 0; j < cols; ++j) {
+        double const g = double(float(got[r * cols + j]));
+        if (std::abs(g - want[j]) <= tol.atol + tol.rtol * std::abs(want[j]))
+          continue;
+        if (bad++ < cfk::utils::kMaxReportedMismatches) {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (report.reported < cfk::utils::kMaxReportedMismatches)
+            report.first[report.reported++] = {r * cols + j, g, want[j]};
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    report.mismatches += bad;
+  });
+  report.sort();
+  return report;
+}
+
+// Host emulation of rowNormKernel's reduction order: thread t of kThreads
+// accumulates columns t, t + kThreads, ...; lanes merge over a butterfly
+// of shuffles, and warp 0 folds the warp results in order. The kernel
+// produces the same statistics up to the rounding of expf.
+template <RowNorm kOp, int kThreads = 256>
+RowNormCoef row_norm_coef_blocked(float const *x, int cols, float eps) {
+  using Stat = RowStat<kOp>;
+  Stat lane[kThreads];
+  for (int t = 0; t < kThreads; ++t)
+    for (int j = t; j < cols; j += kThreads)
+      lane[t].add(x[j]);
+  Stat block;
+  for (int w = 0; w < kThreads / 32; ++w) {
+    Stat *warp = lane + 32 * w;
+    for (int offset = 16; offset > 0; offset /= 2) {
+      Stat next[32];
+      for (int l = 0; l < 32; ++l) {
+        next[l] = warp[l];
+        next[l].merge(warp[l ^ offset]);
+      }
+      std::copy(next, next + 32, warp);
+    }
+    block.merge(warp[0]);
+  }
+  return block.coef(eps);
+}
+
+// Checks the float statistics against the double reference on the CPU,
+// run with --check-row-norm: widths up to 64K, rows far from zero (where a
+// naive sum of squares for LayerNorm loses every digit), softmax inputs
+// spanning many orders of magnitude of exp, and masked entries. Far from
+// zero the inputs themselves carry only ulp(offset) of information, so the
+// normalization tolerance grows with offset / range.
+inline bool check_row_norm() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Row norm check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  struct Data {
+    char const *name;
+    float offset, range;
+  };
+  Data const data[] = {{"uniform", 0.0f, 1.0f},
+                       {"wide", -40.0f, 80.0f},
+                       {"offset", 1e3f, 1.0f}};
+  float const eps = 1e-5f;
+
+  auto run = [&](auto op, int cols, Data const &d, uint64_t seed,
+                 bool masked) {
+    constexpr RowNorm kOp = decltype(op)::value;
+    std::vector<float> x(cols), gamma(cols), beta(cols), y(cols);
+    cfk::utils::fill_random_cpu(x.data(), cols, seed);
+    cfk::utils::fill_random_cpu(gamma.data(), cols, seed + 1);
+    cfk::utils::fill_random_cpu(beta.data(), cols, seed + 2);
+    for (int j = 0; j < cols; ++j) {
+      x[j] = d.offset + d.range * x[j];
+      gamma[j] += 0.5f;
+    }
+    if (masked)
+      for (int j = 0; j < cols; j += 3)
+        x[j] = -INFINITY;
+    RowNormCoef const c = row_norm_coef_blocked<kOp>(x.data(), cols, eps);
+    for (int j = 0; j < cols; ++j)
+      y[j] = row_norm_apply<kOp>(c, x[j], gamma[j], beta[j]);
+    RowNormTolerance tol = row_norm_tolerance<float>(kOp, cols);
+    if (kOp != RowNorm::Softmax) {
+      tol.atol *= 1 + std::abs(d.offset) / d.range;
+      tol.rtol *= 1 + std::abs(d.offset) / d.range;
+    }
+    auto report = row_norm_verify<kOp>(y.data(), x.data(), 1, cols,
+                                       gamma.data(), beta.data(), eps, tol);
+    if (!report.ok())
+      fail(std::string(row_norm_name(kOp)) + ", " + d.name + ", " +
+           std::to_string(cols) + " columns: " +
+           std::to_string(report.mismatches) + " values out of tolerance");
+  };
+
+  using Softmax = std::integral_constant<RowNorm, RowNorm::Softmax>;
+  using LayerNorm = std::integral_constant<RowNorm, RowNorm::LayerNorm>;
+  using RMSNorm = std::integral_constant<RowNorm, RowNorm::RMSNorm>;
+  uint64_t seed = 1;
+  for (int cols : {1, 7, 256, 1000, 4100, 16384, 65536})
+    for (Data const &d : data) {
+      run(Softmax{}, cols, d, seed, false);
+      run(LayerNorm{}, cols, d, seed, false);
+      run(RMSNorm{}, cols, d, seed, false);
+      seed += 3;
+    }
+  run(Softmax{}, 4100, data[1], seed, true);
+
+  // A merge must not depend on which side is empty.
+  SoftmaxStat a, b;
+  b.add(3.0f);
+  a.merge(b);
+  b.merge(SoftmaxStat{});
+  if (a.max != 3.0f || a.sum != 1.0f || b.max != 3.0f || b.sum != 1.0f)
+    fail("softmax merge with an empty side");
+  WelfordStat w, v;
+  v.add(2.0f);
+  v.add(4.0f);
+  w.merge(v);
+  if (w.n != 2.0f || w.mean != 3.0f || w.m2 != 2.0f)
+    fail("Welford merge into an empty side");
+
+  if (ok)
+    std::cout << "Row norm check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
@@ -5,6 +5,7 @@
 #include <cstdlib>
 
 #include <chrono>
+#include <functional>
 
 #include <thrust/device_vector.h>
 #include <thrust/host_vector.h>
@@ -24,8 +25,12 @@
 #include "cutlass/detail/layout.hpp"
 
 #include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
 #include "shared_storage.h"
 #include "smem_helper.hpp"
+#include "static_shapes.hpp"
+#include "verify_gpu.hpp"
 
 template <class Element, class SmemFragmentTensor>
 CUTLASS_DEVICE void scaleTensor(Element scale,
@@ -96,12 +101,6 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   Tensor sS =
       make_tensor(make_smem_ptr(shared_storage.smem.data()), smemLayout);
 
-  // Get mbarrier object and its value type
-  auto &mbarrier = shared_storage.mbarrier;
-  using BarrierType = cutlass::arch::ClusterTransactionBarrier::ValueType;
-  static_assert(cute::is_same_v<BarrierType, uint64_t>,
-                "Value type of mbarrier is uint64_t.");
-
   // Constants used for TMA
   const int warp_idx = cutlass::canonical_warp_idx_sync();
   const bool lane_predicate = cute::elect_one_sync();
@@ -121,15 +120,21 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
 
   auto cta_tmaS = tmaLoad.get_slice(Int<0>{});
 
+  using Pipeline = cfx::TmaPipeline<1>;
+  Pipeline pipeline(shared_storage.pipeline, {kTmaTransactionBytes},
+                    warp_idx == 0 and lane_predicate);
+  typename Pipeline::State state;
+
+  cfk::utils::grid_dependency_wait();
   if (warp_idx == 0 and lane_predicate) {
-    mbarrier.init(1 /* arrive count */);
-    mbarrier.arrive_and_expect_tx(kTmaTransactionBytes);
-    copy(tmaLoad.with(reinterpret_cast<BarrierType &>(mbarrier)),
+    pipeline.producer_acquire(state);
+    copy(tmaLoad.with(pipeline.producer_barrier(state)),
          cta_tmaS.partition_S(gS), cta_tmaS.partition_D(sS));
   }
   __syncthreads();
+  cfk::utils::launch_dependent_grids();
 
-  mbarrier.wait(0 /* phase */);
+  pipeline.consumer_wait(state);
 
   auto tSsS = local_partition(sS, threadLayout, threadIdx.x);
   scaleTensor(scale, tSsS);
@@ -150,29 +155,24 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   // cute::tma_store_wait<0>();
 }
 
-template <int TILE_M = 128, int TILE_N = 128, int THREADS = 256>
-int scaleTmaKernelHost(int M, int N, int iterations = 1) {
+template <class Element, int TILE_M, int TILE_N>
+using ScaleSmemLayout = decltype(cute::tile_to_shape(
+    cfx::getSmemLayoutK<Element, TILE_N>(),
+    cute::make_shape(cute::Int<TILE_M>{}, cute::Int<TILE_N>{})));
+
+// A planned scale: the TMA descriptors are encoded and the smem limit set,
+// so calling it only launches scaleTMAKernel with the given factor.
+template <class Element>
+using ScaleTmaLaunch = std::function<cudaError_t(Element)>;
+
+// Plans D = scale * S for an (M, N) shape of runtime ints or of cute::Int
+// extents (static_shapes.hpp).
+template <int TILE_M, int TILE_N, int THREADS, class Element, class Shape>
+ScaleTmaLaunch<Element> scale_tma_plan_shape(Element *in, Element *out,
+                                             Shape const &tensor_shape,
+                                             cudaStream_t stream = 0) {
   using namespace cute;
-
-  using Element = float;
-
-  auto scale = Element(2.0f);
-
-  printf("Scale kernel with TMA load and store\n");
-
-  auto tensor_shape = make_shape(M, N);
-
-  // Allocate and initialize
-  thrust::host_vector<Element> h_S(size(tensor_shape)); // (M, N)
-  thrust::host_vector<Element> h_D(size(tensor_shape)); // (M, N)
-
-  for (size_t i = 0; i < h_S.size(); ++i) {
-    auto x = float(i) / 1000.0f;
-    h_S[i] = static_cast<Element>(x);
-  }
-
-  thrust::device_vector<Element> d_S = h_S;
-  thrust::device_vector<Element> d_D = h_D;
+  int const M = int(get<0>(tensor_shape)), N = int(get<1>(tensor_shape));
 
   //
   // Make tensors
@@ -180,18 +180,15 @@ int scaleTmaKernelHost(int M, int N, int iterations = 1) {
 
   auto gmemLayoutS = make_layout(tensor_shape, LayoutRight{});
   auto gmemLayoutD = make_layout(tensor_shape, LayoutRight{});
-  Tensor tensor_S = make_tensor(
-      make_gmem_ptr(thrust::raw_pointer_cast(d_S.data())), gmemLayoutS);
-  Tensor tensor_D = make_tensor(
-      make_gmem_ptr(thrust::raw_pointer_cast(d_D.data())), gmemLayoutD);
+  Tensor tensor_S = make_tensor(make_gmem_ptr(in), gmemLayoutS);
+  Tensor tensor_D = make_tensor(make_gmem_ptr(out), gmemLayoutD);
 
   using bM = Int<TILE_M>;
   using bN = Int<TILE_N>;
 
   auto tileShape = make_shape(bM{}, bN{});
   // NOTE: same smem layout for TMA load and store
-  auto smemLayout =
-      tile_to_shape(cfx::getSmemLayoutK<Element, TILE_N>(), tileShape);
+  auto smemLayout = ScaleSmemLayout<Element, TILE_M, TILE_N>{};
   auto tma_load =
       make_tma_copy(SM90_TMA_LOAD{}, tensor_S, smemLayout, tileShape, Int<1>{});
 
@@ -209,23 +206,133 @@ int scaleTmaKernelHost(int M, int N, int iterations = 1) {
   dim3 blockDim(THREADS);
 
   int smem_size = int(sizeof(SharedStorageTMA<Element, decltype(smemLayout)>));
-  printf("smem size: %d.\n", smem_size);
-
   void const *kernel =
       (void const *)scaleTMAKernel<THREADS, Element, decltype(params)>;
   cfk::utils::set_smem_size(smem_size, kernel);
 
-  dim3 cluster_dims(1);
+  cfk::utils::LaunchConfig launch_config{gridDim, blockDim, dim3(1), smem_size,
+                                         stream};
+  return [=](Element scale) {
+    cfk::utils::ScopedRange range("scaleTMAKernel",
+                                  cfk::utils::dtype_name<Element>(), {M, N});
+    return cfk::utils::launch(kernel, launch_config, scale, params);
+  };
+}
+
+// Plans and launches in one call, encoding the descriptors every time.
+template <int TILE_M, int TILE_N, int THREADS, class Element, class Shape>
+cudaError_t scale_tma_shape(Element scale, Element *in, Element *out,
+                            Shape const &tensor_shape,
+                            cudaStream_t stream = 0) {
+  return scale_tma_plan_shape<TILE_M, TILE_N, THREADS>(in, out, tensor_shape,
+                                                       stream)(scale);
+}
+
+template <class Element, int TILE_M = 128, int TILE_N = 128,
+          int THREADS = 256>
+ScaleTmaLaunch<Element> scale_tma_plan(Element *in, Element *out, int M,
+                                       int N) {
+  return scale_tma_plan_shape<TILE_M, TILE_N, THREADS>(in, out,
+                                                       cute::make_shape(M, N));
+}
+
+template <class Element, int TILE_M = 128, int TILE_N = 128,
+          int THREADS = 256>
+cudaError_t scale_tma(Element scale, Element *in, Element *out, int M, int N) {
+  return scale_tma_plan<Element, TILE_M, TILE_N, THREADS>(in, out, M, N)(
+      scale);
+}
 
-  // Define the cluster launch parameter structure.
-  cutlass::ClusterLaunchParams launch_params{gridDim, blockDim, cluster_dims,
-                                             smem_size};
+// scale_tma for the one shape (M, N). TMA clips partial tiles, so every
+// shape can be specialized. Another shape plans a launch that returns
+// cudaErrorInvalidValue.
+template <class Element, int M, int N, int TILE_M = 128, int TILE_N = 128,
+          int THREADS = 256>
+ScaleTmaLaunch<Element> scale_tma_static_plan(Element *in, Element *out,
+                                              int m, int n) {
+  if (m != M || n != N)
+    return [](Element) { return cudaErrorInvalidValue; };
+  return scale_tma_plan_shape<TILE_M, TILE_N, THREADS>(
+      in, out, cute::make_shape(cute::Int<M>{}, cute::Int<N>{}));
+}
+
+template <class Element, int M, int N, int TILE_M = 128, int TILE_N = 128,
+          int THREADS = 256>
+cudaError_t scale_tma_static(Element scale, Element *in, Element *out, int m,
+                             int n) {
+  return scale_tma_static_plan<Element, M, N, TILE_M, TILE_N, THREADS>(
+      in, out, m, n)(scale);
+}
+
+// scale_tma_static_plan for the shapes of the manifest, scale_tma_plan for
+// the rest.
+template <class Element, class Manifest = cfk::utils::Llama7BShapes,
+          int TILE_M = 128, int TILE_N = 128, int THREADS = 256>
+ScaleTmaLaunch<Element> scale_tma_dispatch_plan(Element *in, Element *out,
+                                                int M, int N) {
+  using Fn = ScaleTmaLaunch<Element> (*)(Element *, Element *, int, int);
+  static cfk::utils::ShapeRegistry<Fn> const registry = [] {
+    cfk::utils::ShapeRegistry<Fn> r;
+    cfk::utils::register_shapes(r, Manifest{}, [](auto e) -> Fn {
+      using E = decltype(e);
+      return &scale_tma_static_plan<Element, E::m, E::n, TILE_M, TILE_N,
+                                    THREADS>;
+    });
+    return r;
+  }();
+  return registry.dispatch(
+      {M, N}, &scale_tma_plan<Element, TILE_M, TILE_N, THREADS>)(in, out, M,
+                                                                 N);
+}
+
+template <class Element, class Manifest = cfk::utils::Llama7BShapes,
+          int TILE_M = 128, int TILE_N = 128, int THREADS = 256>
+cudaError_t scale_tma_dispatch(Element scale, Element *in, Element *out,
+                               int M, int N) {
+  return scale_tma_dispatch_plan<Element, Manifest, TILE_M, TILE_N, THREADS>(
+      in, out, M, N)(scale);
+}
+
+// With specialize, manifest shapes run their static-shape instantiation.
+template <int TILE_M = 128, int TILE_N = 128, int THREADS = 256>
+int scaleTmaKernelHost(int M, int N, int iterations = 1,
+                       bool specialize = false) {
+  using namespace cute;
+
+  using Element = float;
+
+  auto scale = Element(2.0f);
+
+  printf("Scale kernel with TMA load and store%s\n",
+         specialize ? ", static shapes" : "");
+
+  auto tensor_shape = make_shape(M, N);
+
+  // Allocate and initialize on the device
+  thrust::device_vector<Element> d_S(size(tensor_shape)); // (M, N)
+  thrust::device_vector<Element> d_D(size(tensor_shape)); // (M, N)
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
+
+  int smem_size = int(sizeof(
+      SharedStorageTMA<Element, ScaleSmemLayout<Element, TILE_M, TILE_N>>));
+  printf("smem size: %d.\n", smem_size);
+
+  // Descriptors and smem limit are set up once; the trials time launches.
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+  ScaleTmaLaunch<Element> run =
+      specialize ? scale_tma_dispatch_plan<Element, cfk::utils::Llama7BShapes,
+                                           TILE_M, TILE_N, THREADS>(S, D, M, N)
+                 : scale_tma_plan<Element, TILE_M, TILE_N, THREADS>(S, D, M, N);
 
   for (int i = 0; i < iterations; i++) {
     auto t1 = std::chrono::high_resolution_clock::now();
-    cutlass::Status status =
-        cutlass::launch_kernel_on_cluster(launch_params, kernel, scale, params);
-    cudaError result = cudaDeviceSynchronize();
+    cudaError result = run(scale);
+    if (result == cudaSuccess)
+      result = cudaDeviceSynchronize();
     auto t2 = std::chrono::high_resolution_clock::now();
     if (result != cudaSuccess) {
       std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
@@ -235,7 +342,9 @@ int scaleTmaKernelHost(int M, int N, int iterations = 1) {
     std::chrono::duration<double, std::milli> tDiff = t2 - t1;
     double time_ms = tDiff.count();
     std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
-              << 2e-6 * M * N * sizeof(Element) / time_ms << " GB/s)"
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     2e-6 * M * N * sizeof(Element) / time_ms)
+              << ")"
               << std::endl;
   }
 
@@ -243,18 +352,10 @@ int scaleTmaKernelHost(int M, int N, int iterations = 1) {
   // Verify
   //
 
-  h_D = d_D;
-
-  int good = 0, bad = 0;
-
-  for (size_t i = 0; i < h_D.size(); ++i) {
-    if (h_D[i] == scale * h_S[i])
-      good++;
-    else
-      bad++;
-  }
-
-  std::cout << "Success " << good << ", Fail " << bad << std::endl;
+  auto report = cfk::utils::verify_on_device(
+      thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+      cfk::utils::ExpectScale<Element>{seed, scale});
+  cfk::utils::print_verify_report(std::cout, report, N);
 
   return 0;
 }
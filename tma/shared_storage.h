@@ -2,10 +2,14 @@
 
 #include "cutlass/detail/layout.hpp"
 
-template <class Element, class SmemLayout> struct SharedStorageTMA {
-  cute::array_aligned<Element, cute::cosize_v<SmemLayout>,
+#include "pipeline.hpp"
+
+// kStages copies of a SmemLayout tile plus the pipeline barriers guarding
+// them.
+template <class Element, class SmemLayout, int kStages = 1>
+struct SharedStorageTMA {
+  cute::array_aligned<Element, cute::cosize_v<SmemLayout> * kStages,
                       cutlass::detail::alignment_for_swizzle(SmemLayout{})>
       smem;
-  // alignas(16) uint64_t tma_load_mbar[1];
-  cutlass::arch::ClusterTransactionBarrier mbarrier;
+  typename cfx::TmaPipeline<kStages>::SharedStorage pipeline;
 };
\ No newline at end of file
@@ -0,0 +1,193 @@
+#pragma once
+
+// Raw 2D TMA: host encoding of row-major tensor maps, loads, L2 prefetches,
+// stores and reduce-stores through a descriptor pointer, descriptor-less 1D
+// bulk copies, and device-side descriptor updates (sm_90a, CUDA 12.3+).
+//
+// A kernel that needs many similar descriptors copies a template into
+// shared memory, patches the fields that differ (base address, extents,
+// strides) with tensormap.replace, and publishes the result to a global
+// slot with tensormap.cp_fenceproxy. After an acquire fence on that slot
+// the TMA unit can use it. Descriptors must be 128-byte aligned in both
+// memories.
+
+#include <cstdint>
+
+#include <cuda.h>
+
+#include <cute/arch/copy_sm90_desc.hpp>
+#include <cute/arch/util.hpp>
+#include <cutlass/arch/barrier.h>
+
+#include "reduce_op.hpp"
+
+namespace cfx {
+
+// Row-major (rows, cols) map over `base` with box_rows x box_cols boxes.
+// Rows are `ld` elements apart, cols unless given (a column window of a
+// wider tensor).
+template <class Element>
+CUresult make_tensor_map_2d(CUtensorMap *map, Element const *base,
+                            uint64_t rows, uint64_t cols, uint32_t box_rows,
+                            uint32_t box_cols, uint64_t ld = 0) {
+  cuuint64_t dims[2] = {cols, rows};
+  cuuint64_t strides[1] = {(ld ? ld : cols) * sizeof(Element)};
+  cuuint32_t box[2] = {box_cols, box_rows};
+  cuuint32_t elem_strides[2] = {1, 1};
+  return cuTensorMapEncodeTiled(
+      map, cute::TMA::to_CUtensorMapDataType<Element>(), 2,
+      const_cast<Element *>(base), dims, strides, box, elem_strides,
+      CU_TENSOR_MAP_INTERLEAVE_NONE, CU_TENSOR_MAP_SWIZZLE_NONE,
+      CU_TENSOR_MAP_L2_PROMOTION_L2_128B, CU_TENSOR_MAP_FLOAT_OOB_FILL_NONE);
+}
+
+#if defined(__CUDACC__)
+
+CUTLASS_DEVICE uint32_t smem_addr(void const *p) {
+  return cute::cast_smem_ptr_to_uint(p);
+}
+
+CUTLASS_DEVICE void tensormap_replace_global_address(CUtensorMap *smem_desc,
+                                                     void const *ptr) {
+  asm volatile(
+      "tensormap.replace.tile.global_address.shared::cta.b1024.b64 [%0], %1;"
+      ::"r"(smem_addr(smem_desc)), "l"(ptr)
+      : "memory");
+}
+
+// Extent of dimension kDim (0 is the innermost).
+template <int kDim>
+CUTLASS_DEVICE void tensormap_replace_global_dim(CUtensorMap *smem_desc,
+                                                 uint32_t extent) {
+  asm volatile(
+      "tensormap.replace.tile.global_dim.shared::cta.b1024.b32 [%0], %1, %2;"
+      ::"r"(smem_addr(smem_desc)), "n"(kDim), "r"(extent)
+      : "memory");
+}
+
+// Byte stride of dimension kDim + 1. Same version gate as CuTe's
+// tma_descriptor_replace_dims_strides_in_shared_mem: after CUDA 12.3 the
+// operand is the stride in units of 16 bytes.
+template <int kDim>
+CUTLASS_DEVICE void tensormap_replace_global_stride(CUtensorMap *smem_desc,
+                                                    uint64_t stride_bytes) {
+#if ((__CUDACC_VER_MAJOR__ > 12) ||                                            \
+     ((__CUDACC_VER_MAJOR__ == 12) && (__CUDACC_VER_MINOR__ > 3)))
+  // 4 LSBs are not included
+  stride_bytes >>= 4;
+#endif
+  asm volatile(
+      "tensormap.replace.tile.global_stride.shared::cta.b1024.b64 [%0], %1, "
+      "%2;" ::"r"(smem_addr(smem_desc)),
+      "n"(kDim), "l"(stride_bytes)
+      : "memory");
+}
+
+// Copy a patched descriptor from smem to global and release it to the TMA
+// unit. Must be executed by a whole warp.
+CUTLASS_DEVICE void tensormap_cp_fence_release(CUtensorMap *gmem_desc,
+                                               CUtensorMap const *smem_desc) {
+  asm volatile("tensormap.cp_fenceproxy.global.shared::cta.tensormap::"
+               "generic.release.gpu.sync.aligned [%0], [%1], 128;" ::"l"(
+                   gmem_desc),
+               "r"(smem_addr(smem_desc))
+               : "memory");
+}
+
+// Make a released descriptor visible to this thread's TMA operations.
+CUTLASS_DEVICE void tensormap_fence_acquire(CUtensorMap const *gmem_desc) {
+  asm volatile(
+      "fence.proxy.tensormap::generic.acquire.gpu [%0], 128;" ::"l"(gmem_desc)
+      : "memory");
+}
+
+// 2D TMA load of the box at (c0, c1), c0 innermost, completing on mbar.
+CUTLASS_DEVICE void tma_load_2d(CUtensorMap const *desc,
+                                cutlass::arch::ClusterTransactionBarrier &mbar,
+                                void *smem, int32_t c0, int32_t c1) {
+  asm volatile("cp.async.bulk.tensor.2d.shared::cluster.global.mbarrier::"
+               "complete_tx::bytes [%0], [%1, {%3, %4}], [%2];" ::"r"(
+                   smem_addr(smem)),
+               "l"(desc), "r"(smem_addr(&mbar)), "r"(c0), "r"(c1)
+               : "memory");
+}
+
+// Pull the box at (c0, c1) into L2. Nothing lands in smem and nothing
+// signals completion; the load is a hint.
+CUTLASS_DEVICE void tma_prefetch_2d(CUtensorMap const *desc, int32_t c0,
+                                    int32_t c1) {
+  asm volatile(
+      "cp.async.bulk.prefetch.tensor.2d.L2.global.tile [%0, {%1, %2}];" ::"l"(
+          desc),
+      "r"(c0), "r"(c1)
+      : "memory");
+}
+
+// 2D TMA store of the box at (c0, c1) as part of a bulk group.
+CUTLASS_DEVICE void tma_store_2d(CUtensorMap const *desc, void const *smem,
+                                 int32_t c0, int32_t c1) {
+  asm volatile("cp.async.bulk.tensor.2d.global.shared::cta.bulk_group "
+               "[%0, {%2, %3}], [%1];" ::"l"(desc),
+               "r"(smem_addr(smem)), "r"(c0), "r"(c1)
+               : "memory");
+}
+
+// 2D TMA reduce-store: global = op(global, smem), applied in L2. The
+// element type comes from the descriptor; f32 supports add only.
+template <ReduceOp kOp>
+CUTLASS_DEVICE void tma_reduce_2d(CUtensorMap const *desc, void const *smem,
+                                  int32_t c0, int32_t c1) {
+  if constexpr (kOp == ReduceOp::Add)
+    asm volatile("cp.reduce.async.bulk.tensor.2d.global.shared::cta.add.tile."
+                 "bulk_group [%0, {%2, %3}], [%1];" ::"l"(desc),
+                 "r"(smem_addr(smem)), "r"(c0), "r"(c1)
+                 : "memory");
+  else if constexpr (kOp == ReduceOp::Min)
+    asm volatile("cp.reduce.async.bulk.tensor.2d.global.shared::cta.min.tile."
+                 "bulk_group [%0, {%2, %3}], [%1];" ::"l"(desc),
+                 "r"(smem_addr(smem)), "r"(c0), "r"(c1)
+                 : "memory");
+  else
+    asm volatile("cp.reduce.async.bulk.tensor.2d.global.shared::cta.max.tile."
+                 "bulk_group [%0, {%2, %3}], [%1];" ::"l"(desc),
+                 "r"(smem_addr(smem)), "r"(c0), "r"(c1)
+                 : "memory");
+}
+
+// 1D bulk copies without a descriptor: `bytes`, the addresses and the
+// global offset must all be multiples of 16. The load completes on mbar.
+CUTLASS_DEVICE void
+bulk_load_1d(cutlass::arch::ClusterTransactionBarrier &mbar, void *smem,
+             void const *gmem, uint32_t bytes) {
+  asm volatile("cp.async.bulk.shared::cluster.global.mbarrier::complete_tx::"
+               "bytes [%0], [%1], %2, [%3];" ::"r"(smem_addr(smem)),
+               "l"(gmem), "r"(bytes), "r"(smem_addr(&mbar))
+               : "memory");
+}
+
+// 1D bulk store as part of a bulk group.
+CUTLASS_DEVICE void bulk_store_1d(void *gmem, void const *smem,
+                                  uint32_t bytes) {
+  asm volatile("cp.async.bulk.global.shared::cta.bulk_group [%0], [%1], %2;"
+               ::"l"(gmem), "r"(smem_addr(smem)), "r"(bytes)
+               : "memory");
+}
+
+CUTLASS_DEVICE void tma_store_commit() {
+  asm volatile("cp.async.bulk.commit_group;" ::: "memory");
+}
+
+// Wait until committed stores have finished reading smem.
+CUTLASS_DEVICE void tma_store_wait_read() {
+  asm volatile("cp.async.bulk.wait_group.read 0;" ::: "memory");
+}
+
+// Wait until committed stores are complete, e.g. before their descriptor
+// is overwritten.
+CUTLASS_DEVICE void tma_store_wait_all() {
+  asm volatile("cp.async.bulk.wait_group 0;" ::: "memory");
+}
+
+#endif // __CUDACC__
+
+} // namespace cfx
@@ -24,8 +24,12 @@
 #include "cutlass/detail/layout.hpp"
 
 #include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
 #include "shared_storage.h"
 #include "smem_helper.hpp"
+#include "trace.h"
+#include "verify_gpu.hpp"
 
 template <typename _TiledCopyS, typename _TiledCopyD, typename _GmemLayout,
           typename _SmemLayout, typename _TileShape>
@@ -77,16 +81,6 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   Tensor sS =
       make_tensor(make_smem_ptr(shared_storage.smem.data()), smemLayout);
 
-  // Get mbarrier object and its value type
-
-  // EA: This mbarrier is of type `cutlass::arch::Cluster Transaction Barrier`,
-  // and note it inherits from `Cluster Barrier`, which notably is where the
-  // `wait` method lives.
-  auto &mbarrier = shared_storage.mbarrier;
-  using BarrierType = cutlass::arch::ClusterTransactionBarrier::ValueType;
-  static_assert(cute::is_same_v<BarrierType, uint64_t>,
-                "Value type of mbarrier is uint64_t.");
-
   // Constants used for TMA
   const int warp_idx = cutlass::canonical_warp_idx_sync();
   const bool lane_predicate = cute::elect_one_sync();
@@ -109,17 +103,28 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
 
   auto cta_tmaS = tmaLoad.get_slice(Int<0>{});
 
+  // One stage, one tile: the pipeline's mbarriers are of type
+  // `cutlass::arch::ClusterTransactionBarrier`.
+  using Pipeline = cfx::TmaPipeline<1>;
+  Pipeline pipeline(shared_storage.pipeline, {kTmaTransactionBytes},
+                    warp_idx == 0 and lane_predicate);
+  typename Pipeline::State state;
+
+  // Everything above overlaps the previous kernel under PDL; the load may
+  // read what it wrote.
+  cfk::utils::grid_dependency_wait();
+
   if (warp_idx == 0 and lane_predicate) {
-    mbarrier.init(1 /* arrive count */);
     // EA: So the next line arrives and sets the number of expected bytes
-    mbarrier.arrive_and_expect_tx(kTmaTransactionBytes);
+    pipeline.producer_acquire(state);
+    CFX_TRACE_EVENT(true, TmaIssue);
     // EA: In the Copy_Traits for `SM90 TMA LOAD` it says:
     // "The non-executable SM90_TMA_LOAD with tma_desc and no tma_mbar
     // Use .with(tma_mbar) to construct an executable version"
     // EA: Note `with` returns:
     // Copy_Traits<SM90_TMA_LOAD_OP, NumBitsPerTMA>
     // (Note the `_OP` at the end)
-    copy(tmaLoad.with(reinterpret_cast<BarrierType &>(mbarrier)),
+    copy(tmaLoad.with(pipeline.producer_barrier(state)),
          cta_tmaS.partition_S(gS), cta_tmaS.partition_D(sS));
     // EA: So that's a little bit of a different API for `copy` than I'm used
     // to...giving the op, then a source layout and a destination layout. I
@@ -127,8 +132,10 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
     // itself, right?
   }
   __syncthreads();
+  cfk::utils::launch_dependent_grids();
 
-  mbarrier.wait(0 /* phase */);
+  pipeline.consumer_wait(state);
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, BarrierComplete);
   // EA: Oh, interesting, I don't think I'd clocked that the barrier itself
   // comes with a phase
   
@@ -144,11 +151,15 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   auto cta_tmaD = tmaStore.get_slice(Int<0>{});
 
   if (warp_idx == 0 and lane_predicate) {
+    CFX_TRACE_EVENT(true, StoreIssue);
     cute::copy(tmaStore, cta_tmaD.partition_S(sS), cta_tmaD.partition_D(gD));
     // EA: Interesting that here they qualify `copy` with `cute`, but not above.
-    // cute::tma_store_arrive();
+    cute::tma_store_arrive();
+    // Wait for the store to read out smem before the CTA exits, so that
+    // StoreCommitted closes the tma_store span at its completion.
+    cute::tma_store_wait<0>();
+    CFX_TRACE_EVENT(true, StoreCommitted);
   }
-  // cute::tma_store_wait<0>();
 }
 
 // EA: I'm not sure I need these to be in all caps
@@ -165,15 +176,13 @@ int copy_host_tma_load_and_store_kernel(int M, int N, int iterations = 1) {
   auto tensor_shape = make_shape(M, N);
   // EA: M vs TILE_M
 
-  // Allocate and initialize
-  thrust::host_vector<Element> h_S(size(tensor_shape)); // (M, N)
-  thrust::host_vector<Element> h_D(size(tensor_shape)); // (M, N)
-
-  for (size_t i = 0; i < h_S.size(); ++i)
-    h_S[i] = static_cast<Element>(float(i));
+  // Allocate and initialize on the device
+  thrust::device_vector<Element> d_S(size(tensor_shape)); // (M, N)
+  thrust::device_vector<Element> d_D(size(tensor_shape)); // (M, N)
 
-  thrust::device_vector<Element> d_S = h_S;
-  thrust::device_vector<Element> d_D = h_D;
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
 
   //
   // Make tensors
@@ -213,16 +222,18 @@ int copy_host_tma_load_and_store_kernel(int M, int N, int iterations = 1) {
       (void const *)copyTMAKernel<THREADS, Element, decltype(params)>;
   cfk::utils::set_smem_size(smem_size, kernel);
 
-  dim3 cluster_dims(1);
+  cfk::utils::LaunchConfig launch_config{gridDim, blockDim, dim3(1),
+                                         smem_size};
 
-  // Define the cluster launch parameter structure.
-  cutlass::ClusterLaunchParams launch_params{gridDim, blockDim, cluster_dims,
-                                             smem_size};
+#if defined(CFX_ENABLE_TMA_TRACE)
+  cfx::TraceSession trace;
+#endif
 
   for (int i = 0; i < iterations; i++) {
     auto t1 = std::chrono::high_resolution_clock::now();    
-    cutlass::Status status =
-        cutlass::launch_kernel_on_cluster(launch_params, kernel, params);
+    cfk::utils::ScopedRange range("copyTMAKernel",
+                                  cfk::utils::dtype_name<Element>(), {M, N});
+    cfk::utils::launch(kernel, launch_config, params);
     cudaError result = cudaDeviceSynchronize();
     auto t2 = std::chrono::high_resolution_clock::now();
     if (result != cudaSuccess) {
@@ -233,26 +244,164 @@ int copy_host_tma_load_and_store_kernel(int M, int N, int iterations = 1) {
     std::chrono::duration<double, std::milli> tDiff = t2 - t1;
     double time_ms = tDiff.count();
     std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
-              << 2e-6 * M * N * sizeof(Element) / time_ms << " GB/s)"
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     2e-6 * M * N * sizeof(Element) / time_ms)
+              << ")"
               << std::endl;
   }
 
+#if defined(CFX_ENABLE_TMA_TRACE)
+  trace.report("trace_copy.json");
+#endif
+
   //
   // Verify
   //
 
-  h_D = d_D;
+  auto report = cfk::utils::verify_on_device(
+      thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+      cfk::utils::ExpectIdentity<Element>{seed});
+  cfk::utils::print_verify_report(std::cout, report, N);
+
+  return 0;
+}
+
+// Persistent copy on a kStages pipeline: one elected thread per CTA runs
+// cfx::persistent_tma_loop with CuTe TMA copies.
+template <int kNumThreads, int kStages, class Element, class Params>
+__global__ static void __launch_bounds__(kNumThreads, 1)
+    copyTMAKernelPipelined(CUTE_GRID_CONSTANT Params const params) {
+  using namespace cute;
+
+  using SmemLayout = typename Params::SmemLayout;
+
+  auto &tmaLoad = params.tmaLoad;
+  auto &tmaStore = params.tmaStore;
+  auto &gmemLayout = params.gmemLayout;
+  auto &smemLayout = params.smemLayout;
+  auto &tileShape = params.tileShape;
+
+  extern __shared__ char shared_memory[];
+  using SharedStorage = SharedStorageTMA<Element, SmemLayout, kStages>;
+  SharedStorage &shared_storage =
+      *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  const int warp_idx = cutlass::canonical_warp_idx_sync();
+  const bool lane_predicate = cute::elect_one_sync();
+  constexpr int kTmaTransactionBytes =
+      sizeof(ArrayEngine<Element, size(SmemLayout{})>);
+
+  using Pipeline = cfx::TmaPipeline<kStages>;
+  Pipeline pipeline(shared_storage.pipeline, {kTmaTransactionBytes},
+                    warp_idx == 0 and lane_predicate);
+  __syncthreads();
+  if (!(warp_idx == 0 and lane_predicate))
+    return;
+
+  prefetch_tma_descriptor(tmaLoad.get_tma_descriptor());
+  prefetch_tma_descriptor(tmaStore.get_tma_descriptor());
+  cfk::utils::grid_dependency_wait();
+
+  Tensor mS = tmaLoad.get_tma_tensor(shape(gmemLayout));
+  Tensor mD = tmaStore.get_tma_tensor(shape(gmemLayout));
+  int const tiles_m = ceil_div(int(size<0>(gmemLayout)), size<0>(tileShape));
+  int const tiles = tiles_m * ceil_div(int(size<1>(gmemLayout)),
+                                       size<1>(tileShape));
+  auto cta_tmaS = tmaLoad.get_slice(Int<0>{});
+  auto cta_tmaD = tmaStore.get_slice(Int<0>{});
+  auto stage = [&](int s) {
+    return make_tensor(make_smem_ptr(shared_storage.smem.data() +
+                                     s * cosize(smemLayout)),
+                       smemLayout);
+  };
+  auto tile = [&](auto &m, int t) {
+    return local_tile(m, tileShape, make_coord(t % tiles_m, t / tiles_m));
+  };
+
+  cfx::persistent_tma_loop(
+      pipeline, tiles,
+      [&](int t, typename Pipeline::State const &state) {
+        copy(tmaLoad.with(pipeline.producer_barrier(state)),
+             cta_tmaS.partition_S(tile(mS, t)),
+             cta_tmaS.partition_D(stage(state.index)));
+      },
+      [&](int t, int s) {
+        copy(tmaStore, cta_tmaD.partition_S(stage(s)),
+             cta_tmaD.partition_D(tile(mD, t)));
+      },
+      [] { cfk::utils::launch_dependent_grids(); });
+}
+
+template <int kStages = 4, int TILE_M = 64, int TILE_N = 128,
+          int THREADS = 32>
+int copy_host_tma_pipelined(int M, int N, int iterations = 1) {
+  using namespace cute;
+
+  printf("Persistent copy with a %d-stage TMA pipeline.\n", kStages);
+
+  using Element = float;
 
-  int good = 0, bad = 0;
+  auto tensor_shape = make_shape(M, N);
+  thrust::device_vector<Element> d_S(size(tensor_shape)); // (M, N)
+  thrust::device_vector<Element> d_D(size(tensor_shape)); // (M, N)
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
+
+  auto gmemLayout = make_layout(tensor_shape, LayoutRight{});
+  Tensor tensor_S = make_tensor(
+      make_gmem_ptr(thrust::raw_pointer_cast(d_S.data())), gmemLayout);
+  Tensor tensor_D = make_tensor(
+      make_gmem_ptr(thrust::raw_pointer_cast(d_D.data())), gmemLayout);
+
+  auto tileShape = make_shape(Int<TILE_M>{}, Int<TILE_N>{});
+  auto smemLayout = make_layout(tileShape, LayoutRight{});
+  Params params(make_tma_copy(SM90_TMA_LOAD{}, tensor_S, smemLayout),
+                make_tma_copy(SM90_TMA_STORE{}, tensor_D, smemLayout),
+                gmemLayout, smemLayout, tileShape);
+
+  int sms = 0;
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, 0);
+  int const tiles = ceil_div(M, TILE_M) * ceil_div(N, TILE_N);
+  dim3 gridDim(std::min(tiles, sms));
+  dim3 blockDim(THREADS);
 
-  for (size_t i = 0; i < h_D.size(); ++i) {
-    if (h_D[i] == h_S[i])
-      good++;
-    else
-      bad++;
+  int smem_size = int(
+      sizeof(SharedStorageTMA<Element, decltype(smemLayout), kStages>));
+  printf("smem size: %d.\n", smem_size);
+
+  void const *kernel = (void const *)
+      copyTMAKernelPipelined<THREADS, kStages, Element, decltype(params)>;
+  cfk::utils::set_smem_size(smem_size, kernel);
+
+  cfk::utils::LaunchConfig launch_config{gridDim, blockDim, dim3(1),
+                                         smem_size};
+
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    cfk::utils::ScopedRange range("copyTMAKernelPipelined",
+                                  cfk::utils::dtype_name<Element>(), {M, N});
+    cfk::utils::launch(kernel, launch_config, params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     2e-6 * M * N * sizeof(Element) / time_ms)
+              << ")" << std::endl;
   }
 
-  std::cout << "Success " << good << ", Fail " << bad << std::endl;
+  auto report = cfk::utils::verify_on_device(
+      thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+      cfk::utils::ExpectIdentity<Element>{seed});
+  cfk::utils::print_verify_report(std::cout, report, N);
 
   return 0;
 }
@@ -24,8 +24,12 @@
 #include "cutlass/detail/layout.hpp"
 
 #include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
 #include "shared_storage.h"
 #include "smem_helper.hpp"
+#include "trace.h"
+#include "verify_gpu.hpp"
 
 template <typename _TiledCopyS, typename _TiledCopyD, typename _GmemLayout,
           typename _GmemLayoutOut, typename _SmemLayout, typename _TileShape,
@@ -95,12 +99,6 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   Tensor sS =
       make_tensor(make_smem_ptr(shared_storage.smem.data()), smemLayout);
 
-  // Get mbarrier object and its value type
-  auto &mbarrier = shared_storage.mbarrier;
-  using BarrierType = cutlass::arch::ClusterTransactionBarrier::ValueType;
-  static_assert(cute::is_same_v<BarrierType, uint64_t>,
-                "Value type of mbarrier is uint64_t.");
-
   // Constants used for TMA
   const int warp_idx = cutlass::canonical_warp_idx_sync();
   const bool lane_predicate = cute::elect_one_sync();
@@ -124,22 +122,30 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   auto tSsSX = cta_tmaS.partition_D(sS);
   auto tSsS = group_modes<1, rank(tSsSX)>(tSsSX);
 
-  if (warp_idx == 0 and lane_predicate) {
-    mbarrier.init(1 /* arrive count */);
-  }
+  // Every CTA receives the whole tile: its own slice plus the slices its
+  // peers multicast into it.
+  using Pipeline = cfx::TmaPipeline<1>;
+  Pipeline pipeline(shared_storage.pipeline,
+                    {kTmaTransactionBytes, 1, tma_mcast_mask},
+                    warp_idx == 0 and lane_predicate);
+  typename Pipeline::State state;
   __syncthreads();
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, ClusterSyncBegin);
   cute::cluster_sync();
-  cutlass::arch::fence_barrier_init();
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, ClusterSyncEnd);
 
+  cfk::utils::grid_dependency_wait();
   if (warp_idx == 0 and lane_predicate) {
-    mbarrier.arrive_and_expect_tx(kTmaTransactionBytes);
-    copy(
-        tmaLoad.with(reinterpret_cast<BarrierType &>(mbarrier), tma_mcast_mask),
-        tSgS(_, 0), tSsS(_, 0));
+    pipeline.producer_acquire(state);
+    CFX_TRACE_EVENT(true, TmaIssue);
+    copy(tmaLoad.with(pipeline.producer_barrier(state), tma_mcast_mask),
+         tSgS(_, 0), tSsS(_, 0));
   }
   __syncthreads();
+  cfk::utils::launch_dependent_grids();
 
-  mbarrier.wait(0 /* phase */);
+  pipeline.consumer_wait(state);
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, BarrierComplete);
 
   cutlass::arch::fence_view_async_shared();
 
@@ -151,11 +157,17 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   auto cta_tmaD = tmaStore.get_slice(Int<0>{});
 
   if (warp_idx == 0 and lane_predicate) {
+    CFX_TRACE_EVENT(true, StoreIssue);
     cute::copy(tmaStore, cta_tmaD.partition_S(sS), cta_tmaD.partition_D(gD));
-    // cute::tma_store_arrive();
+    cute::tma_store_arrive();
+    // Wait for the store to read out smem before the CTA exits, so that
+    // StoreCommitted closes the tma_store span at its completion.
+    cute::tma_store_wait<0>();
+    CFX_TRACE_EVENT(true, StoreCommitted);
   }
-  // cute::tma_store_wait<0>();
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, ClusterSyncBegin);
   cute::cluster_sync();
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, ClusterSyncEnd);
 }
 
 template <int kNumThreads, class Element, class Params>
@@ -189,12 +201,6 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   Tensor sS =
       make_tensor(make_smem_ptr(shared_storage.smem.data()), smemLayout);
 
-  // Get mbarrier object and its value type
-  auto &mbarrier = shared_storage.mbarrier;
-  using BarrierType = cutlass::arch::ClusterTransactionBarrier::ValueType;
-  static_assert(cute::is_same_v<BarrierType, uint64_t>,
-                "Value type of mbarrier is uint64_t.");
-
   // Constants used for TMA
   const int warp_idx = cutlass::canonical_warp_idx_sync();
   const bool lane_predicate = cute::elect_one_sync();
@@ -218,20 +224,24 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   auto tSsSX = cta_tmaS.partition_D(sS);
   auto tSsS = group_modes<1, rank(tSsSX)>(tSsSX);
 
-  if (warp_idx == 0 and lane_predicate) {
-    mbarrier.init(1 /* arrive count */);
-  }
+  using Pipeline = cfx::TmaPipeline<1>;
+  Pipeline pipeline(shared_storage.pipeline, {kTmaTransactionBytes},
+                    warp_idx == 0 and lane_predicate);
+  typename Pipeline::State state;
   __syncthreads();
-  cutlass::arch::fence_barrier_init();
 
+  cfk::utils::grid_dependency_wait();
   if (warp_idx == 0 and lane_predicate) {
-    mbarrier.arrive_and_expect_tx(kTmaTransactionBytes);
-    copy(tmaLoad.with(reinterpret_cast<BarrierType &>(mbarrier)), tSgS(_, 0),
+    pipeline.producer_acquire(state);
+    CFX_TRACE_EVENT(true, TmaIssue);
+    copy(tmaLoad.with(pipeline.producer_barrier(state)), tSgS(_, 0),
          tSsS(_, 0));
   }
   __syncthreads();
+  cfk::utils::launch_dependent_grids();
 
-  mbarrier.wait(0 /* phase */);
+  pipeline.consumer_wait(state);
+  CFX_TRACE_EVENT(warp_idx == 0 and lane_predicate, BarrierComplete);
 
   cutlass::arch::fence_view_async_shared();
 
@@ -243,10 +253,14 @@ __global__ static void __launch_bounds__(kNumThreads, 1)
   auto cta_tmaD = tmaStore.get_slice(Int<0>{});
 
   if (warp_idx == 0 and lane_predicate) {
+    CFX_TRACE_EVENT(true, StoreIssue);
     cute::copy(tmaStore, cta_tmaD.partition_S(sS), cta_tmaD.partition_D(gD));
-    // cute::tma_store_arrive();
+    cute::tma_store_arrive();
+    // Wait for the store to read out smem before the CTA exits, so that
+    // StoreCommitted closes the tma_store span at its completion.
+    cute::tma_store_wait<0>();
+    CFX_TRACE_EVENT(true, StoreCommitted);
   }
-  // cute::tma_store_wait<0>();
 }
 
 template <bool use_multicast = true, int COPYN = 2, int TILE_M = 128,
@@ -270,15 +284,13 @@ int copy_host_tma_load_and_store_kernel_multicast(int M, int N,
   auto tensor_shape = make_shape(M, N);
   auto tensor_shape_out = make_shape(M, N, Int<COPYN>{});
 
-  // Allocate and initialize
-  thrust::host_vector<Element> h_S(size(tensor_shape));     // (M, N)
-  thrust::host_vector<Element> h_D(size(tensor_shape_out)); // (M, N, COPYN)
+  // Allocate and initialize on the device
+  thrust::device_vector<Element> d_S(size(tensor_shape));     // (M, N)
+  thrust::device_vector<Element> d_D(size(tensor_shape_out)); // (M, N, COPYN)
 
-  for (size_t i = 0; i < h_S.size(); ++i)
-    h_S[i] = static_cast<Element>(float(i));
-
-  thrust::device_vector<Element> d_S = h_S;
-  thrust::device_vector<Element> d_D = h_D;
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
 
   //
   // Make tensors
@@ -334,18 +346,23 @@ int copy_host_tma_load_and_store_kernel_multicast(int M, int N,
                                                decltype(params_no_multicast)>;
   cfk::utils::set_smem_size(smem_size, kernel);
 
-  // Define the cluster launch parameter structure.
-  cutlass::ClusterLaunchParams launch_params{gridDim, blockDim, cluster_dims,
-                                             smem_size};
+  cfk::utils::LaunchConfig launch_config{gridDim, blockDim, cluster_dims,
+                                         smem_size};
+
+#if defined(CFX_ENABLE_TMA_TRACE)
+  cfx::TraceSession trace;
+#endif
 
   for (int i = 0; i < iterations; i++) {
     auto t1 = std::chrono::high_resolution_clock::now();
+    cfk::utils::ScopedRange range(use_multicast ? "copyTMAKernelMulticast"
+                                                : "copyTMAKernelNoMulticast",
+                                  cfk::utils::dtype_name<Element>(),
+                                  {M, N, COPYN});
     if constexpr (use_multicast)
-      cutlass::Status status =
-          cutlass::launch_kernel_on_cluster(launch_params, kernel, params);
+      cfk::utils::launch(kernel, launch_config, params);
     else
-      cutlass::Status status = cutlass::launch_kernel_on_cluster(
-          launch_params, kernel, params_no_multicast);
+      cfk::utils::launch(kernel, launch_config, params_no_multicast);
     cudaError result = cudaDeviceSynchronize();
     auto t2 = std::chrono::high_resolution_clock::now();
     if (result != cudaSuccess) {
@@ -356,30 +373,27 @@ int copy_host_tma_load_and_store_kernel_multicast(int M, int N,
     std::chrono::duration<double, std::milli> tDiff = t2 - t1;
     double time_ms = tDiff.count();
     std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
-              << (COPYN + 1) * 1e-6 * M * N * sizeof(Element) / time_ms
-              << " GB/s)" << std::endl;
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     (COPYN + 1) * 1e-6 * M * N * sizeof(Element) / time_ms)
+              << ")" << std::endl;
   }
 
+#if defined(CFX_ENABLE_TMA_TRACE)
+  std::string trace_path = std::string("trace_") +
+                           (use_multicast ? "multicast_" : "no_multicast_") +
+                           std::to_string(COPYN) + ".json";
+  trace.report(trace_path.c_str());
+#endif
+
   //
   // Verify
   //
 
-  h_D = d_D;
-
-  int good = 0, bad = 0;
-
-  int offset = size(tensor_shape);
-
-  for (size_t i = 0; i < h_S.size(); ++i) {
-    for (int j = 0; j < COPYN; ++j) {
-      if (h_D[i + j * offset] == h_S[i])
-        good++;
-      else
-        bad++;
-    }
-  }
-
-  std::cout << "Success " << good << ", Fail " << bad << std::endl;
+  // Output copy j is the (M, N) row-major slab at offset j * M * N.
+  auto report = cfk::utils::verify_on_device(
+      thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+      cfk::utils::ExpectReplicate<Element>{seed, d_S.size()});
+  cfk::utils::print_verify_report(std::cout, report, N);
 
   return 0;
 }
@@ -0,0 +1,216 @@
+#pragma once
+
+// Accumulating copy, dst = op(dst, src), with TMA reduce-stores.
+//
+// Each CTA loads a tile of src with TMA and hands it straight back to the
+// TMA unit as a cp.reduce.async.bulk.tensor, which applies add / min / max
+// to dst in L2. dst never passes through the SM, so the usual three steps
+// (read dst, combine, write dst) collapse into one load and one
+// reduce-store. The driver compares against those three steps done
+// separately: a copy of dst, accumulateKernel, and a copy back.
+// copy_reduce_cpu (reduce_op.hpp) is the CPU reference.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <type_traits>
+
+#include <cuda.h>
+#include <thrust/device_vector.h>
+
+#include <cutlass/arch/barrier.h>
+#include <cutlass/arch/memory_sm90.hpp>
+#include <cutlass/cutlass.h>
+
+#include "cuda_launch.hpp"
+#include "host_trace.hpp"
+#include "huge_pages.hpp"
+#include "peak_gpu.hpp"
+#include "pipeline.hpp"
+#include "reduce_op.hpp"
+#include "tensormap.hpp"
+#include "verify_gpu.hpp"
+
+template <class Element, int kTileM, int kTileN, int kStages>
+struct SharedStorageReduce {
+  alignas(128) Element tile[kStages][kTileM * kTileN];
+  typename cfx::TmaPipeline<kStages>::SharedStorage pipeline;
+};
+
+// One thread per CTA runs cfx::persistent_tma_loop with reduce-stores.
+// Nothing else in the CTA has work, since the data never passes through
+// registers.
+template <class Element, int kTileM, int kTileN, int kStages,
+          cfx::ReduceOp kOp>
+__global__ static void __launch_bounds__(1)
+    reduceTMAKernel(CUTE_GRID_CONSTANT CUtensorMap const load,
+                    CUTE_GRID_CONSTANT CUtensorMap const store, int M,
+                    int N) {
+  extern __shared__ __align__(128) char shared_memory[];
+  using SharedStorage = SharedStorageReduce<Element, kTileM, kTileN, kStages>;
+  SharedStorage &ss = *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  using Pipeline = cfx::TmaPipeline<kStages>;
+  Pipeline pipeline(ss.pipeline, {kTileM * kTileN * sizeof(Element)}, true);
+  __syncthreads();
+  int const tiles_m = (M + kTileM - 1) / kTileM;
+  int const tiles = tiles_m * ((N + kTileN - 1) / kTileN);
+
+  cfx::persistent_tma_loop(
+      pipeline, tiles,
+      [&](int t, typename Pipeline::State const &state) {
+        cfx::tma_load_2d(&load, pipeline.full_barrier(state),
+                         ss.tile[state.index], t / tiles_m * kTileN,
+                         t % tiles_m * kTileM);
+      },
+      [&](int t, int s) {
+        cfx::tma_reduce_2d<kOp>(&store, ss.tile[s], t / tiles_m * kTileN,
+                                t % tiles_m * kTileM);
+      });
+}
+
+// The add step of the unfused baseline: dst = op(dst, src) elementwise.
+template <class Element, cfx::ReduceOp kOp>
+__global__ static void accumulateKernel(Element const *__restrict__ src,
+                                        Element *__restrict__ dst, size_t n) {
+  for (size_t i = blockIdx.x * size_t(blockDim.x) + threadIdx.x; i < n;
+       i += size_t(gridDim.x) * blockDim.x)
+    dst[i] = cfx::reduce_apply<kOp>(dst[i], src[i]);
+}
+
+// dst = op(dst, src) over row-major (M, N) tensors. Rows must be a multiple
+// of 16 bytes. The reduce-store supports f32 for add only; min and max need
+// a 16-bit float or integer type.
+template <cfx::ReduceOp kOp, class Element, int TILE_M = 64, int TILE_N = 128,
+          int kStages = 4>
+cudaError_t copy_reduce(Element const *src, Element *dst, int M, int N,
+                        cudaStream_t stream = 0) {
+  static_assert(kOp == cfx::ReduceOp::Add || !std::is_same_v<Element, float>,
+                "TMA min/max reduce does not support f32");
+  cfk::utils::ScopedRange range("copy_reduce",
+                                cfk::utils::dtype_name<Element>(), {M, N});
+  CUtensorMap load, store;
+  if (cfx::make_tensor_map_2d(&load, src, M, N, TILE_M, TILE_N) !=
+          CUDA_SUCCESS ||
+      cfx::make_tensor_map_2d(&store, dst, M, N, TILE_M, TILE_N) !=
+          CUDA_SUCCESS)
+    return cudaErrorInvalidValue;
+
+  int device = 0, sms = 0;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+  int const tiles = ((M + TILE_M - 1) / TILE_M) * ((N + TILE_N - 1) / TILE_N);
+  int smem_size =
+      int(sizeof(SharedStorageReduce<Element, TILE_M, TILE_N, kStages>));
+  auto kernel = reduceTMAKernel<Element, TILE_M, TILE_N, kStages, kOp>;
+  cfk::utils::set_smem_size(smem_size, (void const *)kernel);
+  kernel<<<std::max(1, std::min(tiles, sms)), 1, smem_size, stream>>>(
+      load, store, M, N);
+  return cudaGetLastError();
+}
+
+// Runtime-op entry point for the Python binding.
+template <class Element>
+cudaError_t copy_reduce(Element const *src, Element *dst, int M, int N,
+                        cfx::ReduceOp op, cudaStream_t stream = 0) {
+  if (op == cfx::ReduceOp::Add)
+    return copy_reduce<cfx::ReduceOp::Add>(src, dst, M, N, stream);
+  if constexpr (std::is_same_v<Element, float>) {
+    return cudaErrorNotSupported;
+  } else {
+    if (op == cfx::ReduceOp::Min)
+      return copy_reduce<cfx::ReduceOp::Min>(src, dst, M, N, stream);
+    return copy_reduce<cfx::ReduceOp::Max>(src, dst, M, N, stream);
+  }
+}
+
+template <class Element, cfx::ReduceOp kOp>
+int copy_reduce_host(int M, int N, int iterations = 1) {
+  using namespace cfx;
+  printf("Accumulating copy (%s) with TMA reduce-store vs. read, add, write "
+         "(%s).\n",
+         reduce_op_name(kOp), cfk::utils::dtype_name<Element>());
+
+  size_t const size = size_t(M) * N;
+  thrust::device_vector<Element> d_S(size);
+  thrust::device_vector<Element> d_D(size);
+  Element *S = thrust::raw_pointer_cast(d_S.data());
+  Element *D = thrust::raw_pointer_cast(d_D.data());
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  uint64_t const seed_dst = seed + 1;
+  cfk::utils::fill_random(S, size, seed);
+
+  int sms = 0;
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, 0);
+
+  // Both variants read src and dst and write dst; the unfused baseline moves
+  // more than this, which its effective bandwidth reflects.
+  double const bytes = 3.0 * size * sizeof(Element);
+  auto run = [&](char const *name, auto &&launch) {
+    printf("%s:\n", name);
+    for (int i = 0; i < iterations; i++) {
+      // dst is reset every trial so the checked result is one application.
+      cfk::utils::fill_random(D, size, seed_dst);
+      cudaDeviceSynchronize();
+      auto t1 = std::chrono::high_resolution_clock::now();
+      cudaError result = launch();
+      if (result == cudaSuccess)
+        result = cudaDeviceSynchronize();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+                << ")" << std::endl;
+    }
+    auto report = cfk::utils::verify_on_device(
+        D, size, ExpectReduce<kOp, Element>{seed, seed_dst});
+    cfk::utils::print_verify_report(std::cout, report, N);
+    return 0;
+  };
+
+  if (run("TMA reduce-store", [&] {
+        return copy_reduce<kOp>(S, D, M, N);
+      }))
+    return -1;
+  // Unfused baseline: read dst into a temporary, combine src into it with
+  // an elementwise kernel, and write the temporary back to dst.
+  thrust::device_vector<Element> d_T(size);
+  Element *T = thrust::raw_pointer_cast(d_T.data());
+  if (run("Read, add kernel, write", [&] {
+        cfk::utils::ScopedRange range("accumulateKernel",
+                                      cfk::utils::dtype_name<Element>(),
+                                      {M, N});
+        cudaMemcpyAsync(T, D, size * sizeof(Element),
+                        cudaMemcpyDeviceToDevice);
+        accumulateKernel<Element, kOp><<<4 * sms, 256>>>(S, T, size);
+        cudaMemcpyAsync(D, T, size * sizeof(Element),
+                        cudaMemcpyDeviceToDevice);
+        return cudaGetLastError();
+      }))
+    return -1;
+
+  // CPU reference, checked against the same closed form.
+  printf("CPU reference:\n");
+  cfk::utils::HostBuffer<Element> h_S(size), h_D(size);
+  cfk::utils::fill_random_cpu(h_S.data(), size, seed);
+  cfk::utils::fill_random_cpu(h_D.data(), size, seed_dst);
+  auto t1 = std::chrono::high_resolution_clock::now();
+  copy_reduce_cpu<kOp>(h_S.data(), h_D.data(), size);
+  auto t2 = std::chrono::high_resolution_clock::now();
+  std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+  std::cout << "Completed in " << tDiff.count() << "ms ("
+            << cfk::utils::with_peak(1e-6 * bytes / tDiff.count(), "GB/s",
+                                     "cpu.stream_copy_gbs")
+            << ")" << std::endl;
+  auto report = cfk::utils::verify_cpu(
+      h_D.data(), size, ExpectReduce<kOp, Element>{seed, seed_dst});
+  cfk::utils::print_verify_report(std::cout, report, N);
+  return 0;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+// Opt-in device-side timestamp instrumentation for the TMA kernels.
+//
+// Compile with -DCFX_ENABLE_TMA_TRACE (or `make TRACE=1`) to have the kernels
+// record a TraceRecord at each pipeline event into a ring buffer in global
+// memory. Without the define, CFX_TRACE_EVENT expands to nothing and the
+// kernels are unchanged.
+
+#include <cstdint>
+
+#if defined(__CUDACC__)
+#include <cutlass/cutlass.h>
+#endif
+
+#include "trace_record.hpp"
+
+namespace cfx {
+
+// Ring buffer of trace records in device memory. `capacity` must be a power
+// of two; `head` counts every record ever written so the host can tell how
+// many were overwritten.
+struct TraceBuffer {
+  TraceRecord *records = nullptr;
+  unsigned long long *head = nullptr;
+  uint32_t capacity = 0;
+};
+
+#if defined(__CUDACC__)
+
+// Internal linkage: each translation unit that includes this header gets its
+// own buffer, which its TraceSession installs and drains.
+static __device__ TraceBuffer g_trace_buffer;
+
+CUTLASS_DEVICE uint64_t globaltimer() {
+  uint64_t t;
+  asm volatile("mov.u64 %0, %%globaltimer;" : "=l"(t));
+  return t;
+}
+
+CUTLASS_DEVICE uint32_t smid() {
+  uint32_t id;
+  asm volatile("mov.u32 %0, %%smid;" : "=r"(id));
+  return id;
+}
+
+// Record one event for the calling CTA. Must be called by a single thread.
+CUTLASS_DEVICE void trace_event(TraceEvent event) {
+  TraceBuffer &buf = g_trace_buffer;
+  if (buf.records == nullptr)
+    return;
+  unsigned long long slot = atomicAdd(buf.head, 1ull);
+  TraceRecord &r = buf.records[slot & (buf.capacity - 1)];
+  r.globaltimer = globaltimer();
+  r.clock = clock64();
+  r.cta = blockIdx.x + gridDim.x * (blockIdx.y + gridDim.y * blockIdx.z);
+  r.smid = smid();
+  r.event = static_cast<uint32_t>(event);
+}
+
+#endif // __CUDACC__
+
+} // namespace cfx
+
+#if defined(CFX_ENABLE_TMA_TRACE)
+#define CFX_TRACE_EVENT(pred, event)                                           \
+  do {                                                                         \
+    if (pred)                                                                  \
+      cfx::trace_event(cfx::TraceEvent::event);                                \
+  } while (0)
+#else
+#define CFX_TRACE_EVENT(pred, event)                                           \
+  do {                                                                         \
+  } while (0)
+#endif
+
+#if defined(CFX_ENABLE_TMA_TRACE) && defined(__CUDACC__)
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+namespace cfx {
+
+// Host-side owner of the device ring buffer. Installs itself into
+// g_trace_buffer on construction and can be drained after the launches.
+class TraceSession {
+public:
+  explicit TraceSession(uint32_t capacity = 1u << 20) {
+    buf_.capacity = capacity;
+    cudaMalloc(&buf_.records, sizeof(TraceRecord) * capacity);
+    cudaMalloc(&buf_.head, sizeof(unsigned long long));
+    reset();
+  }
+
+  ~TraceSession() {
+    TraceBuffer empty;
+    cudaMemcpyToSymbol(g_trace_buffer, &empty, sizeof(TraceBuffer));
+    cudaFree(buf_.records);
+    cudaFree(buf_.head);
+  }
+
+  void reset() {
+    cudaMemset(buf_.head, 0, sizeof(unsigned long long));
+    cudaMemcpyToSymbol(g_trace_buffer, &buf_, sizeof(TraceBuffer));
+  }
+
+  // Copy the valid window of the ring buffer back to the host, oldest first.
+  std::vector<TraceRecord> drain() const {
+    unsigned long long head = 0;
+    cudaMemcpy(&head, buf_.head, sizeof(head), cudaMemcpyDeviceToHost);
+    std::vector<TraceRecord> all(buf_.capacity);
+    cudaMemcpy(all.data(), buf_.records, sizeof(TraceRecord) * buf_.capacity,
+               cudaMemcpyDeviceToHost);
+    return unroll_ring(all, head);
+  }
+
+  // Print per-phase histograms and write a Chrome trace to `path`.
+  void report(char const *path) const {
+    auto records = drain();
+    auto phases = pair_phases(records);
+    print_phase_histograms(std::cout, phases);
+    std::ofstream out(path);
+    write_chrome_trace(out, phases);
+    std::cout << "Wrote " << phases.size() << " trace spans to " << path
+              << std::endl;
+  }
+
+private:
+  TraceBuffer buf_;
+};
+
+} // namespace cfx
+
+#endif
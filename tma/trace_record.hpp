@@ -0,0 +1,275 @@
+#pragma once
+
+// Trace record layout shared by the device ring buffer (trace.h) and the host
+// aggregator below. Nothing in this file depends on CUDA, so the aggregator
+// and the Chrome trace writer can be driven with synthetic records on a CPU;
+// check_trace() does so.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace cfx {
+
+enum class TraceEvent : uint32_t {
+  TmaIssue = 0,      // before the TMA load is issued
+  BarrierComplete,   // after mbarrier.wait returns
+  StoreIssue,        // before the TMA store is issued
+  StoreCommitted,    // after tma_store_wait: the store has read its smem
+  ClusterSyncBegin,  // before cute::cluster_sync()
+  ClusterSyncEnd,    // after cute::cluster_sync()
+  Count
+};
+
+struct TraceRecord {
+  uint64_t globaltimer; // ns, comparable across SMs
+  uint64_t clock;       // SM cycles, only comparable within one SM
+  uint32_t cta;         // linearized blockIdx
+  uint32_t smid;
+  uint32_t event;       // TraceEvent
+  uint32_t pad;
+};
+
+// A phase is the interval between a begin and an end event of the same CTA.
+struct TracePhase {
+  TraceEvent begin;
+  TraceEvent end;
+  char const *name;
+};
+
+inline std::vector<TracePhase> const &trace_phases() {
+  static const std::vector<TracePhase> phases = {
+      {TraceEvent::TmaIssue, TraceEvent::BarrierComplete, "mbarrier_wait"},
+      {TraceEvent::BarrierComplete, TraceEvent::StoreIssue, "smem_handoff"},
+      {TraceEvent::StoreIssue, TraceEvent::StoreCommitted, "tma_store"},
+      {TraceEvent::ClusterSyncBegin, TraceEvent::ClusterSyncEnd,
+       "cluster_sync"},
+  };
+  return phases;
+}
+
+struct TraceSpan {
+  char const *name;
+  uint32_t cta;
+  uint32_t smid;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  uint64_t duration_cycles;
+};
+
+// Return the valid records of a ring buffer of `ring.size()` slots into which
+// `head` records have been written, oldest first.
+inline std::vector<TraceRecord>
+unroll_ring(std::vector<TraceRecord> const &ring, unsigned long long head) {
+  size_t capacity = ring.size();
+  if (head <= capacity)
+    return std::vector<TraceRecord>(ring.begin(), ring.begin() + head);
+  std::vector<TraceRecord> out;
+  out.reserve(capacity);
+  size_t first = head % capacity;
+  out.insert(out.end(), ring.begin() + first, ring.end());
+  out.insert(out.end(), ring.begin(), ring.begin() + first);
+  return out;
+}
+
+// Pair begin/end events per CTA into spans. Records from repeated launches
+// reuse CTA ids, so each end event is matched with the most recent
+// unmatched begin event of the same CTA.
+inline std::vector<TraceSpan>
+pair_phases(std::vector<TraceRecord> records) {
+  std::stable_sort(records.begin(), records.end(),
+                   [](TraceRecord const &a, TraceRecord const &b) {
+                     return a.globaltimer < b.globaltimer;
+                   });
+
+  constexpr int kEvents = int(TraceEvent::Count);
+  struct Open {
+    bool valid[kEvents] = {};
+    TraceRecord rec[kEvents];
+  };
+  std::map<uint32_t, Open> open;
+  std::vector<TraceSpan> spans;
+
+  for (auto const &r : records) {
+    if (r.event >= uint32_t(kEvents))
+      continue;
+    Open &o = open[r.cta];
+    for (auto const &p : trace_phases()) {
+      int b = int(p.begin);
+      if (r.event != uint32_t(p.end) || !o.valid[b])
+        continue;
+      TraceRecord const &s = o.rec[b];
+      spans.push_back({p.name, r.cta, s.smid, s.globaltimer,
+                       r.globaltimer - s.globaltimer,
+                       s.smid == r.smid ? r.clock - s.clock : 0});
+      o.valid[b] = false;
+    }
+    o.valid[r.event] = true;
+    o.rec[r.event] = r;
+  }
+  return spans;
+}
+
+// Log2-bucketed histogram of span durations in nanoseconds. Bucket b holds
+// [lower(b), upper(b)): bucket 0 is [0, 2) so that zero-length spans are
+// counted, and the last bucket is open-ended.
+struct PhaseHistogram {
+  static constexpr int kBuckets = 32;
+
+  static uint64_t lower(int b) { return b == 0 ? 0 : uint64_t(1) << b; }
+  static uint64_t upper(int b) {
+    return b + 1 == kBuckets ? ~uint64_t(0) : uint64_t(1) << (b + 1);
+  }
+  uint64_t count = 0;
+  uint64_t total_ns = 0;
+  uint64_t min_ns = ~uint64_t(0);
+  uint64_t max_ns = 0;
+  uint64_t buckets[kBuckets] = {};
+
+  void add(uint64_t ns) {
+    count++;
+    total_ns += ns;
+    min_ns = std::min(min_ns, ns);
+    max_ns = std::max(max_ns, ns);
+    int b = 0;
+    while (b + 1 < kBuckets && (uint64_t(1) << (b + 1)) <= ns)
+      b++;
+    buckets[b]++;
+  }
+};
+
+inline std::map<std::string, PhaseHistogram>
+phase_histograms(std::vector<TraceSpan> const &spans) {
+  std::map<std::string, PhaseHistogram> hists;
+  for (auto const &s : spans)
+    hists[s.name].add(s.duration_ns);
+  return hists;
+}
+
+inline void print_phase_histograms(std::ostream &os,
+                                   std::vector<TraceSpan> const &spans) {
+  for (auto const &[name, h] : phase_histograms(spans)) {
+    os << name << ": n=" << h.count << " min=" << h.min_ns
+       << "ns mean=" << h.total_ns / h.count << "ns max=" << h.max_ns << "ns"
+       << std::endl;
+    for (int b = 0; b < PhaseHistogram::kBuckets; b++) {
+      if (h.buckets[b] == 0)
+        continue;
+      os << "  [" << PhaseHistogram::lower(b) << ", ";
+      if (b + 1 == PhaseHistogram::kBuckets)
+        os << "inf";
+      else
+        os << PhaseHistogram::upper(b);
+      os << ") ns: " << h.buckets[b] << std::endl;
+    }
+  }
+}
+
+// Write spans in the Chrome trace event format (also read by Perfetto).
+// Each SM is a process and each CTA a thread; timestamps are in
+// microseconds relative to the earliest span.
+inline void write_chrome_trace(std::ostream &os,
+                               std::vector<TraceSpan> const &spans) {
+  uint64_t t0 = ~uint64_t(0);
+  for (auto const &s : spans)
+    t0 = std::min(t0, s.start_ns);
+
+  os << "{\"traceEvents\":[";
+  bool first = true;
+  for (auto const &s : spans) {
+    os << (first ? "\n" : ",\n");
+    first = false;
+    os << "{\"name\":\"" << s.name << "\",\"ph\":\"X\",\"ts\":"
+       << double(s.start_ns - t0) * 1e-3
+       << ",\"dur\":" << double(s.duration_ns) * 1e-3
+       << ",\"pid\":" << s.smid << ",\"tid\":" << s.cta
+       << ",\"args\":{\"cycles\":" << s.duration_cycles << "}}";
+  }
+  os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+}
+
+// Feed synthetic records through the ring unroll, the phase pairing and the
+// histograms, and check that every span lands in the bucket whose printed
+// bounds contain it. Needs no GPU.
+inline bool check_trace() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Trace check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  // Two launches of four CTAs, each CTA going through every phase, with
+  // durations covering zero, the bucket edges and the open last bucket.
+  std::vector<uint64_t> const durations = {
+      0, 1, 2, 1023, 1024, 1025, uint64_t(1) << 31, uint64_t(1) << 40};
+  std::vector<TraceRecord> records;
+  std::vector<uint64_t> expected; // mbarrier_wait durations, in order
+  uint64_t t = 1000;
+  for (int launch = 0; launch < 2; ++launch)
+    for (uint32_t cta = 0; cta < 4; ++cta) {
+      uint64_t d = durations[launch * 4 + cta];
+      auto rec = [&](TraceEvent e, uint64_t at) {
+        records.push_back({at, at * 2, cta, cta % 2, uint32_t(e), 0});
+      };
+      rec(TraceEvent::TmaIssue, t);
+      rec(TraceEvent::BarrierComplete, t + d);
+      rec(TraceEvent::StoreIssue, t + d + 5);
+      rec(TraceEvent::StoreCommitted, t + d + 5 + 7);
+      expected.push_back(d);
+      t += d + 100;
+    }
+
+  // Unrolling a wrapped ring gives back the newest records, oldest first.
+  size_t const capacity = 8;
+  std::vector<TraceRecord> ring(capacity);
+  for (size_t i = 0; i < records.size(); ++i)
+    ring[i % capacity] = records[i];
+  auto window = unroll_ring(ring, records.size());
+  if (window.size() != capacity ||
+      window.front().globaltimer !=
+          records[records.size() - capacity].globaltimer ||
+      window.back().globaltimer != records.back().globaltimer)
+    fail("ring unroll");
+
+  auto spans = pair_phases(records);
+  std::map<std::string, std::vector<uint64_t>> by_name;
+  for (auto const &s : spans)
+    by_name[s.name].push_back(s.duration_ns);
+  if (by_name["mbarrier_wait"] != expected)
+    fail("mbarrier_wait spans do not match the synthetic durations");
+  if (by_name["smem_handoff"] != std::vector<uint64_t>(expected.size(), 5) ||
+      by_name["tma_store"] != std::vector<uint64_t>(expected.size(), 7))
+    fail("smem_handoff / tma_store spans");
+  if (by_name.count("cluster_sync") && !by_name["cluster_sync"].empty())
+    fail("cluster_sync spans without cluster sync events");
+
+  for (auto const &[name, h] : phase_histograms(spans)) {
+    uint64_t total = 0;
+    for (int b = 0; b < PhaseHistogram::kBuckets; ++b) {
+      total += h.buckets[b];
+      uint64_t in_bucket = 0;
+      for (uint64_t d : by_name[name])
+        if (d >= PhaseHistogram::lower(b) &&
+            (d < PhaseHistogram::upper(b) ||
+             b + 1 == PhaseHistogram::kBuckets))
+          ++in_bucket;
+      if (in_bucket != h.buckets[b])
+        fail(name + " bucket " + std::to_string(b) + " holds " +
+             std::to_string(h.buckets[b]) + " spans, " +
+             std::to_string(in_bucket) + " lie in its bounds");
+    }
+    if (total != h.count || h.count != by_name[name].size())
+      fail(name + " bucket counts do not add up");
+  }
+
+  print_phase_histograms(std::cout, spans);
+  if (ok)
+    std::cout << "Trace check passed." << std::endl;
+  return ok;
+}
+
+} // namespace cfx
@@ -37,6 +37,7 @@
 #include <cstdlib>
 
 #include <chrono>
+#include <type_traits>
 
 #include <thrust/device_vector.h>
 #include <thrust/host_vector.h>
@@ -54,14 +55,19 @@
 
 #include "cutlass/detail/layout.hpp"
 
+#include "host_stats.hpp"
+#include "host_trace.hpp"
 #include "shared_storage.h"
 #include "util.h"
 
-template <class TensorS, class TensorD, class ThreadLayout, class VecLayout>
+template <class TensorS, class TensorD, class ThreadLayout, class VecLayout,
+          class ElementOp = IdentityElementOp>
 __global__ static void __launch_bounds__(256, 1)
-    copyKernel(TensorS const S, TensorD const D, ThreadLayout, VecLayout) {
+    copyKernel(TensorS const S, TensorD const D, ThreadLayout, VecLayout,
+               ElementOp const op = {}) {
   using namespace cute;
   using Element = typename TensorS::value_type;
+  using OutElement = typename TensorD::value_type;
 
   Tensor gS = S(make_coord(_, _), blockIdx.x, blockIdx.y);   // (bM, bN)
   Tensor gD = D(make_coord(_, _), blockIdx.x, blockIdx.y); // (bN, bM)
@@ -93,22 +99,43 @@ __global__ static void __launch_bounds__(256, 1)
   Tensor rmem = make_tensor_like(tSgS);               // (ThrValM, ThrValN)
 
   copy(tSgS, rmem);
-  copy(rmem, tDgD);
+  if constexpr (std::is_same_v<ElementOp, IdentityElementOp>) {
+    copy(rmem, tDgD);
+  } else {
+    Tensor tScS = thr_copy.partition_S(make_identity_tensor(shape(gS)));
+    Tensor rout = make_tensor_like<OutElement>(tDgD);
+    int const m0 = blockIdx.x * size<0>(gS), n0 = blockIdx.y * size<1>(gS);
+    CUTE_UNROLL
+    for (int k = 0; k < size(rmem); ++k)
+      rout(k) = static_cast<OutElement>(
+          op(rmem(k), m0 + get<0>(tScS(k)), n0 + get<1>(tScS(k))));
+    copy(rout, tDgD);
+  }
 }
 
-template <typename T> void copy_baseline(TransposeParams<T> params) {
+// copy_baseline for an (M, N) shape of runtime ints or of cute::Int extents
+// (static_shapes.h). `op` maps each element between the load and the store
+// (fused_expr.h), and the output may then have another element type. M
+// must be a multiple of 32 and N of 1024.
+template <typename T, class Shape, typename OutT = T,
+          class ElementOp = IdentityElementOp>
+void copy_baseline_shape(T *input, OutT *output, Shape const &tensor_shape,
+                         ElementOp const &op = {}, cudaStream_t stream = 0) {
 
   using Element = float;
   using namespace cute;
+  cfk::utils::ScopedRange range(
+      "copy_baseline", cfk::utils::dtype_name<T>(),
+      {int(get<0>(tensor_shape)), int(get<1>(tensor_shape))});
+  CFK_HOST_STAGE(layout_timer, "copy_baseline.layouts");
 
   //
   // Make tensors
   //
-  auto tensor_shape = make_shape(params.M, params.N);
   auto gmemLayoutS = make_layout(tensor_shape, LayoutRight{});
   auto gmemLayoutD = make_layout(tensor_shape, LayoutRight{});
-  Tensor tensor_S = make_tensor(make_gmem_ptr(params.input), gmemLayoutS);
-  Tensor tensor_D = make_tensor(make_gmem_ptr(params.output), gmemLayoutD);
+  Tensor tensor_S = make_tensor(make_gmem_ptr(input), gmemLayoutS);
+  Tensor tensor_D = make_tensor(make_gmem_ptr(output), gmemLayoutD);
  
   //
   // Tile tensors
@@ -136,7 +163,14 @@ template <typename T> void copy_baseline(TransposeParams<T> params) {
       size<1>(tiled_tensor_S),
       size<2>(tiled_tensor_S)); // Grid shape corresponds to modes m' and n'
   dim3 blockDim(size(threadLayout)); // 256 threads
+  layout_timer.stop();
+
+  CFK_HOST_STAGE(launch_timer, "copy_baseline.launch");
+  copyKernel<<<gridDim, blockDim, 0, stream>>>(tiled_tensor_S, tiled_tensor_D,
+                                               threadLayout, vec_layout, op);
+}
 
-  copyKernel<<<gridDim, blockDim>>>(tiled_tensor_S, tiled_tensor_D,
-                                       threadLayout,  vec_layout);
+template <typename T> void copy_baseline(TransposeParams<T> params) {
+  copy_baseline_shape(params.input, params.output,
+                      cute::make_shape(params.M, params.N));
 }
@@ -0,0 +1,239 @@
+#pragma once
+
+// GPU evaluation of a compiled FusedExpr (fused_expr_cpu.h): one pass over
+// the tensor however long the chain is. The program is passed as the
+// FusedElementOp of the repo's kernels: chains with a transpose run
+// transposeKernelSmem (transpose_smem.h), which applies it on the way out
+// of the smem tile, and the others run copyKernel (copy.h), which applies
+// it between the load and the store. Those kernels have no edge
+// predication, so shapes that are not multiples of their tiles (64 x 64,
+// and 32 x 1024 for the copy) run fusedTransposeKernel or fusedCopyKernel
+// below instead, which check bounds per element.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+
+#include <cutlass/numeric_types.h>
+
+#include "copy.h"
+#include "fused_expr_cpu.h"
+#include "host_trace.hpp"
+#include "peak_gpu.hpp"
+#include "transpose_smem.h"
+#include "verify_gpu.hpp"
+
+constexpr int kFusedTile = 64;
+
+// The program as the element op of transposeKernelSmem and copyKernel.
+struct FusedElementOp {
+  FusedProgram p;
+  template <class T>
+  CFK_HOST_DEVICE float operator()(T x, int row, int col) const {
+    return p.apply(float(x), row, col);
+  }
+};
+
+// Whether the tiled kernels cover the program's shape without predication
+// and with aligned vector accesses.
+inline bool fused_tiled(FusedProgram const &p, void const *in,
+                        void const *out) {
+  bool const aligned = reinterpret_cast<uintptr_t>(in) % 16 == 0 &&
+                       reinterpret_cast<uintptr_t>(out) % 16 == 0;
+  return aligned && (p.transpose ? p.rows % 64 == 0 && p.cols % 64 == 0
+                                 : p.rows % 32 == 0 && p.cols % 1024 == 0);
+}
+
+// Edge-safe fallbacks for shapes the tiled kernels do not cover.
+template <typename TIn, typename TOut>
+__global__ static void __launch_bounds__(256)
+    fusedTransposeKernel(TIn const *__restrict__ in, TOut *__restrict__ out,
+                         FusedProgram const p) {
+  __shared__ float tile[kFusedTile][kFusedTile + 1];
+  int const i0 = blockIdx.y * kFusedTile, j0 = blockIdx.x * kFusedTile;
+  int const tx = threadIdx.x % 32, ty = threadIdx.x / 32;
+
+  for (int r = ty; r < kFusedTile; r += 8)
+    for (int c = tx; c < kFusedTile; c += 32) {
+      int const i = i0 + r, j = j0 + c;
+      if (i < p.rows && j < p.cols)
+        tile[r][c] = p.apply(float(in[size_t(i) * p.cols + j]), i, j);
+    }
+  __syncthreads();
+
+  // Output row j0 + r is input column j0 + r.
+  for (int r = ty; r < kFusedTile; r += 8)
+    for (int c = tx; c < kFusedTile; c += 32) {
+      int const i = i0 + c, j = j0 + r;
+      if (i < p.rows && j < p.cols)
+        out[size_t(j) * p.rows + i] = TOut(tile[c][r]);
+    }
+}
+
+template <typename TIn, typename TOut>
+__global__ static void __launch_bounds__(256)
+    fusedCopyKernel(TIn const *__restrict__ in, TOut *__restrict__ out,
+                    FusedProgram const p) {
+  for (int i = blockIdx.y; i < p.rows; i += gridDim.y)
+    for (int j = blockIdx.x * blockDim.x + threadIdx.x; j < p.cols;
+         j += gridDim.x * blockDim.x) {
+      size_t const k = size_t(i) * p.cols + j;
+      out[k] = TOut(p.apply(float(in[k]), i, j));
+    }
+}
+
+template <typename TIn, typename TOut>
+void fused_eval(FusedProgram const &p, TIn const *in, TOut *out,
+                cudaStream_t stream = 0) {
+  cfk::utils::ScopedRange range(p.transpose ? "fused_transpose"
+                                            : "fused_copy",
+                                cfk::utils::dtype_name<TIn>(),
+                                {p.rows, p.cols, p.num_ops});
+  TIn *input = const_cast<TIn *>(in);
+  if (fused_tiled(p, in, out)) {
+    if (p.transpose)
+      transpose_smem_shape<TIn, true>(input, out,
+                                      cute::make_shape(p.rows, p.cols), false,
+                                      FusedElementOp{p}, stream);
+    else
+      copy_baseline_shape(input, out, cute::make_shape(p.rows, p.cols),
+                          FusedElementOp{p}, stream);
+  } else if (p.transpose) {
+    dim3 grid((p.cols + kFusedTile - 1) / kFusedTile,
+              (p.rows + kFusedTile - 1) / kFusedTile);
+    fusedTransposeKernel<<<grid, 256, 0, stream>>>(in, out, p);
+  } else {
+    dim3 grid(std::min((p.cols + 255) / 256, 16), std::min(p.rows, 65535));
+    fusedCopyKernel<<<grid, 256, 0, stream>>>(in, out, p);
+  }
+}
+
+// Call f with a value of the element type for `d`.
+template <typename F> void dispatch_fused_dtype(FusedDType d, F &&f) {
+  if (d == FusedDType::F16)
+    f(cutlass::half_t{});
+  else if (d == FusedDType::BF16)
+    f(cutlass::bfloat16_t{});
+  else
+    f(float{});
+}
+
+// fused_eval with the element types taken from the program.
+inline void fused_eval(FusedProgram const &p, void const *in, void *out,
+                       cudaStream_t stream = 0) {
+  dispatch_fused_dtype(p.in, [&](auto i) {
+    dispatch_fused_dtype(p.out, [&](auto o) {
+      using TIn = decltype(i);
+      using TOut = decltype(o);
+      fused_eval(p, static_cast<TIn const *>(in), static_cast<TOut *>(out),
+                 stream);
+    });
+  });
+}
+
+template <class T> struct ExpectBuffer {
+  T const *want;
+  CFK_HOST_DEVICE T operator()(size_t i) const { return want[i]; }
+};
+
+// x^T * 2 + bias, cast to fp16: four passes run one by one, then as one
+// fused pass. The fused output must equal the unfused one bit for bit, and
+// for inputs up to 2^26 elements it is also checked against fused_cpu().
+inline int benchmark_fused(int M, int N, int iterations = 10,
+                           bool verify = true) {
+  using Half = cutlass::half_t;
+  size_t const size = size_t(M) * N;
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  thrust::device_vector<float> d_S(size), d_bias(M);
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), size, seed);
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_bias.data()), M,
+                          seed + 1);
+
+  FusedExpr expr(M, N, FusedDType::F32);
+  expr.transpose()
+      .scale(2.0f)
+      .bias(thrust::raw_pointer_cast(d_bias.data()), M)
+      .cast(FusedDType::F16);
+  FusedProgram const fused = expr.compile();
+  std::vector<FusedProgram> const stages = expr.compile_unfused();
+
+  auto trials = [&](auto &&run, double bytes) {
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      run();
+      cudaError result = cudaDeviceSynchronize();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+                << ")" << std::endl;
+    }
+    return 0;
+  };
+
+  // One buffer per stage output; the last one is the result.
+  std::vector<thrust::device_vector<char>> buffers;
+  double unfused_bytes = 0;
+  for (FusedProgram const &s : stages) {
+    buffers.emplace_back(size * fused_dtype_size(s.out));
+    unfused_bytes += double(size) *
+                     (fused_dtype_size(s.in) + fused_dtype_size(s.out));
+  }
+  std::cout << "Unfused, " << stages.size() << " passes:" << std::endl;
+  auto unfused = [&] {
+    void const *in = thrust::raw_pointer_cast(d_S.data());
+    for (size_t k = 0; k < stages.size(); ++k) {
+      void *out = thrust::raw_pointer_cast(buffers[k].data());
+      fused_eval(stages[k], in, out);
+      in = out;
+    }
+  };
+  if (trials(unfused, unfused_bytes) != 0)
+    return -1;
+
+  thrust::device_vector<Half> d_D(size);
+  Half *D = thrust::raw_pointer_cast(d_D.data());
+  std::cout << "Fused, one pass (" << fused.num_ops << " steps):"
+            << std::endl;
+  auto one_pass = [&] {
+    fused_eval(fused, thrust::raw_pointer_cast(d_S.data()), D);
+  };
+  if (trials(one_pass, double(size) * (sizeof(float) + sizeof(Half))) != 0)
+    return -1;
+
+  if (!verify)
+    return 0;
+  Half const *want =
+      reinterpret_cast<Half const *>(thrust::raw_pointer_cast(
+          buffers.back().data()));
+  cfk::utils::print_verify_report(
+      std::cout,
+      cfk::utils::verify_on_device(D, size, ExpectBuffer<Half>{want}), M);
+  if (size <= (size_t(1) << 26)) {
+    thrust::host_vector<float> h_S = d_S, h_bias = d_bias;
+    thrust::host_vector<Half> h_D = d_D;
+    FusedProgram host = fused;
+    for (int k = 0; k < host.num_ops; ++k)
+      if (host.ops[k].bias)
+        host.ops[k].bias = h_bias.data();
+    std::vector<float> ref(size);
+    fused_cpu(host, [&](size_t i) { return h_S[i]; }, ref.data());
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_cpu(h_D.data(), size,
+                               [&](size_t i) { return Half(ref[i]); }),
+        M);
+  }
+  return 0;
+}
@@ -0,0 +1,356 @@
+#pragma once
+
+// Lazy element-wise chains over a 2D tensor, and their CPU implementation.
+//
+// A FusedExpr records copy, transpose, scale, bias and cast nodes on an
+// (M, N) input without running anything. compile() folds the chain into a
+// FusedProgram: the output layout (one transpose or none) plus at most
+// kMaxFusedOps per-element steps, each a multiply, an optional bias add
+// and a rounding to the dtype the tensor has at that point of the chain.
+// fused_expr.h applies the program in one pass over the smem tile
+// transpose or a plain copy kernel; fused_cpu() below does the same on the
+// task runtime.
+//
+// Because every step rounds to the current dtype, the fused result is bit
+// for bit what running each node as its own pass would produce. A bias is
+// a vector over the columns the tensor has when the bias is added. After
+// an odd number of transposes that is a row index of the input, which the
+// step records in bias_axis.
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_device.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+enum class FusedDType : uint8_t { F32, F16, BF16 };
+
+inline size_t fused_dtype_size(FusedDType d) {
+  return d == FusedDType::F32 ? 4 : 2;
+}
+
+inline char const *fused_dtype_name(FusedDType d) {
+  return d == FusedDType::F32 ? "float32"
+         : d == FusedDType::F16 ? "float16"
+                                : "bfloat16";
+}
+
+CFK_HOST_DEVICE float fused_bits_to_float(uint32_t u) {
+  float x;
+  std::memcpy(&x, &u, sizeof(x));
+  return x;
+}
+
+// Round to the nearest bf16, ties to even. NaNs pass through.
+CFK_HOST_DEVICE float round_to_bf16(float x) {
+  if (x != x)
+    return x;
+  uint32_t u;
+  std::memcpy(&u, &x, sizeof(u));
+  u += 0x7FFFu + ((u >> 16) & 1u);
+  return fused_bits_to_float(u & 0xFFFF0000u);
+}
+
+// Round to the nearest fp16, ties to even, overflowing to infinity and
+// keeping fp16 subnormals. The value is scaled to an integer count of fp16
+// ulps, which rintf() rounds exactly.
+CFK_HOST_DEVICE float round_to_f16(float x) {
+  float a = fabsf(x);
+  if (!(a < INFINITY))
+    return x; // inf, nan
+  uint32_t u;
+  std::memcpy(&u, &a, sizeof(u));
+  int e = int(u >> 23) - 127;
+  if (e < -14)
+    e = -14; // fp16 subnormals share the ulp of the smallest normal
+  float const ulp = fused_bits_to_float(uint32_t(e - 10 + 127) << 23);
+  float r = rintf(a / ulp) * ulp;
+  if (r > 65504.0f)
+    r = INFINITY;
+  return copysignf(r, x);
+}
+
+CFK_HOST_DEVICE float round_to_dtype(FusedDType d, float x) {
+  return d == FusedDType::F16    ? round_to_f16(x)
+         : d == FusedDType::BF16 ? round_to_bf16(x)
+                                 : x;
+}
+
+// One step: x = round(dtype, x * scale + bias[coordinate]).
+struct FusedOp {
+  float scale = 1.0f;
+  float const *bias = nullptr;
+  uint8_t bias_axis = 1; // 0: indexed by input row, 1: by input column
+  FusedDType dtype = FusedDType::F32;
+};
+
+constexpr int kMaxFusedOps = 8;
+
+struct FusedProgram {
+  FusedOp ops[kMaxFusedOps];
+  int num_ops = 0;
+  bool transpose = false;
+  int rows = 0, cols = 0; // input shape
+  FusedDType in = FusedDType::F32, out = FusedDType::F32;
+
+  int out_rows() const { return transpose ? cols : rows; }
+  int out_cols() const { return transpose ? rows : cols; }
+
+  // Value of output element for input element (row, col), as a float that
+  // is exactly representable in `out`. No FMA: the multiply and the add
+  // each round, like two separate passes would.
+  CFK_HOST_DEVICE float apply(float x, int row, int col) const {
+    for (int i = 0; i < kMaxFusedOps && i < num_ops; ++i) {
+      FusedOp const &op = ops[i];
+#if defined(__CUDA_ARCH__)
+      x = __fmul_rn(x, op.scale);
+      if (op.bias)
+        x = __fadd_rn(x, op.bias[op.bias_axis ? col : row]);
+#else
+      x = x * op.scale;
+      if (op.bias)
+        x = x + op.bias[op.bias_axis ? col : row];
+#endif
+      x = round_to_dtype(op.dtype, x);
+    }
+    return x;
+  }
+};
+
+class FusedExpr {
+public:
+  enum class Kind : uint8_t { Copy, Transpose, Scale, Bias, Cast };
+  struct Node {
+    Kind kind;
+    float scale;
+    float const *bias;
+    FusedDType dtype;
+  };
+
+  FusedExpr(int rows, int cols, FusedDType dtype)
+      : rows_(rows), cols_(cols), in_(dtype), dtype_(dtype) {
+    if (rows <= 0 || cols <= 0)
+      throw std::invalid_argument("FusedExpr needs a non-empty 2D tensor");
+  }
+
+  FusedExpr &copy() { return push({Kind::Copy, 1.0f, nullptr, dtype_}); }
+  FusedExpr &transpose() {
+    transposed_ = !transposed_;
+    return push({Kind::Transpose, 1.0f, nullptr, dtype_});
+  }
+  FusedExpr &scale(float s) { return push({Kind::Scale, s, nullptr, dtype_}); }
+  // `bias` holds one float per column of the tensor at this point.
+  FusedExpr &bias(float const *bias, int size) {
+    if (size != cols())
+      throw std::invalid_argument("bias has " + std::to_string(size) +
+                                  " entries for " + std::to_string(cols()) +
+                                  " columns");
+    return push({Kind::Bias, 1.0f, bias, dtype_});
+  }
+  FusedExpr &cast(FusedDType d) {
+    dtype_ = d;
+    return push({Kind::Cast, 1.0f, nullptr, d});
+  }
+
+  // Current shape and dtype, i.e. those of the result.
+  int rows() const { return transposed_ ? cols_ : rows_; }
+  int cols() const { return transposed_ ? rows_ : cols_; }
+  FusedDType dtype() const { return dtype_; }
+  FusedDType input_dtype() const { return in_; }
+  std::vector<Node> const &nodes() const { return nodes_; }
+
+  // Full passes over the tensor the chain costs when each node runs alone.
+  // A chain with no nodes still needs one copy.
+  int passes() const {
+    return nodes_.empty() ? 1 : int(nodes_.size());
+  }
+
+  FusedProgram compile() const {
+    FusedProgram p;
+    p.rows = rows_;
+    p.cols = cols_;
+    p.in = in_;
+    p.out = dtype_;
+    FusedDType current = in_;
+    for (Node const &n : nodes_) {
+      FusedOp op;
+      op.dtype = current;
+      switch (n.kind) {
+      case Kind::Copy:
+        continue;
+      case Kind::Transpose:
+        p.transpose = !p.transpose;
+        continue;
+      case Kind::Scale:
+        op.scale = n.scale;
+        break;
+      case Kind::Bias:
+        op.bias = n.bias;
+        op.bias_axis = p.transpose ? 0 : 1;
+        break;
+      case Kind::Cast:
+        if (n.dtype == current)
+          continue;
+        current = op.dtype = n.dtype;
+        // Float arithmetic already rounded the last step to fp32, so the
+        // cast can replace that step's (no-op) rounding.
+        if (p.num_ops > 0 && p.ops[p.num_ops - 1].dtype == FusedDType::F32) {
+          p.ops[p.num_ops - 1].dtype = n.dtype;
+          continue;
+        }
+        break;
+      }
+      if (p.num_ops == kMaxFusedOps)
+        throw std::invalid_argument("chain needs more than " +
+                                    std::to_string(kMaxFusedOps) +
+                                    " fused steps");
+      p.ops[p.num_ops++] = op;
+    }
+    return p;
+  }
+
+  // Each node compiled on its own, in order: the unfused baseline. The
+  // program for node k reads the result of node k - 1.
+  std::vector<FusedProgram> compile_unfused() const {
+    std::vector<FusedProgram> stages;
+    FusedExpr stage(rows_, cols_, in_);
+    for (Node const &n : nodes_) {
+      FusedExpr one(stage.rows(), stage.cols(), stage.dtype());
+      one.nodes_.push_back(n);
+      one.transposed_ = n.kind == Kind::Transpose;
+      one.dtype_ = n.kind == Kind::Cast ? n.dtype : stage.dtype();
+      stages.push_back(one.compile());
+      stage = one;
+    }
+    if (stages.empty())
+      stages.push_back(compile());
+    return stages;
+  }
+
+private:
+  FusedExpr &push(Node n) {
+    nodes_.push_back(n);
+    return *this;
+  }
+
+  int rows_, cols_;
+  FusedDType in_, dtype_;
+  bool transposed_ = false;
+  std::vector<Node> nodes_;
+};
+
+// out = program(in) on the task runtime. `load(i)` returns input element i
+// as float; `out` receives the (out_rows, out_cols) row-major result.
+template <class Load>
+void fused_cpu(FusedProgram const &p, Load load, float *out) {
+  size_t const out_rows = p.out_rows(), out_cols = p.out_cols();
+  cfk::utils::parallel_for(0, out_rows, 0, [&](size_t lo, size_t hi) {
+    for (size_t r = lo; r < hi; ++r)
+      for (size_t c = 0; c < out_cols; ++c) {
+        size_t const i = p.transpose ? c : r, j = p.transpose ? r : c;
+        out[r * out_cols + c] =
+            p.apply(load(i * p.cols + j), int(i), int(j));
+      }
+  });
+}
+
+// Host check of compile(): random chains, fused vs. one stage per node,
+// compared bit for bit. Run with `./transpose --check-fused`.
+inline bool check_fused_expr(uint64_t seed = 1) {
+  using cfk::utils::philox_bits;
+  using cfk::utils::random_value;
+  bool ok = true;
+  auto expect = [&](bool cond, std::string const &what) {
+    if (!cond) {
+      std::cout << "Fused expression check failed: " << what << std::endl;
+      ok = false;
+    }
+  };
+
+  // Rounding helpers against a few known values.
+  expect(round_to_f16(1.0f + 1.0f / 4096) == 1.0f, "f16 tie to even");
+  expect(round_to_f16(1.0f + 3.0f / 2048) == 1.0f + 1.0f / 512,
+         "f16 tie up to even");
+  expect(round_to_f16(65519.0f) == 65504.0f, "f16 max");
+  expect(std::isinf(round_to_f16(65520.0f)), "f16 overflow");
+  expect(round_to_f16(1e-8f) == 0.0f && round_to_f16(4e-8f) == 0x1p-24f,
+         "f16 subnormals");
+  expect(round_to_bf16(1.0f + 1.0f / 256) == 1.0f, "bf16 tie to even");
+  expect(round_to_f16(-5e-8f) == -0x1p-24f, "f16 sign");
+
+  int const rows = 37, cols = 53;
+  std::vector<float> in(size_t(rows) * cols);
+  for (size_t i = 0; i < in.size(); ++i)
+    in[i] = random_value<float>(seed, i) * 8.0f;
+  std::vector<float> bias_rows(rows), bias_cols(cols);
+  for (int i = 0; i < rows; ++i)
+    bias_rows[i] = random_value<float>(seed + 1, i);
+  for (int j = 0; j < cols; ++j)
+    bias_cols[j] = random_value<float>(seed + 2, j);
+
+  FusedDType const dtypes[] = {FusedDType::F32, FusedDType::F16,
+                               FusedDType::BF16};
+  for (int trial = 0; trial < 200; ++trial) {
+    FusedExpr e(rows, cols, FusedDType::F32);
+    int const nodes = int(philox_bits(seed, 1000 + trial) % 7);
+    try {
+      for (int k = 0; k < nodes; ++k) {
+        uint32_t const r = philox_bits(seed, 100000 + trial * 16 + k);
+        switch (r % 5) {
+        case 0:
+          e.copy();
+          break;
+        case 1:
+          e.transpose();
+          break;
+        case 2:
+          e.scale(float((r >> 8) % 7) * 0.75f - 2.0f);
+          break;
+        case 3:
+          if (e.cols() == cols)
+            e.bias(bias_cols.data(), cols);
+          else
+            e.bias(bias_rows.data(), rows);
+          break;
+        case 4:
+          e.cast(dtypes[(r >> 8) % 3]);
+          break;
+        }
+      }
+      FusedProgram const fused = e.compile();
+      std::vector<float> want = in, next;
+      for (FusedProgram const &stage : e.compile_unfused()) {
+        next.assign(size_t(rows) * cols, 0.0f);
+        fused_cpu(stage, [&](size_t i) { return want[i]; }, next.data());
+        want.swap(next);
+      }
+      std::vector<float> got(size_t(rows) * cols);
+      fused_cpu(fused, [&](size_t i) { return in[i]; }, got.data());
+      bool same = fused.out_rows() == e.rows() && fused.out == e.dtype() &&
+                  fused.num_ops <= nodes;
+      for (size_t i = 0; same && i < got.size(); ++i)
+        same = std::memcmp(&got[i], &want[i], sizeof(float)) == 0;
+      expect(same, "chain " + std::to_string(trial));
+    } catch (std::invalid_argument const &err) {
+      expect(false, err.what());
+    }
+  }
+
+  bool threw = false;
+  try {
+    FusedExpr(rows, cols, FusedDType::F32).bias(bias_rows.data(), rows);
+  } catch (std::invalid_argument const &) {
+    threw = true;
+  }
+  expect(threw, "bias size is checked against the current columns");
+
+  if (ok)
+    std::cout << "Fused expression check passed." << std::endl;
+  return ok;
+}
@@ -0,0 +1,519 @@
+#pragma once
+
+// Row gather and scatter on the GPU (plan and CPU backend in
+// gather_scatter_cpu.h).
+//
+// One warp moves one row with 16-byte vector accesses when the row length
+// and both base pointers allow it, and scalar ones otherwise. Gather reads
+// the rows of src named by idx; every write is a full, contiguous row.
+//
+// Scatter first sorts the source rows by destination on the device
+// (RowScatterPlan, a stable radix sort of the indices), checks the indices
+// against the dst rows and cuts each run of equal destinations into
+// segments of kScatterSegmentRows. A copy writes each run's last row once,
+// from the warp of the segment that holds it. An add runs one warp per
+// segment: the run's first segment reads dst once, sums its rows in index
+// order in registers and writes dst once, and each later segment writes
+// its sum to a partial row. A second kernel adds the partial rows of each
+// run of several segments to dst in order. A hot row is thus summed by many
+// warps, in the fixed order of scatter_add_segmented_reference, so the
+// result is deterministic where the atomicAdd baseline is not, and every
+// repeat of a hot row is a register add instead of another atomic round
+// trip to L2.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <thrust/copy.h>
+#include <thrust/device_ptr.h>
+#include <thrust/device_vector.h>
+#include <thrust/execution_policy.h>
+#include <thrust/extrema.h>
+#include <thrust/fill.h>
+#include <thrust/functional.h>
+#include <thrust/host_vector.h>
+#include <thrust/iterator/counting_iterator.h>
+#include <thrust/iterator/transform_iterator.h>
+#include <thrust/reduce.h>
+#include <thrust/scan.h>
+#include <thrust/sequence.h>
+#include <thrust/sort.h>
+
+#include <cute/tensor.hpp>
+
+#include "gather_scatter_cpu.h"
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "util.h"
+
+constexpr int kRowWarps = 8; // warps per CTA, one row each
+
+// The warp's lane copies elements lane, lane + 32, ... of the row, 16 bytes
+// at a time with kVec.
+template <typename T, bool kVec>
+CUTE_DEVICE void copy_row_warp(T const *src, T *dst, int cols, int lane) {
+  if constexpr (kVec) {
+    uint4 const *s = reinterpret_cast<uint4 const *>(src);
+    uint4 *d = reinterpret_cast<uint4 *>(dst);
+    for (int v = lane; v < cols * int(sizeof(T)) / 16; v += 32)
+      d[v] = s[v];
+  } else {
+    for (int c = lane; c < cols; c += 32)
+      dst[c] = src[c];
+  }
+}
+
+template <typename T, bool kVec>
+__global__ static void __launch_bounds__(32 * kRowWarps)
+    gatherRowsKernel(T const *__restrict__ src,
+                     int64_t const *__restrict__ idx, int n,
+                     T *__restrict__ dst, int cols) {
+  int const lane = threadIdx.x % 32;
+  for (int i = blockIdx.x * kRowWarps + threadIdx.x / 32; i < n;
+       i += gridDim.x * kRowWarps)
+    copy_row_warp<T, kVec>(src + idx[i] * cols, dst + int64_t(i) * cols, cols,
+                           lane);
+}
+
+// Scatter over sorted (keys, order), one warp per segment of RowScatterPlan.
+// head[p] is the first position of p's run, and slot[s] the partial row of
+// segment s when it is not its run's first. A copy is done by the segment
+// holding the run's last row. An add sums the segment in index order in
+// registers, on top of dst for the run's first segment and into its partial
+// row otherwise.
+template <typename T, bool kAdd, bool kVec>
+__global__ static void __launch_bounds__(32 * kRowWarps)
+    scatterSegmentsKernel(T const *__restrict__ src,
+                          int64_t const *__restrict__ keys,
+                          int32_t const *__restrict__ order,
+                          int32_t const *__restrict__ head,
+                          int32_t const *__restrict__ seg_start,
+                          int32_t const *__restrict__ slot, int segments,
+                          T *__restrict__ dst, T *__restrict__ partial,
+                          int cols) {
+  int const lane = threadIdx.x % 32;
+  for (int s = blockIdx.x * kRowWarps + threadIdx.x / 32; s < segments;
+       s += gridDim.x * kRowWarps) {
+    int const begin = seg_start[s], end = seg_start[s + 1];
+    int64_t const row = keys[begin];
+    if constexpr (!kAdd) {
+      if (s + 1 == segments || head[end] == end)
+        copy_row_warp<T, kVec>(src + int64_t(order[end - 1]) * cols,
+                               dst + row * cols, cols, lane);
+      continue;
+    }
+    bool const first = head[begin] == begin;
+    T *d = first ? dst + row * cols : partial + int64_t(slot[s]) * cols;
+    if constexpr (kVec) {
+      constexpr int kPerVec = 16 / sizeof(T);
+      for (int v = lane; v < cols / kPerVec; v += 32) {
+        int m = begin;
+        uint4 acc = first ? reinterpret_cast<uint4 *>(d)[v]
+                          : reinterpret_cast<uint4 const *>(
+                                src + int64_t(order[m++]) * cols)[v];
+        T *a = reinterpret_cast<T *>(&acc);
+        for (; m < end; ++m) {
+          uint4 w = reinterpret_cast<uint4 const *>(
+              src + int64_t(order[m]) * cols)[v];
+          T const *e = reinterpret_cast<T const *>(&w);
+          CUTE_UNROLL
+          for (int k = 0; k < kPerVec; ++k)
+            a[k] = T(a[k] + e[k]);
+        }
+        reinterpret_cast<uint4 *>(d)[v] = acc;
+      }
+    } else {
+      for (int c = lane; c < cols; c += 32) {
+        int m = begin;
+        T acc = first ? d[c] : src[int64_t(order[m++]) * cols + c];
+        for (; m < end; ++m)
+          acc = T(acc + src[int64_t(order[m]) * cols + c]);
+        d[c] = acc;
+      }
+    }
+  }
+}
+
+// Adds the partial rows of each run of several segments to its dst row in
+// segment order, in registers. One warp per run, found at the run's first
+// segment.
+template <typename T, bool kVec>
+__global__ static void __launch_bounds__(32 * kRowWarps)
+    scatterCombineKernel(int64_t const *__restrict__ keys,
+                         int32_t const *__restrict__ head,
+                         int32_t const *__restrict__ seg_start,
+                         int32_t const *__restrict__ slot, int segments,
+                         T *__restrict__ dst, T const *__restrict__ partial,
+                         int cols) {
+  int const lane = threadIdx.x % 32;
+  for (int s = blockIdx.x * kRowWarps + threadIdx.x / 32; s < segments;
+       s += gridDim.x * kRowWarps) {
+    int const begin = seg_start[s];
+    int end = s + 1; // one past the run's last segment
+    if (head[begin] != begin)
+      continue;
+    while (end < segments && head[seg_start[end]] != seg_start[end])
+      ++end;
+    if (end == s + 1)
+      continue;
+    T *d = dst + keys[begin] * cols;
+    if constexpr (kVec) {
+      constexpr int kPerVec = 16 / sizeof(T);
+      for (int v = lane; v < cols / kPerVec; v += 32) {
+        uint4 acc = reinterpret_cast<uint4 *>(d)[v];
+        T *a = reinterpret_cast<T *>(&acc);
+        for (int t = s + 1; t < end; ++t) {
+          uint4 w = reinterpret_cast<uint4 const *>(
+              partial + int64_t(slot[t]) * cols)[v];
+          T const *e = reinterpret_cast<T const *>(&w);
+          CUTE_UNROLL
+          for (int k = 0; k < kPerVec; ++k)
+            a[k] = T(a[k] + e[k]);
+        }
+        reinterpret_cast<uint4 *>(d)[v] = acc;
+      }
+    } else {
+      for (int c = lane; c < cols; c += 32) {
+        T acc = d[c];
+        for (int t = s + 1; t < end; ++t)
+          acc = T(acc + partial[int64_t(slot[t]) * cols + c]);
+        d[c] = acc;
+      }
+    }
+  }
+}
+
+// Unsorted scatter-add baseline: one warp per source row, one atomic per
+// element.
+template <typename T>
+__global__ static void __launch_bounds__(32 * kRowWarps)
+    scatterAtomicKernel(T const *__restrict__ src,
+                        int64_t const *__restrict__ idx, int n, T *dst,
+                        int cols) {
+  int const lane = threadIdx.x % 32;
+  for (int i = blockIdx.x * kRowWarps + threadIdx.x / 32; i < n;
+       i += gridDim.x * kRowWarps)
+    for (int c = lane; c < cols; c += 32)
+      atomicAdd(dst + idx[i] * cols + c, src[int64_t(i) * cols + c]);
+}
+
+template <typename T>
+bool rows_vectorizable(void const *a, void const *b, int cols) {
+  return (size_t(cols) * sizeof(T)) % 16 == 0 &&
+         reinterpret_cast<uintptr_t>(a) % 16 == 0 &&
+         reinterpret_cast<uintptr_t>(b) % 16 == 0;
+}
+
+inline int row_grid(int n) {
+  int device, sms;
+  cudaGetDevice(&device);
+  cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+  return std::max(1, std::min((n + kRowWarps - 1) / kRowWarps, 8 * sms));
+}
+
+// Throws std::invalid_argument unless every index of the device array idx
+// lies in [0, rows). One reduction and a copy of two indices to the host.
+inline void check_row_indices_device(int64_t const *idx, int n, int64_t rows,
+                                     cudaStream_t stream = 0) {
+  if (n == 0)
+    return;
+  auto first = thrust::device_pointer_cast(idx);
+  auto range =
+      thrust::minmax_element(thrust::cuda::par.on(stream), first, first + n);
+  int64_t const extremes[2] = {*range.first, *range.second};
+  for (int64_t i : extremes)
+    if (i < 0 || i >= rows)
+      throw std::invalid_argument("index " + std::to_string(i) +
+                                  " is out of range for " +
+                                  std::to_string(rows) + " rows");
+}
+
+// dst[i] = src[idx[i]] for i < n; idx is a device array of in-range rows
+// (check_row_indices_device).
+template <typename T>
+void gather_rows(T const *src, int64_t const *idx, int n, T *dst, int cols,
+                 cudaStream_t stream = 0) {
+  cfk::utils::ScopedRange range("gather_rows", cfk::utils::dtype_name<T>(),
+                                {n, cols});
+  if (n == 0)
+    return;
+  if (rows_vectorizable<T>(src, dst, cols))
+    gatherRowsKernel<T, true>
+        <<<row_grid(n), 32 * kRowWarps, 0, stream>>>(src, idx, n, dst, cols);
+  else
+    gatherRowsKernel<T, false>
+        <<<row_grid(n), 32 * kRowWarps, 0, stream>>>(src, idx, n, dst, cols);
+}
+
+// Position p's run head, p if keys[p] starts a run and 0 otherwise; an
+// inclusive max-scan carries it over the run.
+struct ScatterRunHead {
+  int64_t const *keys;
+  __host__ __device__ int operator()(int p) const {
+    return p == 0 || keys[p] != keys[p - 1] ? p : 0;
+  }
+};
+
+// Whether position p starts a segment.
+struct ScatterSegmentStart {
+  int32_t const *head;
+  __host__ __device__ bool operator()(int p) const {
+    return (p - head[p]) % kScatterSegmentRows == 0;
+  }
+};
+
+// 1 when segment s is not the first of its run, and so needs a partial row.
+struct ScatterNeedsPartial {
+  int32_t const *head, *seg_start;
+  __host__ __device__ int operator()(int s) const {
+    return head[seg_start[s]] != seg_start[s];
+  }
+};
+
+// The device side of ScatterPlan: idx checked against dst_rows and sorted
+// stably, with the permutation, each position's run head and the segments.
+// Keep one around when the same indices scatter several tensors, e.g. the
+// gradients of several embedding tables.
+class RowScatterPlan {
+public:
+  RowScatterPlan(int64_t const *idx, int n, int64_t dst_rows,
+                 cudaStream_t stream = 0)
+      : keys_(thrust::device_pointer_cast(idx),
+              thrust::device_pointer_cast(idx) + n),
+        order_(n), head_(n), seg_start_(n + 1) {
+    cfk::utils::ScopedRange range("row_scatter_plan", "int64", {n});
+    CFK_HOST_STAGE(plan_timer, "scatter.sort");
+    check_row_indices_device(idx, n, dst_rows, stream);
+    auto policy = thrust::cuda::par.on(stream);
+    thrust::sequence(policy, order_.begin(), order_.end());
+    thrust::stable_sort_by_key(policy, keys_.begin(), keys_.end(),
+                               order_.begin());
+    if (n == 0)
+      return;
+
+    thrust::counting_iterator<int> pos(0);
+    int32_t *head = thrust::raw_pointer_cast(head_.data());
+    thrust::inclusive_scan(
+        policy,
+        thrust::make_transform_iterator(
+            pos, ScatterRunHead{thrust::raw_pointer_cast(keys_.data())}),
+        thrust::make_transform_iterator(
+            pos + n, ScatterRunHead{thrust::raw_pointer_cast(keys_.data())}),
+        head_.begin(), thrust::maximum<int>());
+    segments_ = int(thrust::copy_if(policy, pos, pos + n, seg_start_.begin(),
+                                    ScatterSegmentStart{head}) -
+                    seg_start_.begin());
+    seg_start_[segments_] = n;
+    seg_start_.resize(segments_ + 1);
+
+    slot_.resize(segments_);
+    auto needs_partial = thrust::make_transform_iterator(
+        pos, ScatterNeedsPartial{head,
+                                 thrust::raw_pointer_cast(seg_start_.data())});
+    thrust::exclusive_scan(policy, needs_partial, needs_partial + segments_,
+                           slot_.begin());
+    partials_ = thrust::reduce(policy, needs_partial,
+                               needs_partial + segments_);
+  }
+
+  int size() const { return int(keys_.size()); }
+
+  template <typename T, bool kAdd>
+  void apply(T const *src, T *dst, int cols, cudaStream_t stream = 0) const {
+    cfk::utils::ScopedRange range(kAdd ? "scatter_add_rows" : "scatter_rows",
+                                  cfk::utils::dtype_name<T>(),
+                                  {size(), cols});
+    if (segments_ == 0)
+      return;
+    int64_t const *keys = thrust::raw_pointer_cast(keys_.data());
+    int32_t const *order = thrust::raw_pointer_cast(order_.data());
+    int32_t const *head = thrust::raw_pointer_cast(head_.data());
+    int32_t const *seg_start = thrust::raw_pointer_cast(seg_start_.data());
+    int32_t const *slot = thrust::raw_pointer_cast(slot_.data());
+    size_t const partial_bytes = size_t(partials_) * cols * sizeof(T);
+    if (kAdd && partial_.size() < partial_bytes)
+      partial_.resize(partial_bytes);
+    T *partial = reinterpret_cast<T *>(thrust::raw_pointer_cast(partial_.data()));
+
+    auto launch = [&](auto vec) {
+      constexpr bool kVec = decltype(vec)::value;
+      scatterSegmentsKernel<T, kAdd, kVec>
+          <<<row_grid(segments_), 32 * kRowWarps, 0, stream>>>(
+              src, keys, order, head, seg_start, slot, segments_, dst,
+              partial, cols);
+      if (kAdd && partials_ > 0)
+        scatterCombineKernel<T, kVec>
+            <<<row_grid(segments_), 32 * kRowWarps, 0, stream>>>(
+                keys, head, seg_start, slot, segments_, dst, partial, cols);
+    };
+    if (rows_vectorizable<T>(src, dst, cols))
+      launch(std::true_type{});
+    else
+      launch(std::false_type{});
+  }
+
+private:
+  thrust::device_vector<int64_t> keys_;
+  thrust::device_vector<int32_t> order_;
+  thrust::device_vector<int32_t> head_;      // first position of each run
+  thrust::device_vector<int32_t> seg_start_; // segments + 1
+  thrust::device_vector<int32_t> slot_;      // partial row of each segment
+  int segments_ = 0, partials_ = 0;
+  mutable thrust::device_vector<char> partial_; // grown by apply
+};
+
+// dst[idx[i]] = src[i], or += with kAdd, for a dst of dst_rows rows. Sorts
+// on every call; keep a RowScatterPlan when the indices repeat.
+template <typename T, bool kAdd>
+void scatter_rows(T const *src, int64_t const *idx, int n, T *dst,
+                  int64_t dst_rows, int cols, cudaStream_t stream = 0) {
+  RowScatterPlan(idx, n, dst_rows, stream)
+      .apply<T, kAdd>(src, dst, cols, stream);
+}
+
+// Embedding-style gather of n rows out of a (rows, cols) table, then the
+// matching scatter-add of n gradient rows back into it: atomics against
+// the sorted scatter. Indices are skewed, so hot rows repeat many times.
+template <typename T = float>
+int benchmark_gather_scatter(int rows, int n, int cols, int iterations = 10,
+                             bool verify = true) {
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  size_t const table_size = size_t(rows) * cols, rows_size = size_t(n) * cols;
+  std::vector<int64_t> h_idx = skewed_indices(n, rows, seed);
+  thrust::device_vector<int64_t> d_idx(h_idx.begin(), h_idx.end());
+  int64_t const *idx = thrust::raw_pointer_cast(d_idx.data());
+  thrust::device_vector<T> d_table(table_size), d_rows(rows_size);
+  T *table = thrust::raw_pointer_cast(d_table.data());
+  T *out = thrust::raw_pointer_cast(d_rows.data());
+  cfk::utils::fill_random(table, table_size, seed);
+  std::cout << n << " rows of " << cols << " from a table of " << rows
+            << std::endl;
+
+  auto trials = [&](auto &&run, double bytes) {
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      run();
+      cudaError result = cudaDeviceSynchronize();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+                << ")" << std::endl;
+    }
+    return 0;
+  };
+
+  std::cout << "Gather (index_select):" << std::endl;
+  if (trials([&] { gather_rows(table, idx, n, out, cols); },
+             2.0 * rows_size * sizeof(T)) != 0)
+    return -1;
+  if (verify)
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_on_device(
+            out, rows_size, ExpectGather<T>{seed, idx, int64_t(cols)}),
+        cols);
+
+  // Scatter-add the gathered rows back; dst starts at zero every trial.
+  double const scatter_bytes = 3.0 * rows_size * sizeof(T);
+  std::cout << "Scatter-add (index_add), atomics:" << std::endl;
+  auto atomics = [&] {
+    thrust::fill(d_table.begin(), d_table.end(), T(0));
+    scatterAtomicKernel<T>
+        <<<row_grid(n), 32 * kRowWarps>>>(out, idx, n, table, cols);
+  };
+  if (trials(atomics, scatter_bytes) != 0)
+    return -1;
+
+  std::cout << "Scatter-add (index_add), sorted runs:" << std::endl;
+  auto sorted = [&] {
+    thrust::fill(d_table.begin(), d_table.end(), T(0));
+    scatter_rows<T, true>(out, idx, n, table, rows, cols);
+  };
+  if (trials(sorted, scatter_bytes) != 0)
+    return -1;
+
+  if (verify) {
+    thrust::host_vector<T> h_rows = d_rows, h_table = d_table;
+    std::vector<T> want(table_size, T(0));
+    scatter_rows_cpu<T, true>(h_rows.data(), h_idx.data(), n, want.data(),
+                              rows, cols);
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_cpu(h_table.data(), table_size,
+                               [&](size_t i) { return want[i]; }),
+        cols);
+  }
+  return 0;
+}
+
+// Host counterpart on the task runtime.
+template <typename T = float>
+int benchmark_gather_scatter_cpu(int rows, int n, int cols,
+                                 int iterations = 10, bool verify = true) {
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  size_t const table_size = size_t(rows) * cols, rows_size = size_t(n) * cols;
+  std::vector<int64_t> idx = skewed_indices(n, rows, seed);
+  cfk::utils::HostBuffer<T> table(table_size), out(rows_size);
+  cfk::utils::fill_random_cpu(table.data(), table_size, seed);
+  std::cout << n << " rows of " << cols << " from a table of " << rows
+            << std::endl;
+
+  auto trials = [&](auto &&run, double bytes) {
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      run();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::with_peak(1e-6 * bytes / time_ms, "GB/s",
+                                         "cpu.stream_copy_gbs")
+                << ")" << std::endl;
+    }
+  };
+
+  std::cout << "Gather (index_select):" << std::endl;
+  auto gather = [&] {
+    gather_rows_cpu(table.data(), rows, idx.data(), n, out.data(), cols);
+  };
+  trials(gather, 2.0 * rows_size * sizeof(T));
+  if (verify)
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_cpu(
+            out.data(), rows_size,
+            ExpectGather<T>{seed, idx.data(), int64_t(cols)}),
+        cols);
+
+  std::cout << "Scatter-add (index_add), plan and sorted runs:" << std::endl;
+  auto scatter_add = [&] {
+    std::fill(table.data(), table.data() + table_size, T(0));
+    scatter_rows_cpu<T, true>(out.data(), idx.data(), n, table.data(), rows,
+                              cols);
+  };
+  trials(scatter_add, 3.0 * rows_size * sizeof(T));
+  if (verify) {
+    std::vector<T> want(table_size, T(0));
+    scatter_add_segmented_reference(out.data(), idx.data(), n, want.data(),
+                                    rows, cols);
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_cpu(table.data(), table_size,
+                               [&](size_t i) { return want[i]; }),
+        cols);
+  }
+  return 0;
+}
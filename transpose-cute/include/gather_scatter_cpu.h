@@ -0,0 +1,330 @@
+#pragma once
+
+// Row gather and scatter along the outer dimension of row-major tensors
+// (index_select, index_copy, index_add), the plan that makes scatters
+// deterministic, and the CPU backend that runs on it. The GPU kernels are in
+// gather_scatter.h.
+//
+// Gather: dst[i] = src[idx[i]]. Rows are independent.
+// Scatter: dst[idx[i]] = src[i], or dst[idx[i]] += src[i] with kAdd.
+// Indices may repeat, so the source rows are first sorted by destination
+// (stable). Each run of equal destinations then has a single owner: a copy
+// keeps the run's last row. An add splits the run into segments of
+// kScatterSegmentRows rows, so that a hot row is summed by many workers.
+// The first segment sums in index order on top of dst, each later one sums
+// its own rows in index order, and their sums are added to dst in order.
+// There are no atomics and the order is fixed, so the result is
+// deterministic, and bit for bit that of the sequential loop for runs of up
+// to kScatterSegmentRows rows (scatter_add_segmented_reference).
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_device.hpp"
+#include "philox.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+// Throws std::invalid_argument unless every index lies in [0, rows).
+inline void check_row_indices(int64_t const *idx, int n, int64_t rows) {
+  for (int i = 0; i < n; ++i)
+    if (idx[i] < 0 || idx[i] >= rows)
+      throw std::invalid_argument("index " + std::to_string(idx[i]) +
+                                  " at position " + std::to_string(i) +
+                                  " is out of range for " +
+                                  std::to_string(rows) + " rows");
+}
+
+// Rows of a run summed by one worker before the partial sums are combined.
+constexpr int kScatterSegmentRows = 32;
+
+struct ScatterPlan {
+  std::vector<int32_t> order;     // source rows sorted by destination
+  std::vector<int32_t> run_start; // runs of one destination, runs + 1
+  std::vector<int64_t> run_dst;   // destination row of each run
+  std::vector<int32_t> seg_start; // runs cut every kScatterSegmentRows rows
+  std::vector<int32_t> seg_run;   // run of each segment
+  std::vector<int32_t> run_seg;   // first segment of each run, runs + 1
+
+  int runs() const { return int(run_dst.size()); }
+  int segments() const { return int(seg_run.size()); }
+};
+
+// Counting sort of the source rows by destination, O(n + dst_rows).
+inline ScatterPlan make_scatter_plan(int64_t const *idx, int n,
+                                     int64_t dst_rows) {
+  check_row_indices(idx, n, dst_rows);
+  std::vector<int32_t> start(dst_rows + 1, 0);
+  for (int i = 0; i < n; ++i)
+    ++start[idx[i] + 1];
+  for (int64_t r = 0; r < dst_rows; ++r)
+    start[r + 1] += start[r];
+
+  ScatterPlan plan;
+  plan.order.resize(n);
+  plan.run_start.assign(1, 0);
+  for (int i = 0; i < n; ++i)
+    plan.order[start[idx[i]]++] = i;
+  // start[r] is now the end of destination r's run.
+  for (int64_t r = 0, begin = 0; r < dst_rows; begin = start[r++])
+    if (start[r] > begin) {
+      plan.run_dst.push_back(r);
+      plan.run_start.push_back(start[r]);
+    }
+
+  plan.run_seg.assign(1, 0);
+  for (int r = 0; r < plan.runs(); ++r) {
+    for (int m = plan.run_start[r]; m < plan.run_start[r + 1];
+         m += kScatterSegmentRows) {
+      plan.seg_start.push_back(m);
+      plan.seg_run.push_back(r);
+    }
+    plan.run_seg.push_back(plan.segments());
+  }
+  plan.seg_start.push_back(n);
+  return plan;
+}
+
+template <typename T>
+void gather_rows_cpu(T const *src, int64_t src_rows, int64_t const *idx,
+                     int n, T *dst, int cols) {
+  check_row_indices(idx, n, src_rows);
+  cfk::utils::parallel_for(0, n, 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      std::memcpy(dst + i * cols, src + idx[i] * cols, cols * sizeof(T));
+  });
+}
+
+// A copy runs one task per run of the plan. An add runs one task per
+// segment, then one per run of several segments to fold the partial sums
+// into dst. Segment s of run r, if it is not the run's first, sums into
+// partial row s - r - 1.
+template <typename T, bool kAdd>
+void scatter_rows_cpu(T const *src, ScatterPlan const &plan, T *dst,
+                      int cols) {
+  if constexpr (!kAdd) {
+    cfk::utils::parallel_for(0, plan.runs(), 0, [&](size_t lo, size_t hi) {
+      for (size_t r = lo; r < hi; ++r)
+        std::memcpy(dst + plan.run_dst[r] * cols,
+                    src + int64_t(plan.order[plan.run_start[r + 1] - 1]) * cols,
+                    cols * sizeof(T));
+    });
+  } else {
+    std::vector<T> partial(size_t(plan.segments() - plan.runs()) * cols);
+    cfk::utils::parallel_for(0, plan.segments(), 0, [&](size_t lo,
+                                                        size_t hi) {
+      for (size_t s = lo; s < hi; ++s) {
+        int const r = plan.seg_run[s];
+        int begin = plan.seg_start[s];
+        int const end = plan.seg_start[s + 1];
+        T *d = dst + plan.run_dst[r] * cols;
+        if (int(s) != plan.run_seg[r]) {
+          d = partial.data() + size_t(s - r - 1) * cols;
+          std::memcpy(d, src + int64_t(plan.order[begin++]) * cols,
+                      cols * sizeof(T));
+        }
+        for (int m = begin; m < end; ++m) {
+          T const *e = src + int64_t(plan.order[m]) * cols;
+          for (int c = 0; c < cols; ++c)
+            d[c] = T(d[c] + e[c]);
+        }
+      }
+    });
+    cfk::utils::parallel_for(0, plan.runs(), 0, [&](size_t lo, size_t hi) {
+      for (size_t r = lo; r < hi; ++r) {
+        T *d = dst + plan.run_dst[r] * cols;
+        for (int s = plan.run_seg[r] + 1; s < plan.run_seg[r + 1]; ++s) {
+          T const *e = partial.data() + size_t(s - r - 1) * cols;
+          for (int c = 0; c < cols; ++c)
+            d[c] = T(d[c] + e[c]);
+        }
+      }
+    });
+  }
+}
+
+template <typename T, bool kAdd>
+void scatter_rows_cpu(T const *src, int64_t const *idx, int n, T *dst,
+                      int64_t dst_rows, int cols) {
+  scatter_rows_cpu<T, kAdd>(src, make_scatter_plan(idx, n, dst_rows), dst,
+                            cols);
+}
+
+// The sequential loop. A copy must match it bit for bit, an add within
+// rounding (exactly for runs of up to kScatterSegmentRows rows).
+template <typename T, bool kAdd>
+void scatter_rows_reference(T const *src, int64_t const *idx, int n, T *dst,
+                            int cols) {
+  for (int i = 0; i < n; ++i)
+    for (int c = 0; c < cols; ++c) {
+      T &d = dst[idx[i] * cols + c];
+      d = kAdd ? T(d + src[int64_t(i) * cols + c]) : src[int64_t(i) * cols + c];
+    }
+}
+
+// The add order the scatter must reproduce bit for bit, from idx alone:
+// each destination's source rows in index order, summed in segments of
+// kScatterSegmentRows as described at the top of this file.
+template <typename T>
+void scatter_add_segmented_reference(T const *src, int64_t const *idx, int n,
+                                     T *dst, int64_t dst_rows, int cols) {
+  std::vector<std::vector<int>> rows(dst_rows);
+  for (int i = 0; i < n; ++i)
+    rows[idx[i]].push_back(i);
+  std::vector<T> sum(cols);
+  for (int64_t r = 0; r < dst_rows; ++r)
+    for (size_t m0 = 0; m0 < rows[r].size(); m0 += kScatterSegmentRows) {
+      size_t const m1 = std::min(rows[r].size(), m0 + kScatterSegmentRows);
+      T *d = dst + r * cols;
+      if (m0 > 0) {
+        std::copy(src + int64_t(rows[r][m0]) * cols,
+                  src + int64_t(rows[r][m0] + 1) * cols, sum.begin());
+        d = sum.data();
+      }
+      for (size_t m = m0 + (m0 > 0); m < m1; ++m)
+        for (int c = 0; c < cols; ++c)
+          d[c] = T(d[c] + src[int64_t(rows[r][m]) * cols + c]);
+      if (m0 > 0)
+        for (int c = 0; c < cols; ++c)
+          dst[r * cols + c] = T(dst[r * cols + c] + sum[c]);
+    }
+}
+
+// Indices for the benchmarks and the check: rows * u^2 for uniform u, so
+// low rows repeat often, as in embedding lookups of skewed token ids.
+inline std::vector<int64_t> skewed_indices(int n, int64_t rows,
+                                           uint64_t seed) {
+  std::vector<int64_t> idx(n);
+  for (int i = 0; i < n; ++i) {
+    double const u = cfk::utils::philox_bits(seed, i) * 0x1p-32;
+    idx[i] = std::min(rows - 1, int64_t(double(rows) * u * u));
+  }
+  return idx;
+}
+
+// dst[i] = src[idx[i]] for a (rows, cols) src drawn from `seed`. `idx` must
+// be readable where the functor runs.
+template <class T> struct ExpectGather {
+  uint64_t seed;
+  int64_t const *idx;
+  int64_t cols;
+  CFK_HOST_DEVICE T operator()(uint64_t d) const {
+    return cfk::utils::random_value<T>(seed, idx[d / cols] * cols + d % cols);
+  }
+};
+
+// Checks the plan and the CPU backend, run with --check-gather: the sort is
+// stable and covers every source row once, the segments cut each run every
+// kScatterSegmentRows rows, a scatter matches the sequential loop bit for
+// bit and an add matches the segmented order bit for bit and the
+// sequential loop within rounding, with heavy repetition. Bad indices are
+// rejected.
+inline bool check_gather_scatter() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Gather/scatter check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  int const cols = 37;
+  for (int n : {0, 1, 1000, 20000})
+    for (int64_t rows : {int64_t(1), int64_t(300), int64_t(100000)}) {
+      std::string const shape =
+          std::to_string(n) + " indices into " + std::to_string(rows) + " rows";
+      std::vector<int64_t> idx = skewed_indices(n, rows, n + rows);
+      ScatterPlan plan = make_scatter_plan(idx.data(), n, rows);
+
+      std::vector<int> seen(n, 0);
+      for (int r = 0; r < plan.runs(); ++r)
+        for (int m = plan.run_start[r]; m < plan.run_start[r + 1]; ++m) {
+          ++seen[plan.order[m]];
+          if (idx[plan.order[m]] != plan.run_dst[r] ||
+              (m > plan.run_start[r] && plan.order[m] < plan.order[m - 1]))
+            fail("plan order, " + shape);
+        }
+      if (plan.run_start.back() != n ||
+          std::count(seen.begin(), seen.end(), 1) != n)
+        fail("plan coverage, " + shape);
+      for (int r = 0; r < plan.runs(); ++r)
+        for (int s = plan.run_seg[r]; s < plan.run_seg[r + 1]; ++s)
+          if (plan.seg_run[s] != r ||
+              plan.seg_start[s] !=
+                  plan.run_start[r] + (s - plan.run_seg[r]) * kScatterSegmentRows ||
+              plan.seg_start[s + 1] - plan.seg_start[s] < 1 ||
+              plan.seg_start[s + 1] - plan.seg_start[s] > kScatterSegmentRows)
+            fail("plan segments, " + shape);
+      if (plan.run_seg.back() != plan.segments() ||
+          plan.seg_start.back() != n)
+        fail("plan segment coverage, " + shape);
+
+      size_t const in_size = size_t(n) * cols, out_size = size_t(rows) * cols;
+      std::vector<float> src(in_size), want(out_size), got(out_size);
+      cfk::utils::fill_random_cpu(src.data(), in_size, 1);
+      cfk::utils::fill_random_cpu(want.data(), out_size, 2);
+      got = want;
+      scatter_rows_reference<float, false>(src.data(), idx.data(), n,
+                                           want.data(), cols);
+      scatter_rows_cpu<float, false>(src.data(), plan, got.data(), cols);
+      if (std::memcmp(got.data(), want.data(), out_size * sizeof(float)))
+        fail("scatter, " + shape);
+
+      // The add, against the segmented order and the sequential loop. The
+      // two orders differ by at most 2 * run length * eps * the sum of the
+      // magnitudes added.
+      std::vector<float> sequential(out_size), bound(out_size);
+      cfk::utils::fill_random_cpu(want.data(), out_size, 2);
+      got = sequential = want;
+      for (size_t i = 0; i < out_size; ++i)
+        bound[i] = std::abs(want[i]);
+      std::vector<int> run_length(rows, 0);
+      for (int i = 0; i < n; ++i) {
+        ++run_length[idx[i]];
+        for (int c = 0; c < cols; ++c)
+          bound[idx[i] * cols + c] += std::abs(src[int64_t(i) * cols + c]);
+      }
+      scatter_add_segmented_reference(src.data(), idx.data(), n, want.data(),
+                                      rows, cols);
+      scatter_rows_reference<float, true>(src.data(), idx.data(), n,
+                                          sequential.data(), cols);
+      scatter_rows_cpu<float, true>(src.data(), plan, got.data(), cols);
+      if (std::memcmp(got.data(), want.data(), out_size * sizeof(float)))
+        fail("scatter-add, " + shape);
+      for (size_t i = 0; i < out_size; ++i)
+        if (std::abs(got[i] - sequential[i]) >
+            2.0f * run_length[i / cols] * 0x1p-23f * bound[i]) {
+          fail("scatter-add against the sequential loop, " + shape);
+          break;
+        }
+      if (plan.segments() == plan.runs() &&
+          std::memcmp(got.data(), sequential.data(), out_size * sizeof(float)))
+        fail("scatter-add of short runs, " + shape);
+
+      std::vector<float> table(out_size), gathered(in_size);
+      cfk::utils::fill_random_cpu(table.data(), out_size, 3);
+      gather_rows_cpu(table.data(), rows, idx.data(), n, gathered.data(),
+                      cols);
+      auto report = cfk::utils::verify_cpu(
+          gathered.data(), in_size, ExpectGather<float>{3, idx.data(), cols});
+      if (!report.ok())
+        fail("gather, " + shape);
+    }
+
+  for (int64_t bad : {int64_t(-1), int64_t(10)}) {
+    std::vector<int64_t> idx = {0, 3, bad};
+    try {
+      make_scatter_plan(idx.data(), 3, 10);
+      fail("index " + std::to_string(bad) + " accepted");
+    } catch (std::invalid_argument const &) {
+    }
+  }
+
+  if (ok)
+    std::cout << "Gather/scatter check passed." << std::endl;
+  return ok;
+}
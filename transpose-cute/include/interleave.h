@@ -0,0 +1,124 @@
+#pragma once
+
+// Interleaved <-> planar conversion, e.g. complex (re, im) pairs to split
+// re / im arrays, or RGBA pixels to four channel planes, and back.
+//
+// Both are transposes with a tiny inner dimension: deinterleave is the
+// (P, C) -> (C, P) transpose of P pixels with C channels, interleave the
+// (C, P) -> (P, C) one. They take TransposeParams with N == C resp.
+// M == C, so the usual benchmark() and its verification apply. The 64x64
+// tile kernels waste almost all of each tile here. Instead each thread
+// moves kVec whole pixels: C 16-byte loads, a register permutation, and C
+// 16-byte stores, one per plane.
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+#include <cute/tensor.hpp>
+
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "util.h"
+
+template <typename T, int kChannels, int kVec>
+__global__ static void __launch_bounds__(256)
+    deinterleaveKernel(T const *__restrict__ input, T *__restrict__ output,
+                       size_t P) {
+  using Vec = cute::uint_bit_t<8 * sizeof(T) * kVec>;
+  size_t const groups = P / kVec;
+  for (size_t g = size_t(blockIdx.x) * blockDim.x + threadIdx.x; g < groups;
+       g += size_t(gridDim.x) * blockDim.x) {
+    alignas(sizeof(Vec)) T in[kChannels * kVec];
+    alignas(sizeof(Vec)) T out[kChannels][kVec];
+    CUTE_UNROLL
+    for (int c = 0; c < kChannels; ++c)
+      reinterpret_cast<Vec *>(in)[c] =
+          reinterpret_cast<Vec const *>(input + g * kVec * kChannels)[c];
+    CUTE_UNROLL
+    for (int c = 0; c < kChannels; ++c) {
+      CUTE_UNROLL
+      for (int k = 0; k < kVec; ++k)
+        out[c][k] = in[k * kChannels + c];
+    }
+    CUTE_UNROLL
+    for (int c = 0; c < kChannels; ++c)
+      *reinterpret_cast<Vec *>(output + c * P + g * kVec) =
+          *reinterpret_cast<Vec *>(out[c]);
+  }
+}
+
+template <typename T, int kChannels, int kVec>
+__global__ static void __launch_bounds__(256)
+    interleaveKernel(T const *__restrict__ input, T *__restrict__ output,
+                     size_t P) {
+  using Vec = cute::uint_bit_t<8 * sizeof(T) * kVec>;
+  size_t const groups = P / kVec;
+  for (size_t g = size_t(blockIdx.x) * blockDim.x + threadIdx.x; g < groups;
+       g += size_t(gridDim.x) * blockDim.x) {
+    alignas(sizeof(Vec)) T in[kChannels][kVec];
+    alignas(sizeof(Vec)) T out[kChannels * kVec];
+    CUTE_UNROLL
+    for (int c = 0; c < kChannels; ++c)
+      *reinterpret_cast<Vec *>(in[c]) =
+          *reinterpret_cast<Vec const *>(input + c * P + g * kVec);
+    CUTE_UNROLL
+    for (int k = 0; k < kVec; ++k) {
+      CUTE_UNROLL
+      for (int c = 0; c < kChannels; ++c)
+        out[k * kChannels + c] = in[c][k];
+    }
+    CUTE_UNROLL
+    for (int c = 0; c < kChannels; ++c)
+      reinterpret_cast<Vec *>(output + g * kVec * kChannels)[c] =
+          reinterpret_cast<Vec *>(out)[c];
+  }
+}
+
+// 16-byte vectors need P to be a multiple of the pixels per vector and
+// 16-byte aligned buffers; anything else takes the one-pixel-per-step path.
+template <typename T>
+bool use_vector_path(T const *input, T const *output, size_t P) {
+  constexpr size_t kVec = 16 / sizeof(T);
+  return P % kVec == 0 && reinterpret_cast<uintptr_t>(input) % 16 == 0 &&
+         reinterpret_cast<uintptr_t>(output) % 16 == 0;
+}
+
+inline dim3 interleave_grid(size_t groups) {
+  return dim3(unsigned(std::min<size_t>((groups + 255) / 256, 1u << 20)));
+}
+
+// params.input is (P, kChannels), params.output (kChannels, P).
+template <typename T, int kChannels>
+void deinterleave(TransposeParams<T> params) {
+  cfk::utils::ScopedRange range("deinterleave",
+                                cfk::utils::dtype_name<T>(),
+                                {params.M, params.N});
+  assert(params.N == kChannels);
+  CFK_HOST_STAGE(launch_timer, "deinterleave.launch");
+  size_t const P = params.M;
+  constexpr int kVec = 16 / sizeof(T);
+  if (use_vector_path(params.input, params.output, P))
+    deinterleaveKernel<T, kChannels, kVec>
+        <<<interleave_grid(P / kVec), 256>>>(params.input, params.output, P);
+  else
+    deinterleaveKernel<T, kChannels, 1>
+        <<<interleave_grid(P), 256>>>(params.input, params.output, P);
+}
+
+// params.input is (kChannels, P), params.output (P, kChannels).
+template <typename T, int kChannels>
+void interleave(TransposeParams<T> params) {
+  cfk::utils::ScopedRange range("interleave", cfk::utils::dtype_name<T>(),
+                                {params.M, params.N});
+  assert(params.M == kChannels);
+  CFK_HOST_STAGE(launch_timer, "interleave.launch");
+  size_t const P = params.N;
+  constexpr int kVec = 16 / sizeof(T);
+  if (use_vector_path(params.input, params.output, P))
+    interleaveKernel<T, kChannels, kVec>
+        <<<interleave_grid(P / kVec), 256>>>(params.input, params.output, P);
+  else
+    interleaveKernel<T, kChannels, 1>
+        <<<interleave_grid(P), 256>>>(params.input, params.output, P);
+}
@@ -0,0 +1,393 @@
+#pragma once
+
+// Multi-tensor copy and scale in one persistent launch, in the style of
+// multi_tensor_apply.
+//
+// MultiTensorPlan uploads the src / dst pointer lists and the chunk table
+// (multi_tensor_cpu.h) to the device once. Every copy() / scale() after that
+// is a single launch of about four CTAs per SM, which walk the table; there
+// is no per-tensor launch or CuTe setup. Reuse a plan when the same list is
+// processed every step, e.g. an optimizer's parameters; the one-shot forms
+// do so through a small cache of recent plans.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <thrust/device_vector.h>
+#include <thrust/fill.h>
+
+#include <cute/tensor.hpp>
+
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "multi_tensor_cpu.h"
+#include "util.h"
+
+// One CTA processes n elements: a scalar head up to 16-byte alignment,
+// 16-byte vectors, and a scalar tail. src and dst must share their
+// misalignment for the vector part, otherwise all of it is scalar.
+template <typename T, bool kScale>
+CUTE_DEVICE void scale_span(T const *src, T *dst, size_t n, T scale) {
+  constexpr int kVec = 16 / sizeof(T);
+  uintptr_t const mis = reinterpret_cast<uintptr_t>(dst) % 16;
+  size_t head = n, body = 0;
+  if (reinterpret_cast<uintptr_t>(src) % 16 == mis) {
+    head = cute::min(n, (16 - mis) % 16 / sizeof(T));
+    body = (n - head) / kVec * kVec;
+  }
+  auto op = [&](T x) {
+    if constexpr (kScale)
+      return scale * x;
+    else
+      return x;
+  };
+  for (size_t i = threadIdx.x; i < head; i += blockDim.x)
+    dst[i] = op(src[i]);
+  uint4 const *vs = reinterpret_cast<uint4 const *>(src + head);
+  uint4 *vd = reinterpret_cast<uint4 *>(dst + head);
+  for (size_t v = threadIdx.x; v < body / kVec; v += blockDim.x) {
+    uint4 w = vs[v];
+    if constexpr (kScale) {
+      T *e = reinterpret_cast<T *>(&w);
+      CUTE_UNROLL
+      for (int k = 0; k < kVec; ++k)
+        e[k] = scale * e[k];
+    }
+    vd[v] = w;
+  }
+  for (size_t i = head + body + threadIdx.x; i < n; i += blockDim.x)
+    dst[i] = op(src[i]);
+}
+
+template <typename T, bool kScale>
+__global__ static void __launch_bounds__(256)
+    multiTensorKernel(T const *const *src, T *const *dst,
+                      TensorChunk const *chunks, int num_chunks, T scale) {
+  for (int c = blockIdx.x; c < num_chunks; c += gridDim.x) {
+    TensorChunk const k = chunks[c];
+    scale_span<T, kScale>(src[k.tensor] + k.offset, dst[k.tensor] + k.offset,
+                          k.count, scale);
+  }
+}
+
+// One tensor per launch, one chunk per CTA: the per-tensor baseline.
+template <typename T, bool kScale>
+__global__ static void __launch_bounds__(256)
+    tensorChunksKernel(T const *src, T *dst, size_t n, T scale) {
+  size_t const chunk = kMultiTensorChunkBytes / sizeof(T);
+  size_t const o = size_t(blockIdx.x) * chunk;
+  scale_span<T, kScale>(src + o, dst + o, cute::min(chunk, n - o), scale);
+}
+
+template <typename T> class MultiTensorPlan {
+public:
+  MultiTensorPlan(std::vector<T const *> const &src,
+                  std::vector<T *> const &dst,
+                  std::vector<size_t> const &sizes) {
+    cfk::utils::ScopedRange range("multi_tensor_plan",
+                                  cfk::utils::dtype_name<T>(),
+                                  {int(sizes.size())});
+    CFK_HOST_STAGE(plan_timer, "multi_tensor.plan");
+    std::vector<TensorChunk> chunks = plan_chunks<T>(sizes);
+    num_chunks_ = int(chunks.size());
+    size_t const tensors = sizes.size();
+
+    // One buffer: src pointers, dst pointers, chunk table.
+    size_t const ptr_bytes = tensors * sizeof(void *);
+    std::vector<char> table(2 * ptr_bytes +
+                            chunks.size() * sizeof(TensorChunk));
+    std::memcpy(table.data(), src.data(), ptr_bytes);
+    std::memcpy(table.data() + ptr_bytes, dst.data(), ptr_bytes);
+    std::memcpy(table.data() + 2 * ptr_bytes, chunks.data(),
+                chunks.size() * sizeof(TensorChunk));
+    plan_timer.stop();
+
+    CFK_HOST_STAGE(upload_timer, "multi_tensor.upload");
+    cudaMallocAsync(&table_, table.size(), 0);
+    cudaMemcpyAsync(table_, table.data(), table.size(),
+                    cudaMemcpyHostToDevice, 0);
+    src_ = reinterpret_cast<T const *const *>(table_);
+    dst_ = reinterpret_cast<T *const *>(table_ + ptr_bytes);
+    chunks_ = reinterpret_cast<TensorChunk const *>(table_ + 2 * ptr_bytes);
+
+    int device, sms;
+    cudaGetDevice(&device);
+    cudaDeviceGetAttribute(&sms, cudaDevAttrMultiProcessorCount, device);
+    grid_ = std::max(1, std::min(num_chunks_, 4 * sms));
+  }
+
+  ~MultiTensorPlan() {
+    if (table_)
+      cudaFreeAsync(table_, 0);
+  }
+
+  MultiTensorPlan(MultiTensorPlan const &) = delete;
+  MultiTensorPlan &operator=(MultiTensorPlan const &) = delete;
+
+  int num_chunks() const { return num_chunks_; }
+
+  void copy() const { launch<false>(T(1)); }
+  void scale(T s) const { launch<true>(s); }
+
+private:
+  template <bool kScale> void launch(T s) const {
+    cfk::utils::ScopedRange range(kScale ? "multi_tensor_scale"
+                                         : "multi_tensor_copy",
+                                  cfk::utils::dtype_name<T>(), {num_chunks_});
+    CFK_HOST_STAGE(launch_timer, "multi_tensor.launch");
+    if (num_chunks_ > 0)
+      multiTensorKernel<T, kScale>
+          <<<grid_, 256>>>(src_, dst_, chunks_, num_chunks_, s);
+  }
+
+  char *table_ = nullptr;
+  T const *const *src_ = nullptr;
+  T *const *dst_ = nullptr;
+  TensorChunk const *chunks_ = nullptr;
+  int num_chunks_ = 0;
+  int grid_ = 1;
+};
+
+// Number of plans kept by multi_tensor_plan_cached().
+constexpr int kMultiTensorPlanCache = 8;
+
+// The plan for this list of tensors, built and uploaded on first use. The
+// most recently used kMultiTensorPlanCache plans are kept, keyed by the
+// pointer lists and sizes, so a list that repeats every step (an optimizer's
+// parameters) is uploaded once. A plan only holds pointers and sizes, so a
+// hit is valid even if the tensors were reallocated at the same addresses.
+template <typename T>
+MultiTensorPlan<T> const &
+multi_tensor_plan_cached(std::vector<T const *> const &src,
+                         std::vector<T *> const &dst,
+                         std::vector<size_t> const &sizes) {
+  struct Entry {
+    std::vector<T const *> src;
+    std::vector<T *> dst;
+    std::vector<size_t> sizes;
+    std::unique_ptr<MultiTensorPlan<T>> plan;
+  };
+  // Never destroyed: freeing device memory after the CUDA runtime has shut
+  // down at exit would fail.
+  static auto *cache = new std::vector<Entry>();
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  auto hit = std::find_if(cache->begin(), cache->end(), [&](Entry const &e) {
+    return e.sizes == sizes && e.src == src && e.dst == dst;
+  });
+  if (hit == cache->end()) {
+    if (int(cache->size()) == kMultiTensorPlanCache)
+      cache->pop_back();
+    cache->insert(cache->begin(),
+                  Entry{src, dst, sizes,
+                        std::make_unique<MultiTensorPlan<T>>(src, dst, sizes)});
+  } else {
+    std::rotate(cache->begin(), hit, hit + 1);
+  }
+  return *cache->front().plan;
+}
+
+// One-shot forms on a cached plan. Build a MultiTensorPlan directly to
+// control its lifetime.
+template <typename T>
+void multi_tensor_copy(std::vector<T const *> const &src,
+                       std::vector<T *> const &dst,
+                       std::vector<size_t> const &sizes) {
+  multi_tensor_plan_cached<T>(src, dst, sizes).copy();
+}
+
+template <typename T>
+void multi_tensor_scale(std::vector<T const *> const &src,
+                        std::vector<T *> const &dst,
+                        std::vector<size_t> const &sizes, T scale) {
+  multi_tensor_plan_cached<T>(src, dst, sizes).scale(scale);
+}
+
+// Tensor sizes for the benchmarks: log-uniform between 2^8 and 2^19
+// elements, deliberately not multiples of the vector width.
+inline std::vector<size_t> multi_tensor_sizes(int tensors, uint64_t seed) {
+  std::vector<size_t> sizes(tensors);
+  for (int t = 0; t < tensors; ++t) {
+    uint32_t b = cfk::utils::philox_bits(seed, t);
+    size_t base = size_t(256) << (b % 11);
+    sizes[t] = base + (b >> 8) % base;
+  }
+  return sizes;
+}
+
+// Time `run` like the other drivers; returns -1 on a CUDA error.
+template <class F>
+int time_multi_tensor(F &&run, double bytes, int iterations) {
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    run();
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+  return 0;
+}
+
+// Copy (or scale by 2) `tensors` small tensors, first with one launch per
+// tensor, then with one MultiTensorPlan launch. The tensors are packed back
+// to back in one src and one dst allocation, so each output is checked in a
+// single pass over the whole dst buffer.
+template <typename T = float>
+int benchmark_multi_tensor(int tensors, bool scale, int iterations = 10,
+                           bool verify = true) {
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  std::vector<size_t> sizes = multi_tensor_sizes(tensors, seed);
+  size_t total = 0;
+  for (size_t n : sizes)
+    total += n;
+
+  thrust::device_vector<T> d_S(total), d_D(total);
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), total, seed);
+  std::vector<T const *> src(tensors);
+  std::vector<T *> dst(tensors);
+  for (size_t t = 0, o = 0; t < size_t(tensors); o += sizes[t++]) {
+    src[t] = thrust::raw_pointer_cast(d_S.data()) + o;
+    dst[t] = thrust::raw_pointer_cast(d_D.data()) + o;
+  }
+  T const factor = T(scale ? 2.0f : 1.0f);
+  std::cout << tensors << " tensors, " << total << " elements" << std::endl;
+
+  auto check = [&] {
+    if (!verify)
+      return;
+    T const *out = thrust::raw_pointer_cast(d_D.data());
+    auto report =
+        scale ? cfk::utils::verify_on_device(
+                    out, total, cfk::utils::ExpectScale<T>{seed, factor})
+              : cfk::utils::verify_on_device(
+                    out, total, cfk::utils::ExpectIdentity<T>{seed});
+    cfk::utils::print_verify_report(std::cout, report, 0);
+  };
+
+  double const bytes = 2.0 * total * sizeof(T);
+  size_t const chunk = kMultiTensorChunkBytes / sizeof(T);
+  std::cout << "Per-tensor launches:" << std::endl;
+  auto per_tensor = [&] {
+    for (size_t t = 0; t < size_t(tensors); ++t) {
+      unsigned blocks = unsigned((sizes[t] + chunk - 1) / chunk);
+      if (scale)
+        tensorChunksKernel<T, true>
+            <<<blocks, 256>>>(src[t], dst[t], sizes[t], factor);
+      else
+        tensorChunksKernel<T, false>
+            <<<blocks, 256>>>(src[t], dst[t], sizes[t], factor);
+    }
+  };
+  if (time_multi_tensor(per_tensor, bytes, iterations) != 0)
+    return -1;
+  check();
+
+  thrust::fill(d_D.begin(), d_D.end(), T(0));
+  MultiTensorPlan<T> plan(src, dst, sizes);
+  std::cout << "Multi-tensor, one launch (" << plan.num_chunks()
+            << " chunks):" << std::endl;
+  auto fused = [&] {
+    if (scale)
+      plan.scale(factor);
+    else
+      plan.copy();
+  };
+  if (time_multi_tensor(fused, bytes, iterations) != 0)
+    return -1;
+  check();
+  return 0;
+}
+
+// Host counterpart: one parallel_for per tensor against one over the chunk
+// table.
+template <typename T = float>
+int benchmark_multi_tensor_cpu(int tensors, bool scale, int iterations = 10,
+                               bool verify = true) {
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  std::vector<size_t> sizes = multi_tensor_sizes(tensors, seed);
+  size_t total = 0;
+  for (size_t n : sizes)
+    total += n;
+
+  cfk::utils::HostBuffer<T> h_S(total), h_D(total);
+  cfk::utils::fill_random_cpu(h_S.data(), total, seed);
+  std::vector<T const *> src(tensors);
+  std::vector<T *> dst(tensors);
+  for (size_t t = 0, o = 0; t < size_t(tensors); o += sizes[t++]) {
+    src[t] = h_S.data() + o;
+    dst[t] = h_D.data() + o;
+  }
+  T const factor = T(scale ? 2.0f : 1.0f);
+  std::cout << tensors << " tensors, " << total << " elements" << std::endl;
+
+  double const bytes = 2.0 * total * sizeof(T);
+  auto trials = [&](auto &&run) {
+    for (int i = 0; i < iterations; i++) {
+      auto t1 = std::chrono::high_resolution_clock::now();
+      run();
+      auto t2 = std::chrono::high_resolution_clock::now();
+      std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+      double time_ms = tDiff.count();
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << cfk::utils::with_peak(1e-6 * bytes / time_ms, "GB/s",
+                                         "cpu.stream_copy_gbs")
+                << ")" << std::endl;
+    }
+    if (verify) {
+      auto report =
+          scale ? cfk::utils::verify_cpu(
+                      h_D.data(), total,
+                      cfk::utils::ExpectScale<T>{seed, factor})
+                : cfk::utils::verify_cpu(h_D.data(), total,
+                                         cfk::utils::ExpectIdentity<T>{seed});
+      cfk::utils::print_verify_report(std::cout, report, 0);
+    }
+  };
+
+  // Both variants plan their chunk tables before the timed trials, so only
+  // the passes over the data are compared.
+  std::vector<std::vector<TensorChunk>> per_tensor(tensors);
+  for (size_t t = 0; t < size_t(tensors); ++t)
+    per_tensor[t] = plan_chunks<T>({sizes[t]});
+  std::vector<TensorChunk> chunks = plan_chunks<T>(sizes);
+
+  std::cout << "Per-tensor parallel_for:" << std::endl;
+  trials([&] {
+    for (size_t t = 0; t < size_t(tensors); ++t) {
+      if (scale)
+        multi_tensor_apply_cpu<T, true>(&src[t], &dst[t], per_tensor[t],
+                                        factor);
+      else
+        multi_tensor_apply_cpu<T, false>(&src[t], &dst[t], per_tensor[t],
+                                         factor);
+    }
+  });
+
+  std::fill(h_D.data(), h_D.data() + total, T(0));
+  std::cout << "Chunk table, one parallel_for (" << chunks.size()
+            << " chunks):" << std::endl;
+  trials([&] {
+    if (scale)
+      multi_tensor_apply_cpu<T, true>(src.data(), dst.data(), chunks, factor);
+    else
+      multi_tensor_apply_cpu<T, false>(src.data(), dst.data(), chunks,
+                                       factor);
+  });
+  return 0;
+}
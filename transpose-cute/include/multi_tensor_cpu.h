@@ -0,0 +1,73 @@
+#pragma once
+
+// Chunk table for multi-tensor copy and scale (multi_tensor.h), and the CPU
+// implementation that uses the same table.
+//
+// A list of tensors, each given by src / dst pointers and an element count,
+// is cut into chunks of at most kMultiTensorChunkBytes. Chunk k is one row of
+// the table: (tensor, offset, count). Both backends then run over the table
+// with no per-tensor setup: the GPU kernel hands chunks to persistent CTAs,
+// the CPU version hands them to the task runtime. Offsets are multiples of
+// the chunk size, so every chunk keeps the alignment of its tensor.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "task_runtime.hpp"
+
+constexpr size_t kMultiTensorChunkBytes = 64 << 10;
+
+struct TensorChunk {
+  uint32_t tensor;
+  uint32_t count;
+  uint64_t offset;
+};
+
+template <typename T>
+std::vector<TensorChunk> plan_chunks(std::vector<size_t> const &sizes) {
+  size_t const chunk = kMultiTensorChunkBytes / sizeof(T);
+  std::vector<TensorChunk> chunks;
+  for (size_t t = 0; t < sizes.size(); ++t)
+    for (size_t o = 0; o < sizes[t]; o += chunk)
+      chunks.push_back({uint32_t(t), uint32_t(std::min(chunk, sizes[t] - o)),
+                        uint64_t(o)});
+  return chunks;
+}
+
+// dst[t][i] = scale * src[t][i], or a plain copy without kScale.
+template <typename T, bool kScale>
+void multi_tensor_apply_cpu(T const *const *src, T *const *dst,
+                            std::vector<TensorChunk> const &chunks,
+                            T scale) {
+  cfk::utils::parallel_for(0, chunks.size(), 1, [&](size_t lo, size_t hi) {
+    for (size_t c = lo; c < hi; ++c) {
+      TensorChunk const k = chunks[c];
+      T const *s = src[k.tensor] + k.offset;
+      T *d = dst[k.tensor] + k.offset;
+      if constexpr (kScale) {
+        for (uint32_t i = 0; i < k.count; ++i)
+          d[i] = scale * s[i];
+      } else {
+        std::memcpy(d, s, k.count * sizeof(T));
+      }
+    }
+  });
+}
+
+template <typename T>
+void multi_tensor_copy_cpu(std::vector<T const *> const &src,
+                           std::vector<T *> const &dst,
+                           std::vector<size_t> const &sizes) {
+  multi_tensor_apply_cpu<T, false>(src.data(), dst.data(),
+                                   plan_chunks<T>(sizes), T(1));
+}
+
+template <typename T>
+void multi_tensor_scale_cpu(std::vector<T const *> const &src,
+                            std::vector<T *> const &dst,
+                            std::vector<size_t> const &sizes, T scale) {
+  multi_tensor_apply_cpu<T, true>(src.data(), dst.data(),
+                                  plan_chunks<T>(sizes), scale);
+}
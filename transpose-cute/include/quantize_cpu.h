@@ -0,0 +1,164 @@
+#pragma once
+
+// CPU reference for quantize_dual_fp8 (quantize_dual.h). It produces the
+// same bytes and scales as the GPU kernel.
+//
+// For an (M, N) row-major input A:
+//   q_row     (M, N)            FP8 E4M3 of A, one scale per 1 x 128 row block
+//   scale_row (M, N / 128)
+//   q_col     (N, M)            FP8 E4M3 of A^T, one scale per 1 x 128 block
+//   scale_col (N, M / 128)      of A^T, i.e. per 128 x 1 column block of A
+// M and N must be multiples of 128. check_quantize_cpu() checks the FP8
+// encoder and the reference on the CPU.
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "fp8.hpp"
+#include "task_runtime.hpp"
+#include "verify.hpp"
+
+constexpr int kQuantBlock = 128;
+
+// `load(i)` returns element i of A as float, so the input can be raw bf16
+// bits or any type convertible to float.
+template <class Load>
+void quantize_dual_fp8_cpu(Load load, int M, int N, uint8_t *q_row,
+                           float *scale_row, uint8_t *q_col,
+                           float *scale_col) {
+  using namespace cfk::utils;
+  size_t const blocksN = N / kQuantBlock, blocksM = M / kQuantBlock;
+
+  parallel_for(0, size_t(M), 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      for (size_t b = 0; b < blocksN; ++b) {
+        size_t base = i * N + b * kQuantBlock;
+        float amax = 0.0f;
+        for (int k = 0; k < kQuantBlock; ++k)
+          amax = std::fmax(amax, std::fabs(load(base + k)));
+        float scale, inv;
+        fp8_block_scale(amax, scale, inv);
+        for (int k = 0; k < kQuantBlock; ++k)
+          q_row[base + k] = fp8_e4m3_encode(load(base + k) * inv);
+        scale_row[i * blocksN + b] = scale;
+      }
+  });
+
+  parallel_for(0, size_t(N), 0, [&](size_t lo, size_t hi) {
+    for (size_t j = lo; j < hi; ++j)
+      for (size_t b = 0; b < blocksM; ++b) {
+        size_t i0 = b * kQuantBlock;
+        float amax = 0.0f;
+        for (int k = 0; k < kQuantBlock; ++k)
+          amax = std::fmax(amax, std::fabs(load((i0 + k) * N + j)));
+        float scale, inv;
+        fp8_block_scale(amax, scale, inv);
+        for (int k = 0; k < kQuantBlock; ++k)
+          q_col[j * M + i0 + k] =
+              fp8_e4m3_encode(load((i0 + k) * N + j) * inv);
+        scale_col[j * blocksM + b] = scale;
+      }
+  });
+}
+
+namespace detail {
+
+// Nearest E4M3 code by brute force over the finite codes, ties to the even
+// code, saturating to +-448 and keeping NaN.
+inline uint8_t fp8_e4m3_encode_brute(float x) {
+  using namespace cfk::utils;
+  uint8_t const sign = std::signbit(x) ? 0x80 : 0x00;
+  if (std::isnan(x))
+    return sign | 0x7F;
+  double const a = std::fabs(double(x));
+  if (a >= kFp8E4M3Max)
+    return sign | 0x7E;
+  uint8_t best = 0;
+  for (int c = 1; c <= 0x7E; ++c) {
+    double d = std::fabs(double(fp8_e4m3_decode(uint8_t(c))) - a),
+           e = std::fabs(double(fp8_e4m3_decode(best)) - a);
+    if (d < e || (d == e && (c & 1) == 0))
+      best = uint8_t(c);
+  }
+  return sign | best;
+}
+
+} // namespace detail
+
+// Checks fp8_e4m3_encode against a brute-force nearest-even search on
+// every bf16 value and on every midpoint between adjacent codes and its two
+// float neighbours. Then checks that quantize_dual_fp8_cpu dequantizes back
+// to its input within half an FP8 ulp, both orientations. Needs no GPU.
+inline bool check_quantize_cpu() {
+  using namespace cfk::utils;
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Quantize check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  std::vector<float> inputs;
+  for (uint32_t b = 0; b < 0x10000; ++b)
+    inputs.push_back(bf16_bits_to_float(uint16_t(b)));
+  for (int c = 0; c < 0x7E; ++c) {
+    float mid = 0.5f * (fp8_e4m3_decode(uint8_t(c)) +
+                        fp8_e4m3_decode(uint8_t(c + 1)));
+    for (float x : {std::nextafter(mid, 0.0f), mid,
+                    std::nextafter(mid, 1e9f)}) {
+      inputs.push_back(x);
+      inputs.push_back(-x);
+    }
+  }
+  size_t bad = 0;
+  for (float x : inputs) {
+    uint8_t got = fp8_e4m3_encode(x);
+    uint8_t want = ::detail::fp8_e4m3_encode_brute(x);
+    if (got != want && bad++ < 4)
+      fail("encode(" + std::to_string(x) + ") = " + std::to_string(got) +
+           ", nearest even is " + std::to_string(want));
+  }
+  if (bad > 0)
+    fail(std::to_string(bad) + " of " + std::to_string(inputs.size()) +
+         " encodings");
+
+  int const M = 256, N = 384;
+  size_t const size = size_t(M) * N, blocks = size / kQuantBlock;
+  std::vector<float> a(size);
+  fill_random_cpu(a.data(), size, 3);
+  for (size_t i = 0; i < size; ++i) // signed, over several binades
+    a[i] = (a[i] - 0.5f) * std::ldexp(1.0f, int(i % 11) - 5);
+  std::vector<uint8_t> q_row(size), q_col(size);
+  std::vector<float> scale_row(blocks), scale_col(blocks);
+  quantize_dual_fp8_cpu([&](size_t i) { return a[i]; }, M, N, q_row.data(),
+                        scale_row.data(), q_col.data(), scale_col.data());
+
+  // Half an ulp of a 3-bit mantissa is 2^-4 of the value, and 2^-10 of the
+  // scale below the smallest normal; the slack covers rounding x * inv.
+  auto close = [](float x, uint8_t q, float scale) {
+    double dq = double(fp8_e4m3_decode(q)) * scale;
+    double bound = std::fmax(std::fabs(x) * 0x1p-4, double(scale) * 0x1p-10);
+    return std::fabs(dq - x) <= bound * (1 + 1e-5);
+  };
+  size_t bad_row = 0, bad_col = 0;
+  for (int i = 0; i < M; ++i)
+    for (int j = 0; j < N; ++j) {
+      float x = a[size_t(i) * N + j];
+      bad_row += !close(x, q_row[size_t(i) * N + j],
+                        scale_row[size_t(i) * (N / kQuantBlock) +
+                                  j / kQuantBlock]);
+      bad_col += !close(x, q_col[size_t(j) * M + i],
+                        scale_col[size_t(j) * (M / kQuantBlock) +
+                                  i / kQuantBlock]);
+    }
+  if (bad_row > 0)
+    fail(std::to_string(bad_row) + " row-wise values off after dequant");
+  if (bad_col > 0)
+    fail(std::to_string(bad_col) + " column-wise values off after dequant");
+
+  if (ok)
+    std::cout << "Quantize check passed." << std::endl;
+  return ok;
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+// Fused row-wise and column-wise 1x128 block FP8 quantization.
+//
+// FP8 training needs every activation quantized twice: row-wise for the
+// forward GEMM and column-wise (i.e. transposed) for the backward GEMM,
+// each with its own per-block scales. quantizeDualKernel reads a 128 x 128
+// bf16 tile into smem once, the way transposeKernelSmem stages its tiles.
+// From the staged tile it computes both sets of block maxima and writes
+// both FP8 outputs plus their scales. Output layout and the CPU reference
+// are in quantize_cpu.h.
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+
+#include <chrono>
+
+#include <thrust/device_vector.h>
+#include <thrust/host_vector.h>
+#include <thrust/transform.h>
+
+#include "cutlass/numeric_types.h"
+#include <cute/tensor.hpp>
+#include <cutlass/cutlass.h>
+
+#include "fp8.hpp"
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "quantize_cpu.h"
+#include "shared_storage.h"
+#include "util.h"
+
+template <typename Element> struct QuantizeDualParams {
+  Element const *input;
+  cutlass::float_e4m3_t *q_row;
+  float *scale_row;
+  cutlass::float_e4m3_t *q_col;
+  float *scale_col;
+
+  const int M;
+  const int N;
+
+  QuantizeDualParams(Element const *input_, cutlass::float_e4m3_t *q_row_,
+                     float *scale_row_, cutlass::float_e4m3_t *q_col_,
+                     float *scale_col_, int M_, int N_)
+      : input(input_), q_row(q_row_), scale_row(scale_row_), q_col(q_col_),
+        scale_col(scale_col_), M(M_), N(N_) {}
+};
+
+CUTE_DEVICE float warp_max(float x) {
+  CUTE_UNROLL
+  for (int offset = 16; offset > 0; offset /= 2)
+    x = fmaxf(x, __shfl_xor_sync(0xffffffff, x, offset));
+  return x;
+}
+
+CUTE_DEVICE uint8_t fp8_e4m3_bits(float x) {
+  return cutlass::float_e4m3_t(x).storage;
+}
+
+template <class TensorS, class SmemLayout, class ThreadLayout,
+          class Element = typename TensorS::value_type>
+__global__ static void __launch_bounds__(256, 1)
+    quantizeDualKernel(TensorS const S, SmemLayout const smemLayout,
+                       ThreadLayout const tS,
+                       QuantizeDualParams<Element> const params) {
+  using namespace cute;
+  constexpr int kWarps = 8;
+
+  extern __shared__ char shared_memory[];
+  using SharedStorage = SharedStorageTranspose<Element, SmemLayout>;
+  SharedStorage &shared_storage =
+      *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  // Rows are padded by one 32-bit word so the column pass is conflict free.
+  Tensor sS = make_tensor(make_smem_ptr(shared_storage.smem.data()),
+                          smemLayout); // (bM, bN)
+  Tensor gS = S(make_coord(_, _), blockIdx.x, blockIdx.y); // (bM, bN)
+
+  Tensor tSgS = local_partition(gS, tS, threadIdx.x);
+  Tensor tSsS = local_partition(sS, tS, threadIdx.x);
+  cute::copy(tSgS, tSsS);
+  __syncthreads();
+
+  int const warp = threadIdx.x / 32, lane = threadIdx.x % 32;
+  size_t const M = params.M, N = params.N;
+  size_t const m0 = size_t(blockIdx.x) * kQuantBlock;
+  size_t const n0 = size_t(blockIdx.y) * kQuantBlock;
+
+  // Row-wise: one warp per 1 x 128 block, four consecutive elements per lane
+  // packed into one 32-bit store.
+  for (int r = warp; r < kQuantBlock; r += kWarps) {
+    float v[4], amax = 0.0f;
+    CUTE_UNROLL
+    for (int k = 0; k < 4; ++k) {
+      v[k] = float(sS(r, lane * 4 + k));
+      amax = fmaxf(amax, fabsf(v[k]));
+    }
+    float scale, inv;
+    cfk::utils::fp8_block_scale(warp_max(amax), scale, inv);
+    uint32_t packed = 0;
+    CUTE_UNROLL
+    for (int k = 0; k < 4; ++k)
+      packed |= uint32_t(fp8_e4m3_bits(v[k] * inv)) << (8 * k);
+    reinterpret_cast<uint32_t *>(params.q_row + (m0 + r) * N + n0)[lane] =
+        packed;
+    if (lane == 0)
+      params.scale_row[(m0 + r) * (N / kQuantBlock) + blockIdx.y] = scale;
+  }
+
+  // Column-wise: one warp per 128 x 1 block of the tile, written as a row of
+  // q_col. Lane l holds rows l, l + 32, l + 64 and l + 96.
+  for (int c = warp; c < kQuantBlock; c += kWarps) {
+    float v[4], amax = 0.0f;
+    CUTE_UNROLL
+    for (int k = 0; k < 4; ++k) {
+      v[k] = float(sS(lane + 32 * k, c));
+      amax = fmaxf(amax, fabsf(v[k]));
+    }
+    float scale, inv;
+    cfk::utils::fp8_block_scale(warp_max(amax), scale, inv);
+    uint8_t *row =
+        reinterpret_cast<uint8_t *>(params.q_col + (n0 + c) * M + m0);
+    CUTE_UNROLL
+    for (int k = 0; k < 4; ++k)
+      row[lane + 32 * k] = fp8_e4m3_bits(v[k] * inv);
+    if (lane == 0)
+      params.scale_col[(n0 + c) * (M / kQuantBlock) + blockIdx.x] = scale;
+  }
+}
+
+template <typename Element>
+void quantize_dual_fp8(QuantizeDualParams<Element> params) {
+  using namespace cute;
+  cfk::utils::ScopedRange range("quantize_dual_fp8",
+                                cfk::utils::dtype_name<Element>(),
+                                {params.M, params.N});
+  CFK_HOST_STAGE(layout_timer, "quantize_dual_fp8.layouts");
+  assert(params.M % kQuantBlock == 0 && params.N % kQuantBlock == 0);
+
+  auto tensor_shape = make_shape(params.M, params.N);
+  auto gmemLayoutS = make_layout(tensor_shape, LayoutRight{});
+  Tensor tensor_S = make_tensor(make_gmem_ptr(params.input), gmemLayoutS);
+
+  using bM = Int<kQuantBlock>;
+  using bN = Int<kQuantBlock>;
+  auto block_shape = make_shape(bM{}, bN{});
+  Tensor tiled_tensor_S =
+      tiled_divide(tensor_S, block_shape); // ((bM, bN), m', n')
+
+  // One 32-bit word of padding per row.
+  constexpr int kPad = 4 / sizeof(Element);
+  auto smemLayout =
+      make_layout(block_shape, make_stride(Int<kQuantBlock + kPad>{}, _1{}));
+  auto threadLayout =
+      make_layout(make_shape(Int<8>{}, Int<32>{}), LayoutRight{});
+
+  size_t smem_size =
+      sizeof(SharedStorageTranspose<Element, decltype(smemLayout)>);
+
+  dim3 gridDim(size<1>(tiled_tensor_S), size<2>(tiled_tensor_S));
+  dim3 blockDim(size(threadLayout));
+  layout_timer.stop();
+
+  CFK_HOST_STAGE(launch_timer, "quantize_dual_fp8.launch");
+  quantizeDualKernel<<<gridDim, blockDim, smem_size>>>(
+      tiled_tensor_S, smemLayout, threadLayout, params);
+}
+
+// Maps a uniform [0, 1) draw to a signed value in roughly +-2^3.
+template <typename Element> struct SpreadBinades {
+  __device__ Element operator()(Element x) const {
+    float u = float(x);
+    return Element((u - 0.5f) * exp2f(8.0f * u - 4.0f));
+  }
+};
+
+// Time quantize_dual_fp8 and compare its output byte for byte with
+// quantize_dual_fp8_cpu. The comparison copies the outputs back, so it runs
+// once after the timed trials.
+template <typename Element = cutlass::bfloat16_t>
+int benchmark_quantize_dual(int M, int N, int iterations = 10,
+                            bool verify = true) {
+  size_t const size = size_t(M) * N;
+  size_t const blocks = size / kQuantBlock;
+  thrust::device_vector<Element> d_S(size);
+  thrust::device_vector<cutlass::float_e4m3_t> d_QR(size), d_QC(size);
+  thrust::device_vector<float> d_SR(blocks), d_SC(blocks);
+
+  // Signed inputs spanning a few binades, so scales and subnormals vary.
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), size, seed);
+  thrust::transform(d_S.begin(), d_S.end(), d_S.begin(),
+                    SpreadBinades<Element>{});
+
+  QuantizeDualParams<Element> params(
+      thrust::raw_pointer_cast(d_S.data()),
+      thrust::raw_pointer_cast(d_QR.data()),
+      thrust::raw_pointer_cast(d_SR.data()),
+      thrust::raw_pointer_cast(d_QC.data()),
+      thrust::raw_pointer_cast(d_SC.data()), M, N);
+
+  double bytes = double(size) * (sizeof(Element) + 2) + 8.0 * blocks;
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    quantize_dual_fp8(params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    thrust::host_vector<Element> h_S = d_S;
+    thrust::host_vector<cutlass::float_e4m3_t> h_QR = d_QR, h_QC = d_QC;
+    thrust::host_vector<float> h_SR = d_SR, h_SC = d_SC;
+    std::vector<uint8_t> r_QR(size), r_QC(size);
+    std::vector<float> r_SR(blocks), r_SC(blocks);
+    quantize_dual_fp8_cpu([&](size_t i) { return float(h_S[i]); }, M, N,
+                          r_QR.data(), r_SR.data(), r_QC.data(), r_SC.data());
+
+    size_t bad = 0;
+    for (size_t i = 0; i < size; ++i)
+      bad += (h_QR[i].storage != r_QR[i]) + (h_QC[i].storage != r_QC[i]);
+    for (size_t i = 0; i < blocks; ++i)
+      bad += (h_SR[i] != r_SR[i]) + (h_SC[i] != r_SC[i]);
+    if (bad > 0) {
+      std::cout << "Validation failed. Incorrect values: " << bad << std::endl;
+      return -1;
+    }
+    std::cout << "Validation success." << std::endl;
+  }
+  return 0;
+}
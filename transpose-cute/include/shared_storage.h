@@ -7,4 +7,14 @@ template <class Element, class SmemLayout> struct SharedStorageTranspose {
   cute::array_aligned<Element, cute::cosize_v<SmemLayout>,
                       cutlass::detail::alignment_for_swizzle(SmemLayout{})>
       smem;
-};
\ No newline at end of file
+};
+
+// Shared Storage for a tile pair (i, j) / (j, i) of two operands
+template <class Element, class SmemLayout> struct SharedStorageTilePair {
+  static constexpr int kAlignment =
+      cutlass::detail::alignment_for_swizzle(SmemLayout{});
+  cute::array_aligned<Element, cute::cosize_v<SmemLayout>, kAlignment> a0;
+  cute::array_aligned<Element, cute::cosize_v<SmemLayout>, kAlignment> a1;
+  cute::array_aligned<Element, cute::cosize_v<SmemLayout>, kAlignment> b0;
+  cute::array_aligned<Element, cute::cosize_v<SmemLayout>, kAlignment> b1;
+};
@@ -0,0 +1,97 @@
+#pragma once
+
+// Transpose and copy specialized for the shapes of a model manifest
+// (static_shapes.hpp in include/utils).
+//
+// transpose_static and copy_static take the same params as transpose_smem and
+// copy_baseline but build every layout from cute::Int extents, so the tile
+// counts, strides and grid are compile-time constants. The dispatchers pick
+// the specialization when the shape is in the manifest and the dynamic
+// launcher otherwise; they have the launchers' signature and drop into
+// benchmark() unchanged. Neither kernel predicates partial tiles, so a shape
+// the tiles do not divide is declined and stays dynamic, where the
+// transpose rejects it.
+
+#include <stdexcept>
+
+#include "copy.h"
+#include "static_shapes.hpp"
+#include "transpose_smem.h"
+#include "util.h"
+
+template <typename Element, int M, int N, bool isSwizzled = true>
+void transpose_static(TransposeParams<Element> params) {
+  static_assert(M % 64 == 0 && N % 64 == 0, "whole 64 x 64 tiles");
+  if (params.M != M || params.N != N)
+    throw std::invalid_argument("transpose_static instantiated for another "
+                                "shape");
+  transpose_smem_shape<Element, isSwizzled>(
+      params.input, params.output,
+      cute::make_shape(cute::Int<M>{}, cute::Int<N>{}), params.pdl);
+}
+
+template <typename T, int M, int N>
+void copy_static(TransposeParams<T> params) {
+  static_assert(M % 32 == 0 && N % 1024 == 0, "whole 32 x 1024 tiles");
+  if (params.M != M || params.N != N)
+    throw std::invalid_argument("copy_static instantiated for another shape");
+  copy_baseline_shape(params.input, params.output,
+                      cute::make_shape(cute::Int<M>{}, cute::Int<N>{}));
+}
+
+// transpose_smem, after checking that the shape is whole 64 x 64 tiles.
+template <typename Element>
+void transpose_smem_checked(TransposeParams<Element> params) {
+  if (params.M % 64 != 0 || params.N % 64 != 0)
+    throw std::invalid_argument("transpose_smem needs M and N to be "
+                                "multiples of 64");
+  transpose_smem<Element, true>(params);
+}
+
+template <typename Element, class Manifest = cfk::utils::Llama7BShapes>
+void transpose_dispatch(TransposeParams<Element> params) {
+  using Fn = void (*)(TransposeParams<Element>);
+  static cfk::utils::ShapeRegistry<Fn> const registry = [] {
+    cfk::utils::ShapeRegistry<Fn> r;
+    cfk::utils::register_shapes(r, Manifest{}, [](auto e) -> Fn {
+      using E = decltype(e);
+      if constexpr (cfk::utils::tiles_evenly<E>(64, 64))
+        return &transpose_static<Element, E::m, E::n>;
+      else
+        return nullptr;
+    });
+    return r;
+  }();
+  registry.dispatch({params.M, params.N},
+                    &transpose_smem_checked<Element>)(params);
+}
+
+template <typename T, class Manifest = cfk::utils::Llama7BShapes>
+void copy_dispatch(TransposeParams<T> params) {
+  using Fn = void (*)(TransposeParams<T>);
+  static cfk::utils::ShapeRegistry<Fn> const registry = [] {
+    cfk::utils::ShapeRegistry<Fn> r;
+    cfk::utils::register_shapes(r, Manifest{}, [](auto e) -> Fn {
+      using E = decltype(e);
+      if constexpr (cfk::utils::tiles_evenly<E>(32, 1024))
+        return &copy_static<T, E::m, E::n>;
+      else
+        return nullptr;
+    });
+    return r;
+  }();
+  registry.dispatch({params.M, params.N}, &copy_baseline<T>)(params);
+}
+
+// Dynamic launcher against its dispatcher on a manifest shape of each.
+template <typename Element> void benchmark_static_shapes() {
+  printf("Swizzled transpose (11008, 4096), runtime shape:\n");
+  benchmark<Element>(transpose_smem<Element, true>, 11008, 4096);
+  printf("Swizzled transpose (11008, 4096), static shape:\n");
+  benchmark<Element>(transpose_dispatch<Element>, 11008, 4096);
+
+  printf("Copy (4096, 12288), runtime shape:\n");
+  benchmark<Element, false>(copy_baseline<Element>, 4096, 12288);
+  printf("Copy (4096, 12288), static shape:\n");
+  benchmark<Element, false>(copy_dispatch<Element>, 4096, 12288);
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+// Fused transpose-add, C = alpha * A + beta * B^T, and symmetrize,
+// A = (A + A^T) / 2, without a transposed temporary.
+//
+// For square operands one CTA owns the tile pair (i, j) / (j, i). It loads
+// both tiles of A and B into smem and only then writes both tiles of C, so
+// no other CTA ever reads a tile this one writes. That makes every aliasing
+// of A, B and C safe, including fully in place. Rectangular operands use
+// one CTA per output tile; there C may alias A but not B.
+
+#include <cassert>
+
+#include <cute/tensor.hpp>
+#include <cutlass/cutlass.h>
+
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "shared_storage.h"
+#include "util.h"
+
+template <class Element, class TensorA, class TensorB, class TensorC>
+CUTE_DEVICE void axpby(Element alpha, TensorA const &a, Element beta,
+                       TensorB const &b, TensorC &&c) {
+  CUTE_UNROLL
+  for (int e = 0; e < cute::size(c); ++e)
+    c(e) = alpha * a(e) + beta * b(e);
+}
+
+template <class TensorA, class TensorB, class TensorC, class SmemLayout,
+          class SmemLayoutT, class ThreadLayout,
+          class Element = typename TensorC::value_type>
+__global__ static void __launch_bounds__(256, 1)
+    transposeAddPairKernel(TensorA const A, TensorB const B, TensorC const C,
+                           Element alpha, Element beta,
+                           SmemLayout const smemLayout,
+                           SmemLayoutT const smemLayoutT,
+                           ThreadLayout const tT) {
+  using namespace cute;
+
+  int i, j;
+  tile_pair_from_index(blockIdx.x, i, j);
+
+  extern __shared__ char shared_memory[];
+  using SharedStorage = SharedStorageTilePair<Element, SmemLayout>;
+  SharedStorage &shared_storage =
+      *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  Tensor sA0 = make_tensor(make_smem_ptr(shared_storage.a0.data()),
+                           smemLayout); // A(i, j)
+  Tensor sA1 = make_tensor(make_smem_ptr(shared_storage.a1.data()),
+                           smemLayout); // A(j, i)
+  Tensor sB0 = make_tensor(make_smem_ptr(shared_storage.b0.data()),
+                           smemLayout); // B(i, j)
+  Tensor sB1 = make_tensor(make_smem_ptr(shared_storage.b1.data()),
+                           smemLayout); // B(j, i)
+  // Transposed views of the B tiles
+  Tensor sB0t = make_tensor(make_smem_ptr(shared_storage.b0.data()),
+                            smemLayoutT);
+  Tensor sB1t = make_tensor(make_smem_ptr(shared_storage.b1.data()),
+                            smemLayoutT);
+
+  auto part = [&](auto &&t) { return local_partition(t, tT, threadIdx.x); };
+
+  cute::copy(part(A(make_coord(_, _), i, j)), part(sA0));
+  cute::copy(part(A(make_coord(_, _), j, i)), part(sA1));
+  cute::copy(part(B(make_coord(_, _), i, j)), part(sB0));
+  cute::copy(part(B(make_coord(_, _), j, i)), part(sB1));
+  __syncthreads();
+
+  axpby(alpha, part(sA0), beta, part(sB1t), part(C(make_coord(_, _), i, j)));
+  if (i != j)
+    axpby(alpha, part(sA1), beta, part(sB0t),
+          part(C(make_coord(_, _), j, i)));
+}
+
+template <class TensorA, class TensorB, class TensorC, class SmemLayout,
+          class SmemLayoutT, class ThreadLayout,
+          class Element = typename TensorC::value_type>
+__global__ static void __launch_bounds__(256, 1)
+    transposeAddKernel(TensorA const A, TensorB const B, TensorC const C,
+                       Element alpha, Element beta,
+                       SmemLayout const smemLayout,
+                       SmemLayoutT const smemLayoutT, ThreadLayout const tT) {
+  using namespace cute;
+
+  extern __shared__ char shared_memory[];
+  using SharedStorage = SharedStorageTranspose<Element, SmemLayout>;
+  SharedStorage &shared_storage =
+      *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  Tensor sB = make_tensor(make_smem_ptr(shared_storage.smem.data()),
+                          smemLayout); // B(j, i)
+  Tensor sBt = make_tensor(make_smem_ptr(shared_storage.smem.data()),
+                           smemLayoutT); // B(j, i)^T
+
+  Tensor gA = A(make_coord(_, _), blockIdx.x, blockIdx.y);
+  Tensor gB = B(make_coord(_, _), blockIdx.y, blockIdx.x);
+  Tensor gC = C(make_coord(_, _), blockIdx.x, blockIdx.y);
+
+  cute::copy(local_partition(gB, tT, threadIdx.x),
+             local_partition(sB, tT, threadIdx.x));
+  __syncthreads();
+
+  // A is read straight from gmem; each thread reads an element of A before
+  // writing the same element of C, so C == A is fine.
+  axpby(alpha, local_partition(gA, tT, threadIdx.x), beta,
+        local_partition(sBt, tT, threadIdx.x),
+        local_partition(gC, tT, threadIdx.x));
+}
+
+// M and N must be multiples of 32.
+template <typename Element>
+void transpose_add(TransposeAddParams<Element> params) {
+  using namespace cute;
+  cfk::utils::ScopedRange range("transpose_add",
+                                cfk::utils::dtype_name<Element>(),
+                                {params.M, params.N});
+  CFK_HOST_STAGE(layout_timer, "transpose_add.layouts");
+  assert(params.M % 32 == 0 && params.N % 32 == 0);
+
+  auto tensor_shape = make_shape(params.M, params.N);
+  auto tensor_shape_trans = make_shape(params.N, params.M);
+  Tensor tensor_A = make_tensor(make_gmem_ptr(params.A),
+                                make_layout(tensor_shape, LayoutRight{}));
+  Tensor tensor_B = make_tensor(make_gmem_ptr(params.B),
+                                make_layout(tensor_shape_trans, LayoutRight{}));
+  Tensor tensor_C = make_tensor(make_gmem_ptr(params.C),
+                                make_layout(tensor_shape, LayoutRight{}));
+
+  using bT = Int<32>;
+  auto block_shape = make_shape(bT{}, bT{});
+  Tensor tiled_tensor_A = tiled_divide(tensor_A, block_shape);
+  Tensor tiled_tensor_B = tiled_divide(tensor_B, block_shape);
+  Tensor tiled_tensor_C = tiled_divide(tensor_C, block_shape);
+
+  // Swizzled like transpose_smem so that both views are conflict free.
+  auto tileLayout = make_layout(block_shape, LayoutRight{});
+  auto smemLayout = composition(Swizzle<5, 0, 5>{}, tileLayout);
+  auto smemLayoutT = composition(smemLayout, tileLayout);
+  auto threadLayout =
+      make_layout(make_shape(Int<8>{}, Int<32>{}), LayoutRight{});
+  dim3 blockDim(size(threadLayout));
+  layout_timer.stop();
+
+  CFK_HOST_STAGE(launch_timer, "transpose_add.launch");
+  if (params.M == params.N) {
+    int tiles = params.M / 32;
+    size_t smem_size =
+        sizeof(SharedStorageTilePair<Element, decltype(smemLayout)>);
+    transposeAddPairKernel<<<tiles * (tiles + 1) / 2, blockDim, smem_size>>>(
+        tiled_tensor_A, tiled_tensor_B, tiled_tensor_C, params.alpha,
+        params.beta, smemLayout, smemLayoutT, threadLayout);
+  } else {
+    size_t smem_size =
+        sizeof(SharedStorageTranspose<Element, decltype(smemLayout)>);
+    dim3 gridDim(params.M / 32, params.N / 32);
+    transposeAddKernel<<<gridDim, blockDim, smem_size>>>(
+        tiled_tensor_A, tiled_tensor_B, tiled_tensor_C, params.alpha,
+        params.beta, smemLayout, smemLayoutT, threadLayout);
+  }
+}
@@ -0,0 +1,494 @@
+#pragma once
+
+// Host implementations of the copy and transpose kernels. They take the
+// same TransposeParams as the GPU launchers, with host pointers, and are
+// benchmarked by benchmark_cpu in util.h. All of them run on the shared
+// work-stealing runtime in task_runtime.hpp.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(__AVX__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+#include "huge_pages.hpp"
+#include "task_runtime.hpp"
+#include "util.h"
+
+template <typename T> void copy_cpu(TransposeParams<T> params) {
+  size_t const N = params.N;
+  cfk::utils::parallel_for(0, params.M, 0, [&](size_t lo, size_t hi) {
+    std::memcpy(params.output + lo * N, params.input + lo * N,
+                (hi - lo) * N * sizeof(T));
+  });
+}
+
+// Row-order reads, column-order writes.
+template <typename T> void transpose_cpu_naive(TransposeParams<T> params) {
+  size_t const M = params.M, N = params.N;
+  cfk::utils::parallel_for(0, M, 0, [&](size_t lo, size_t hi) {
+    for (size_t i = lo; i < hi; ++i)
+      for (size_t j = 0; j < N; ++j)
+        params.output[j * M + i] = params.input[i * N + j];
+  });
+}
+
+// Cache-blocked transpose over kBlock x kBlock tiles. Rows of tiles are
+// distributed over threads.
+template <typename T, int kBlock = 64>
+void transpose_cpu_blocked(TransposeParams<T> params) {
+  size_t const M = params.M, N = params.N;
+  size_t const tilesM = (M + kBlock - 1) / kBlock;
+  cfk::utils::parallel_for(0, tilesM, 1, [&](size_t lo, size_t hi) {
+    for (size_t ti = lo; ti < hi; ++ti) {
+      size_t i0 = ti * kBlock, i1 = std::min(M, i0 + kBlock);
+      for (size_t j0 = 0; j0 < N; j0 += kBlock) {
+        size_t j1 = std::min(N, j0 + kBlock);
+        for (size_t i = i0; i < i1; ++i)
+          for (size_t j = j0; j < j1; ++j)
+            params.output[j * M + i] = params.input[i * N + j];
+      }
+    }
+  });
+}
+
+// Number of rows with a stride of `row_bytes` whose pages fit in half of a
+// `tlb_entries`-entry TLB, rounded down to a multiple of `block` (at least
+// one block). With 4 KiB pages and a wide matrix every row is its own page;
+// with 2 MiB pages page_bytes / row_bytes rows share one entry.
+inline size_t tlb_reach_rows(size_t row_bytes, size_t page_bytes,
+                             size_t tlb_entries, size_t block) {
+  size_t rows_per_page = std::max<size_t>(1, page_bytes / row_bytes);
+  size_t rows = tlb_entries / 2 * rows_per_page;
+  return std::max(block, rows / block * block);
+}
+
+// Transpose blocked for the TLB as well as the caches. The output is cut
+// into strips of output rows (input columns) sized by tlb_reach_rows, so the
+// pages written by one strip stay resident in the second-level dTLB while
+// the strip walks down all input rows in kBlock x kBlock tiles. Strips are
+// distributed over threads (each core has its own TLB), and are narrowed if
+// needed so every thread gets one. kPageBytes should match how the buffers
+// were allocated (see huge_pages.hpp); kTlbEntries is the STLB size.
+template <typename T, size_t kPageBytes = cfk::utils::kSmallPageBytes,
+          int kBlock = 64, size_t kTlbEntries = 1536>
+void transpose_cpu_tlb(TransposeParams<T> params) {
+  size_t const M = params.M, N = params.N;
+  size_t const threads = cfk::utils::TaskRuntime::instance().num_threads();
+  size_t const per_thread = ((N + threads - 1) / threads + kBlock - 1) /
+                            kBlock * kBlock;
+  size_t const strip = std::min(
+      per_thread, tlb_reach_rows(M * sizeof(T), kPageBytes, kTlbEntries, kBlock));
+  size_t const strips = (N + strip - 1) / strip;
+  cfk::utils::parallel_for(0, strips, 1, [&](size_t lo, size_t hi) {
+    for (size_t s = lo; s < hi; ++s) {
+      size_t js0 = s * strip, js1 = std::min(N, js0 + strip);
+      for (size_t i0 = 0; i0 < M; i0 += kBlock) {
+        size_t i1 = std::min(M, i0 + kBlock);
+        for (size_t j0 = js0; j0 < js1; j0 += kBlock) {
+          size_t j1 = std::min(js1, j0 + kBlock);
+          for (size_t i = i0; i < i1; ++i)
+            for (size_t j = j0; j < j1; ++j)
+              params.output[j * M + i] = params.input[i * N + j];
+        }
+      }
+    }
+  });
+}
+
+// Transpose a square block of e = 32 / kBits packed rows (one word each) in
+// place, SWAR style: swap the off-diagonal halves, then quarters, and so on
+// down to single elements, five steps for bits and three for nibbles.
+template <int kBits> inline void transpose_packed_block(uint32_t *a) {
+  constexpr int e = 32 / kBits;
+  uint32_t m = 0xFFFFFFFFu;
+  for (int j = e / 2; j > 0; j /= 2) {
+    int const s = j * kBits;
+    m ^= m << s; // low j elements of every 2j-element group
+    for (int r = 0; r < e; ++r)
+      if (!(r & j)) {
+        uint32_t t = ((a[r] >> s) ^ a[r + j]) & m;
+        a[r] ^= t << s;
+        a[r + j] ^= t;
+      }
+  }
+}
+
+// Sub-byte transpose on packed words, without unpacking to bytes. M and N
+// must be multiples of 32 / kBits.
+template <int kBits>
+void transpose_cpu_packed(PackedTransposeParams<kBits> params) {
+  constexpr int e = 32 / kBits;
+  size_t const wordsM = params.M / e, wordsN = params.N / e;
+  cfk::utils::parallel_for(0, wordsM, 1, [&](size_t lo, size_t hi) {
+    uint32_t block[e];
+    for (size_t rb = lo; rb < hi; ++rb)
+      for (size_t cb = 0; cb < wordsN; ++cb) {
+        for (int t = 0; t < e; ++t)
+          block[t] = params.input[(rb * e + t) * wordsN + cb];
+        transpose_packed_block<kBits>(block);
+        for (int t = 0; t < e; ++t)
+          params.output[(cb * e + t) * wordsM + rb] = block[t];
+      }
+  });
+}
+
+// Reference transpose-add, C = alpha * A + beta * B^T. B^T goes through a
+// temporary, so any aliasing of A, B and C is fine.
+template <typename T> void transpose_add_cpu_ref(TransposeAddParams<T> params) {
+  size_t const M = params.M, N = params.N;
+  std::vector<T> bt(M * N);
+  for (size_t i = 0; i < M; ++i)
+    for (size_t j = 0; j < N; ++j)
+      bt[i * N + j] = params.B[j * M + i];
+  for (size_t k = 0; k < M * N; ++k)
+    params.C[k] = params.alpha * params.A[k] + params.beta * bt[k];
+}
+
+// Which path the AVX and SSSE3 kernels below were built with, for benchmark labels.
+// The Makefile passes -mavx2; without it they fall back to scalar loops.
+#if defined(__AVX__)
+constexpr char const *kCpuAvx = "AVX";
+#else
+constexpr char const *kCpuAvx = "scalar, built without AVX";
+#endif
+#if defined(__SSSE3__)
+constexpr char const *kCpuSsse3 = "SSSE3";
+#else
+constexpr char const *kCpuSsse3 = "scalar, built without SSSE3";
+#endif
+
+namespace detail {
+
+#if defined(__AVX__)
+// Transpose the 8 x 8 block held in r[0..7] in registers.
+inline void transpose8x8_ps(__m256 r[8]) {
+  __m256 t[8], u[8];
+  for (int k = 0; k < 8; k += 2) {
+    t[k] = _mm256_unpacklo_ps(r[k], r[k + 1]);
+    t[k + 1] = _mm256_unpackhi_ps(r[k], r[k + 1]);
+  }
+  for (int k = 0; k < 8; k += 4) {
+    u[k] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(1, 0, 1, 0));
+    u[k + 1] = _mm256_shuffle_ps(t[k], t[k + 2], _MM_SHUFFLE(3, 2, 3, 2));
+    u[k + 2] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(1, 0, 1, 0));
+    u[k + 3] = _mm256_shuffle_ps(t[k + 1], t[k + 3], _MM_SHUFFLE(3, 2, 3, 2));
+  }
+  for (int k = 0; k < 4; ++k) {
+    r[k] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x20);
+    r[k + 4] = _mm256_permute2f128_ps(u[k], u[k + 4], 0x31);
+  }
+}
+#endif
+
+// c(r, s) = alpha * a(r, s) + beta * b(s, r) for a rows x cols tile, with
+// leading dimensions lda, ldb and ldc. c may alias a but not b. Float tiles
+// go through 8 x 8 AVX blocks when the target has AVX.
+template <typename T>
+inline void tile_transpose_add(T const *a, size_t lda, T const *b, size_t ldb,
+                               T *c, size_t ldc, size_t rows, size_t cols,
+                               T alpha, T beta) {
+  size_t r0 = 0;
+#if defined(__AVX__)
+  if constexpr (std::is_same_v<T, float>) {
+    __m256 const va = _mm256_set1_ps(alpha), vb = _mm256_set1_ps(beta);
+    for (; r0 + 8 <= rows; r0 += 8) {
+      size_t s0 = 0;
+      for (; s0 + 8 <= cols; s0 += 8) {
+        __m256 t[8];
+        for (int k = 0; k < 8; ++k)
+          t[k] = _mm256_loadu_ps(b + (s0 + k) * ldb + r0);
+        transpose8x8_ps(t);
+        for (int k = 0; k < 8; ++k) {
+          __m256 x = _mm256_loadu_ps(a + (r0 + k) * lda + s0);
+          _mm256_storeu_ps(c + (r0 + k) * ldc + s0,
+                           _mm256_add_ps(_mm256_mul_ps(va, x),
+                                         _mm256_mul_ps(vb, t[k])));
+        }
+      }
+      for (size_t r = r0; r < r0 + 8; ++r)
+        for (size_t s = s0; s < cols; ++s)
+          c[r * ldc + s] = alpha * a[r * lda + s] + beta * b[s * ldb + r];
+    }
+  }
+#endif
+  for (size_t r = r0; r < rows; ++r)
+    for (size_t s = 0; s < cols; ++s)
+      c[r * ldc + s] = alpha * a[r * lda + s] + beta * b[s * ldb + r];
+}
+
+} // namespace detail
+
+// Blocked transpose-add. For square operands each task takes tile pairs
+// (i, j) / (j, i), copies all four input tiles to a local buffer and then
+// writes both output tiles, like the GPU kernel, so A, B and C may alias
+// freely. Otherwise output tiles are computed straight from A and B, and C
+// may alias A but not B.
+template <typename T, int kBlock = 32>
+void transpose_add_cpu(TransposeAddParams<T> params) {
+  using detail::tile_transpose_add;
+  size_t const M = params.M, N = params.N;
+  size_t const tilesM = (M + kBlock - 1) / kBlock;
+  T const alpha = params.alpha, beta = params.beta;
+
+  if (M != N) {
+    cfk::utils::parallel_for(0, tilesM, 1, [&](size_t lo, size_t hi) {
+      for (size_t ti = lo; ti < hi; ++ti) {
+        size_t i0 = ti * kBlock, rows = std::min<size_t>(kBlock, M - i0);
+        for (size_t j0 = 0; j0 < N; j0 += kBlock)
+          tile_transpose_add(params.A + i0 * N + j0, N,
+                             params.B + j0 * M + i0, M,
+                             params.C + i0 * N + j0, N, rows,
+                             std::min<size_t>(kBlock, N - j0), alpha, beta);
+      }
+    });
+    return;
+  }
+
+  constexpr size_t kTile = size_t(kBlock) * kBlock;
+  cfk::utils::parallel_for(
+      0, tilesM * (tilesM + 1) / 2, 1, [&](size_t lo, size_t hi) {
+        T buf[4][kTile]; // A(i, j), A(j, i), B(i, j), B(j, i)
+        for (size_t k = lo; k < hi; ++k) {
+          int ti, tj;
+          tile_pair_from_index(int(k), ti, tj);
+          size_t i0 = ti * kBlock, j0 = tj * kBlock;
+          size_t h = std::min<size_t>(kBlock, N - i0);
+          size_t w = std::min<size_t>(kBlock, N - j0);
+          for (size_t r = 0; r < h; ++r) {
+            std::memcpy(buf[0] + r * kBlock, params.A + (i0 + r) * N + j0,
+                        w * sizeof(T));
+            std::memcpy(buf[2] + r * kBlock, params.B + (i0 + r) * N + j0,
+                        w * sizeof(T));
+          }
+          for (size_t r = 0; r < w; ++r) {
+            std::memcpy(buf[1] + r * kBlock, params.A + (j0 + r) * N + i0,
+                        h * sizeof(T));
+            std::memcpy(buf[3] + r * kBlock, params.B + (j0 + r) * N + i0,
+                        h * sizeof(T));
+          }
+          tile_transpose_add(buf[0], kBlock, buf[3], kBlock,
+                             params.C + i0 * N + j0, N, h, w, alpha, beta);
+          if (ti != tj)
+            tile_transpose_add(buf[1], kBlock, buf[2], kBlock,
+                               params.C + j0 * N + i0, N, w, h, alpha, beta);
+        }
+      });
+}
+
+// Checks transpose_add_cpu against transpose_add_cpu_ref on shapes with and
+// without whole 8 x 8 and 32 x 32 blocks, rectangular with C aliasing A and
+// square with C aliasing A, B or both (symmetrize). Needs no GPU.
+inline bool check_transpose_add_cpu() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Transpose-add check failed: " << what << std::endl;
+    ok = false;
+  };
+  auto same = [](std::vector<float> const &got,
+                 std::vector<float> const &want) {
+    for (size_t k = 0; k < want.size(); ++k)
+      if (std::abs(got[k] - want[k]) > 1e-6f * (1 + std::abs(want[k])))
+        return false;
+    return true;
+  };
+
+  float const alpha = 0.75f, beta = -1.5f;
+  for (int M : {1, 7, 8, 33, 64, 100})
+    for (int N : {1, 8, 31, 64, 96}) {
+      std::string const shape =
+          "(" + std::to_string(M) + ", " + std::to_string(N) + ")";
+      size_t const size = size_t(M) * N;
+      std::vector<float> a(size), b(size), want(size), got(size);
+      cfk::utils::fill_random_cpu(a.data(), size, 1);
+      cfk::utils::fill_random_cpu(b.data(), size, 2);
+      transpose_add_cpu_ref<float>({a.data(), b.data(), want.data(), M, N,
+                                    alpha, beta});
+      transpose_add_cpu<float>({a.data(), b.data(), got.data(), M, N, alpha,
+                                beta});
+      if (!same(got, want))
+        fail(shape);
+      got = a; // C = A
+      transpose_add_cpu<float>({got.data(), b.data(), got.data(), M, N,
+                                alpha, beta});
+      if (!same(got, want))
+        fail(shape + " in place over A");
+      if (M != N)
+        continue;
+      got = b; // C = B
+      transpose_add_cpu<float>({a.data(), got.data(), got.data(), M, N,
+                                alpha, beta});
+      if (!same(got, want))
+        fail(shape + " in place over B");
+      transpose_add_cpu_ref<float>(
+          TransposeAddParams<float>::symmetrize(a.data(), want.data(), M));
+      got = a;
+      transpose_add_cpu<float>(
+          TransposeAddParams<float>::symmetrize(got.data(), got.data(), M));
+      if (!same(got, want))
+        fail(shape + " symmetrize");
+    }
+
+  if (ok)
+    std::cout << "Transpose-add check passed (" << kCpuAvx << ")."
+              << std::endl;
+  return ok;
+}
+
+namespace detail {
+
+// Pixels [lo, hi) of deinterleave_cpu / interleave_cpu. fp32 complex pairs
+// go through AVX and 8-bit RGBA through SSSE3 byte shuffles when the target
+// has them; the rest, and the tail of each range, is scalar.
+template <typename T, int kChannels>
+inline void deinterleave_range(T const *in, T *out, size_t P, size_t lo,
+                               size_t hi) {
+  size_t p = lo;
+#if defined(__AVX__)
+  if constexpr (std::is_same_v<T, float> && kChannels == 2) {
+    for (; p + 8 <= hi; p += 8) {
+      __m256 a = _mm256_loadu_ps(in + 2 * p);
+      __m256 b = _mm256_loadu_ps(in + 2 * p + 8);
+      __m256 x = _mm256_permute2f128_ps(a, b, 0x20); // p0 p1 | p4 p5
+      __m256 y = _mm256_permute2f128_ps(a, b, 0x31); // p2 p3 | p6 p7
+      _mm256_storeu_ps(out + p, _mm256_shuffle_ps(x, y, 0x88));
+      _mm256_storeu_ps(out + P + p, _mm256_shuffle_ps(x, y, 0xDD));
+    }
+  }
+#endif
+#if defined(__SSSE3__)
+  if constexpr (std::is_same_v<T, uint8_t> && kChannels == 4) {
+    // Transposes the 4 x 4 bytes of each 32-bit lane.
+    __m128i const m = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3,
+                                    7, 11, 15);
+    for (; p + 16 <= hi; p += 16) {
+      __m128i v[4];
+      for (int k = 0; k < 4; ++k)
+        v[k] = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(in + 4 * p) + k),
+            m);
+      __m128i t0 = _mm_unpacklo_epi32(v[0], v[1]);
+      __m128i t1 = _mm_unpacklo_epi32(v[2], v[3]);
+      __m128i t2 = _mm_unpackhi_epi32(v[0], v[1]);
+      __m128i t3 = _mm_unpackhi_epi32(v[2], v[3]);
+      __m128i c[4] = {_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                      _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)};
+      for (int k = 0; k < 4; ++k)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + k * P + p), c[k]);
+    }
+  }
+#endif
+  for (; p < hi; ++p)
+    for (int c = 0; c < kChannels; ++c)
+      out[c * P + p] = in[p * kChannels + c];
+}
+
+template <typename T, int kChannels>
+inline void interleave_range(T const *in, T *out, size_t P, size_t lo,
+                             size_t hi) {
+  size_t p = lo;
+#if defined(__AVX__)
+  if constexpr (std::is_same_v<T, float> && kChannels == 2) {
+    for (; p + 8 <= hi; p += 8) {
+      __m256 re = _mm256_loadu_ps(in + p), im = _mm256_loadu_ps(in + P + p);
+      __m256 x = _mm256_unpacklo_ps(re, im); // p0 p1 | p4 p5
+      __m256 y = _mm256_unpackhi_ps(re, im); // p2 p3 | p6 p7
+      _mm256_storeu_ps(out + 2 * p, _mm256_permute2f128_ps(x, y, 0x20));
+      _mm256_storeu_ps(out + 2 * p + 8, _mm256_permute2f128_ps(x, y, 0x31));
+    }
+  }
+#endif
+#if defined(__SSSE3__)
+  if constexpr (std::is_same_v<T, uint8_t> && kChannels == 4) {
+    __m128i const m = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3,
+                                    7, 11, 15);
+    for (; p + 16 <= hi; p += 16) {
+      __m128i c[4];
+      for (int k = 0; k < 4; ++k)
+        c[k] = _mm_loadu_si128(
+            reinterpret_cast<__m128i const *>(in + k * P + p));
+      __m128i t0 = _mm_unpacklo_epi32(c[0], c[1]);
+      __m128i t1 = _mm_unpacklo_epi32(c[2], c[3]);
+      __m128i t2 = _mm_unpackhi_epi32(c[0], c[1]);
+      __m128i t3 = _mm_unpackhi_epi32(c[2], c[3]);
+      __m128i v[4] = {_mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+                      _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3)};
+      for (int k = 0; k < 4; ++k)
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 4 * p) + k,
+                         _mm_shuffle_epi8(v[k], m));
+    }
+  }
+#endif
+  for (; p < hi; ++p)
+    for (int c = 0; c < kChannels; ++c)
+      out[p * kChannels + c] = in[c * P + p];
+}
+
+} // namespace detail
+
+// Host versions of deinterleave / interleave (interleave.h), with the same
+// TransposeParams conventions: N == kChannels resp. M == kChannels.
+template <typename T, int kChannels>
+void deinterleave_cpu(TransposeParams<T> params) {
+  size_t const P = params.M;
+  cfk::utils::parallel_for(0, P, 0, [&](size_t lo, size_t hi) {
+    detail::deinterleave_range<T, kChannels>(params.input, params.output, P,
+                                             lo, hi);
+  });
+}
+
+template <typename T, int kChannels>
+void interleave_cpu(TransposeParams<T> params) {
+  size_t const P = params.N;
+  cfk::utils::parallel_for(0, P, 0, [&](size_t lo, size_t hi) {
+    detail::interleave_range<T, kChannels>(params.input, params.output, P, lo,
+                                           hi);
+  });
+}
+
+namespace detail {
+
+// deinterleave_cpu / interleave_cpu against the plain loops, for P pixels.
+template <typename T, int kChannels> bool check_interleave(size_t P) {
+  size_t const size = P * kChannels;
+  std::vector<T> in(size), want(size), got(size), back(size);
+  cfk::utils::fill_random_cpu(in.data(), size, P);
+  for (size_t p = 0; p < P; ++p)
+    for (int c = 0; c < kChannels; ++c)
+      want[c * P + p] = in[p * kChannels + c];
+  deinterleave_cpu<T, kChannels>({in.data(), got.data(), int(P), kChannels});
+  interleave_cpu<T, kChannels>({got.data(), back.data(), kChannels, int(P)});
+  return got == want && back == in;
+}
+
+} // namespace detail
+
+// Checks the SIMD deinterleave / interleave paths against the plain loops,
+// with pixel counts around the 8- and 16-pixel vector widths so the scalar
+// tails are covered too. Needs no GPU.
+inline bool check_interleave_cpu() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Interleave check failed: " << what << std::endl;
+    ok = false;
+  };
+  for (size_t P : {0, 1, 7, 8, 9, 15, 16, 17, 33, 1000, 100003}) {
+    std::string const pixels = ", " + std::to_string(P) + " pixels";
+    if (!detail::check_interleave<float, 2>(P))
+      fail("complex fp32" + pixels);
+    if (!detail::check_interleave<uint8_t, 4>(P))
+      fail("RGBA8" + pixels);
+    if (!detail::check_interleave<float, 3>(P))
+      fail("fp32 x 3" + pixels);
+  }
+  if (ok)
+    std::cout << "Interleave check passed (" << kCpuAvx << ", " << kCpuSsse3
+              << ")." << std::endl;
+  return ok;
+}
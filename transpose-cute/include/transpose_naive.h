@@ -22,6 +22,8 @@
 
 #include "cutlass/detail/layout.hpp"
 
+#include "host_stats.hpp"
+#include "host_trace.hpp"
 #include "shared_storage.h"
 #include "util.h"
 
@@ -46,7 +48,11 @@ transposeKernelNaive(TensorS const S, TensorD const DT,
 }
 
 template <typename Element> void transpose_naive(TransposeParams<Element> params) {
-  
+  cfk::utils::ScopedRange range("transpose_naive",
+                                cfk::utils::dtype_name<Element>(),
+                                {params.M, params.N});
+  CFK_HOST_STAGE(layout_timer, "transpose_naive.layouts");
+
   //
   // Make Tensors
   //
@@ -83,6 +89,9 @@ template <typename Element> void transpose_naive(TransposeParams<Element> params
       size<1>(tiled_tensor_S),
       size<2>(tiled_tensor_S)); // Grid shape corresponds to modes m' and n'
   dim3 blockDim(size(threadLayoutS)); // 256 threads
+  layout_timer.stop();
+
+  CFK_HOST_STAGE(launch_timer, "transpose_naive.launch");
   transposeKernelNaive<<<gridDim, blockDim>>>(tiled_tensor_S, tiled_tensor_DT,
                                             threadLayoutS, threadLayoutD);
 };
@@ -5,6 +5,7 @@
 #include <cstdlib>
 
 #include <chrono>
+#include <type_traits>
 
 #include <thrust/device_vector.h>
 #include <thrust/host_vector.h>
@@ -22,16 +23,23 @@
 
 #include "cutlass/detail/layout.hpp"
 
+#include "cuda_launch.hpp"
+#include "host_stats.hpp"
+#include "host_trace.hpp"
 #include "shared_storage.h"
+#include "util.h"
 
 template <class TensorS, class TensorD, class SmemLayoutS, class ThreadLayoutS,
-          class SmemLayoutD, class ThreadLayoutD>
+          class SmemLayoutD, class ThreadLayoutD,
+          class ElementOp = IdentityElementOp>
 __global__ static void __launch_bounds__(256, 1)
     transposeKernelSmem(TensorS const S, TensorD const D,
                         SmemLayoutS const smemLayoutS, ThreadLayoutS const tS,
-                        SmemLayoutD const smemLayoutD, ThreadLayoutD const tD) {
+                        SmemLayoutD const smemLayoutD, ThreadLayoutD const tD,
+                        ElementOp const op = {}) {
   using namespace cute;
   using Element = typename TensorS::value_type;
+  using OutElement = typename TensorD::value_type;
 
   // Use Shared Storage structure to allocate aligned SMEM addresses.
   extern __shared__ char shared_memory[];
@@ -53,28 +61,55 @@ __global__ static void __launch_bounds__(256, 1)
   Tensor tDgD = local_partition(gD, tD, threadIdx.x);
   Tensor tDsD = local_partition(sD, tD, threadIdx.x);
 
+  cfk::utils::grid_dependency_wait();
   cute::copy(tSgS, tSsS); // LDGSTS
 
   cp_async_fence();
   cp_async_wait<0>();
   __syncthreads();
+  cfk::utils::launch_dependent_grids();
 
-  cute::copy(tDsD, tDgD);
+  if constexpr (std::is_same_v<ElementOp, IdentityElementOp>) {
+    cute::copy(tDsD, tDgD);
+  } else {
+    // Element (r, c) of the (bN, bM) tile of D is input (m0 + c, n0 + r).
+    Tensor tDcD = local_partition(make_identity_tensor(shape(gD)), tD,
+                                  threadIdx.x);
+    int const m0 = blockIdx.x * size<0>(gS), n0 = blockIdx.y * size<1>(gS);
+    CUTE_UNROLL
+    for (int k = 0; k < size(tDgD); ++k)
+      tDgD(k) = static_cast<OutElement>(
+          op(tDsD(k), m0 + get<1>(tDcD(k)), n0 + get<0>(tDcD(k))));
+  }
 }
 
-template <typename Element, bool isSwizzled = true> void transpose_smem(TransposeParams<Element> params) {
+// transpose_smem for an (M, N) shape of runtime ints or of cute::Int extents
+// (static_shapes.h); the layouts, tilings and grid follow the shape's types.
+// `op` maps each element on its way out of smem (fused_expr.h), and the
+// output may then have another element type. M and N must be multiples of
+// 64.
+template <typename Element, bool isSwizzled, class Shape,
+          typename OutElement = Element, class ElementOp = IdentityElementOp>
+void transpose_smem_shape(Element *input, OutElement *output,
+                          Shape const &tensor_shape, bool pdl,
+                          ElementOp const &op = {}, cudaStream_t stream = 0) {
 
   using namespace cute;
+  cfk::utils::ScopedRange range(
+      isSwizzled ? "transpose_swizzle" : "transpose_smem",
+      cfk::utils::dtype_name<Element>(),
+      {int(get<0>(tensor_shape)), int(get<1>(tensor_shape))});
+  CFK_HOST_STAGE(layout_timer, "transpose_smem.layouts");
 
   //
   // Make tensors
   //
-  auto tensor_shape = make_shape(params.M, params.N);
-  auto tensor_shape_trans = make_shape(params.N, params.M);
+  auto tensor_shape_trans =
+      make_shape(get<1>(tensor_shape), get<0>(tensor_shape));
   auto gmemLayoutS = make_layout(tensor_shape, LayoutRight{});
   auto gmemLayoutD = make_layout(tensor_shape_trans, LayoutRight{});
-  Tensor tensor_S = make_tensor(make_gmem_ptr(params.input), gmemLayoutS);
-  Tensor tensor_D = make_tensor(make_gmem_ptr(params.output), gmemLayoutD);
+  Tensor tensor_S = make_tensor(make_gmem_ptr(input), gmemLayoutS);
+  Tensor tensor_D = make_tensor(make_gmem_ptr(output), gmemLayoutD);
 
   //
   // Tile tensors
@@ -115,14 +150,156 @@ template <typename Element, bool isSwizzled = true> void transpose_smem(Transpos
       size<1>(tiled_tensor_S),
       size<2>(tiled_tensor_S)); // Grid shape corresponds to modes m' and n'
   dim3 blockDim(size(threadLayoutS)); // 256 threads
+  layout_timer.stop();
+
+  CFK_HOST_STAGE(launch_timer, "transpose_smem.launch");
+  cfk::utils::LaunchConfig config{gridDim, blockDim, dim3(1), int(smem_size),
+                                  stream, pdl};
+  auto launch = [&](auto const &smemLayoutS, auto const &smemLayoutD) {
+    void const *kernel = (void const *)transposeKernelSmem<
+        decltype(tiled_tensor_S), decltype(tiled_tensor_D),
+        std::decay_t<decltype(smemLayoutS)>, decltype(threadLayoutS),
+        std::decay_t<decltype(smemLayoutD)>, decltype(threadLayoutD),
+        ElementOp>;
+    cfk::utils::launch(kernel, config, tiled_tensor_S, tiled_tensor_D,
+                       smemLayoutS, threadLayoutS, smemLayoutD, threadLayoutD,
+                       op);
+  };
+  if constexpr (isSwizzled) {
+    launch(smemLayoutS_swizzle, smemLayoutD_swizzle);
+  } else {
+    launch(smemLayoutS, smemLayoutD);
+  }
+}
+
+template <typename Element, bool isSwizzled = true>
+void transpose_smem(TransposeParams<Element> params) {
+  transpose_smem_shape<Element, isSwizzled>(
+      params.input, params.output, cute::make_shape(params.M, params.N),
+      params.pdl);
+}
+
+// Element-wise copy with conversion, for outputs whose dtype differs from
+// the staged input.
+template <class SrcTensor, class DstTensor>
+CUTE_DEVICE void convert_copy(SrcTensor const &src, DstTensor &&dst) {
+  using DstElement = typename cute::remove_cvref_t<DstTensor>::value_type;
+  CUTE_UNROLL
+  for (int i = 0; i < cute::size(src); ++i)
+    dst(i) = static_cast<DstElement>(src(i));
+}
+
+// transposeKernelSmem with a second output: the tile staged in smem is also
+// written back in its original layout to C, so A and A^T (each in its own
+// dtype) cost one DRAM read.
+template <class TensorS, class TensorC, class TensorD, class SmemLayoutS,
+          class ThreadLayoutS, class SmemLayoutD, class ThreadLayoutD>
+__global__ static void __launch_bounds__(256, 1)
+    transposeKernelSmemDual(TensorS const S, TensorC const C, TensorD const D,
+                            SmemLayoutS const smemLayoutS,
+                            ThreadLayoutS const tS,
+                            SmemLayoutD const smemLayoutD,
+                            ThreadLayoutD const tD) {
+  using namespace cute;
+  using Element = typename TensorS::value_type;
+
+  extern __shared__ char shared_memory[];
+  using SharedStorage = SharedStorageTranspose<Element, SmemLayoutD>;
+  SharedStorage &shared_storage =
+      *reinterpret_cast<SharedStorage *>(shared_memory);
+
+  Tensor sS = make_tensor(make_smem_ptr(shared_storage.smem.data()),
+                          smemLayoutS); // (bM, bN)
+  Tensor sD = make_tensor(make_smem_ptr(shared_storage.smem.data()),
+                          smemLayoutD); // (bN, bM)
+
+  Tensor gS = S(make_coord(_, _), blockIdx.x, blockIdx.y); // (bM, bN)
+  Tensor gC = C(make_coord(_, _), blockIdx.x, blockIdx.y); // (bM, bN)
+  Tensor gD = D(make_coord(_, _), blockIdx.y, blockIdx.x); // (bN, bM)
+
+  Tensor tSgS = local_partition(gS, tS, threadIdx.x); // (ThrValM, ThrValN)
+  Tensor tSsS = local_partition(sS, tS, threadIdx.x); // (ThrValM, ThrValN)
+  Tensor tSgC = local_partition(gC, tS, threadIdx.x); // (ThrValM, ThrValN)
+  Tensor tDgD = local_partition(gD, tD, threadIdx.x);
+  Tensor tDsD = local_partition(sD, tD, threadIdx.x);
+
+  cfk::utils::grid_dependency_wait();
+  cute::copy(tSgS, tSsS); // LDGSTS
+
+  cp_async_fence();
+  cp_async_wait<0>();
+  __syncthreads();
+  cfk::utils::launch_dependent_grids();
+
+  // Each thread reads back the elements it loaded, so the original-layout
+  // write needs no further synchronization.
+  convert_copy(tSsS, tSgC);
+  convert_copy(tDsD, tDgD);
+}
+
+// Writes params.copy = A and params.transpose = A^T from one read of A. M and
+// N must be multiples of 64: the kernel does not predicate partial tiles.
+template <typename Element, typename CopyElement = Element,
+          typename TransposeElement = Element, bool isSwizzled = true>
+void transpose_smem_dual(
+    DualTransposeParams<Element, CopyElement, TransposeElement> params) {
+
+  using namespace cute;
+  cfk::utils::ScopedRange range("transpose_dual",
+                                cfk::utils::dtype_name<Element>(),
+                                {params.M, params.N});
+  assert(params.M % 64 == 0 && params.N % 64 == 0);
+  CFK_HOST_STAGE(layout_timer, "transpose_dual.layouts");
+
+  auto tensor_shape = make_shape(params.M, params.N);
+  auto tensor_shape_trans = make_shape(params.N, params.M);
+  auto gmemLayoutS = make_layout(tensor_shape, LayoutRight{});
+  auto gmemLayoutD = make_layout(tensor_shape_trans, LayoutRight{});
+  Tensor tensor_S = make_tensor(make_gmem_ptr(params.input), gmemLayoutS);
+  Tensor tensor_C = make_tensor(make_gmem_ptr(params.copy), gmemLayoutS);
+  Tensor tensor_D = make_tensor(make_gmem_ptr(params.transpose), gmemLayoutD);
+
+  using bM = Int<64>;
+  using bN = Int<64>;
+
+  auto block_shape = make_shape(bM{}, bN{});       // (bM, bN)
+  auto block_shape_trans = make_shape(bN{}, bM{}); // (bN, bM)
+
+  Tensor tiled_tensor_S =
+      tiled_divide(tensor_S, block_shape); // ((bM, bN), m', n')
+  Tensor tiled_tensor_C =
+      tiled_divide(tensor_C, block_shape); // ((bM, bN), m', n')
+  Tensor tiled_tensor_D =
+      tiled_divide(tensor_D, block_shape_trans); // ((bN, bM), n', m')
+
+  auto tileShapeS = make_layout(block_shape, LayoutRight{});
+  auto tileShapeD = make_layout(block_shape_trans, LayoutRight{});
+
+  auto smemLayoutS = tileShapeS;
+  auto smemLayoutD = composition(smemLayoutS, tileShapeD);
+  auto smemLayoutS_swizzle = composition(Swizzle<5, 0, 5>{}, tileShapeS);
+  auto smemLayoutD_swizzle = composition(smemLayoutS_swizzle, tileShapeD);
+
+  auto threadLayoutS =
+      make_layout(make_shape(Int<8>{}, Int<32>{}), LayoutRight{});
+  auto threadLayoutD =
+      make_layout(make_shape(Int<8>{}, Int<32>{}), LayoutRight{});
+
+  size_t smem_size = int(
+      sizeof(SharedStorageTranspose<Element, decltype(smemLayoutS_swizzle)>));
+
+  dim3 gridDim(size<1>(tiled_tensor_S), size<2>(tiled_tensor_S));
+  dim3 blockDim(size(threadLayoutS)); // 256 threads
+  layout_timer.stop();
 
+  CFK_HOST_STAGE(launch_timer, "transpose_dual.launch");
   if constexpr (isSwizzled) {
-    transposeKernelSmem<<<gridDim, blockDim, smem_size>>>(
-        tiled_tensor_S, tiled_tensor_D, smemLayoutS_swizzle, threadLayoutS,
-        smemLayoutD_swizzle, threadLayoutD);
+    transposeKernelSmemDual<<<gridDim, blockDim, smem_size>>>(
+        tiled_tensor_S, tiled_tensor_C, tiled_tensor_D, smemLayoutS_swizzle,
+        threadLayoutS, smemLayoutD_swizzle, threadLayoutD);
   } else {
-    transposeKernelSmem<<<gridDim, blockDim, smem_size>>>(
-        tiled_tensor_S, tiled_tensor_D, smemLayoutS, threadLayoutS,
-        smemLayoutD, threadLayoutD);
+    transposeKernelSmemDual<<<gridDim, blockDim, smem_size>>>(
+        tiled_tensor_S, tiled_tensor_C, tiled_tensor_D, smemLayoutS,
+        threadLayoutS, smemLayoutD, threadLayoutD);
   }
 }
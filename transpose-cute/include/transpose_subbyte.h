@@ -0,0 +1,74 @@
+#pragma once
+
+// Transpose of packed sub-byte matrices (int4, int2, 1-bit) without
+// unpacking them to bytes. See PackedTransposeParams in util.h for the
+// layout.
+//
+// Each warp transposes a 32 x 32 element block entirely in registers. Lane i
+// loads row i of the block (kBits words). For every column c and bit k,
+// __ballot_sync collects bit k of element (i, c) over all 32 rows, which is
+// bit plane k of output row c, and lane c keeps it. Lane c then interleaves
+// its kBits planes back into packed words for output row c. The bit
+// helpers are in transpose_subbyte_cpu.h, with a host emulation of this
+// kernel.
+
+#include <cassert>
+#include <cstdint>
+
+#include <cute/tensor.hpp>
+
+#include "host_stats.hpp"
+#include "host_trace.hpp"
+#include "transpose_subbyte_cpu.h"
+#include "util.h"
+
+// Block of 32 rows x 256 columns: warp w handles columns [32w, 32w + 32).
+template <int kBits>
+__global__ static void __launch_bounds__(256, 1)
+    transposeSubByteKernel(uint32_t const *__restrict__ input,
+                           uint32_t *__restrict__ output, int M, int N) {
+  constexpr int kPerWord = 32 / kBits;
+  int const warp = threadIdx.x / 32, lane = threadIdx.x % 32;
+  size_t const row0 = size_t(blockIdx.y) * 32;
+  size_t const col0 = (size_t(blockIdx.x) * 8 + warp) * 32;
+  size_t const wordsM = size_t(M) / kPerWord, wordsN = size_t(N) / kPerWord;
+
+  uint32_t row[kBits];
+  uint32_t const *in = input + (row0 + lane) * wordsN + col0 / kPerWord;
+  CUTE_UNROLL
+  for (int w = 0; w < kBits; ++w)
+    row[w] = in[w];
+
+  uint32_t planes[kBits] = {};
+  CUTE_UNROLL
+  for (int c = 0; c < 32; ++c) {
+    CUTE_UNROLL
+    for (int k = 0; k < kBits; ++k) {
+      uint32_t mask = __ballot_sync(0xffffffff, packed_bit<kBits>(row, c, k));
+      if (lane == c)
+        planes[k] = mask;
+    }
+  }
+
+  // Lane c holds elements row0 .. row0 + 31 of output row col0 + c.
+  uint32_t *out = output + (col0 + lane) * wordsM + row0 / kPerWord;
+  CUTE_UNROLL
+  for (int q = 0; q < kBits; ++q)
+    out[q] = pack_planes<kBits>(planes, q);
+}
+
+// M must be a multiple of 32 and N a multiple of 256.
+template <int kBits>
+void transpose_packed(PackedTransposeParams<kBits> params) {
+  char const *names[] = {"", "transpose_packed_b1", "transpose_packed_b2", "",
+                         "transpose_packed_b4"};
+  cfk::utils::ScopedRange range(names[kBits], "packed",
+                                {params.M, params.N});
+  assert(params.M % 32 == 0 && params.N % 256 == 0);
+
+  CFK_HOST_STAGE(launch_timer, "transpose_packed.launch");
+  dim3 gridDim(params.N / 256, params.M / 32);
+  dim3 blockDim(256);
+  transposeSubByteKernel<kBits><<<gridDim, blockDim>>>(
+      params.input, params.output, params.M, params.N);
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+// Bit-plane helpers shared by transposeSubByteKernel (transpose_subbyte.h)
+// and a host emulation of it. The emulation walks the kernel's blocks,
+// warps and lanes in order and replaces each __ballot_sync with a loop over
+// the 32 lanes, so the kernel's indexing and plane interleave can be checked
+// without a GPU. check_packed_transpose_cpu() runs it and
+// transpose_cpu_packed against ExpectPackedTranspose.
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "host_device.hpp"
+#include "transpose_cpu.h"
+#include "util.h"
+#include "verify.hpp"
+
+// Spread the low 32 / kBits bits of x so that bit t lands at bit kBits * t.
+template <int kBits> CFK_HOST_DEVICE uint32_t spread_bits(uint32_t x) {
+  if constexpr (kBits == 1) {
+    return x;
+  } else if constexpr (kBits == 2) {
+    x &= 0xFFFF;
+    x = (x | (x << 8)) & 0x00FF00FF;
+    x = (x | (x << 4)) & 0x0F0F0F0F;
+    x = (x | (x << 2)) & 0x33333333;
+    return (x | (x << 1)) & 0x55555555;
+  } else {
+    x &= 0xFF;
+    x = (x | (x << 12)) & 0x000F000F;
+    x = (x | (x << 6)) & 0x03030303;
+    return (x | (x << 3)) & 0x11111111;
+  }
+}
+
+// Bit k of element c of a lane's block row, held as kBits words.
+template <int kBits>
+CFK_HOST_DEVICE uint32_t packed_bit(uint32_t const *row, int c, int k) {
+  int const bit = c * kBits + k;
+  return (row[bit / 32] >> (bit % 32)) & 1;
+}
+
+// Word q of an output row from its kBits bit planes: plane k holds bit k of
+// the row's 32 elements.
+template <int kBits>
+CFK_HOST_DEVICE uint32_t pack_planes(uint32_t const *planes, int q) {
+  constexpr int kPerWord = 32 / kBits;
+  uint32_t word = 0;
+  for (int k = 0; k < kBits; ++k)
+    word |= spread_bits<kBits>(planes[k] >> (q * kPerWord)) << k;
+  return word;
+}
+
+// transposeSubByteKernel on the host: blocks of 32 rows x 256 columns, eight
+// warps per block, 32 lanes per warp. M must be a multiple of 32 and N a
+// multiple of 256.
+template <int kBits>
+void transpose_packed_ballot_emulated(PackedTransposeParams<kBits> params) {
+  constexpr int kPerWord = 32 / kBits;
+  size_t const wordsM = size_t(params.M) / kPerWord,
+               wordsN = size_t(params.N) / kPerWord;
+
+  for (int by = 0; by < params.M / 32; ++by)
+    for (int bx = 0; bx < params.N / 256; ++bx)
+      for (int warp = 0; warp < 8; ++warp) {
+        size_t const row0 = size_t(by) * 32;
+        size_t const col0 = (size_t(bx) * 8 + warp) * 32;
+
+        uint32_t row[32][kBits];
+        for (int lane = 0; lane < 32; ++lane)
+          for (int w = 0; w < kBits; ++w)
+            row[lane][w] =
+                params.input[(row0 + lane) * wordsN + col0 / kPerWord + w];
+
+        // __ballot_sync for column c, bit k, kept by lane c.
+        uint32_t planes[32][kBits];
+        for (int c = 0; c < 32; ++c)
+          for (int k = 0; k < kBits; ++k) {
+            uint32_t mask = 0;
+            for (int lane = 0; lane < 32; ++lane)
+              mask |= packed_bit<kBits>(row[lane], c, k) << lane;
+            planes[c][k] = mask;
+          }
+
+        for (int lane = 0; lane < 32; ++lane)
+          for (int q = 0; q < kBits; ++q)
+            params.output[(col0 + lane) * wordsM + row0 / kPerWord + q] =
+                pack_planes<kBits>(planes[lane], q);
+      }
+}
+
+namespace detail {
+
+template <int kBits, class Fail>
+void check_packed_transpose(int M, int N, Fail &fail) {
+  std::string const shape = std::to_string(kBits) + "-bit (" +
+                            std::to_string(M) + ", " + std::to_string(N) +
+                            ")";
+  uint64_t const seed = 11;
+  PackedTransposeParams<kBits> shape_only(nullptr, nullptr, M, N);
+  std::vector<uint32_t> in(shape_only.words()), out(in.size());
+  cfk::utils::fill_random_cpu(in.data(), in.size(), seed);
+  cfk::utils::ExpectPackedTranspose<kBits> expect{seed, size_t(M), size_t(N)};
+
+  PackedTransposeParams<kBits> params(in.data(), out.data(), M, N);
+  transpose_packed_ballot_emulated<kBits>(params);
+  if (!cfk::utils::verify_cpu(out.data(), out.size(), expect).ok())
+    fail("ballot emulation, " + shape);
+  std::fill(out.begin(), out.end(), 0u);
+  transpose_cpu_packed<kBits>(params);
+  if (!cfk::utils::verify_cpu(out.data(), out.size(), expect).ok())
+    fail("transpose_cpu_packed, " + shape);
+}
+
+} // namespace detail
+
+// Checks the host emulation of transposeSubByteKernel and
+// transpose_cpu_packed against ExpectPackedTranspose for every element
+// width, on square and rectangular shapes. Needs no GPU.
+inline bool check_packed_transpose_cpu() {
+  bool ok = true;
+  auto fail = [&](std::string const &what) {
+    std::cout << "Packed transpose check failed: " << what << std::endl;
+    ok = false;
+  };
+
+  for (auto [M, N] : {std::pair{32, 256}, {256, 256}, {96, 512}, {512, 768}}) {
+    detail::check_packed_transpose<1>(M, N, fail);
+    detail::check_packed_transpose<2>(M, N, fail);
+    detail::check_packed_transpose<4>(M, N, fail);
+  }
+
+  if (ok)
+    std::cout << "Packed transpose check passed." << std::endl;
+  return ok;
+}
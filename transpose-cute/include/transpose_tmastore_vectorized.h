@@ -21,6 +21,9 @@
 
 #include "cutlass/detail/layout.hpp"
 
+#include "cuda_launch.hpp"
+#include "host_stats.hpp"
+#include "host_trace.hpp"
 #include "shared_storage.h"
 #include "smem_helper.hpp"
 
@@ -58,7 +61,11 @@ __global__ static void __launch_bounds__(256)
   Tensor tSrS = make_fragment_like(tSgS);   // (CopyOp, CopyM, CopyN)
   Tensor tMsM = local_partition(sM, tM, threadIdx.x);
 
+  if (leaderWarp and lane_predicate)
+    prefetch_tma_descriptor(tmaStoreD.get_tma_descriptor());
+
   // Copy from GMEM to RMEM to SMEM
+  cfk::utils::grid_dependency_wait();
   copy(tiled_copy_S, tSgS, tSrS);
   copy(tSrS, tMsM);
 
@@ -67,6 +74,7 @@ __global__ static void __launch_bounds__(256)
   };
   cutlass::arch::fence_view_async_shared();
   synchronize();
+  cfk::utils::launch_dependent_grids();
 
   // Issue the TMA store.
   Tensor mD = tmaStoreD.get_tma_tensor(shape(gmemLayoutD));
@@ -95,6 +103,10 @@ __global__ static void __launch_bounds__(256)
 template <typename Element> void transpose_tma(TransposeParams<Element> params) {
 //  printf("Vectorized load into registers, write out via TMA Store\n");
 //  printf("Profiler reports uncoalesced smem accesses\n");
+  cfk::utils::ScopedRange range("transpose_tma",
+                                cfk::utils::dtype_name<Element>(),
+                                {params.M, params.N});
+  CFK_HOST_STAGE(layout_timer, "transpose_tma.layouts");
 
   auto tensor_shape = make_shape(params.M, params.N);
   auto tensor_shape_trans = make_shape(params.N, params.M);
@@ -129,8 +141,11 @@ template <typename Element> void transpose_tma(TransposeParams<Element> params)
                     make_shape(shape<0>(tileShapeD), shape<1>(tileShapeD)));
   // TMA only supports certain swizzles
   // https://github.com/NVIDIA/cutlass/blob/main/include/cute/atom/copy_traits_sm90_tma_swizzle.hpp
+  layout_timer.stop();
+  CFK_HOST_STAGE(tma_timer, "transpose_tma.make_tma_copy");
   auto tmaD = make_tma_copy(SM90_TMA_STORE{}, tensor_D, smemLayoutD, tileShapeD,
                             Int<1>{});
+  tma_timer.stop();
 
   auto tileShapeM = make_shape(Int<4>{}, Int<8>{}, Int<32>{});
   auto smemLayoutM = composition(smemLayoutD, make_layout(tileShapeM));
@@ -149,7 +164,14 @@ template <typename Element> void transpose_tma(TransposeParams<Element> params)
       size<2>(tiled_tensor_S)); // Grid shape corresponds to modes m' and n'
   dim3 blockDim(size(threadLayoutS));
 
-  transposeKernelTMA<<<gridDim, blockDim, smem_size>>>(
-      tiled_tensor_S, smemLayoutD, tiled_copy_S, tmaD, gmemLayoutD, tileShapeD,
-      threadLayoutM, smemLayoutM);
+  CFK_HOST_STAGE(launch_timer, "transpose_tma.launch");
+  void const *kernel = (void const *)transposeKernelTMA<
+      decltype(tiled_tensor_S), decltype(smemLayoutD), decltype(tiled_copy_S),
+      decltype(tmaD), decltype(gmemLayoutD), decltype(tileShapeD),
+      decltype(threadLayoutM), decltype(smemLayoutM)>;
+  cfk::utils::launch(kernel,
+                     {gridDim, blockDim, dim3(1), int(smem_size), nullptr,
+                      params.pdl},
+                     tiled_tensor_S, smemLayoutD, tiled_copy_S, tmaD,
+                     gmemLayoutD, tileShapeD, threadLayoutM, smemLayoutM);
 }
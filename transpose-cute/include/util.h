@@ -1,5 +1,24 @@
 #pragma once
 
+#include <cmath>
+#include <vector>
+
+#include "host_device.hpp"
+#include "huge_pages.hpp"
+#include "peak_gpu.hpp"
+#include "perf_counters.hpp"
+#include "task_runtime.hpp"
+#include "verify_gpu.hpp"
+
+// Element-wise op the copy and transpose kernels apply on the way out:
+// op(x, row, col) for the input element x at (row, col) of the input.
+// The identity keeps the plain copy path.
+struct IdentityElementOp {
+  template <class T> CFK_HOST_DEVICE T operator()(T x, int, int) const {
+    return x;
+  }
+};
+
 template <typename T> struct TransposeParams {
   T *input;
   T *output;
@@ -7,10 +26,85 @@ template <typename T> struct TransposeParams {
   const int M;
   const int N;
 
+  // Launch as a programmatic dependent of the previous kernel in the stream
+  // (transpose_smem and transpose_tma).
+  bool pdl = false;
+
   TransposeParams(T *input_, T *output_, int M_, int N_)
       : input(input_), output(output_), M(M_), N(N_) {}
 };
 
+// Two outputs from one input: `copy` in the input's layout and `transpose`,
+// each in its own element type.
+template <typename T, typename TC = T, typename TD = T>
+struct DualTransposeParams {
+  T *input;
+  TC *copy;
+  TD *transpose;
+
+  const int M;
+  const int N;
+
+  DualTransposeParams(T *input_, TC *copy_, TD *transpose_, int M_, int N_)
+      : input(input_), copy(copy_), transpose(transpose_), M(M_), N(N_) {}
+};
+
+// C = alpha * A + beta * B^T, with A and C (M, N) and B (N, M), all
+// row-major. C may alias A. When M == N, the kernels process tile pairs
+// (i, j) / (j, i) together, so any of the three may alias. That gives the
+// in-place forms, e.g. symmetrize(a, a, n) for A = (A + A^T) / 2.
+template <typename T> struct TransposeAddParams {
+  T const *A;
+  T const *B;
+  T *C;
+
+  const int M;
+  const int N;
+  const T alpha;
+  const T beta;
+
+  TransposeAddParams(T const *A_, T const *B_, T *C_, int M_, int N_,
+                     T alpha_ = T(1), T beta_ = T(1))
+      : A(A_), B(B_), C(C_), M(M_), N(N_), alpha(alpha_), beta(beta_) {}
+
+  // out = (a + a^T) / 2 for an (n, n) matrix; out may be a.
+  static TransposeAddParams symmetrize(T *a, T *out, int n) {
+    return TransposeAddParams(a, a, out, n, n, T(0.5f), T(0.5f));
+  }
+};
+
+// Tile pair k of the upper triangle (i <= j) of a tiles x tiles grid, in
+// column order: (0,0), (0,1), (1,1), (0,2), ...
+CFK_HOST_DEVICE void tile_pair_from_index(int k, int &i, int &j) {
+  j = int((sqrtf(8.0f * k + 1.0f) - 1.0f) * 0.5f);
+  while (j * (j + 1) / 2 > k)
+    --j;
+  while ((j + 1) * (j + 2) / 2 <= k)
+    ++j;
+  i = k - j * (j + 1) / 2;
+}
+
+// Transpose of kBits-wide elements (1, 2 or 4) packed LSB-first into 32-bit
+// words: element (i, j) of an (M, N) matrix is bits
+// [(j % e) * kBits, (j % e + 1) * kBits) of word i * N / e + j / e, with
+// e = 32 / kBits. M and N count elements.
+template <int kBits> struct PackedTransposeParams {
+  static_assert(kBits == 1 || kBits == 2 || kBits == 4,
+                "packed elements must be 1, 2 or 4 bits wide");
+  static constexpr int kPerWord = 32 / kBits;
+
+  uint32_t *input;
+  uint32_t *output;
+
+  const int M;
+  const int N;
+
+  PackedTransposeParams(uint32_t *input_, uint32_t *output_, int M_, int N_)
+      : input(input_), output(output_), M(M_), N(N_) {}
+
+  size_t words() const { return size_t(M) * N / kPerWord; }
+};
+
 //template <typename T> int benchmark(void (*transpose)(int M, int N, T* input, T* output), int M, int N, int iterations=10, bool verify=true) {
 template <typename T, bool isTranspose = true> int benchmark(void (*transpose)(TransposeParams<T> params), int M, int N, int iterations=10, bool verify=true) {
   using namespace cute;
@@ -18,15 +112,13 @@ template <typename T, bool isTranspose = true> int benchmark(void (*transpose)(T
   auto tensor_shape_S = make_shape(M, N);
   auto tensor_shape_D = (isTranspose) ? make_shape(N, M) : make_shape(M, N);
 
-  // Allocate and initialize
-  thrust::host_vector<T> h_S(size(tensor_shape_S));       // (M, N)
-  thrust::host_vector<T> h_D(size(tensor_shape_D)); // (N, M)
-
-  for (size_t i = 0; i < h_S.size(); ++i)
-    h_S[i] = static_cast<T>(i);
+  // Allocate and initialize on the device
+  thrust::device_vector<T> d_S(size(tensor_shape_S)); // (M, N)
+  thrust::device_vector<T> d_D(size(tensor_shape_D)); // (N, M)
 
-  thrust::device_vector<T> d_S = h_S;
-  thrust::device_vector<T> d_D = h_D;
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
 
   TransposeParams<T> params(thrust::raw_pointer_cast(d_S.data()), thrust::raw_pointer_cast(d_D.data()), M, N);
 
@@ -44,30 +136,370 @@ template <typename T, bool isTranspose = true> int benchmark(void (*transpose)(T
     std::chrono::duration<double, std::milli> tDiff = t2 - t1;
     double time_ms = tDiff.count();
     std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
-              << 2e-6 * M * N * sizeof(T) / time_ms << " GB/s)"
+              << cfk::utils::gpu_bandwidth_with_peak(
+                     2e-6 * M * N * sizeof(T) / time_ms)
+              << ")"
               << std::endl;
   }
 
   if(verify) {
-    h_D = d_D;
-  
-    int bad = 0;
-    if constexpr (isTranspose) {
-      auto transpose_function = make_layout(tensor_shape_S, LayoutRight{});
-      for (size_t i = 0; i < h_D.size(); ++i) 
-        if (h_D[i] != h_S[transpose_function(i)])
-          bad++;
-    } else {
-      for (size_t i = 0; i < h_D.size(); ++i) 
-        if (h_D[i] != h_S[i])
-          bad++;
+    T const *out = thrust::raw_pointer_cast(d_D.data());
+    cfk::utils::VerifyReport report;
+    if constexpr (isTranspose)
+      report = cfk::utils::verify_on_device(
+          out, d_D.size(),
+          cfk::utils::ExpectTranspose<T>{seed, size_t(M), size_t(N)});
+    else
+      report = cfk::utils::verify_on_device(
+          out, d_D.size(), cfk::utils::ExpectIdentity<T>{seed});
+    cfk::utils::print_verify_report(std::cout, report, isTranspose ? M : N);
+  }
+  return 0;
+}
+
+// benchmark() for the dual-output kernels: both outputs are checked, and the
+// bandwidth counts one read and two writes.
+template <typename T, typename TC, typename TD>
+int benchmark_dual(void (*transpose)(DualTransposeParams<T, TC, TD> params),
+                   int M, int N, int iterations = 10, bool verify = true) {
+  size_t const size = size_t(M) * N;
+  thrust::device_vector<T> d_S(size);
+  thrust::device_vector<TC> d_C(size);
+  thrust::device_vector<TD> d_D(size);
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), size, seed);
+
+  DualTransposeParams<T, TC, TD> params(
+      thrust::raw_pointer_cast(d_S.data()),
+      thrust::raw_pointer_cast(d_C.data()),
+      thrust::raw_pointer_cast(d_D.data()), M, N);
+
+  double bytes = double(size) * (sizeof(T) + sizeof(TC) + sizeof(TD));
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    transpose(params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
     }
-  
-    if (bad > 0) {
-      std::cout << "Validation failed. Correct values: " << h_D.size()-bad << ". Incorrect values: " << bad << std::endl;
-    } else {
-      std::cout << "Validation success." << std::endl;
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    using cfk::utils::ExpectCast;
+    using cfk::utils::ExpectIdentity;
+    using cfk::utils::ExpectTranspose;
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_on_device(
+            thrust::raw_pointer_cast(d_C.data()), size,
+            ExpectCast<ExpectIdentity<T>, TC>{{seed}}),
+        N);
+    cfk::utils::print_verify_report(
+        std::cout,
+        cfk::utils::verify_on_device(
+            thrust::raw_pointer_cast(d_D.data()), size,
+            ExpectCast<ExpectTranspose<T>, TD>{
+                {seed, size_t(M), size_t(N)}}),
+        M);
+  }
+  return 0;
+}
+
+// benchmark() for packed sub-byte transposes. Inputs are raw random words.
+template <int kBits>
+int benchmark_packed(void (*transpose)(PackedTransposeParams<kBits> params),
+                     int M, int N, int iterations = 10, bool verify = true) {
+  PackedTransposeParams<kBits> shape(nullptr, nullptr, M, N);
+  thrust::device_vector<uint32_t> d_S(shape.words()), d_D(shape.words());
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(thrust::raw_pointer_cast(d_S.data()), d_S.size(),
+                          seed);
+
+  PackedTransposeParams<kBits> params(thrust::raw_pointer_cast(d_S.data()),
+                                      thrust::raw_pointer_cast(d_D.data()),
+                                      M, N);
+
+  double bytes = 8.0 * shape.words();
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    transpose(params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
     }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    auto report = cfk::utils::verify_on_device(
+        thrust::raw_pointer_cast(d_D.data()), d_D.size(),
+        cfk::utils::ExpectPackedTranspose<kBits>{seed, size_t(M), size_t(N)});
+    cfk::utils::print_verify_report(std::cout, report,
+                                    M / PackedTransposeParams<kBits>::kPerWord);
+  }
+  return 0;
+}
+
+// benchmark() for transpose-add. Computes C = A + B^T out of place, or with
+// `symmetrize` overwrites an (M, M) input with (A + A^T) / 2. Symmetrize is
+// idempotent, so the repeated trials leave a checkable result.
+template <typename T>
+int benchmark_transpose_add(void (*op)(TransposeAddParams<T> params), int M,
+                            int N, bool symmetrize, int iterations = 10,
+                            bool verify = true) {
+  size_t const size = size_t(M) * N;
+  thrust::device_vector<T> d_A(size), d_B(symmetrize ? 0 : size),
+      d_C(symmetrize ? 0 : size);
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  uint64_t const seed_b = symmetrize ? seed : seed + 1;
+  T *A = thrust::raw_pointer_cast(d_A.data());
+  cfk::utils::fill_random(A, size, seed);
+  if (!symmetrize)
+    cfk::utils::fill_random(thrust::raw_pointer_cast(d_B.data()), size,
+                            seed_b);
+
+  TransposeAddParams<T> params =
+      symmetrize ? TransposeAddParams<T>::symmetrize(A, A, M)
+                 : TransposeAddParams<T>(
+                       A, thrust::raw_pointer_cast(d_B.data()),
+                       thrust::raw_pointer_cast(d_C.data()), M, N);
+
+  double bytes = (symmetrize ? 2.0 : 3.0) * size * sizeof(T);
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    op(params);
+    cudaError result = cudaDeviceSynchronize();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    if (result != cudaSuccess) {
+      std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                << std::endl;
+      return -1;
+    }
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::gpu_bandwidth_with_peak(1e-6 * bytes / time_ms)
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    auto report = cfk::utils::verify_on_device(
+        params.C, size,
+        cfk::utils::ExpectTransposeAdd<T>{seed, seed_b, size_t(M), size_t(N),
+                                          params.alpha, params.beta});
+    cfk::utils::print_verify_report(std::cout, report, N);
+  }
+  return 0;
+}
+
+// Back-to-back dependent transposes of an (n, n) matrix, serialized and with
+// programmatic dependent launch (TransposeParams::pdl). The chain ping-pongs
+// X0 -> X1 -> X0, so every kernel reads what the one before it wrote, and
+// with an even length X0 ends up equal to the input. Small n makes each
+// kernel's prologue and tail a visible share of its runtime.
+template <typename T>
+int benchmark_chain(void (*transpose)(TransposeParams<T> params), int n,
+                    int kernels, int iterations = 10) {
+  kernels = (kernels + 1) / 2 * 2;
+  size_t const size = size_t(n) * n;
+  thrust::device_vector<T> d_X0(size), d_X1(size);
+  T *X0 = thrust::raw_pointer_cast(d_X0.data());
+  T *X1 = thrust::raw_pointer_cast(d_X1.data());
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random(X0, size, seed);
+
+  TransposeParams<T> forward(X0, X1, n, n), back(X1, X0, n, n);
+  cudaEvent_t start, stop;
+  cudaEventCreate(&start);
+  cudaEventCreate(&stop);
+
+  char const *modes[] = {"Serialized", "Programmatic dependent launch"};
+  double chain_ms[2] = {};
+  for (int pdl = 0; pdl < 2; ++pdl) {
+    printf("%s:\n", modes[pdl]);
+    forward.pdl = back.pdl = pdl == 1;
+    for (int i = 0; i < iterations; i++) {
+      cudaEventRecord(start);
+      for (int k = 0; k < kernels; k += 2) {
+        transpose(forward);
+        transpose(back);
+      }
+      cudaEventRecord(stop);
+      cudaError result = cudaDeviceSynchronize();
+      if (result != cudaSuccess) {
+        std::cerr << "CUDA Runtime error: " << cudaGetErrorString(result)
+                  << std::endl;
+        return -1;
+      }
+      float time_ms = 0;
+      cudaEventElapsedTime(&time_ms, start, stop);
+      chain_ms[pdl] += time_ms / iterations;
+      std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+                << time_ms * 1e3 / kernels << "us per kernel, "
+                << cfk::utils::gpu_bandwidth_with_peak(
+                       2e-6 * kernels * size * sizeof(T) / time_ms)
+                << ")" << std::endl;
+    }
+  }
+  std::cout << "PDL saved " << (chain_ms[0] - chain_ms[1]) * 1e3 / kernels
+            << "us per kernel" << std::endl;
+
+  cudaEventDestroy(start);
+  cudaEventDestroy(stop);
+
+  auto report = cfk::utils::verify_on_device(
+      X0, size, cfk::utils::ExpectIdentity<T>{seed});
+  cfk::utils::print_verify_report(std::cout, report, n);
+  return 0;
+}
+
+// Host counterpart of benchmark() for the CPU kernels in transpose_cpu.h.
+// Next to time and bandwidth it reports hardware counters for each trial
+// when perf_event_open is permitted. `pages` selects the page size backing
+// the input and output buffers.
+template <typename T, bool isTranspose = true> int benchmark_cpu(void (*transpose)(TransposeParams<T> params), int M, int N, int iterations=10, bool verify=true, cfk::utils::PageMode pages=cfk::utils::PageMode::kSmall) {
+
+  cfk::utils::HostBuffer<T> h_S(size_t(M) * N, pages);
+  cfk::utils::HostBuffer<T> h_D(size_t(M) * N, pages);
+  std::cout << "Host buffers: " << cfk::utils::page_mode_name(h_S.mode())
+            << " pages" << std::endl;
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random_cpu(h_S.data(), h_S.size(), seed);
+
+  TransposeParams<T> params(h_S.data(), h_D.data(), M, N);
+
+  cfk::utils::PerfCounters counters(
+      cfk::utils::TaskRuntime::instance().thread_ids());
+  if (!counters.available())
+    std::cout << "Hardware counters unavailable: " << counters.error()
+              << std::endl;
+
+  double bytes = 2.0 * M * N * sizeof(T);
+  for (int i = 0; i < iterations; i++) {
+    counters.start();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    transpose(params);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    auto sample = counters.stop();
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::with_peak(1e-6 * bytes / time_ms, "GB/s",
+                                       "cpu.stream_copy_gbs")
+              << ")" << std::endl;
+    if (sample.any())
+      std::cout << "  " << cfk::utils::format_perf_sample(sample, bytes, 1e-3 * time_ms)
+                << std::endl;
+  }
+
+  if(verify) {
+    cfk::utils::VerifyReport report;
+    if constexpr (isTranspose)
+      report = cfk::utils::verify_cpu(
+          h_D.data(), h_D.size(),
+          cfk::utils::ExpectTranspose<T>{seed, size_t(M), size_t(N)});
+    else
+      report = cfk::utils::verify_cpu(h_D.data(), h_D.size(),
+                                      cfk::utils::ExpectIdentity<T>{seed});
+    cfk::utils::print_verify_report(std::cout, report, isTranspose ? M : N);
+  }
+  return 0;
+}
+
+// benchmark_cpu() for packed sub-byte transposes.
+template <int kBits>
+int benchmark_packed_cpu(
+    void (*transpose)(PackedTransposeParams<kBits> params), int M, int N,
+    int iterations = 10, bool verify = true) {
+  PackedTransposeParams<kBits> shape(nullptr, nullptr, M, N);
+  cfk::utils::HostBuffer<uint32_t> h_S(shape.words()), h_D(shape.words());
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  cfk::utils::fill_random_cpu(h_S.data(), h_S.size(), seed);
+
+  PackedTransposeParams<kBits> params(h_S.data(), h_D.data(), M, N);
+
+  double bytes = 8.0 * shape.words();
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    transpose(params);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::with_peak(1e-6 * bytes / time_ms, "GB/s",
+                                       "cpu.stream_copy_gbs")
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    auto report = cfk::utils::verify_cpu(
+        h_D.data(), h_D.size(),
+        cfk::utils::ExpectPackedTranspose<kBits>{seed, size_t(M), size_t(N)});
+    cfk::utils::print_verify_report(std::cout, report,
+                                    M / PackedTransposeParams<kBits>::kPerWord);
+  }
+  return 0;
+}
+
+// benchmark_cpu() for transpose-add; see benchmark_transpose_add().
+template <typename T>
+int benchmark_transpose_add_cpu(void (*op)(TransposeAddParams<T> params),
+                                int M, int N, bool symmetrize,
+                                int iterations = 10, bool verify = true) {
+  size_t const size = size_t(M) * N;
+  cfk::utils::HostBuffer<T> h_A(size), h_B(symmetrize ? 0 : size),
+      h_C(symmetrize ? 0 : size);
+
+  uint64_t const seed = cfk::utils::kDefaultInputSeed;
+  uint64_t const seed_b = symmetrize ? seed : seed + 1;
+  cfk::utils::fill_random_cpu(h_A.data(), size, seed);
+  if (!symmetrize)
+    cfk::utils::fill_random_cpu(h_B.data(), size, seed_b);
+
+  TransposeAddParams<T> params =
+      symmetrize ? TransposeAddParams<T>::symmetrize(h_A.data(), h_A.data(), M)
+                 : TransposeAddParams<T>(h_A.data(), h_B.data(), h_C.data(),
+                                         M, N);
+
+  double bytes = (symmetrize ? 2.0 : 3.0) * size * sizeof(T);
+  for (int i = 0; i < iterations; i++) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    op(params);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    std::chrono::duration<double, std::milli> tDiff = t2 - t1;
+    double time_ms = tDiff.count();
+    std::cout << "Trial " << i << " Completed in " << time_ms << "ms ("
+              << cfk::utils::with_peak(1e-6 * bytes / time_ms, "GB/s",
+                                       "cpu.stream_copy_gbs")
+              << ")" << std::endl;
+  }
+
+  if (verify) {
+    auto report = cfk::utils::verify_cpu(
+        params.C, size,
+        cfk::utils::ExpectTransposeAdd<T>{seed, seed_b, size_t(M), size_t(N),
+                                          params.alpha, params.beta});
+    cfk::utils::print_verify_report(std::cout, report, N);
   }
   return 0;
 }
@@ -1,8 +1,18 @@
 #include "cutlass/util/command_line.h"
 
+#include "check_flags.hpp"
 #include "include/copy.h"
+#include "include/fused_expr.h"
+#include "include/gather_scatter.h"
+#include "include/interleave.h"
+#include "include/multi_tensor.h"
+#include "include/quantize_dual.h"
+#include "include/static_shapes.h"
+#include "include/transpose_add.h"
+#include "include/transpose_cpu.h"
 #include "include/transpose_naive.h"
 #include "include/transpose_smem.h"
+#include "include/transpose_subbyte.h"
 #include "include/transpose_tmastore_vectorized.h"
 #include "include/util.h"
 
@@ -16,9 +26,37 @@ int main(int argc, char const **argv) {
   int M, N;
   cmd.get_cmd_line_argument("M", M, 32768);
   cmd.get_cmd_line_argument("N", N, 32768);
+  int tensors, chain;
+  cmd.get_cmd_line_argument("tensors", tensors, 512);
+  cmd.get_cmd_line_argument("chain", chain, 0);
 
   std::cout << "Matrix size: " << M << " x " << N << std::endl;
 
+  // Host-side self-tests. Given only --check-* flags, the driver runs them
+  // and exits with their status; otherwise it goes on to the benchmarks.
+  cfk::utils::CheckFlags checks(cmd);
+  checks.run("check-rng",
+             [] { return cfk::utils::check_generators<Element>(); });
+  // Chain compilation for the lazy fused expressions; needs no GPU.
+  checks.run("check-fused", [] { return check_fused_expr(); });
+  // Scatter plan and CPU gather / scatter backend; needs no GPU.
+  checks.run("check-gather", [] { return check_gather_scatter(); });
+  // SIMD transpose-add against the plain reference; needs no GPU.
+  checks.run("check-transpose-add", [] { return check_transpose_add_cpu(); });
+  // SIMD deinterleave / interleave against the plain loops; needs no GPU.
+  checks.run("check-interleave", [] { return check_interleave_cpu(); });
+  // Host emulation of the ballot kernel and the SWAR CPU path for packed
+  // sub-byte transposes; needs no GPU.
+  checks.run("check-packed", [] { return check_packed_transpose_cpu(); });
+  // FP8 encoder against brute force, and the dequantized CPU reference;
+  // needs no GPU.
+  checks.run("check-quantize", [] { return check_quantize_cpu(); });
+  // Manifest registry and fallback of the static-shape launchers; needs no
+  // GPU.
+  checks.run("check-static", [] { return cfk::utils::check_static_shapes(); });
+  if (checks.only_checks())
+    return checks.exit_code();
+
   printf("Baseline copy; No transpose\n");
   benchmark<Element, false>(copy_baseline<Element>, M, N);
   
@@ -34,5 +72,139 @@ int main(int argc, char const **argv) {
   printf("\nTMA (tma, smem passthrough, vectorized, swizzled):\n");
   benchmark<Element>(transpose_tma<Element>, M, N);
 
-  return 0;
+  // --chain=<kernels> on a small matrix, where the prologue and tail are a
+  // visible share of each kernel
+  if (chain > 0) {
+    printf("\nChain of %d dependent swizzled transposes, 2048 x 2048:\n",
+           chain);
+    benchmark_chain<Element>(transpose_smem<Element, true>, 2048, chain);
+    printf("\nChain of %d dependent TMA transposes, 2048 x 2048:\n", chain);
+    benchmark_chain<Element>(transpose_tma<Element>, 2048, chain);
+  }
+
+  printf("\nDual output (A and A^T from one read, swizzled):\n");
+  benchmark_dual<Element, Element, Element>(
+      transpose_smem_dual<Element, Element, Element>, M, N);
+
+  printf("\nDual output, bf16 copy and bf16 A^T:\n");
+  benchmark_dual<Element, cutlass::bfloat16_t, cutlass::bfloat16_t>(
+      transpose_smem_dual<Element, cutlass::bfloat16_t, cutlass::bfloat16_t>,
+      M, N);
+
+  printf("\nDual row/column 1x128 block FP8 quantization (bf16 in):\n");
+  // The bit-exact check runs the CPU reference over the whole matrix, so it
+  // is skipped for very large sizes.
+  benchmark_quantize_dual<cutlass::bfloat16_t>(
+      M, N, 10, size_t(M) * N <= (size_t(1) << 28));
+
+  printf("\nPacked int4 transpose (ballot bit planes):\n");
+  benchmark_packed<4>(transpose_packed<4>, M, N);
+
+  printf("\nPacked 1-bit transpose (ballot):\n");
+  benchmark_packed<1>(transpose_packed<1>, M, N);
+
+  // Symmetrize works on the leading square block.
+  int const S = std::min(M, N);
+  printf("\nTranspose-add C = A + B^T (fused, no temporary):\n");
+  benchmark_transpose_add<Element>(transpose_add<Element>, M, N, false);
+
+  printf("\nIn-place symmetrize A = (A + A^T) / 2 (tile pairs), %d x %d:\n",
+         S, S);
+  benchmark_transpose_add<Element>(transpose_add<Element>, S, S, true);
+
+  // Interleaved <-> planar with the same number of bytes as the matrix.
+  int const P2 = int(size_t(M) * N / 2), P4 = int(size_t(M) * N / 4);
+  printf("\nDeinterleave complex fp32 (re, im) -> planar, %d pairs:\n", P2);
+  benchmark<Element>(deinterleave<Element, 2>, P2, 2);
+
+  printf("\nInterleave planar -> complex fp32 (re, im):\n");
+  benchmark<Element>(interleave<Element, 2>, 2, P2);
+
+  printf("\nDeinterleave RGBA8 -> planes, %d pixels:\n", P4);
+  benchmark<uint8_t>(deinterleave<uint8_t, 4>, P4, 4);
+
+  printf("\nInterleave planes -> RGBA8:\n");
+  benchmark<uint8_t>(interleave<uint8_t, 4>, 4, P4);
+
+  printf("\nLazy chain transpose -> scale -> bias -> fp16 cast, unfused vs "
+         "fused:\n");
+  benchmark_fused(M, N);
+
+  printf("\nMulti-tensor copy (per-tensor launches vs one launch):\n");
+  benchmark_multi_tensor<Element>(tensors, false);
+
+  printf("\nMulti-tensor scale:\n");
+  benchmark_multi_tensor<Element>(tensors, true);
+
+  // Embedding-sized rows: 256K lookups of 1 KiB rows into a 256K-row table.
+  printf("\nRow gather / scatter-add (index_select / index_add):\n");
+  benchmark_gather_scatter<Element>(1 << 18, 1 << 18, 256);
+
+  printf("\nStatic-shape launchers for the Llama-2 7B manifest:\n");
+  benchmark_static_shapes<Element>();
+
+  if (cmd.check_cmd_line_flag("cpu")) {
+    printf("\nCPU baseline copy; No transpose\n");
+    benchmark_cpu<Element, false>(copy_cpu<Element>, M, N);
+
+    printf("\nCPU naive transpose:\n");
+    benchmark_cpu<Element>(transpose_cpu_naive<Element>, M, N);
+
+    printf("\nCPU blocked transpose (64x64 tiles):\n");
+    benchmark_cpu<Element>(transpose_cpu_blocked<Element>, M, N);
+
+    // 4K vs 2M pages: the same blocked kernel, then the TLB-aware kernel with
+    // strips sized for each page size.
+    using cfk::utils::PageMode;
+    printf("\nCPU blocked transpose, 2M pages:\n");
+    benchmark_cpu<Element>(transpose_cpu_blocked<Element>, M, N, 10, true,
+                           PageMode::kTransparent);
+
+    printf("\nCPU TLB-aware transpose, 4K pages:\n");
+    benchmark_cpu<Element>(
+        transpose_cpu_tlb<Element, cfk::utils::kSmallPageBytes>, M, N);
+
+    printf("\nCPU TLB-aware transpose, 2M pages:\n");
+    benchmark_cpu<Element>(
+        transpose_cpu_tlb<Element, cfk::utils::kHugePageBytes>, M, N, 10,
+        true, PageMode::kTransparent);
+
+    printf("\nCPU packed int4 transpose (SWAR 8x8 nibble blocks):\n");
+    benchmark_packed_cpu<4>(transpose_cpu_packed<4>, M, N);
+
+    printf("\nCPU packed 1-bit transpose (SWAR 32x32 bit blocks):\n");
+    benchmark_packed_cpu<1>(transpose_cpu_packed<1>, M, N);
+
+    printf("\nCPU transpose-add C = A + B^T (32x32 tiles, %s):\n", kCpuAvx);
+    benchmark_transpose_add_cpu<Element>(transpose_add_cpu<Element>, M, N,
+                                         false);
+
+    printf("\nCPU in-place symmetrize (tile pairs, %s), %d x %d:\n", kCpuAvx,
+           S, S);
+    benchmark_transpose_add_cpu<Element>(transpose_add_cpu<Element>, S, S,
+                                         true);
+
+    printf("\nCPU deinterleave complex fp32 (%s):\n", kCpuAvx);
+    benchmark_cpu<Element>(deinterleave_cpu<Element, 2>, P2, 2);
+
+    printf("\nCPU interleave complex fp32 (%s):\n", kCpuAvx);
+    benchmark_cpu<Element>(interleave_cpu<Element, 2>, 2, P2);
+
+    printf("\nCPU deinterleave RGBA8 (%s):\n", kCpuSsse3);
+    benchmark_cpu<uint8_t>(deinterleave_cpu<uint8_t, 4>, P4, 4);
+
+    printf("\nCPU interleave RGBA8 (%s):\n", kCpuSsse3);
+    benchmark_cpu<uint8_t>(interleave_cpu<uint8_t, 4>, 4, P4);
+
+    printf("\nCPU multi-tensor copy (per-tensor vs chunk table):\n");
+    benchmark_multi_tensor_cpu<Element>(tensors, false);
+
+    printf("\nCPU multi-tensor scale:\n");
+    benchmark_multi_tensor_cpu<Element>(tensors, true);
+
+    printf("\nCPU row gather / scatter-add (sorted runs):\n");
+    benchmark_gather_scatter_cpu<Element>(1 << 18, 1 << 18, 256);
+  }
+
+  return checks.exit_code();
 }
@@ -8,7 +8,12 @@
 
 // File containing the CUTLASS portion of the code.
 #include "include/copy.h"
+#include "include/gather_scatter.h"
+#include "include/multi_tensor.h"
 #include "include/util.h"
+#include "host_stats.hpp"
+#include "concat_split.h"
+#include "tma_reduce.h"
 
 // Once the datatypes are known, get the sizes and the pointers and call the CUTLASS part of the code.
 template<typename T> void copy_cute_unpack(torch::Tensor input, torch::Tensor output) {
@@ -23,12 +28,61 @@ template<typename T> void copy_cute_unpack(torch::Tensor input, torch::Tensor ou
   copy_baseline<T>(params);
 }
 
+// output = op(output, input) with a TMA reduce-store, for copy(..., reduce=...).
+torch::Tensor copy_reduce_cute(torch::Tensor input, c10::optional<torch::Tensor> output,
+                               std::string const &reduce) {
+  CFK_HOST_STAGE(total_timer, "copy_reduce.total");
+  cfx::ReduceOp const op = cfx::parse_reduce_op(reduce);
+  if(!output.has_value())
+    throw std::invalid_argument("copy with reduce accumulates into `output`, which must be given");
+  torch::Tensor _output = output.value();
+  if(!(input.device().is_cuda() && _output.device().is_cuda()))
+    throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(input.dim() != 2 || input.sizes() != _output.sizes() || input.dtype() != _output.dtype())
+    throw std::invalid_argument("copy with reduce needs 2D input and output of the same shape and dtype");
+  if(!_output.is_contiguous())
+    throw std::invalid_argument("copy with reduce needs a contiguous output");
+  torch::Tensor _input = input.contiguous();
+  const int M = _input.sizes()[0];
+  const int N = _input.sizes()[1];
+  if((N * _input.element_size()) % 16 != 0)
+    throw std::invalid_argument("copy with reduce needs rows of a multiple of 16 bytes");
+
+  auto run = [&](auto e) {
+    using T = decltype(e);
+    return copy_reduce<T>(reinterpret_cast<T const *>(_input.data_ptr()),
+                          reinterpret_cast<T *>(_output.data_ptr()), M, N, op);
+  };
+  cudaError_t result;
+  if(_input.dtype() == torch::kFloat16)
+    result = run(cutlass::half_t{});
+  else if(_input.dtype() == torch::kBFloat16)
+    result = run(cutlass::bfloat16_t{});
+  else if(_input.dtype() == torch::kFloat32)
+    result = run(float{});
+  else if(_input.dtype() == torch::kInt32)
+    result = run(int32_t{});
+  else
+    throw std::invalid_argument("Unsupported precision type");
+  if(result == cudaErrorNotSupported)
+    throw std::invalid_argument("reduce='" + reduce + "' is not supported for float32; use add");
+  if(result != cudaSuccess)
+    throw std::runtime_error(cudaGetErrorString(result));
+  return _output;
+}
+
 // This function is bound to "copy_cute.copy". 
 torch::Tensor copy_cute(torch::Tensor input,
-                             c10::optional<torch::Tensor> output) {
+                             c10::optional<torch::Tensor> output,
+                             c10::optional<std::string> reduce) {
+  cfk::utils::ScopedRange range("cc.copy");
+  if(reduce.has_value())
+    return copy_reduce_cute(input, output, reduce.value());
+  CFK_HOST_STAGE(total_timer, "copy.total");
 
   // Handling the optional output matrix.
   torch::Tensor _output;
+  CFK_HOST_STAGE(alloc_timer, "copy.alloc_output");
   if(output.has_value()) {  // Output tensor was provided. So we will use it.
     _output = output.value();
   } else {               // Output tensor was not provided. Creating an empty tensor.
@@ -39,28 +93,252 @@ torch::Tensor copy_cute(torch::Tensor input,
     auto output_options = torch::TensorOptions().device(torch::kCUDA).dtype(input.dtype());
     _output = torch::empty({M, N}, output_options);
   }
+  alloc_timer.stop();
 
   // Ensuring that the matrices are contiguous. 
+  CFK_HOST_STAGE(contiguous_timer, "copy.contiguous");
   torch::Tensor _input  = input.contiguous();
   _output = _output.contiguous();
 
   // Check that all tensors are allocated on GPU device.
   if(!(_input.device().is_cuda() && _output.device().is_cuda()))
     throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  contiguous_timer.stop();
 
   // Select the CUTLASS precision type to use based on Torch input data type.
+  // The dispatch stage covers only the selection, not the launch.
+  CFK_HOST_STAGE(dispatch_timer, "copy.dispatch");
+  void (*unpack)(torch::Tensor, torch::Tensor);
   if(_input.dtype() == torch::kFloat16)
-    copy_cute_unpack<cutlass::half_t>(_input, _output);
+    unpack = &copy_cute_unpack<cutlass::half_t>;
   else if(_input.dtype() == torch::kFloat32)
-    copy_cute_unpack<float>(_input, _output);
+    unpack = &copy_cute_unpack<float>;
   else
     throw std::invalid_argument("Unsupported precision type");
+  dispatch_timer.stop();
+  unpack(_input, _output);
 
   // Return the Torch tensor back to PyTorch
   return _output;
 }
 
+// Shared by multi_tensor_copy and multi_tensor_scale: checks the lists,
+// allocates outputs when none are given and launches once over all tensors.
+std::vector<torch::Tensor> multi_tensor_cute(std::vector<torch::Tensor> const &srcs,
+                                             c10::optional<std::vector<torch::Tensor>> dsts,
+                                             c10::optional<double> scale) {
+  CFK_HOST_STAGE(total_timer, "multi_tensor.total");
+  std::vector<torch::Tensor> outs;
+  if(dsts.has_value()) {
+    outs = dsts.value();
+    if(outs.size() != srcs.size())
+      throw std::invalid_argument("multi_tensor needs as many outputs as inputs");
+  } else {
+    for(auto const &s : srcs)
+      outs.push_back(torch::empty_like(s, torch::MemoryFormat::Contiguous));
+  }
+  if(srcs.empty())
+    return outs;
+
+  auto const dtype = srcs[0].scalar_type();
+  std::vector<size_t> sizes;
+  for(size_t t = 0; t < srcs.size(); ++t) {
+    auto const &s = srcs[t], &d = outs[t];
+    if(!(s.device().is_cuda() && d.device().is_cuda()))
+      throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+    if(!(s.is_contiguous() && d.is_contiguous()))
+      throw std::invalid_argument("multi_tensor needs contiguous tensors");
+    if(s.scalar_type() != dtype || d.scalar_type() != dtype || s.numel() != d.numel())
+      throw std::invalid_argument("multi_tensor needs one dtype and matching sizes");
+    sizes.push_back(s.numel());
+  }
+
+  auto run = [&](auto e) {
+    using T = decltype(e);
+    std::vector<T const *> src;
+    std::vector<T *> dst;
+    for(size_t t = 0; t < srcs.size(); ++t) {
+      src.push_back(reinterpret_cast<T const *>(srcs[t].data_ptr()));
+      dst.push_back(reinterpret_cast<T *>(outs[t].data_ptr()));
+    }
+    if(scale.has_value())
+      multi_tensor_scale<T>(src, dst, sizes, T(scale.value()));
+    else
+      multi_tensor_copy<T>(src, dst, sizes);
+  };
+  if(dtype == torch::kFloat16)
+    run(cutlass::half_t{});
+  else if(dtype == torch::kBFloat16)
+    run(cutlass::bfloat16_t{});
+  else if(dtype == torch::kFloat32)
+    run(float{});
+  else
+    throw std::invalid_argument("Unsupported precision type");
+  return outs;
+}
+
+// Bound to "copy_cute.multi_tensor_copy": copies every tensor of `srcs`
+// (into `dsts` when given) with a single kernel launch.
+std::vector<torch::Tensor> multi_tensor_copy_cute(std::vector<torch::Tensor> srcs,
+                                                  c10::optional<std::vector<torch::Tensor>> dsts) {
+  cfk::utils::ScopedRange range("cc.multi_tensor_copy");
+  return multi_tensor_cute(srcs, dsts, c10::nullopt);
+}
+
+// Bound to "copy_cute.multi_tensor_scale": dst = scale * src for every pair.
+std::vector<torch::Tensor> multi_tensor_scale_cute(std::vector<torch::Tensor> srcs, double scale,
+                                                   c10::optional<std::vector<torch::Tensor>> dsts) {
+  cfk::utils::ScopedRange range("cc.multi_tensor_scale");
+  return multi_tensor_cute(srcs, dsts, scale);
+}
+
+// Shared dtype dispatch for the row gather / scatter bindings.
+template <typename F> void dispatch_rows(torch::Tensor const &t, F &&f) {
+  if(t.dtype() == torch::kFloat16)
+    f(cutlass::half_t{});
+  else if(t.dtype() == torch::kBFloat16)
+    f(cutlass::bfloat16_t{});
+  else if(t.dtype() == torch::kFloat32)
+    f(float{});
+  else
+    throw std::invalid_argument("Unsupported precision type");
+}
+
+void check_rows(torch::Tensor const &t, torch::Tensor const &index) {
+  if(!(t.device().is_cuda() && index.device().is_cuda()))
+    throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(t.dim() != 2 || index.dim() != 1 || index.scalar_type() != torch::kInt64)
+    throw std::invalid_argument("row gather / scatter needs a 2D tensor and a 1D int64 index");
+}
+
+// Bound to "copy_cute.index_select": input[index] along dim 0. Raises
+// ValueError for an index out of range.
+torch::Tensor index_select_cute(torch::Tensor input, torch::Tensor index) {
+  cfk::utils::ScopedRange range("cc.index_select");
+  check_rows(input, index);
+  torch::Tensor _input = input.contiguous(), _index = index.contiguous();
+  const int n = _index.numel(), cols = _input.sizes()[1];
+  check_row_indices_device(_index.data_ptr<int64_t>(), n, _input.sizes()[0]);
+  torch::Tensor output = torch::empty({n, cols}, _input.options());
+  dispatch_rows(_input, [&](auto e) {
+    using T = decltype(e);
+    gather_rows<T>(reinterpret_cast<T const *>(_input.data_ptr()),
+                   _index.data_ptr<int64_t>(), n,
+                   reinterpret_cast<T *>(output.data_ptr()), cols);
+  });
+  return output;
+}
+
+// Bound to "copy_cute.index_add": output[index[i]] += source[i] in place,
+// deterministic for repeated indices (sorted runs, no atomics). Raises
+// ValueError for an index out of range.
+torch::Tensor index_add_cute(torch::Tensor output, torch::Tensor index, torch::Tensor source) {
+  cfk::utils::ScopedRange range("cc.index_add");
+  check_rows(output, index);
+  if(!output.is_contiguous())
+    throw std::invalid_argument("index_add needs a contiguous output");
+  if(source.dim() != 2 || source.sizes()[0] != index.numel() ||
+     source.sizes()[1] != output.sizes()[1] || source.dtype() != output.dtype())
+    throw std::invalid_argument("index_add needs one source row per index, with the output's width and dtype");
+  torch::Tensor _source = source.contiguous(), _index = index.contiguous();
+  dispatch_rows(output, [&](auto e) {
+    using T = decltype(e);
+    scatter_rows<T, true>(reinterpret_cast<T const *>(_source.data_ptr()),
+                          _index.data_ptr<int64_t>(), _index.numel(),
+                          reinterpret_cast<T *>(output.data_ptr()),
+                          output.sizes()[0], output.sizes()[1]);
+  });
+  return output;
+}
+
+// The concat kernels index rows and columns with int; reject extents past
+// that before narrowing torch's int64 sizes.
+int concat_extent(int64_t n, char const *what) {
+  if(n < 0 || n > INT32_MAX)
+    throw std::invalid_argument(std::string(what) + " must be between 0 and 2^31 - 1");
+  return int(n);
+}
+
+// Bound to "copy_cute.cat": torch.cat(tensors, dim=1) for 2D tensors with
+// one row count, in one launch per kMaxConcatPieces tensors.
+torch::Tensor cat_cute(std::vector<torch::Tensor> tensors) {
+  cfk::utils::ScopedRange range("cc.cat");
+  if(tensors.empty())
+    throw std::invalid_argument("cat needs at least one tensor");
+  std::vector<torch::Tensor> pieces;
+  std::vector<int> widths;
+  for(auto const &t : tensors) {
+    if(!t.device().is_cuda())
+      throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+    if(t.dim() != 2 || t.sizes()[0] != tensors[0].sizes()[0] || t.dtype() != tensors[0].dtype())
+      throw std::invalid_argument("cat needs 2D tensors with one row count and dtype");
+    pieces.push_back(t.contiguous());
+    widths.push_back(concat_extent(t.sizes()[1], "cat widths"));
+  }
+  const int M = concat_extent(pieces[0].sizes()[0], "cat rows");
+  int64_t total = 0;
+  for(int w : widths)
+    total += w;
+  const int N = concat_extent(total, "the cat result width");
+  torch::Tensor output = torch::empty({M, N}, pieces[0].options());
+  cudaError_t result = cudaSuccess;
+  dispatch_rows(output, [&](auto e) {
+    using T = decltype(e);
+    std::vector<T const *> srcs;
+    for(auto const &p : pieces)
+      srcs.push_back(reinterpret_cast<T const *>(p.data_ptr()));
+    result = concat_cols<T>(srcs, widths, reinterpret_cast<T *>(output.data_ptr()), M);
+  });
+  if(result != cudaSuccess)
+    throw std::runtime_error(cudaGetErrorString(result));
+  return output;
+}
+
+// Bound to "copy_cute.split": contiguous copies of input[:, a:b] for
+// consecutive column ranges of the given sizes, in one launch per
+// kMaxConcatPieces outputs.
+std::vector<torch::Tensor> split_cute(torch::Tensor input, std::vector<int64_t> sizes) {
+  cfk::utils::ScopedRange range("cc.split");
+  if(!input.device().is_cuda())
+    throw std::invalid_argument("copy_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(input.dim() != 2)
+    throw std::invalid_argument("split needs a 2D tensor");
+  torch::Tensor _input = input.contiguous();
+  const int M = concat_extent(_input.sizes()[0], "split rows");
+  concat_extent(_input.sizes()[1], "split columns");
+  std::vector<int> widths;
+  int64_t N = 0;
+  for(int64_t w : sizes) {
+    widths.push_back(concat_extent(w, "split sizes"));
+    N += w;
+  }
+  if(N != _input.sizes()[1])
+    throw std::invalid_argument("split sizes must add up to the number of columns");
+  std::vector<torch::Tensor> outs;
+  for(int w : widths)
+    outs.push_back(torch::empty({M, w}, _input.options()));
+  cudaError_t result = cudaSuccess;
+  dispatch_rows(_input, [&](auto e) {
+    using T = decltype(e);
+    std::vector<T *> dsts;
+    for(auto &o : outs)
+      dsts.push_back(reinterpret_cast<T *>(o.data_ptr()));
+    result = split_cols<T>(reinterpret_cast<T const *>(_input.data_ptr()), M, widths, dsts);
+  });
+  if(result != cudaSuccess)
+    throw std::runtime_error(cudaGetErrorString(result));
+  return outs;
+}
+
 // Binding the function to Python
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
-  m.def("copy", py::overload_cast<torch::Tensor,c10::optional<torch::Tensor>>(&copy_cute), py::arg("input"), py::arg("output") = py::none());
+  m.def("copy", &copy_cute, py::arg("input"), py::arg("output") = py::none(), py::arg("reduce") = py::none());
+  m.def("multi_tensor_copy", &multi_tensor_copy_cute, py::arg("srcs"), py::arg("dsts") = py::none());
+  m.def("multi_tensor_scale", &multi_tensor_scale_cute, py::arg("srcs"), py::arg("scale"), py::arg("dsts") = py::none());
+  m.def("index_select", &index_select_cute, py::arg("input"), py::arg("index"));
+  m.def("index_add", &index_add_cute, py::arg("output"), py::arg("index"), py::arg("source"));
+  m.def("cat", &cat_cute, py::arg("tensors"));
+  m.def("split", &split_cute, py::arg("input"), py::arg("sizes"));
+  // Host overhead counters: stats() and reset_stats().
+  cfk::utils::bind_host_stats(m);
 }
@@ -14,10 +14,24 @@ cute_transpose_dir = [os.environ.get("CUTE_TRANSPOSE_DIR", "")]
 if not os.path.isdir(cute_transpose_dir[0]):
   raise Exception("Environment variable CUTE_TRANSPOSE should point to the cute_transpose dir. Got {}".format(os.path.abspath(cute_transpose_dir))) 
 
+# Shared host utilities (tracing, etc.) live at the top of the repo
+repo_utils_dir = [os.path.join(cute_transpose_dir[0], "..", "include", "utils")]
+
+# Raw TMA kernels (reduce-store) shared with the tma/ examples
+repo_tma_dir = [os.path.join(cute_transpose_dir[0], "..", "tma")]
+
 # Set additional flags needed for compilation here
 nvcc_flags=["-O3","-DNDEBUG","-std=c++17","--generate-code=arch=compute_90a,code=[sm_90a]"]
 ld_flags=["cuda"]
 
+# CFK_JIT=1 builds transpose_cute with the NVRTC transpose (tma/jit_kernels.h)
+# as the fallback for shapes the tiled kernels do not divide. Without it
+# those shapes raise ValueError.
+transpose_jit = os.environ.get("CFK_JIT", "0") == "1"
+transpose_include_dirs = repo_tma_dir if transpose_jit else []
+transpose_nvcc_flags = nvcc_flags + (["-DCFK_WITH_JIT"] if transpose_jit else [])
+transpose_ld_flags = ld_flags + (["nvrtc"] if transpose_jit else [])
+
 
 setup(
     name='transpose_cute',
@@ -25,13 +39,13 @@ setup(
         CUDAExtension(
                 name="transpose_cute",  
                 sources=["transpose_cute.cu"],
-                include_dirs=cutlass_include_dirs+cute_transpose_dir,
-                extra_compile_args={'nvcc': nvcc_flags},
-                libraries=ld_flags),
+                include_dirs=cutlass_include_dirs+cute_transpose_dir+repo_utils_dir+transpose_include_dirs,
+                extra_compile_args={'nvcc': transpose_nvcc_flags},
+                libraries=transpose_ld_flags),
         CUDAExtension(
                 name="copy_cute",  
                 sources=["copy_cute.cu"],
-                include_dirs=cutlass_include_dirs+cute_transpose_dir,
+                include_dirs=cutlass_include_dirs+cute_transpose_dir+repo_utils_dir+repo_tma_dir,
                 extra_compile_args={'nvcc': nvcc_flags},
                 libraries=ld_flags)
    ],
@@ -7,10 +7,19 @@
 #include <iostream>
 
 // File containing the CUTLASS portion of the code.
+#include "include/fused_expr.h"
+#include "include/interleave.h"
+#include "include/quantize_dual.h"
+#include "include/transpose_add.h"
 #include "include/transpose_naive.h"
 #include "include/transpose_smem.h"
+#include "include/transpose_subbyte.h"
 #include "include/transpose_tmastore_vectorized.h"
 #include "include/util.h"
+#include "host_stats.hpp"
+#ifdef CFK_WITH_JIT
+#include "jit_kernels.h"
+#endif
 
 // Different versions of transpose
 enum Version {
@@ -21,7 +30,10 @@ enum Version {
 };
 
 // Once the datatypes are known, get the sizes and the pointers and call the CUTLASS part of the code.
-template<typename T> void transpose_cute_unpack(torch::Tensor input, torch::Tensor output, Version ver) {
+// None of the versions predicates partial tiles. A shape their tiles (32 x 32
+// for TMA, 64 x 64 otherwise) do not divide runs the JIT transpose in a
+// CFK_JIT=1 build, and is rejected otherwise.
+template<typename T> void transpose_cute_unpack(torch::Tensor input, torch::Tensor output, Version ver, bool pdl) {
   // Get the input shapes
   const int M = input.sizes()[0];
   const int N = input.sizes()[1];
@@ -30,7 +42,19 @@ template<typename T> void transpose_cute_unpack(torch::Tensor input, torch::Tens
   T *input_ptr  = reinterpret_cast<T*>(input.data_ptr());
   T *output_ptr = reinterpret_cast<T*>(output.data_ptr());
   TransposeParams<T> params = TransposeParams<T>(input_ptr, output_ptr, M, N);
-  if(ver == naive) 
+  params.pdl = pdl;
+  const int tile = ver == tma ? 32 : 64;
+  if(M % tile != 0 || N % tile != 0) {
+#ifdef CFK_WITH_JIT
+    cudaError_t result = jit_transpose_fallback<T>(input_ptr, output_ptr, M, N);
+    if(result != cudaSuccess)
+      throw std::runtime_error(std::string("JIT transpose fallback: ") + cudaGetErrorString(result));
+#else
+    throw std::invalid_argument("transpose needs sizes that are multiples of " + std::to_string(tile) +
+                                "; build with CFK_JIT=1 for a fallback");
+#endif
+  }
+  else if(ver == naive) 
     transpose_naive<T>(params);
   else if(ver == smem) 
     transpose_smem<T, false>(params);
@@ -51,13 +75,18 @@ std::string get_version_info(Version const ver) {
     return "TMA (tma, smem passthrough, vectorized, swizzled):";
 }
 
-// This function is bound to "transpose_cute.transpose". 
+// This function is bound to "transpose_cute.transpose". With pdl the smem
+// and TMA versions launch as programmatic dependents of the previous kernel
+// on the stream, so their prologue overlaps its tail.
 torch::Tensor transpose_cute(torch::Tensor input,
                              c10::optional<torch::Tensor> output,
-                             Version const ver) {
+                             Version const ver, bool pdl) {
+  cfk::utils::ScopedRange range("tc.transpose");
+  CFK_HOST_STAGE(total_timer, "transpose.total");
 
   // Handling the optional output matrix.
   torch::Tensor _output;
+  CFK_HOST_STAGE(alloc_timer, "transpose.alloc_output");
   if(output.has_value()) {  // Output tensor was provided. So we will use it.
     _output = output.value();
   } else {               // Output tensor was not provided. Creating an empty tensor.
@@ -68,27 +97,368 @@ torch::Tensor transpose_cute(torch::Tensor input,
     auto output_options = torch::TensorOptions().device(torch::kCUDA).dtype(input.dtype());
     _output = torch::empty({N, M}, output_options);
   }
+  alloc_timer.stop();
 
   // Ensuring that the matrices are contiguous. 
+  CFK_HOST_STAGE(contiguous_timer, "transpose.contiguous");
   torch::Tensor _input  = input.contiguous();
   _output = _output.contiguous();
 
   // Check that all tensors are allocated on GPU device.
   if(!(_input.device().is_cuda() && _output.device().is_cuda()))
     throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  contiguous_timer.stop();
 
   // Select the CUTLASS precision type to use based on Torch input data type.
+  // The dispatch stage covers only the selection, not the launch.
+  CFK_HOST_STAGE(dispatch_timer, "transpose.dispatch");
+  void (*unpack)(torch::Tensor, torch::Tensor, Version, bool);
   if(_input.dtype() == torch::kFloat16)
-    transpose_cute_unpack<cutlass::half_t>(_input, _output, ver);
+    unpack = &transpose_cute_unpack<cutlass::half_t>;
   else if(_input.dtype() == torch::kFloat32)
-    transpose_cute_unpack<float>(_input, _output, ver);
+    unpack = &transpose_cute_unpack<float>;
   else
     throw std::invalid_argument("Unsupported precision type");
+  dispatch_timer.stop();
+  unpack(_input, _output, ver, pdl);
 
   // Return the Torch tensor back to PyTorch
   return _output;
 }
 
+// Call f with a value of the CUTLASS element type matching a Torch dtype.
+template <typename F> void dispatch_dtype(at::ScalarType dtype, F &&f) {
+  if(dtype == torch::kFloat16)
+    f(cutlass::half_t{});
+  else if(dtype == torch::kBFloat16)
+    f(cutlass::bfloat16_t{});
+  else if(dtype == torch::kFloat32)
+    f(float{});
+  else
+    throw std::invalid_argument("Unsupported precision type");
+}
+
+// This function is bound to "transpose_cute.transpose_dual". Returns (A, A^T)
+// written from a single read of A; either output may use a different dtype
+// than the input (default: the input's).
+std::tuple<torch::Tensor, torch::Tensor>
+transpose_dual_cute(torch::Tensor input,
+                    c10::optional<at::ScalarType> copy_dtype,
+                    c10::optional<at::ScalarType> transpose_dtype) {
+  cfk::utils::ScopedRange range("tc.transpose_dual");
+  CFK_HOST_STAGE(total_timer, "transpose_dual.total");
+
+  CFK_HOST_STAGE(contiguous_timer, "transpose_dual.contiguous");
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  contiguous_timer.stop();
+  if(_input.dim() != 2 || _input.sizes()[0] % 64 != 0 || _input.sizes()[1] % 64 != 0)
+    throw std::invalid_argument("transpose_dual needs a 2D matrix with sizes that are multiples of 64");
+
+  const int M = _input.sizes()[0];
+  const int N = _input.sizes()[1];
+
+  CFK_HOST_STAGE(alloc_timer, "transpose_dual.alloc_output");
+  auto options = torch::TensorOptions().device(_input.device());
+  torch::Tensor copy = torch::empty(
+      {M, N}, options.dtype(copy_dtype.value_or(_input.scalar_type())));
+  torch::Tensor transposed = torch::empty(
+      {N, M}, options.dtype(transpose_dtype.value_or(_input.scalar_type())));
+  alloc_timer.stop();
+
+  CFK_HOST_STAGE(dispatch_timer, "transpose_dual.dispatch");
+  dispatch_dtype(_input.scalar_type(), [&](auto in) {
+    dispatch_dtype(copy.scalar_type(), [&](auto c) {
+      dispatch_dtype(transposed.scalar_type(), [&](auto d) {
+        using T = decltype(in);
+        using TC = decltype(c);
+        using TD = decltype(d);
+        DualTransposeParams<T, TC, TD> params(
+            reinterpret_cast<T *>(_input.data_ptr()),
+            reinterpret_cast<TC *>(copy.data_ptr()),
+            reinterpret_cast<TD *>(transposed.data_ptr()), M, N);
+        dispatch_timer.stop(); // the launch is not part of the dispatch
+        transpose_smem_dual<T, TC, TD>(params);
+      });
+    });
+  });
+
+  return {copy, transposed};
+}
+
+// This function is bound to "transpose_cute.transpose_packed". `input` holds
+// an (M, N) matrix of `bits`-wide elements packed LSB-first, as a uint8
+// tensor of shape (M, N * bits / 8). Returns the packed (N, M) transpose.
+torch::Tensor transpose_packed_cute(torch::Tensor input, int bits) {
+  cfk::utils::ScopedRange range("tc.transpose_packed");
+  CFK_HOST_STAGE(total_timer, "transpose_packed.total");
+
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(_input.scalar_type() != torch::kUInt8)
+    throw std::invalid_argument("transpose_packed expects packed uint8 data");
+  if(bits != 1 && bits != 2 && bits != 4)
+    throw std::invalid_argument("transpose_packed supports 1, 2 and 4 bit elements");
+
+  const int M = _input.sizes()[0];
+  const int N = _input.sizes()[1] * 8 / bits;
+  if(M % 32 != 0 || N % 256 != 0)
+    throw std::invalid_argument("transpose_packed needs M % 32 == 0 and N % 256 == 0 (in elements)");
+
+  torch::Tensor output = torch::empty({N, M * bits / 8}, _input.options());
+  uint32_t *in = reinterpret_cast<uint32_t *>(_input.data_ptr());
+  uint32_t *out = reinterpret_cast<uint32_t *>(output.data_ptr());
+  if(bits == 1)
+    transpose_packed<1>(PackedTransposeParams<1>(in, out, M, N));
+  else if(bits == 2)
+    transpose_packed<2>(PackedTransposeParams<2>(in, out, M, N));
+  else
+    transpose_packed<4>(PackedTransposeParams<4>(in, out, M, N));
+  return output;
+}
+
+// Runs op<T, C>(params) for the element type of `t` (fp32, fp16, bf16 or
+// uint8) and C = 2, 3 or 4 channels.
+template <template <typename, int> class Op>
+void dispatch_interleave(torch::Tensor const &t, torch::Tensor const &out,
+                         int M, int N, int channels) {
+  auto run = [&](auto e) {
+    using T = decltype(e);
+    TransposeParams<T> params(reinterpret_cast<T *>(t.data_ptr()),
+                              reinterpret_cast<T *>(out.data_ptr()), M, N);
+    if(channels == 2)
+      Op<T, 2>::run(params);
+    else if(channels == 3)
+      Op<T, 3>::run(params);
+    else if(channels == 4)
+      Op<T, 4>::run(params);
+    else
+      throw std::invalid_argument("interleave supports 2, 3 and 4 channels");
+  };
+  if(t.scalar_type() == torch::kUInt8)
+    run(uint8_t{});
+  else
+    dispatch_dtype(t.scalar_type(), run);
+}
+
+template <typename T, int C> struct DeinterleaveOp {
+  static void run(TransposeParams<T> p) { deinterleave<T, C>(p); }
+};
+template <typename T, int C> struct InterleaveOp {
+  static void run(TransposeParams<T> p) { interleave<T, C>(p); }
+};
+
+// This function is bound to "transpose_cute.deinterleave". Splits a (P, C)
+// tensor of interleaved channels, e.g. torch.view_as_real of a complex
+// vector or RGBA pixels, into a (C, P) tensor of planes.
+torch::Tensor deinterleave_cute(torch::Tensor input) {
+  cfk::utils::ScopedRange range("tc.deinterleave");
+  CFK_HOST_STAGE(total_timer, "deinterleave.total");
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(_input.dim() != 2)
+    throw std::invalid_argument("deinterleave expects a (P, C) tensor");
+  const int P = _input.sizes()[0];
+  const int C = _input.sizes()[1];
+  torch::Tensor output = torch::empty({C, P}, _input.options());
+  dispatch_interleave<DeinterleaveOp>(_input, output, P, C, C);
+  return output;
+}
+
+// This function is bound to "transpose_cute.interleave". Inverse of
+// deinterleave: (C, P) planes to a (P, C) interleaved tensor.
+torch::Tensor interleave_cute(torch::Tensor input) {
+  cfk::utils::ScopedRange range("tc.interleave");
+  CFK_HOST_STAGE(total_timer, "interleave.total");
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(_input.dim() != 2)
+    throw std::invalid_argument("interleave expects a (C, P) tensor");
+  const int C = _input.sizes()[0];
+  const int P = _input.sizes()[1];
+  torch::Tensor output = torch::empty({P, C}, _input.options());
+  dispatch_interleave<InterleaveOp>(_input, output, C, P, C);
+  return output;
+}
+
+// Checks shared by transpose_add and symmetrize.
+void check_transpose_add_shape(torch::Tensor const &t) {
+  if(!t.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(t.dim() != 2 || t.sizes()[0] % 32 != 0 || t.sizes()[1] % 32 != 0)
+    throw std::invalid_argument("transpose_add needs 2D matrices with sizes that are multiples of 32");
+}
+
+// This function is bound to "transpose_cute.transpose_add". Returns
+// alpha * A + beta * B^T for an (M, N) A and an (N, M) B, written to `out`
+// when given. `out` may be A, and for square inputs also B.
+torch::Tensor transpose_add_cute(torch::Tensor A, torch::Tensor B,
+                                 c10::optional<torch::Tensor> out,
+                                 double alpha, double beta) {
+  cfk::utils::ScopedRange range("tc.transpose_add");
+  CFK_HOST_STAGE(total_timer, "transpose_add.total");
+
+  torch::Tensor _A = A.contiguous();
+  torch::Tensor _B = B.contiguous();
+  check_transpose_add_shape(_A);
+  const int M = _A.sizes()[0];
+  const int N = _A.sizes()[1];
+  if(_B.sizes() != torch::IntArrayRef({N, M}) || _B.scalar_type() != _A.scalar_type())
+    throw std::invalid_argument("transpose_add needs B with A's dtype and shape (N, M)");
+
+  torch::Tensor C = out.has_value() ? out.value() : torch::empty_like(_A);
+  if(!C.is_contiguous() || C.sizes() != _A.sizes() || C.scalar_type() != _A.scalar_type())
+    throw std::invalid_argument("transpose_add needs a contiguous out with A's dtype and shape");
+  if(M != N && C.data_ptr() == _B.data_ptr())
+    throw std::invalid_argument("transpose_add can only write over B for square inputs");
+
+  dispatch_dtype(_A.scalar_type(), [&](auto t) {
+    using T = decltype(t);
+    transpose_add<T>(TransposeAddParams<T>(
+        reinterpret_cast<T const *>(_A.data_ptr()),
+        reinterpret_cast<T const *>(_B.data_ptr()),
+        reinterpret_cast<T *>(C.data_ptr()), M, N, T(alpha), T(beta)));
+  });
+  return C;
+}
+
+// This function is bound to "transpose_cute.symmetrize". Returns
+// (A + A^T) / 2 for a square A, overwriting A when `inplace`.
+torch::Tensor symmetrize_cute(torch::Tensor A, bool inplace) {
+  cfk::utils::ScopedRange range("tc.symmetrize");
+  CFK_HOST_STAGE(total_timer, "symmetrize.total");
+
+  if(inplace && !A.is_contiguous())
+    throw std::invalid_argument("symmetrize(inplace=True) needs a contiguous A");
+  torch::Tensor _A = A.contiguous();
+  check_transpose_add_shape(_A);
+  const int n = _A.sizes()[0];
+  if(_A.sizes()[1] != n)
+    throw std::invalid_argument("symmetrize needs a square matrix");
+
+  torch::Tensor C = inplace ? _A : torch::empty_like(_A);
+  dispatch_dtype(_A.scalar_type(), [&](auto t) {
+    using T = decltype(t);
+    transpose_add<T>(TransposeAddParams<T>::symmetrize(
+        reinterpret_cast<T *>(_A.data_ptr()),
+        reinterpret_cast<T *>(C.data_ptr()), n));
+  });
+  return C;
+}
+
+// This function is bound to "transpose_cute.quantize_dual_fp8". Quantizes a
+// bf16 (M, N) matrix to FP8 E4M3 with 1x128 block scales, both row-wise and
+// column-wise, and returns (q_row, scale_row, q_col, scale_col) where q_col
+// is (N, M), i.e. the quantized transpose.
+std::tuple<torch::Tensor, torch::Tensor, torch::Tensor, torch::Tensor>
+quantize_dual_fp8_cute(torch::Tensor input) {
+  cfk::utils::ScopedRange range("tc.quantize_dual_fp8");
+  CFK_HOST_STAGE(total_timer, "quantize_dual_fp8.total");
+
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(_input.scalar_type() != torch::kBFloat16)
+    throw std::invalid_argument("quantize_dual_fp8 expects a bf16 input");
+
+  const int M = _input.sizes()[0];
+  const int N = _input.sizes()[1];
+  if(M % kQuantBlock != 0 || N % kQuantBlock != 0)
+    throw std::invalid_argument("quantize_dual_fp8 needs M and N to be multiples of 128");
+
+  CFK_HOST_STAGE(alloc_timer, "quantize_dual_fp8.alloc_output");
+  auto options = torch::TensorOptions().device(_input.device());
+  torch::Tensor q_row = torch::empty({M, N}, options.dtype(torch::kFloat8_e4m3fn));
+  torch::Tensor q_col = torch::empty({N, M}, options.dtype(torch::kFloat8_e4m3fn));
+  torch::Tensor scale_row = torch::empty({M, N / kQuantBlock}, options.dtype(torch::kFloat32));
+  torch::Tensor scale_col = torch::empty({N, M / kQuantBlock}, options.dtype(torch::kFloat32));
+  alloc_timer.stop();
+
+  QuantizeDualParams<cutlass::bfloat16_t> params(
+      reinterpret_cast<cutlass::bfloat16_t *>(_input.data_ptr()),
+      reinterpret_cast<cutlass::float_e4m3_t *>(q_row.data_ptr()),
+      scale_row.data_ptr<float>(),
+      reinterpret_cast<cutlass::float_e4m3_t *>(q_col.data_ptr()),
+      scale_col.data_ptr<float>(), M, N);
+  quantize_dual_fp8(params);
+
+  return {q_row, scale_row, q_col, scale_col};
+}
+
+FusedDType to_fused_dtype(at::ScalarType dtype) {
+  if(dtype == torch::kFloat16)
+    return FusedDType::F16;
+  if(dtype == torch::kBFloat16)
+    return FusedDType::BF16;
+  if(dtype == torch::kFloat32)
+    return FusedDType::F32;
+  throw std::invalid_argument("Unsupported precision type");
+}
+
+at::ScalarType to_scalar_type(FusedDType dtype) {
+  return dtype == FusedDType::F16 ? torch::kFloat16
+         : dtype == FusedDType::BF16 ? torch::kBFloat16 : torch::kFloat32;
+}
+
+// Bound to "transpose_cute.LazyTensor", created by "transpose_cute.lazy".
+// Each method returns a new LazyTensor with one more node; nothing runs
+// until eval(), which executes the whole chain as a single pass.
+struct LazyTensor {
+  torch::Tensor input;
+  FusedExpr expr;
+  std::vector<torch::Tensor> biases; // fp32 copies the program points into
+
+  LazyTensor transpose() const { LazyTensor r = *this; r.expr.transpose(); return r; }
+  LazyTensor copy() const { LazyTensor r = *this; r.expr.copy(); return r; }
+  LazyTensor scale(double s) const { LazyTensor r = *this; r.expr.scale(float(s)); return r; }
+  LazyTensor cast(at::ScalarType dtype) const {
+    LazyTensor r = *this;
+    r.expr.cast(to_fused_dtype(dtype));
+    return r;
+  }
+  LazyTensor bias(torch::Tensor b) const {
+    if(!b.device().is_cuda() || b.dim() != 1)
+      throw std::invalid_argument("bias must be a 1D CUDA tensor");
+    LazyTensor r = *this;
+    torch::Tensor b32 = b.to(torch::kFloat32).contiguous();
+    r.expr.bias(b32.data_ptr<float>(), b32.sizes()[0]);
+    r.biases.push_back(b32);
+    return r;
+  }
+
+  torch::Tensor eval(c10::optional<torch::Tensor> out) const {
+    cfk::utils::ScopedRange range("tc.lazy.eval");
+    CFK_HOST_STAGE(total_timer, "lazy.total");
+    FusedProgram const p = expr.compile();
+    torch::Tensor _out = out.has_value() ? out.value()
+        : torch::empty({p.out_rows(), p.out_cols()},
+                       input.options().dtype(to_scalar_type(p.out)));
+    if(!_out.is_contiguous() || _out.sizes() != torch::IntArrayRef({p.out_rows(), p.out_cols()}) ||
+       _out.scalar_type() != to_scalar_type(p.out))
+      throw std::invalid_argument("out must be contiguous with the chain's result shape and dtype");
+    fused_eval(p, input.data_ptr(), _out.data_ptr());
+    return _out;
+  }
+};
+
+// This function is bound to "transpose_cute.lazy". Starts a chain on a 2D
+// fp32, fp16 or bf16 CUDA tensor.
+LazyTensor lazy_cute(torch::Tensor input) {
+  torch::Tensor _input = input.contiguous();
+  if(!_input.device().is_cuda())
+    throw std::invalid_argument("transpose_cute only supports GPU device. Use .to(device=torch.device('cuda'))");
+  if(_input.dim() != 2)
+    throw std::invalid_argument("lazy expects a 2D tensor");
+  return {_input,
+          FusedExpr(_input.sizes()[0], _input.sizes()[1],
+                    to_fused_dtype(_input.scalar_type())),
+          {}};
+}
+
 // Binding the function to Python
 PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
   py::enum_<Version>(m, "version")
@@ -97,6 +467,24 @@ PYBIND11_MODULE(TORCH_EXTENSION_NAME, m) {
       .value("swizzle", swizzle)
       .value("tma", tma)
       .export_values();
-  m.def("transpose", py::overload_cast<torch::Tensor,c10::optional<torch::Tensor>,Version>(&transpose_cute), py::arg("input"), py::arg("output") = py::none(), py::arg("version")=swizzle);
+  m.def("transpose", py::overload_cast<torch::Tensor,c10::optional<torch::Tensor>,Version,bool>(&transpose_cute), py::arg("input"), py::arg("output") = py::none(), py::arg("version")=swizzle, py::arg("pdl") = false);
+  m.def("transpose_dual", &transpose_dual_cute, py::arg("input"), py::arg("copy_dtype") = py::none(), py::arg("transpose_dtype") = py::none());
+  m.def("transpose_packed", &transpose_packed_cute, py::arg("input"), py::arg("bits"));
+  m.def("deinterleave", &deinterleave_cute, py::arg("input"));
+  m.def("interleave", &interleave_cute, py::arg("input"));
+  m.def("transpose_add", &transpose_add_cute, py::arg("A"), py::arg("B"), py::arg("out") = py::none(), py::arg("alpha") = 1.0, py::arg("beta") = 1.0);
+  m.def("symmetrize", &symmetrize_cute, py::arg("A"), py::arg("inplace") = true);
+  m.def("quantize_dual_fp8", &quantize_dual_fp8_cute, py::arg("input"));
+  py::class_<LazyTensor>(m, "LazyTensor")
+      .def("transpose", &LazyTensor::transpose)
+      .def("copy", &LazyTensor::copy)
+      .def("scale", &LazyTensor::scale, py::arg("s"))
+      .def("bias", &LazyTensor::bias, py::arg("b"))
+      .def("cast", &LazyTensor::cast, py::arg("dtype"))
+      .def("eval", &LazyTensor::eval, py::arg("out") = py::none())
+      .def_property_readonly("passes", [](LazyTensor const &t) { return t.expr.passes(); });
+  m.def("lazy", &lazy_cute, py::arg("input"));
   m.def("get_version_info",&get_version_info);
+  // Host overhead counters: stats() and reset_stats().
+  cfk::utils::bind_host_stats(m);
 }
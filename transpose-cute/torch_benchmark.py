@@ -3,6 +3,8 @@ import math
 import transpose_cute as tc
 import copy_cute as cc
 import argparse
+import os
+import socket
 
 from torch.utils.benchmark import Timer
 from torch.utils.benchmark import Measurement
@@ -16,6 +18,21 @@ cuda = torch.device('cuda')
 A = torch.normal(0,1,size=(args.M, args.N)).to(device=cuda)
 AT_reference = torch.transpose(A, 0, 1)
 
+# Measured STREAM copy bandwidth from ../calibrate, if it has been run here
+def load_peak_gbs():
+  path = os.environ.get("CFK_PEAK_FILE", os.path.join(os.path.expanduser("~"), ".cache", "cfk", "peak-{}.txt".format(socket.gethostname())))
+  key = "gpu.{}.stream_copy_gbs".format(torch.cuda.get_device_name().replace(" ", "_"))
+  if not os.path.isfile(path):
+    return None
+  with open(path) as f:
+    for line in f:
+      parts = line.split()
+      if len(parts) == 2 and parts[0] == key:
+        return float(parts[1])
+  return None
+
+peak_gbs = load_peak_gbs()
+
 def benchmark(stmt, glob, desc): 
   timer = Timer(
       stmt=stmt,
@@ -25,7 +42,9 @@ def benchmark(stmt, glob, desc):
   
   m: Measurement = timer.blocked_autorange(min_run_time=3)
   print(desc)
-  print("Mean: {{:.{0}g}} ms ({{:.{0}g}} GB/s)".format(m.significant_figures).format(m.mean*pow(10,3),2*args.M*args.N*A.element_size()/m.mean*pow(10,-9)))
+  gbs = 2*args.M*args.N*A.element_size()/m.mean*pow(10,-9)
+  peak = ", {:.1f}% of peak".format(100*gbs/peak_gbs) if peak_gbs else ""
+  print("Mean: {{:.{0}g}} ms ({{:.{0}g}} GB/s{{}})".format(m.significant_figures).format(m.mean*pow(10,3),gbs,peak))
   print("IQR: {{:.{}g}} us".format(m.significant_figures).format(m.iqr*pow(10,6)))
 
 def validate(res, reference):
@@ -38,6 +57,14 @@ benchmark("cc.copy(A)",{"cc": cc, "A": A},"Baseline copy:")
 validate(cc.copy(A), A)
 print()
 
+# Accumulating copy D += A: TMA reduce-store vs. read-modify-write
+D = torch.zeros_like(A)
+benchmark("D.add_(A)",{"A": A, "D": D},"Torch in-place add:")
+benchmark("cc.copy(A, D, reduce='add')",{"cc": cc, "A": A, "D": D},"TMA reduce-store add:")
+D.copy_(A)
+validate(cc.copy(A, D, reduce="add"), A * 2)
+print()
+
 benchmark("torch.transpose(A, 0, 1).contiguous()",{"A": A},"Torch transpose:")
 print()
 
@@ -49,3 +76,89 @@ for ver in [tc.version.naive,tc.version.smem,tc.version.swizzle,tc.version.tma]:
   benchmark("tc.transpose(A, version=ver)",{"tc": tc, "A": A, "ver": ver},tc.get_version_info(ver))
   validate(tc.transpose(A, version=ver), AT_reference)
   print()
+
+# Chain of dependent transposes on a small matrix, serialized vs PDL
+X = torch.normal(0,1,size=(2048, 2048)).to(device=cuda)
+X0 = X.clone()
+Y = torch.empty_like(X)
+def transpose_chain(pdl, pairs=50):
+  for _ in range(pairs):
+    tc.transpose(X, Y, version=tc.version.swizzle, pdl=pdl)
+    tc.transpose(Y, X, version=tc.version.swizzle, pdl=pdl)
+for pdl in [False, True]:
+  m = Timer(stmt="transpose_chain(pdl)", globals={"transpose_chain": transpose_chain, "pdl": pdl}, num_threads=1).blocked_autorange(min_run_time=3)
+  print("Chain of 100 dependent transposes, 2048 x 2048 ({}):".format("PDL" if pdl else "serialized"))
+  print("Mean: {:.3g} us per kernel".format(m.mean*pow(10,6)/100))
+validate(X, X0)
+print()
+
+benchmark("tc.transpose_dual(A)",{"tc": tc, "A": A},"Dual output (A and A^T from one read):")
+C, AT = tc.transpose_dual(A)
+validate(C, A)
+validate(AT, AT_reference)
+print()
+
+# Complex interleaved <-> planar
+Z = torch.view_as_real(torch.randn(args.M * args.N // 2, device="cuda", dtype=torch.complex64))
+benchmark("tc.deinterleave(Z)",{"tc": tc, "Z": Z},"Deinterleave complex64:")
+planes = tc.deinterleave(Z)
+validate(planes, Z.t())
+validate(tc.interleave(planes), Z)
+print()
+
+# Lazy chain: transpose -> scale -> bias -> fp16 cast in one pass
+bias = torch.rand(args.M, device="cuda")
+benchmark("(A.t() * 2.0 + bias).half()",{"A": A, "bias": bias},"Torch chain (transpose, scale, bias, cast):")
+chain = tc.lazy(A).transpose().scale(2.0).bias(bias).cast(torch.float16)
+benchmark("chain.eval()",{"chain": chain},"Lazy chain, one pass ({} nodes):".format(chain.passes))
+validate(chain.eval(), (A.t().contiguous() * 2.0 + bias).half())
+print()
+
+# Many small tensors: one launch instead of one per tensor
+small = [torch.rand(256 + 997 * k, device="cuda") for k in range(256)]
+benchmark("[t.clone() for t in small]",{"small": small},"Per-tensor clone (256 tensors):")
+benchmark("cc.multi_tensor_copy(small)",{"cc": cc, "small": small},"Multi-tensor copy (256 tensors):")
+validate(torch.cat(cc.multi_tensor_scale(small, 2.0)), torch.cat(small) * 2)
+print()
+
+# Row gather and scatter-add with skewed (repeating) indices. The gradient
+# rows are small integers, so every summation order gives the same result.
+E = torch.rand((65536, 256), device="cuda")
+idx = (torch.rand(65536, device="cuda") ** 2 * 65536).long()
+G = torch.randint(0, 8, (65536, 256), device="cuda").float()
+benchmark("E.index_select(0, idx)",{"E": E, "idx": idx},"Torch index_select:")
+benchmark("cc.index_select(E, idx)",{"cc": cc, "E": E, "idx": idx},"Row gather:")
+validate(cc.index_select(E, idx), E.index_select(0, idx))
+benchmark("E.index_add_(0, idx, G)",{"E": E, "idx": idx, "G": G},"Torch index_add_:")
+benchmark("cc.index_add(E, idx, G)",{"cc": cc, "E": E, "idx": idx, "G": G},"Row scatter-add (sorted runs):")
+validate(cc.index_add(torch.zeros_like(E), idx, G), torch.zeros_like(E).index_add_(0, idx, G))
+print()
+
+# Concat / split along the columns: one launch for all pieces
+parts = [torch.rand((4096, w), device="cuda") for w in (1024, 36, 512, 2000, 4)]
+benchmark("torch.cat(parts, dim=1)",{"torch": torch, "parts": parts},"Torch cat (5 pieces):")
+benchmark("cc.cat(parts)",{"cc": cc, "parts": parts},"TMA cat, one launch:")
+validate(cc.cat(parts), torch.cat(parts, dim=1))
+whole = torch.cat(parts, dim=1)
+validate(torch.cat(cc.split(whole, [p.shape[1] for p in parts]), dim=1), whole)
+print()
+
+# Fused C = A + B^T and in-place symmetrize (square leading block of A)
+B = torch.rand((args.N, args.M), device="cuda", dtype=A.dtype)
+benchmark("tc.transpose_add(A, B)",{"tc": tc, "A": A, "B": B},"Transpose-add C = A + B^T:")
+validate(tc.transpose_add(A, B), A + B.t())
+S = A[:min(args.M, args.N), :min(args.M, args.N)].contiguous()
+S_reference = (S + S.t()) / 2
+tc.symmetrize(S)
+validate(S, S_reference)
+print()
+
+# Row-wise and column-wise FP8 block quantization, checked by dequantizing
+Abf = A.to(torch.bfloat16)
+benchmark("tc.quantize_dual_fp8(Abf)",{"tc": tc, "Abf": Abf},"Dual 1x128 block FP8 quantization:")
+q_row, s_row, q_col, s_col = tc.quantize_dual_fp8(Abf)
+deq_row = (q_row.float().view(args.M, -1, 128) * s_row.unsqueeze(-1)).view(args.M, args.N)
+deq_col = (q_col.float().view(args.N, -1, 128) * s_col.unsqueeze(-1)).view(args.N, args.M)
+ref = Abf.float()
+print("Max dequantization error: row {:.3g}, col {:.3g}".format((deq_row - ref).abs().max().item(), (deq_col - ref.t()).abs().max().item()))
+print()